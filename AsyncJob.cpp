@@ -0,0 +1,68 @@
+#include "AsyncJob.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+double JobProgress::fraction() const {
+    std::uint64_t all = total.load();
+    return all == 0 ? 0.0 : std::min(1.0, static_cast<double>(done.load()) / all);
+}
+
+void JobProgress::finish(const std::string& outcome) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        result = outcome;
+    }
+    finished.store(true);
+}
+
+std::string JobProgress::outcome() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return result;
+}
+
+JobList& JobList::shared() {
+    static JobList list;
+    return list;
+}
+
+std::shared_ptr<JobProgress> JobList::add(const std::string& description) {
+    std::shared_ptr<JobProgress> job = std::make_shared<JobProgress>();
+    job->description = description;
+    std::lock_guard<std::mutex> lock(mutex);
+    job->id = nextId++;
+    jobs.push_back(job);
+    return job;
+}
+
+std::vector<std::shared_ptr<JobProgress>> JobList::all() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return jobs;
+}
+
+std::shared_ptr<JobProgress> JobList::find(unsigned id) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& job : jobs) {
+        if (job->id == id)
+            return job;
+    }
+    return nullptr;
+}
+
+std::vector<std::shared_ptr<JobProgress>> JobList::running() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::shared_ptr<JobProgress>> result;
+    for (const auto& job : jobs) {
+        if (!job->finished.load())
+            result.push_back(job);
+    }
+    return result;
+}
+
+void JobList::cancelAll() {
+    for (const auto& job : running())
+        job->cancelRequested = true;
+    // Jobs stop at their next batch boundary, a few milliseconds away
+    while (!running().empty())
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "TaskScheduler.h"
+
+// Progress of a long-running background job, shared between the job and
+// whoever watches it. The job reports `done` out of `total` units and checks
+// `cancelRequested` between steps.
+struct JobProgress {
+    unsigned id = 0;
+    std::string description;
+    std::atomic<std::uint64_t> done{ 0 }, total{ 0 };
+    std::atomic<bool> cancelRequested{ false };
+    std::atomic<bool> finished{ false };
+
+    double fraction() const;
+    // Finishes the job with a one-line outcome ("12000 shapes imported").
+    void finish(const std::string& outcome);
+    std::string outcome() const;
+
+private:
+    mutable std::mutex mutex;
+    std::string result; // guarded by mutex
+};
+
+// Every job started in this process, newest last.
+class JobList {
+public:
+    static JobList& shared();
+
+    std::shared_ptr<JobProgress> add(const std::string& description);
+    std::vector<std::shared_ptr<JobProgress>> all() const;
+    std::shared_ptr<JobProgress> find(unsigned id) const;
+    // Jobs still running.
+    std::vector<std::shared_ptr<JobProgress>> running() const;
+    // Asks every running job to stop and waits until they have. Call before
+    // tearing down anything the jobs use.
+    void cancelAll();
+
+private:
+    mutable std::mutex mutex;
+    std::vector<std::shared_ptr<JobProgress>> jobs;
+    unsigned nextId = 1;
+};
+
+// Return type of a fire-and-forget coroutine. It starts on the calling thread
+// and its frame is freed when it finishes; the body reports through a
+// JobProgress rather than a return value.
+struct AsyncJob {
+    struct promise_type {
+        AsyncJob get_return_object() noexcept {
+            return AsyncJob();
+        }
+        std::suspend_never initial_suspend() noexcept {
+            return {};
+        }
+        std::suspend_never final_suspend() noexcept {
+            return {};
+        }
+        void return_void() noexcept {
+        }
+        void unhandled_exception() noexcept {
+            std::terminate();
+        }
+    };
+};
+
+// co_await resumeOn(scheduler, priority) suspends the coroutine and continues
+// it as a task of the scheduler. Awaiting this between steps moves a job off
+// the thread that started it and lets higher-priority tasks run in between.
+// The steps after it run on pool workers only, never on a thread waiting for
+// its own parallel work, so they may block on locks such a thread holds.
+class ResumeOn {
+public:
+    ResumeOn(TaskScheduler& scheduler, TaskPriority priority) : scheduler(scheduler), priority(priority) {
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+    void await_suspend(std::coroutine_handle<> coroutine) {
+        scheduler.submit([coroutine]() { coroutine.resume(); }, priority);
+    }
+    void await_resume() const noexcept {
+    }
+
+private:
+    TaskScheduler& scheduler;
+    TaskPriority priority;
+};
+
+inline ResumeOn resumeOn(TaskScheduler& scheduler, TaskPriority priority = TaskPriority::Background) {
+    return ResumeOn(scheduler, priority);
+}
@@ -0,0 +1,523 @@
+#include "Benchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+#include "ConvexHull.h"
+#include "PolygonBoolean.h"
+#include "PointCloud.h"
+#include "Predicates.h"
+#include "Raster.h"
+#include "Shape.h"
+#include "SpatialIndex.h"
+
+namespace {
+
+// Largest size a benchmark accepts, as a multiple of its default: enough to see
+// how it scales without running for minutes or exhausting memory.
+const std::size_t kMaxSizeFactor = 10;
+
+double elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Random rectangles and tessellated circles spread so that roughly a third overlap.
+Paths randomRegions(std::size_t count, std::mt19937& rng) {
+    int extent = static_cast<int>(std::sqrt(static_cast<double>(count)) * 60.0) + 100;
+    std::uniform_int_distribution<int> pos(0, extent);
+    std::uniform_int_distribution<int> size(5, 60);
+    Paths paths;
+    paths.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        int x = pos(rng), y = pos(rng), w = size(rng), h = size(rng);
+        if (i % 4 == 3)
+            paths.push_back(tessellateCircle(x, y, w / 2, circleSegments(w / 2)));
+        else
+            paths.push_back(Path{ { x, y }, { x + w, y }, { x + w, y + h }, { x, y + h } });
+    }
+    return paths;
+}
+
+void benchBoolean(std::size_t size, std::ostream& out) {
+    std::mt19937 rng(42);
+    Paths subject = randomRegions(size, rng);
+    Paths clip = randomRegions(size / 4 + 1, rng);
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+    out << "boolean: " << subject.size() << " subject / " << clip.size() << " clip polygons\n";
+    struct Case { const char* name; BooleanOp op; const Paths* clip; };
+    const Case cases[] = {
+        { "union (subject only)", BooleanOp::Union, nullptr },
+        { "union", BooleanOp::Union, &clip },
+        { "intersection", BooleanOp::Intersection, &clip },
+        { "difference", BooleanOp::Difference, &clip },
+    };
+    Paths none;
+    for (const auto& c : cases) {
+        for (unsigned t : { 1u, threads }) {
+            auto start = std::chrono::steady_clock::now();
+            Paths result = polygonBoolean(subject, c.clip ? *c.clip : none, c.op, t);
+            out << "  " << c.name << ", " << t << " thread(s): " << elapsedMs(start) << " ms, "
+                << result.size() << " rings\n";
+            if (threads == 1)
+                break;
+        }
+    }
+
+    // Polygons come in whichever direction they were drawn: the union of the
+    // subject stored as polygons with every other ring reversed must cover
+    // exactly what the original union covers
+    std::shared_ptr<VertexPool> pool = std::make_shared<VertexPool>();
+    Paths redrawn;
+    redrawn.reserve(subject.size());
+    for (std::size_t i = 0; i < subject.size(); ++i) {
+        std::vector<Point> points;
+        for (const auto& p : subject[i])
+            points.push_back(Point(p.x, p.y));
+        if (i % 2 == 1)
+            std::reverse(points.begin(), points.end());
+        redrawn.push_back(shapeToPath(Polygon(pool, pool->append(points), points.size())));
+    }
+    Paths merged = polygonBoolean(subject, none, BooleanOp::Union, threads);
+    double expected = 0.0, area = 0.0;
+    for (const auto& ring : merged)
+        expected += signedArea2(ring);
+    for (const auto& ring : polygonBoolean(redrawn, none, BooleanOp::Union, threads))
+        area += signedArea2(ring);
+    out << "  mixed winding union: area " << area / 2.0 << ", expected " << expected / 2.0
+        << (area == expected ? "\n" : " (mismatch)\n");
+
+    // A boolean of a boolean result: frames merged from four rectangles each,
+    // stored as polygons with holes and merged again, must keep every hole
+    std::size_t frames = std::max<std::size_t>(1, size / 100);
+    Paths sides;
+    for (std::size_t i = 0; i < frames; ++i) {
+        int x = static_cast<int>(i) * 40;
+        for (const Path& side : { Path{ { x, 0 }, { x + 30, 0 }, { x + 30, 10 }, { x, 10 } },
+                 Path{ { x, 20 }, { x + 30, 20 }, { x + 30, 30 }, { x, 30 } },
+                 Path{ { x, 0 }, { x + 10, 0 }, { x + 10, 30 }, { x, 30 } },
+                 Path{ { x + 20, 0 }, { x + 30, 0 }, { x + 30, 30 }, { x + 20, 30 } } })
+            sides.push_back(side);
+    }
+    Paths again;
+    std::size_t holes = 0;
+    for (const auto& rings : groupRings(polygonBoolean(sides, none, BooleanOp::Union, threads))) {
+        std::vector<Point> points;
+        std::vector<std::size_t> starts;
+        for (const auto& ring : rings) {
+            if (!points.empty())
+                starts.push_back(points.size());
+            for (const auto& p : ring)
+                points.push_back(Point(p.x, p.y));
+        }
+        holes += starts.size();
+        Paths stored = shapeToPaths(Polygon(pool, pool->append(points), points.size(), std::move(starts)));
+        again.insert(again.end(), stored.begin(), stored.end());
+    }
+    area = 0.0;
+    for (const auto& ring : polygonBoolean(again, none, BooleanOp::Union, threads))
+        area += signedArea2(ring);
+    expected = 2.0 * 800.0 * static_cast<double>(frames);
+    out << "  union of " << frames << " merged frames: " << holes << " holes, area " << area / 2.0 << ", expected "
+        << expected / 2.0 << (holes == frames && area == expected ? "\n" : " (mismatch)\n");
+}
+
+// Mix of random triples and snapped CAD-like input (vertices on shared grid lines
+// and long collinear runs) where the incircle filter is expected to give up occasionally.
+void benchPredicates(std::size_t size, std::ostream& out) {
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> coord(-1000000, 1000000);
+    std::uniform_int_distribution<int> grid(-50, 50);
+    std::vector<int> data(size * 8);
+    for (std::size_t i = 0; i < size; ++i) {
+        int* q = &data[i * 8];
+        if (i % 10 == 0) {
+            // three points on one line plus a grid point: degenerate orientation
+            int x = grid(rng) * 100, y = grid(rng) * 100, dx = grid(rng), dy = grid(rng);
+            q[0] = x; q[1] = y; q[2] = x + dx * 7; q[3] = y + dy * 7; q[4] = x + dx * 13; q[5] = y + dy * 13;
+            q[6] = grid(rng) * 100; q[7] = grid(rng) * 100;
+        }
+        else {
+            for (int k = 0; k < 8; ++k)
+                q[k] = coord(rng);
+        }
+    }
+
+    long long checksum = 0;
+    auto run = [&](const char* name, int (*fn)(const int*)) {
+        resetPredicateStats();
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < size; ++i)
+            checksum += fn(&data[i * 8]);
+        double ms = elapsedMs(start);
+        PredicateStats stats = predicateStats();
+        unsigned long long calls = stats.filtered + stats.exact;
+        out << "  " << name << ": " << ms << " ms (" << ms * 1e6 / static_cast<double>(size) << " ns/call)";
+        if (calls > 0)
+            out << ", filter decided " << 100.0 * static_cast<double>(stats.filtered) / static_cast<double>(calls) << "%";
+        out << "\n";
+    };
+
+    out << "predicates: " << size << " calls each\n";
+    run("orient2d", [](const int* q) { return orient2d(q[0], q[1], q[2], q[3], q[4], q[5]); });
+    run("incircle filtered", [](const int* q) { return incircle(q[0], q[1], q[2], q[3], q[4], q[5], q[6], q[7]); });
+    run("incircle exact", [](const int* q) { return incircleExact(q[0], q[1], q[2], q[3], q[4], q[5], q[6], q[7]); });
+    run("segment intersection", [](const int* q) {
+        return static_cast<int>(segmentIntersection(q[0], q[1], q[2], q[3], q[4], q[5], q[6], q[7]));
+    });
+    out << "  (checksum " << checksum << ")\n";
+}
+
+// Mixed scene of lines, rectangles, circles and short polylines spread over a
+// square sized so that density stays constant as `size` grows.
+std::vector<std::shared_ptr<Shape>> randomScene(std::size_t size, int& extent, std::mt19937& rng) {
+    extent = static_cast<int>(std::sqrt(static_cast<double>(size)) * 20.0) + 100;
+    std::uniform_int_distribution<int> pos(0, extent);
+    std::uniform_int_distribution<int> offset(-30, 30);
+    std::uniform_int_distribution<int> length(1, 30);
+    auto pool = std::make_shared<VertexPool>();
+    std::vector<std::shared_ptr<Shape>> shapes;
+    shapes.reserve(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        int x = pos(rng), y = pos(rng);
+        switch (i % 4) {
+        case 0:
+            shapes.push_back(std::make_shared<Line>(Point(x, y), Point(x + offset(rng), y + offset(rng))));
+            break;
+        case 1:
+            shapes.push_back(std::make_shared<Rectangle>(Point(x, y), length(rng), length(rng)));
+            break;
+        case 2:
+            shapes.push_back(std::make_shared<Circle>(Point(x, y), length(rng)));
+            break;
+        default: {
+            std::vector<Point> points;
+            for (int k = 0; k < 6; ++k)
+                points.push_back(Point(x + offset(rng), y + offset(rng)));
+            std::size_t first = pool->append(points);
+            shapes.push_back(std::make_shared<Polyline>(pool, first, points.size()));
+        }
+        }
+    }
+    return shapes;
+}
+
+// Single-nearest hover lookups as the viewer issues them on every mouse move.
+void benchNearest(std::size_t size, std::ostream& out) {
+    std::mt19937 rng(11);
+    int extent = 0;
+    std::vector<std::shared_ptr<Shape>> shapes = randomScene(size, extent, rng);
+    std::uniform_int_distribution<int> pos(0, extent);
+
+    SpatialIndex index;
+    auto start = std::chrono::steady_clock::now();
+    index.build(shapes);
+    out << "nearest: " << size << " shapes, build " << elapsedMs(start) << " ms\n";
+
+    const std::size_t queries = 100000;
+    std::vector<double> qx(queries), qy(queries);
+    for (std::size_t i = 0; i < queries; ++i) {
+        qx[i] = pos(rng) + 0.5;
+        qy[i] = pos(rng) + 0.5;
+    }
+    for (std::size_t k : { 1u, 8u }) {
+        std::size_t found = 0;
+        start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < queries; ++i)
+            found += index.nearest(shapes, qx[i], qy[i], k, 8.0).size();
+        double ms = elapsedMs(start);
+        out << "  k=" << k << " within 8: " << ms * 1000.0 / static_cast<double>(queries) << " us/query, "
+            << found << " hits\n";
+    }
+
+    // Linear scan on a sample of the queries, for reference and as a correctness check
+    const std::size_t scanned = std::max<std::size_t>(1, std::min<std::size_t>(queries, 20000000 / (size + 1)));
+    std::vector<double> expected(scanned, 8.0);
+    start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < scanned; ++i) {
+        for (const auto& shape : shapes)
+            expected[i] = std::min(expected[i], shape->distanceTo(qx[i], qy[i]));
+    }
+    double scanMs = elapsedMs(start);
+    std::size_t mismatches = 0;
+    for (std::size_t i = 0; i < scanned; ++i) {
+        std::vector<Neighbor> hit = index.nearest(shapes, qx[i], qy[i], 1, 8.0);
+        if ((hit.empty() ? 8.0 : hit[0].distance) != expected[i])
+            ++mismatches;
+    }
+    out << "  linear scan: " << scanMs * 1000.0 / static_cast<double>(scanned) << " us/query, "
+        << mismatches << " mismatches in " << scanned << "\n";
+}
+
+// The console's spatial queries (count, find-in-rect, intersecting, nearest)
+// over one index, with a linear scan of a few windows as reference.
+void benchQueries(std::size_t size, std::ostream& out) {
+    std::mt19937 rng(23);
+    int extent = 0;
+    std::vector<std::shared_ptr<Shape>> shapes = randomScene(size, extent, rng);
+    std::uniform_int_distribution<int> pos(0, extent);
+    std::uniform_int_distribution<std::size_t> pick(0, size - 1);
+
+    SpatialIndex index;
+    auto start = std::chrono::steady_clock::now();
+    index.build(shapes);
+    out << "queries: " << size << " shapes, build " << elapsedMs(start) << " ms\n";
+
+    // Windows about 200 units wide hold a few hundred shapes at the scene's density
+    const std::size_t queries = 20000;
+    std::vector<Bounds> windows(queries);
+    for (Bounds& window : windows) {
+        int x = pos(rng), y = pos(rng);
+        window = Bounds(x, y, x + 200, y + 200);
+    }
+    auto report = [&](const char* name, double ms, std::size_t results) {
+        out << "  " << name << ": " << static_cast<double>(queries) * 1000.0 / std::max(ms, 1e-9) << " queries/s, "
+            << static_cast<double>(results) / static_cast<double>(queries) << " results/query\n";
+    };
+
+    std::size_t found = 0;
+    start = std::chrono::steady_clock::now();
+    for (const Bounds& window : windows)
+        found += index.count(shapes, window);
+    report("count in window", elapsedMs(start), found);
+
+    std::vector<std::size_t> hits;
+    std::vector<IndexCluster> clusters;
+    found = 0;
+    start = std::chrono::steady_clock::now();
+    for (const Bounds& window : windows) {
+        hits.clear();
+        index.collect(shapes, window, 0.0, 0.0, hits, clusters);
+        found += hits.size();
+    }
+    report("find-in-rect", elapsedMs(start), found);
+
+    found = 0;
+    start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < queries; ++i) {
+        hits.clear();
+        index.collect(shapes, shapes[pick(rng)]->bounds(), 0.0, 0.0, hits, clusters);
+        found += hits.size() - 1;
+    }
+    report("intersecting", elapsedMs(start), found);
+
+    for (std::size_t k : { 1u, 16u }) {
+        found = 0;
+        start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < queries; ++i)
+            found += index.nearest(shapes, pos(rng) + 0.5, pos(rng) + 0.5, k, std::numeric_limits<double>::infinity()).size();
+        report(k == 1 ? "nearest k=1" : "nearest k=16", elapsedMs(start), found);
+    }
+
+    // Linear scan of the first few windows, for reference and as a correctness check
+    const std::size_t scanned = std::max<std::size_t>(1, std::min<std::size_t>(queries, 50000000 / (size + 1)));
+    std::size_t mismatches = 0;
+    start = std::chrono::steady_clock::now();
+    for (std::size_t q = 0; q < scanned; ++q) {
+        const Bounds& w = windows[q];
+        std::size_t expected = 0;
+        for (const auto& shape : shapes) {
+            Bounds b = shape->bounds();
+            if (b.minX <= w.maxX && b.maxX >= w.minX && b.minY <= w.maxY && b.maxY >= w.minY)
+                ++expected;
+        }
+        if (expected != index.count(shapes, w))
+            ++mismatches;
+    }
+    double scanMs = elapsedMs(start);
+    out << "  linear scan: " << static_cast<double>(scanned) * 1000.0 / std::max(scanMs, 1e-9) << " queries/s, "
+        << mismatches << " mismatches in " << scanned << "\n";
+}
+
+// Points scattered uniformly in a disc (the octagon filter's typical case) and
+// points on a circle, where every point is a hull vertex candidate.
+void benchHull(std::size_t size, std::ostream& out) {
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    const double radius = 1e8;
+    std::vector<IntPoint> disc(size), ring(size / 10 + 1);
+    for (auto& p : disc) {
+        double r = radius * std::sqrt(unit(rng)), a = unit(rng) * 6.283185307179586;
+        p = IntPoint{ static_cast<int>(r * std::cos(a)), static_cast<int>(r * std::sin(a)) };
+    }
+    for (auto& p : ring) {
+        double a = unit(rng) * 6.283185307179586;
+        p = IntPoint{ static_cast<int>(radius * std::cos(a)), static_cast<int>(radius * std::sin(a)) };
+    }
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+
+    struct Case { const char* name; const std::vector<IntPoint>* points; };
+    const Case cases[] = { { "disc", &disc }, { "circle", &ring } };
+    for (const auto& c : cases) {
+        Path hull;
+        for (unsigned t : { 1u, threads }) {
+            auto start = std::chrono::steady_clock::now();
+            hull = convexHull(*c.points, t);
+            out << "hull " << c.name << ": " << c.points->size() << " points, " << t << " thread(s): "
+                << elapsedMs(start) << " ms, " << hull.size() << " vertices\n";
+            if (threads == 1)
+                break;
+        }
+        auto start = std::chrono::steady_clock::now();
+        OrientedRect rect = minAreaRect(hull);
+        double rectMs = elapsedMs(start);
+        start = std::chrono::steady_clock::now();
+        HullDiameter diameter = hullDiameter(hull);
+        out << "  min-area rect " << rect.width << " x " << rect.height << " (" << rectMs << " ms), diameter "
+            << diameter.length << " (" << elapsedMs(start) << " ms)\n";
+    }
+}
+
+// Visible-set collection for an 800x600 window, fully zoomed out and at a few
+// closer zoom levels; this bounds the per-frame traversal cost of the renderer.
+void benchLod(std::size_t size, std::ostream& out) {
+    std::mt19937 rng(13);
+    int extent = 0;
+    std::vector<std::shared_ptr<Shape>> shapes = randomScene(size, extent, rng);
+    SpatialIndex index;
+    auto start = std::chrono::steady_clock::now();
+    index.build(shapes);
+    out << "lod: " << size << " shapes, build " << elapsedMs(start) << " ms\n";
+
+    std::vector<std::size_t> visible;
+    std::vector<IndexCluster> clusters;
+    for (double pixelSize : { extent / 600.0, extent / 6000.0, 4.0, 1.0 }) {
+        double halfW = 400.0 * pixelSize, halfH = 300.0 * pixelSize, c = extent / 2.0;
+        Bounds view(static_cast<int>(c - halfW), static_cast<int>(c - halfH), static_cast<int>(c + halfW), static_cast<int>(c + halfH));
+        const int frames = 20;
+        start = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; ++f) {
+            visible.clear();
+            clusters.clear();
+            index.collect(shapes, view, 8.0 * pixelSize, 1.0 / (16.0 * pixelSize * pixelSize), visible, clusters);
+        }
+        out << "  " << pixelSize << " units/pixel: " << elapsedMs(start) / frames << " ms/frame, "
+            << visible.size() << " shapes, " << clusters.size() << " impostors\n";
+    }
+}
+
+// Survey-like clustered points binned into an 800x600 density grid, fully
+// zoomed out and zoomed onto one cluster, followed by the heatmap coloring.
+void benchPointCloud(std::size_t size, std::ostream& out) {
+    std::mt19937 rng(17);
+    std::normal_distribution<double> spread(0.0, 2000.0);
+    std::uniform_int_distribution<int> centre(0, 100000);
+    std::vector<std::shared_ptr<Shape>> shapes;
+    shapes.reserve(size);
+    int cx = 0, cy = 0;
+    for (std::size_t i = 0; i < size; ++i) {
+        if (i % 10000 == 0) {
+            cx = centre(rng);
+            cy = centre(rng);
+        }
+        shapes.push_back(std::make_shared<Point>(cx + static_cast<int>(spread(rng)), cy + static_cast<int>(spread(rng))));
+    }
+
+    PointCloud cloud;
+    auto start = std::chrono::steady_clock::now();
+    cloud.refresh(shapes, 1);
+    out << "pointcloud: " << cloud.size() << " points, gather " << elapsedMs(start) << " ms\n";
+
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::uint32_t> grid;
+    std::vector<std::uint8_t> rgba;
+    struct View { const char* name; double x, y, cell; };
+    const View views[] = { { "full extent", -10000.0, -10000.0, 200.0 }, { "one cluster", cx - 4000.0, cy - 3000.0, 10.0 } };
+    for (const auto& v : views) {
+        for (unsigned t : { 1u, threads }) {
+            start = std::chrono::steady_clock::now();
+            std::size_t binned = cloud.bin(v.x, v.y, v.cell, 800, 600, grid, t);
+            out << "  " << v.name << ", " << t << " thread(s): bin " << elapsedMs(start) << " ms, "
+                << binned << " points in view\n";
+            if (threads == 1)
+                break;
+        }
+        start = std::chrono::steady_clock::now();
+        densityToRgba(grid, 64, rgba);
+        out << "  heatmap coloring " << elapsedMs(start) << " ms\n";
+    }
+}
+
+void benchRaster(std::size_t size, std::ostream& out) {
+    // Strokes of mixed size on a 1920x1080 plot, rendered twice over a white background
+    std::mt19937 rng(23);
+    std::uniform_real_distribution<double> position(-50.0, 1970.0), extent(2.0, 300.0), width(1.0, 4.0);
+    struct Stroke { ShapeType type; double x0, y0, x1, y1, width; RasterColor color; };
+    std::vector<Stroke> strokes(size);
+    const ShapeType types[] = { ShapeType::Line, ShapeType::Rectangle, ShapeType::Circle };
+    for (std::size_t i = 0; i < size; ++i) {
+        Stroke& s = strokes[i];
+        s.type = types[i % 3];
+        s.x0 = position(rng);
+        s.y0 = position(rng) * 0.55;
+        s.x1 = s.x0 + extent(rng) - 150.0;
+        s.y1 = s.y0 + extent(rng) - 150.0;
+        s.width = width(rng);
+        s.color = RasterColor{ static_cast<std::uint8_t>(rng()), static_cast<std::uint8_t>(rng()), static_cast<std::uint8_t>(rng()),
+            static_cast<std::uint8_t>(128 + rng() % 128) };
+    }
+
+    const RasterColor white{ 255, 255, 255, 255 };
+    RasterImage fast(1920, 1080, white), reference(1920, 1080, white);
+    auto start = std::chrono::steady_clock::now();
+    for (const Stroke& s : strokes) {
+        if (s.type == ShapeType::Line)
+            rasterLine(fast, s.x0, s.y0, s.x1, s.y1, s.width, s.color);
+        else if (s.type == ShapeType::Rectangle)
+            rasterRectangle(fast, s.x0, s.y0, s.x1, s.y1, s.width, s.color);
+        else
+            rasterCircle(fast, s.x0, s.y0, std::fabs(s.x1 - s.x0), s.width, s.color);
+    }
+    double fastMs = elapsedMs(start);
+
+    start = std::chrono::steady_clock::now();
+    for (const Stroke& s : strokes) {
+        if (s.type == ShapeType::Line)
+            rasterLineReference(reference, s.x0, s.y0, s.x1, s.y1, s.width, s.color);
+        else if (s.type == ShapeType::Rectangle)
+            rasterRectangleReference(reference, s.x0, s.y0, s.x1, s.y1, s.width, s.color);
+        else
+            rasterCircleReference(reference, s.x0, s.y0, std::fabs(s.x1 - s.x0), s.width, s.color);
+    }
+    double referenceMs = elapsedMs(start);
+
+    int worst = 0;
+    for (std::size_t i = 0; i < fast.rgba.size(); ++i)
+        worst = std::max(worst, std::abs(static_cast<int>(fast.rgba[i]) - static_cast<int>(reference.rgba[i])));
+    out << "raster: " << size << " strokes at 1920x1080\n"
+        << "  span kernels " << fastMs << " ms, per-pixel reference " << referenceMs << " ms ("
+        << referenceMs / std::max(fastMs, 1e-9) << "x), largest channel difference " << worst << "\n";
+}
+
+}
+
+bool runBenchmark(const std::string& name, std::size_t size, std::ostream& out) {
+    struct Entry { const char* name; void (*run)(std::size_t, std::ostream&); std::size_t size; };
+    const Entry entries[] = {
+        { "boolean", benchBoolean, 100000 },
+        { "predicates", benchPredicates, 10000000 },
+        { "hull", benchHull, 10000000 },
+        { "nearest", benchNearest, 1000000 },
+        { "queries", benchQueries, 10000000 },
+        { "pointcloud", benchPointCloud, 5000000 },
+        { "lod", benchLod, 5000000 },
+        { "raster", benchRaster, 20000 },
+    };
+    for (const auto& entry : entries) {
+        if (name != entry.name)
+            continue;
+        if (size > entry.size * kMaxSizeFactor) {
+            size = entry.size * kMaxSizeFactor;
+            out << "Size capped at " << size << ".\n";
+        }
+        entry.run(size == 0 ? entry.size : size, out);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstddef>
+#include <iosfwd>
+#include <string>
+
+// Console benchmarks ("bench <name> [size]"). Each one generates its own random
+// input of the requested size, at most ten times its default, and prints
+// timings to `out`. Returns false when `name` is not a known benchmark.
+bool runBenchmark(const std::string& name, std::size_t size, std::ostream& out);
+
@@ -0,0 +1,116 @@
+#include "Block.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <iostream>
+#include <iterator>
+#include <limits>
+
+namespace {
+
+const std::size_t kMaxBlockName = 64;
+
+int clampToInt(double v) {
+    return static_cast<int>(std::max<double>(INT_MIN, std::min<double>(INT_MAX, v)));
+}
+
+}
+
+BlockDefinition::BlockDefinition(std::string name_) : name(std::move(name_)) {
+}
+
+void BlockDefinition::append(std::shared_ptr<const Shape> shape) {
+    boxes.push_back(shape->bounds());
+    box.expand(boxes.back());
+    shapes.push_back(std::move(shape));
+}
+
+double BlockDefinition::distanceTo(double x, double y) const {
+    double best = std::numeric_limits<double>::infinity();
+    for (std::size_t i = 0; i < shapes.size(); ++i) {
+        if (boxes[i].distanceTo(x, y) < best)
+            best = std::min(best, shapes[i]->distanceTo(x, y));
+    }
+    return best;
+}
+
+BlockReference::BlockReference(std::shared_ptr<const BlockDefinition> block_, const Affine2D& placement_)
+    : block(std::move(block_)), placement(placement_) {
+    // The placed corners of the block's box bound everything in it
+    const Bounds& b = block->box;
+    if (b.isEmpty())
+        return;
+    double xs[2] = { static_cast<double>(b.minX), static_cast<double>(b.maxX) };
+    double ys[2] = { static_cast<double>(b.minY), static_cast<double>(b.maxY) };
+    double minX = HUGE_VAL, minY = HUGE_VAL, maxX = -HUGE_VAL, maxY = -HUGE_VAL;
+    for (double x : xs) {
+        for (double y : ys) {
+            double px = placement.a * x + placement.b * y + placement.tx;
+            double py = placement.c * x + placement.d * y + placement.ty;
+            minX = std::min(minX, px);
+            minY = std::min(minY, py);
+            maxX = std::max(maxX, px);
+            maxY = std::max(maxY, py);
+        }
+    }
+    box = Bounds(clampToInt(std::floor(minX)), clampToInt(std::floor(minY)), clampToInt(std::ceil(maxX)), clampToInt(std::ceil(maxY)));
+}
+
+void BlockReference::draw() const {
+    std::cout << "Draw Reference to block " << block->name << " at (" << placement.tx << ", " << placement.ty << ")\n";
+}
+
+std::string BlockReference::toString() const {
+    return "Reference(" + block->name + " at " + Point(clampToInt(std::lround(placement.tx)), clampToInt(std::lround(placement.ty))).toString() + ")";
+}
+
+ShapeType BlockReference::type() const {
+    return ShapeType::Reference;
+}
+
+Bounds BlockReference::bounds() const {
+    return box;
+}
+
+double BlockReference::distanceTo(double x, double y) const {
+    Affine2D toBlock = placement.inverse();
+    return block->distanceTo(toBlock.a * x + toBlock.b * y + toBlock.tx, toBlock.c * x + toBlock.d * y + toBlock.ty) * scale();
+}
+
+double BlockReference::scale() const {
+    return std::sqrt(std::fabs(placement.determinant()));
+}
+
+bool isValidBlockName(const std::string& name) {
+    if (name.empty() || name.size() > kMaxBlockName)
+        return false;
+    return std::all_of(name.begin(), name.end(), [](char ch) {
+        return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_' || ch == '-' || ch == '.';
+    });
+}
+
+bool isValidPlacement(const Affine2D& placement) {
+    const double terms[] = { placement.a, placement.b, placement.c, placement.d, placement.tx, placement.ty };
+    if (!std::all_of(std::begin(terms), std::end(terms), [](double v) { return std::isfinite(v); }))
+        return false;
+    return std::fabs(placement.determinant()) > 1e-9 && std::fabs(placement.tx) < INT_MAX && std::fabs(placement.ty) < INT_MAX;
+}
+
+bool isValidPlacement(const BlockDefinition& block, const Affine2D& placement) {
+    if (!isValidPlacement(placement))
+        return false;
+    const Bounds& b = block.box;
+    if (b.isEmpty())
+        return true;
+    const double xs[2] = { static_cast<double>(b.minX), static_cast<double>(b.maxX) };
+    const double ys[2] = { static_cast<double>(b.minY), static_cast<double>(b.maxY) };
+    for (double x : xs) {
+        for (double y : ys) {
+            double px = placement.a * x + placement.b * y + placement.tx;
+            double py = placement.c * x + placement.d * y + placement.ty;
+            if (!(std::fabs(px) < INT_MAX - 1.0 && std::fabs(py) < INT_MAX - 1.0))
+                return false;
+        }
+    }
+    return true;
+}
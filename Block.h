@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Shape.h"
+#include "Transform.h"
+
+// A named group of shapes in block coordinates, drawn wherever a reference
+// places it. Blocks hold plain shapes: no arrays and no other blocks.
+//
+// A definition is shared by pointer between the scene's block table and every
+// reference to it, and never changes once referenced: the scene owner only
+// appends to a definition nothing else holds yet.
+struct BlockDefinition {
+    std::string name;
+    std::vector<std::shared_ptr<const Shape>> shapes;
+    std::vector<Bounds> boxes; // bounds of each shape, for pruning hit tests
+    Bounds box;                // all of them
+
+    explicit BlockDefinition(std::string name);
+    void append(std::shared_ptr<const Shape> shape);
+    // Distance from (x, y), in block coordinates, to the nearest shape.
+    double distanceTo(double x, double y) const;
+};
+
+// One placement of a block: the definition it shows and the map from block to
+// scene coordinates, in about a hundred bytes however large the block is.
+// Immutable like arrays: an edit replaces the reference with a new one.
+class BlockReference : public Shape {
+public:
+    std::shared_ptr<const BlockDefinition> block;
+    Affine2D placement;
+
+    BlockReference(std::shared_ptr<const BlockDefinition> block, const Affine2D& placement);
+    void draw() const override;
+    std::string toString() const override;
+    ShapeType type() const override;
+    Bounds bounds() const override;
+    // Measured in block space and scaled back, so exact for moves, rotations
+    // and uniform scaling, and approximate under non-uniform scaling.
+    double distanceTo(double x, double y) const override;
+
+    // Square root of the area scale of the placement.
+    double scale() const;
+
+private:
+    Bounds box;
+};
+
+// True for names a drawing file and the console can carry: letters, digits,
+// '_', '-' and '.', at most 64 of them.
+bool isValidBlockName(const std::string& name);
+
+// True when `placement` is finite, invertible and keeps translations within
+// integer coordinates.
+bool isValidPlacement(const Affine2D& placement);
+// As above, and every corner of `block`'s box placed by it stays within
+// integer coordinates, so everything in the block does.
+bool isValidPlacement(const BlockDefinition& block, const Affine2D& placement);
@@ -0,0 +1,706 @@
+#include "CommandInterpreter.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include "SFML/Graphics.hpp"
+#include "Benchmark.h"
+#include "ConvexHull.h"
+#include "Intersection.h"
+#include "LockStats.h"
+#include "Profiler.h"
+#include "Raster.h"
+#include "SceneFile.h"
+#include "TaskScheduler.h"
+
+namespace {
+
+bool readWindow(std::istringstream& in, Bounds& window) {
+    int x1, y1, x2, y2;
+    if (!(in >> x1 >> y1 >> x2 >> y2))
+        return false;
+    window = Bounds(std::min(x1, x2), std::min(y1, y2), std::max(x1, x2), std::max(y1, y2));
+    return true;
+}
+
+// The scene's query index, brought up to date. Needs the scene mutex.
+const SpatialIndex& queryIndex(Scene& scene) {
+    // Both versions only grow, so their sum changes whenever either does
+    scene.queryIndex.refresh(scene.shapes, scene.editVersion + scene.moveVersion);
+    return scene.queryIndex;
+}
+
+// Writes shape ids in ascending order, sixteen to a line, in pieces of about
+// 64 KB so long results go out while they are formatted.
+void writeIds(std::ostream& out, std::vector<std::size_t>& ids) {
+    std::sort(ids.begin(), ids.end());
+    std::string text;
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+        text += std::to_string(ids[i]);
+        text += i % 16 == 15 || i + 1 == ids.size() ? '\n' : ' ';
+        if (text.size() >= 64 * 1024) {
+            out << text << std::flush;
+            text.clear();
+        }
+    }
+    out << text;
+}
+
+// The commands a SceneOnly interpreter accepts: edits and queries of the scene.
+bool isSceneCommand(const std::string& command) {
+    static const char* const kSceneCommands[] = { "addpoint", "addline", "addrect", "addrectangle", "addcircle",
+        "addpoints", "addlines", "addpolyline", "addpolygon", "array", "block", "insert", "blocks", "select",
+        "selectall", "count", "extents", "find-in-rect", "intersecting", "nearest", "hull", "move", "rotate", "scale",
+        "begin", "commit", "abort", "undo", "redo", "history", "union", "intersect", "cut", "exit" };
+    return std::find(std::begin(kSceneCommands), std::end(kSceneCommands), command) != std::end(kSceneCommands);
+}
+
+const int kMaxScriptDepth = 8;
+const std::size_t kScriptBatch = 64 * 1024; // add commands per transaction
+const int kMaxPlotSize = 16384;              // pixels per side, 1 GB of RGBA at most
+
+}
+
+CommandInterpreter::CommandInterpreter(Scene& scene, SceneOwner& owner, CommandAccess access)
+    : scene(scene), owner(owner), access(access) {
+}
+
+void CommandInterpreter::printHelp(std::ostream& out) {
+    out << "Commands: addpoint x y | addline x1 y1 x2 y2 | addrect x y w h | addcircle cx cy r\n";
+    out << "          addpolyline n x1 y1 ... | addpolygon n x1 y1 ...\n";
+    out << "          addpoints n x1 y1 ... | addlines n x1 y1 x2 y2 ... (or n base64 <int32 coordinates>)\n";
+    out << "          array linear n dx dy | grid cols rows dx dy | polar n cx cy [degrees], then an add command\n";
+    out << "          block name [add command] (the selection, or one shape) | insert name x y [degrees [scale]] | blocks\n";
+    out << "          select x1 y1 x2 y2 | selectall | move dx dy | rotate deg cx cy | scale sx sy cx cy\n";
+    out << "          undo | redo | history [budget MB] | begin | commit | abort (stage edits, publish at once)\n";
+    out << "          hull (of the selection, or everything when nothing is selected) | count [x1 y1 x2 y2] | extents\n";
+    out << "          find-in-rect x1 y1 x2 y2 | nearest x y k | intersecting id (ids are shape indices)\n";
+    out << "          union | intersect x1 y1 x2 y2 | cut x1 y1 x2 y2 | bench name [size]\n";
+    out << "          plot file.png width height (anti-aliased lines, rectangles and circles)\n";
+    out << "          import file | export file (in the background) | jobs | cancel id | run script\n";
+    out << "          profile on|off|export file.json | tasks [reset] | locks [reset|export file.json] | exit\n";
+}
+
+std::string CommandInterpreter::queue(SceneCommand command, const char* done) {
+    if (inTransaction) {
+        staged.push_back(std::move(command));
+        return "Staged.\n";
+    }
+    owner.post(std::move(command));
+    return done;
+}
+
+std::string CommandInterpreter::apply(SceneCommand command) {
+    if (inTransaction) {
+        staged.push_back(std::move(command));
+        return "Staged.\n";
+    }
+    SceneReply reply;
+    command.reply = &reply;
+    owner.post(std::move(command));
+    owner.flush();
+    return reply.message;
+}
+
+bool CommandInterpreter::runScript(const CompiledScript& script, std::ostream& out, std::size_t& shapesAdded) {
+    const std::vector<std::int32_t>& code = script.code;
+    std::vector<SceneCommand> batch;
+    std::size_t batchShapes = 0;
+    auto flushBatch = [&]() {
+        if (batch.empty())
+            return;
+        shapesAdded += batchShapes;
+        batchShapes = 0;
+        apply(SceneCommand::transaction(std::move(batch)));
+        batch.clear();
+    };
+    auto readPath = [&](std::size_t& pc, std::size_t count) {
+        std::vector<Point> points;
+        points.reserve(count);
+        for (std::size_t i = 0; i < count; ++i, pc += 2)
+            points.push_back(Point(code[pc], code[pc + 1]));
+        return points;
+    };
+
+    std::size_t pc = 0;
+    while (pc < code.size()) {
+        const std::int32_t* w = &code[pc + 1];
+        switch (static_cast<ScriptOp>(code[pc])) {
+        case ScriptOp::AddPoint:
+            batch.push_back(SceneCommand::addPoint(w[0], w[1]));
+            ++batchShapes;
+            pc += 3;
+            break;
+        case ScriptOp::AddLine:
+            batch.push_back(SceneCommand::addLine(w[0], w[1], w[2], w[3]));
+            ++batchShapes;
+            pc += 5;
+            break;
+        case ScriptOp::AddRectangle:
+            batch.push_back(SceneCommand::addRectangle(w[0], w[1], w[2], w[3]));
+            ++batchShapes;
+            pc += 5;
+            break;
+        case ScriptOp::AddCircle:
+            batch.push_back(SceneCommand::addCircle(w[0], w[1], w[2]));
+            ++batchShapes;
+            pc += 4;
+            break;
+        case ScriptOp::AddPolyline:
+        case ScriptOp::AddPolygon:
+        case ScriptOp::AddPoints:
+        case ScriptOp::AddLines: {
+            ScriptOp op = static_cast<ScriptOp>(code[pc]);
+            std::size_t count = static_cast<std::size_t>(w[0]) * (op == ScriptOp::AddLines ? 2 : 1);
+            pc += 2;
+            std::vector<Point> points = readPath(pc, count);
+            batchShapes += op == ScriptOp::AddPoints || op == ScriptOp::AddLines ? static_cast<std::size_t>(w[0]) : 1;
+            if (op == ScriptOp::AddPoints)
+                batch.push_back(SceneCommand::addPoints(std::move(points)));
+            else if (op == ScriptOp::AddLines)
+                batch.push_back(SceneCommand::addLines(std::move(points)));
+            else
+                batch.push_back(SceneCommand::addPath(std::move(points), op == ScriptOp::AddPolygon));
+            break;
+        }
+        case ScriptOp::Console: {
+            // Whatever the line reads or edits must see the adds before it
+            flushBatch();
+            bool keepGoing = execute(script.lines[static_cast<std::size_t>(w[0])], out);
+            pc += 2;
+            if (!keepGoing)
+                return false;
+            break;
+        }
+        }
+        if (batch.size() >= kScriptBatch)
+            flushBatch();
+    }
+    flushBatch();
+    return true;
+}
+
+bool CommandInterpreter::execute(const std::string& line, std::ostream& out) {
+    std::istringstream in(line);
+    std::string command;
+    if (!(in >> command))
+        return true;
+    if (access == CommandAccess::SceneOnly && !isSceneCommand(command)) {
+        out << "Not available in a shared session.\n";
+        return true;
+    }
+
+    // Additions are only queued: the owner applies them in order, and every
+    // command that reads the scene waits for what was posted before it
+    if (command == "addpoint") {
+        int x, y;
+        if (!(in >> x >> y)) {
+            out << "Usage: addpoint x y\n";
+            return true;
+        }
+        out << queue(SceneCommand::addPoint(x, y), "Point added.\n");
+    }
+    else if (command == "addline") {
+        int x1, y1, x2, y2;
+        if (!(in >> x1 >> y1 >> x2 >> y2)) {
+            out << "Usage: addline x1 y1 x2 y2\n";
+            return true;
+        }
+        out << queue(SceneCommand::addLine(x1, y1, x2, y2), "Line added.\n");
+    }
+    else if (command == "addrect" || command == "addrectangle") {
+        int x, y, width, height;
+        if (!(in >> x >> y >> width >> height) || width < 0 || height < 0) {
+            out << "Usage: addrect x y width height\n";
+            return true;
+        }
+        if (!isValidRectangle(x, y, width, height)) {
+            out << "The rectangle's far corner is beyond integer coordinates.\n";
+            return true;
+        }
+        out << queue(SceneCommand::addRectangle(x, y, width, height), "Rectangle added.\n");
+    }
+    else if (command == "addcircle") {
+        int cx, cy, radius;
+        if (!(in >> cx >> cy >> radius) || radius < 0) {
+            out << "Usage: addcircle cx cy radius\n";
+            return true;
+        }
+        if (!isValidCircle(cx, cy, radius)) {
+            out << "The circle reaches beyond integer coordinates.\n";
+            return true;
+        }
+        out << queue(SceneCommand::addCircle(cx, cy, radius), "Circle added.\n");
+    }
+    else if (command == "addpoints" || command == "addlines") {
+        // Bulk forms: the whole array is parsed here and added by one owner command
+        bool lines = command == "addlines";
+        std::size_t n = 0;
+        std::vector<Point> points;
+        bool read = in >> n && n != 0;
+        std::size_t from = in.eof() ? line.size() : static_cast<std::size_t>(in.tellg());
+        if (!read || !readPoints(line, from, lines ? 2 * n : n, points)) {
+            out << "Usage: " << command << (lines ? " n x1 y1 x2 y2 ..." : " n x1 y1 ...") << " | " << command
+                << " n base64 <little-endian int32 coordinates>\n";
+            return true;
+        }
+        out << queue(lines ? SceneCommand::addLines(std::move(points)) : SceneCommand::addPoints(std::move(points)),
+            lines ? "Lines added.\n" : "Points added.\n");
+    }
+    else if (command == "addpolyline" || command == "addpolygon") {
+        bool closed = command == "addpolygon";
+        std::size_t n = 0;
+        in >> n;
+        std::vector<Point> points;
+        points.reserve(std::min<std::size_t>(n, 1 << 16));
+        for (std::size_t i = 0; i < n; ++i) {
+            int x, y;
+            if (!(in >> x >> y))
+                break;
+            points.push_back(Point(x, y));
+        }
+        if (points.size() != n || n < (closed ? 3u : 2u)) {
+            out << "Not enough vertices.\n";
+            return true;
+        }
+        out << queue(SceneCommand::addPath(std::move(points), closed), closed ? "Polygon added.\n" : "Polyline added.\n");
+    }
+    else if (command == "array") {
+        SceneCommand add;
+        if (!parseDrawingLine(line, add)) {
+            out << "Usage: array linear n dx dy | array grid columns rows dx dy | array polar n cx cy [degrees],\n"
+                << "       each followed by the add command of the item (array grid 100 100 50 50 addrect 0 0 40 20)\n";
+            return true;
+        }
+        std::string done = "Array of " + std::to_string(add.array->pattern.count()) + " added.\n";
+        out << queue(std::move(add), done.c_str());
+    }
+    else if (command == "block") {
+        std::string name, rest;
+        in >> name;
+        std::getline(in, rest);
+        SceneCommand define;
+        if (rest.find_first_not_of(" \t\r") == std::string::npos)
+            define = SceneCommand::defineBlock(name, {});
+        else if (!parseDrawingLine(line, define))
+            name.clear();
+        if (name.empty()) {
+            out << "Usage: block name (copies the selection into the block) | block name addline ... (adds one shape)\n";
+            return true;
+        }
+        out << apply(std::move(define));
+    }
+    else if (command == "insert") {
+        SceneCommand reference;
+        if (!parseDrawingLine(line, reference)) {
+            out << "Usage: insert name x y [degrees [scale]] | insert name x y matrix a b c d\n";
+            return true;
+        }
+        out << apply(std::move(reference));
+    }
+    else if (command == "blocks") {
+        owner.flush();
+        InstrumentedLock lock(scene.mutex);
+        if (scene.blocks.empty()) {
+            out << "No blocks defined.\n";
+            return true;
+        }
+        for (const auto& entry : scene.blocks) {
+            std::size_t references = 0;
+            for (const auto& shape : scene.shapes) {
+                if (shape->type() == ShapeType::Reference && static_cast<const BlockReference&>(*shape).block == entry.second)
+                    ++references;
+            }
+            out << entry.first << ": " << entry.second->shapes.size() << " shapes, " << references << " references\n";
+        }
+    }
+    else if (command == "select" || command == "selectall") {
+        Bounds window(INT_MIN, INT_MIN, INT_MAX, INT_MAX);
+        if (command == "select" && !readWindow(in, window)) {
+            out << "Usage: select x1 y1 x2 y2\n";
+            return true;
+        }
+        out << apply(SceneCommand::select(window));
+    }
+    else if (command == "count") {
+        Bounds window;
+        bool windowed = readWindow(in, window);
+        owner.flush();
+        InstrumentedLock lock(scene.mutex);
+        if (windowed)
+            out << queryIndex(scene).count(scene.shapes, window) << " shapes meet the window.\n";
+        else
+            out << scene.shapes.size() << " shapes, " << scene.selection.size() << " selected.\n";
+    }
+    else if (command == "extents") {
+        owner.flush();
+        InstrumentedLock lock(scene.mutex);
+        Bounds extent = queryIndex(scene).extent(scene.shapes);
+        if (extent.isEmpty())
+            out << "Nothing drawn.\n";
+        else
+            out << "Extents (" << extent.minX << ", " << extent.minY << ") to (" << extent.maxX << ", " << extent.maxY
+                << "), " << scene.shapes.size() << " shapes.\n";
+    }
+    else if (command == "find-in-rect" || command == "intersecting") {
+        Bounds window;
+        std::size_t id = 0;
+        bool byShape = command == "intersecting";
+        if (byShape ? !(in >> id) : !readWindow(in, window)) {
+            out << (byShape ? "Usage: intersecting id\n" : "Usage: find-in-rect x1 y1 x2 y2\n");
+            return true;
+        }
+        std::vector<std::size_t> hits;
+        std::size_t candidates = 0;
+        {
+            owner.flush();
+            InstrumentedLock lock(scene.mutex);
+            if (byShape) {
+                if (id >= scene.shapes.size()) {
+                    out << "No shape " << id << ".\n";
+                    return true;
+                }
+                window = scene.shapes[id]->bounds();
+            }
+            std::vector<IndexCluster> clusters; // stays empty: a zero cluster extent never clusters
+            queryIndex(scene).collect(scene.shapes, window, 0.0, 0.0, hits, clusters);
+            if (byShape) {
+                // The index only finds shapes whose bounds overlap; keep those that touch the shape itself
+                hits.erase(std::remove(hits.begin(), hits.end(), id), hits.end());
+                candidates = hits.size();
+                const Shape& shape = *scene.shapes[id];
+                hits.erase(std::remove_if(hits.begin(), hits.end(),
+                               [&](std::size_t h) { return !shapesIntersect(shape, *scene.shapes[h]); }),
+                    hits.end());
+            }
+        }
+        writeIds(out, hits);
+        if (byShape)
+            out << hits.size() << " shapes intersect shape " << id << " (" << candidates << " overlap its bounds).\n";
+        else
+            out << hits.size() << " shapes meet the window.\n";
+    }
+    else if (command == "nearest") {
+        double x, y;
+        std::size_t k = 0;
+        if (!(in >> x >> y >> k) || k == 0) {
+            out << "Usage: nearest x y k\n";
+            return true;
+        }
+        owner.flush();
+        InstrumentedLock lock(scene.mutex);
+        k = std::min(k, scene.shapes.size());
+        std::vector<Neighbor> hits = queryIndex(scene).nearest(scene.shapes, x, y, k, std::numeric_limits<double>::infinity());
+        for (const Neighbor& hit : hits) {
+            char distance[32];
+            std::snprintf(distance, sizeof(distance), "%.3f", hit.distance);
+            out << hit.index << " at " << distance << ": " << scene.shapes[hit.index]->toString() << "\n";
+        }
+        if (hits.empty())
+            out << "Nothing drawn.\n";
+    }
+    else if (command == "hull") {
+        std::vector<IntPoint> vertices;
+        {
+            owner.flush();
+            InstrumentedLock lock(scene.mutex);
+            vertices = shapeVertices(scene.shapes, scene.selection);
+        }
+        Path hull = convexHull(vertices);
+        if (hull.empty()) {
+            out << "Nothing to measure.\n";
+            return true;
+        }
+        OrientedRect rect = minAreaRect(hull);
+        HullDiameter diameter = hullDiameter(hull);
+        out << "Hull: " << hull.size() << " vertices from " << vertices.size() << " points, area "
+            << signedArea2(hull) / 2.0 << "\n";
+        out << "Minimum bounding rectangle: " << rect.width << " x " << rect.height << " at "
+            << rect.angleDegrees << " degrees, corners";
+        for (const auto& corner : rect.corners)
+            out << " (" << corner[0] << ", " << corner[1] << ")";
+        out << "\nDiameter: " << diameter.length << " between (" << diameter.a.x << ", " << diameter.a.y
+            << ") and (" << diameter.b.x << ", " << diameter.b.y << ")\n";
+    }
+    else if (command == "plot") {
+        std::string path;
+        int width = 0, height = 0;
+        in >> path >> width >> height;
+        if (width <= 0 || height <= 0 || width > kMaxPlotSize || height > kMaxPlotSize) {
+            out << "Plot size must be between 1 and " << kMaxPlotSize << " pixels per side.\n";
+            return true;
+        }
+        RasterImage image(static_cast<unsigned>(width), static_cast<unsigned>(height), RasterColor{ 255, 255, 255, 255 });
+        std::size_t drawn;
+        {
+            owner.flush();
+            InstrumentedLock lock(scene.mutex);
+            Bounds extent;
+            for (const auto& shape : scene.shapes)
+                extent.expand(shape->bounds());
+            if (extent.isEmpty()) {
+                out << "Nothing to plot.\n";
+                return true;
+            }
+            // Fit the drawing inside a 10 pixel margin
+            const double margin = 10.0;
+            // Spans in double: a drawing wider than INT_MAX would overflow the int difference
+            double spanX = std::max(1.0, static_cast<double>(extent.maxX) - extent.minX);
+            double spanY = std::max(1.0, static_cast<double>(extent.maxY) - extent.minY);
+            double scale = std::min((width - 2 * margin) / spanX, (height - 2 * margin) / spanY);
+            scale = std::max(scale, 1e-9);
+            drawn = rasterShapes(image, scene.shapes, extent.minX - margin / scale, extent.minY - margin / scale, scale,
+                1.5, RasterColor{ 0, 0, 0, 255 });
+        }
+        sf::Image output;
+        output.create(image.width, image.height, image.rgba.data());
+        if (output.saveToFile(path))
+            out << drawn << " shapes plotted to " << path << "\n";
+        else
+            out << "Could not write " << path << "\n";
+    }
+    else if (command == "move" || command == "rotate" || command == "scale") {
+        Affine2D matrix = Affine2D::identity();
+        if (command == "move") {
+            double dx, dy;
+            if (!(in >> dx >> dy)) {
+                out << "Usage: move dx dy\n";
+                return true;
+            }
+            matrix = Affine2D::translation(dx, dy);
+        }
+        else if (command == "rotate") {
+            double degrees, cx, cy;
+            if (!(in >> degrees >> cx >> cy)) {
+                out << "Usage: rotate deg cx cy\n";
+                return true;
+            }
+            matrix = Affine2D::rotation(degrees, cx, cy);
+        }
+        else {
+            double sx, sy, cx, cy;
+            if (!(in >> sx >> sy >> cx >> cy)) {
+                out << "Usage: scale sx sy cx cy\n";
+                return true;
+            }
+            if (sx == 0.0 || sy == 0.0) {
+                out << "Scale must be non-zero.\n";
+                return true;
+            }
+            matrix = Affine2D::scaling(sx, sy, cx, cy);
+        }
+        out << apply(SceneCommand::transform(matrix));
+    }
+    else if (command == "begin") {
+        if (inTransaction) {
+            out << "A transaction is already open.\n";
+            return true;
+        }
+        inTransaction = true;
+        out << "Transaction started; edits are staged until commit.\n";
+    }
+    else if (command == "commit" || command == "abort") {
+        if (!inTransaction) {
+            out << "No transaction is open.\n";
+            return true;
+        }
+        inTransaction = false;
+        std::vector<SceneCommand> batch;
+        batch.swap(staged);
+        if (command == "abort")
+            out << batch.size() << " staged edits discarded.\n";
+        else if (batch.empty())
+            out << "Nothing to commit.\n";
+        else
+            out << apply(SceneCommand::transaction(std::move(batch)));
+    }
+    else if (inTransaction && (command == "undo" || command == "redo" || command == "history")) {
+        out << "Commit or abort the transaction first.\n";
+    }
+    else if (command == "undo") {
+        out << apply(SceneCommand::undo());
+    }
+    else if (command == "redo") {
+        out << apply(SceneCommand::redo());
+    }
+    else if (command == "history") {
+        std::string action;
+        int megabytes = 0;
+        if (in >> action) {
+            if (action != "budget" || !(in >> megabytes) || megabytes < 0) {
+                out << "Usage: history [budget MB]\n";
+                return true;
+            }
+            out << apply(SceneCommand::setHistoryBudget(megabytes));
+            return true;
+        }
+        owner.flush();
+        InstrumentedLock lock(scene.mutex);
+        const EditHistory& history = scene.history;
+        char text[128];
+        std::snprintf(text, sizeof(text), "%zu undo and %zu redo steps, %.1f of %.0f MB\n", history.undoCount(),
+            history.redoCount(), history.memoryBytes() / 1048576.0, history.budget() / 1048576.0);
+        out << text;
+    }
+    else if (command == "union") {
+        out << apply(SceneCommand::applyBoolean(BooleanOp::Union, Bounds()));
+    }
+    else if (command == "intersect" || command == "cut") {
+        Bounds window;
+        if (!readWindow(in, window)) {
+            out << "Usage: " << command << " x1 y1 x2 y2\n";
+            return true;
+        }
+        out << apply(SceneCommand::applyBoolean(command == "cut" ? BooleanOp::Difference : BooleanOp::Intersection, window));
+    }
+    else if (command == "import" || command == "export") {
+        std::string path;
+        if (!(in >> path)) {
+            out << "Usage: " << command << " file\n";
+            return true;
+        }
+        if (inTransaction) {
+            out << "Commit or abort the transaction first.\n";
+            return true;
+        }
+        std::shared_ptr<JobProgress> job = command == "import" ? importDrawing(path, owner) : exportDrawing(path, scene, owner);
+        out << "Job " << job->id << " started: " << job->description << " (\"jobs\" shows progress).\n";
+    }
+    else if (command == "jobs") {
+        std::vector<std::shared_ptr<JobProgress>> jobs = JobList::shared().all();
+        if (jobs.empty())
+            out << "No jobs.\n";
+        for (const auto& job : jobs) {
+            char text[64];
+            if (job->finished)
+                std::snprintf(text, sizeof(text), "job %u done: ", job->id);
+            else
+                std::snprintf(text, sizeof(text), "job %u %5.1f%%%s: ", job->id, job->fraction() * 100.0,
+                    job->cancelRequested ? " cancelling" : "");
+            out << text << (job->finished ? job->outcome() : job->description) << "\n";
+        }
+    }
+    else if (command == "cancel") {
+        unsigned id = 0;
+        if (!(in >> id)) {
+            out << "Usage: cancel id\n";
+            return true;
+        }
+        std::shared_ptr<JobProgress> job = JobList::shared().find(id);
+        if (!job)
+            out << "No job " << id << ".\n";
+        else if (job->finished)
+            out << "Job " << id << " has already finished.\n";
+        else {
+            job->cancelRequested = true;
+            out << "Cancelling job " << id << ".\n";
+        }
+    }
+    else if (command == "run") {
+        std::string path;
+        if (!(in >> path)) {
+            out << "Usage: run file\n";
+            return true;
+        }
+        if (scriptDepth >= kMaxScriptDepth) {
+            out << "Scripts nest too deeply.\n";
+            return true;
+        }
+        auto start = std::chrono::steady_clock::now();
+        CompiledScript script;
+        if (!loadScript(path, script)) {
+            out << "Could not read " << path << ".\n";
+            return true;
+        }
+        std::size_t added = 0;
+        ++scriptDepth;
+        bool finished = runScript(script, out, added);
+        --scriptDepth;
+        owner.flush();
+        char text[160];
+        std::snprintf(text, sizeof(text), "%s: %zu shapes added, %zu other commands%s, %.1f ms (%s).\n", path.c_str(),
+            added, script.lines.size(), finished ? "" : ", stopped at exit",
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(),
+            script.fromCache ? "cached bytecode" : "compiled");
+        out << text;
+    }
+    else if (command == "bench") {
+        std::string name;
+        std::size_t size = 0;
+        in >> name;
+        if (!(in >> size))
+            size = 0;
+        if (!runBenchmark(name, size, out))
+            out << "Unknown benchmark.\n";
+    }
+    else if (command == "profile") {
+        std::string action;
+        in >> action;
+        if (action == "on" || action == "off") {
+            setProfilingEnabled(action == "on");
+            out << "Profiling " << action << " (F3 in the viewer shows the overlay).\n";
+        }
+        else if (action == "export") {
+            std::string path;
+            in >> path;
+            if (exportChromeTrace(path))
+                out << "Trace written to " << path << " (open in chrome://tracing).\n";
+            else
+                out << "Could not write " << path << ".\n";
+        }
+        else {
+            out << "Usage: profile on|off|export file.json\n";
+        }
+    }
+    else if (command == "tasks") {
+        TaskScheduler& scheduler = TaskScheduler::shared();
+        std::string action;
+        if (in >> action && action == "reset") {
+            scheduler.resetStats();
+            out << "Task counters reset.\n";
+            return true;
+        }
+        std::vector<WorkerStats> stats = scheduler.stats();
+        for (std::size_t w = 0; w < stats.size(); ++w) {
+            char text[96];
+            std::snprintf(text, sizeof(text), "worker %2zu: %8llu tasks, %7llu stolen, %5.1f%% busy\n", w,
+                static_cast<unsigned long long>(stats[w].tasks), static_cast<unsigned long long>(stats[w].steals),
+                stats[w].utilization * 100.0);
+            out << text;
+        }
+    }
+    else if (command == "locks") {
+        std::string action;
+        if (!(in >> action)) {
+            printLockStats(out);
+        }
+        else if (action == "reset") {
+            resetLockStats();
+            out << "Lock counters reset.\n";
+        }
+        else if (action == "export") {
+            std::string path;
+            in >> path;
+            if (exportLockStats(path))
+                out << "Lock histograms written to " << path << ".\n";
+            else
+                out << "Could not write " << path << ".\n";
+        }
+        else {
+            out << "Usage: locks [reset|export file.json]\n";
+        }
+    }
+    else if (command == "exit") {
+        return false;
+    }
+    else {
+        out << "Unknown command.\n";
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "CommandScript.h"
+#include "Scene.h"
+
+// The console command language, one command per line. The console, every
+// server client and every session viewer get their own interpreter: edits go
+// through the scene owner and reads take the scene mutex, so any number of
+// them can run on different threads. Between "begin" and "commit" an
+// interpreter stages its edits and then publishes them as one transaction.
+
+// What an interpreter may do besides reading and editing the scene. Remote
+// session viewers get SceneOnly: no files on the host (import, export, plot,
+// run, profile and lock exports), no benchmarks and no process-wide settings.
+enum class CommandAccess {
+    Full,
+    SceneOnly,
+};
+
+class CommandInterpreter {
+public:
+    CommandInterpreter(Scene& scene, SceneOwner& owner, CommandAccess access = CommandAccess::Full);
+
+    // Runs one command line and writes its reply to `out`. Returns false for
+    // "exit".
+    bool execute(const std::string& line, std::ostream& out);
+
+    static void printHelp(std::ostream& out);
+
+private:
+    Scene& scene;
+    SceneOwner& owner;
+    CommandAccess access;
+    bool inTransaction = false;
+    std::vector<SceneCommand> staged;
+    int scriptDepth = 0; // scripts may run scripts, up to kMaxScriptDepth deep
+
+    // Posts `command` without waiting and returns `done`.
+    std::string queue(SceneCommand command, const char* done);
+    // Posts `command`, waits for it and returns the owner's reply.
+    std::string apply(SceneCommand command);
+    // Runs a compiled script. Each run of consecutive adds is applied as one
+    // transaction; every other line goes through execute(). False on "exit".
+    bool runScript(const CompiledScript& script, std::ostream& out, std::size_t& shapesAdded);
+};
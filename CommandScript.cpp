@@ -0,0 +1,411 @@
+#include "CommandScript.h"
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string_view>
+#include <system_error>
+#if !defined(_WIN32)
+#include <cerrno>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const char kMagic[4] = { 'M', 'C', 'B', 'C' };
+const std::uint32_t kFormatVersion = 1;
+
+// Decodes standard base64, stopping at the first '=' or character outside the
+// alphabet. Returns the position after the last character used.
+std::size_t decodeBase64(const std::string& text, std::size_t from, std::vector<unsigned char>& bytes) {
+    static const std::string kAlphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    static const auto kValues = []() {
+        std::vector<signed char> values(256, -1);
+        for (std::size_t i = 0; i < kAlphabet.size(); ++i)
+            values[static_cast<unsigned char>(kAlphabet[i])] = static_cast<signed char>(i);
+        return values;
+    }();
+    bytes.reserve((text.size() - from) * 3 / 4);
+    unsigned bits = 0;
+    int bitCount = 0;
+    std::size_t i = from;
+    for (; i < text.size(); ++i) {
+        int value = kValues[static_cast<unsigned char>(text[i])];
+        if (value < 0)
+            break;
+        bits = (bits << 6) | static_cast<unsigned>(value);
+        bitCount += 6;
+        if (bitCount >= 8) {
+            bitCount -= 8;
+            bytes.push_back(static_cast<unsigned char>(bits >> bitCount));
+        }
+    }
+    while (i < text.size() && text[i] == '=')
+        ++i;
+    return i;
+}
+
+bool isBlank(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+// Parses the integers of one add line into `code`, or returns false and
+// leaves `code` as it was.
+class AddParser {
+public:
+    AddParser(const std::string& line, std::size_t from, std::vector<std::int32_t>& code)
+        : line(line), p(line.data() + from), end(line.data() + line.size()), code(code), start(code.size()) {
+    }
+
+    // Appends `count` integers, each at least `minimum`.
+    bool ints(std::size_t count, int minimum = INT32_MIN) {
+        for (std::size_t i = 0; i < count; ++i) {
+            while (p < end && isBlank(*p))
+                ++p;
+            int value;
+            std::from_chars_result result = std::from_chars(p, end, value);
+            if (result.ec != std::errc() || value < minimum)
+                return fail();
+            p = result.ptr;
+            code.push_back(value);
+        }
+        return true;
+    }
+
+    // A count followed by that many x y pairs (or, for lines, quadruples).
+    bool counted(int minimum, std::size_t perItem) {
+        if (!ints(1, minimum))
+            return false;
+        std::size_t n = static_cast<std::size_t>(code.back());
+        if (n * perItem > static_cast<std::size_t>(end - p))
+            return fail();
+        return ints(n * perItem);
+    }
+
+    // A count followed by the text or base64 form that readPoints accepts.
+    bool bulk(std::size_t pointsPerItem) {
+        if (!ints(1, 1))
+            return false;
+        std::vector<Point> points;
+        if (!readPoints(line, static_cast<std::size_t>(p - line.data()), static_cast<std::size_t>(code.back()) * pointsPerItem, points))
+            return fail();
+        for (const Point& point : points) {
+            code.push_back(point.x);
+            code.push_back(point.y);
+        }
+        p = end;
+        return true;
+    }
+
+    bool done() {
+        while (p < end && isBlank(*p))
+            ++p;
+        return p == end || fail();
+    }
+
+private:
+    const std::string& line;
+    const char* p;
+    const char* end;
+    std::vector<std::int32_t>& code;
+    std::size_t start;
+
+    bool fail() {
+        code.resize(start);
+        return false;
+    }
+};
+
+// Compiles one add line; false for anything else.
+bool compileAdd(const std::string& line, std::vector<std::int32_t>& code, std::size_t& shapes) {
+    std::size_t first = line.find_first_not_of(" \t");
+    std::size_t last = line.find_first_of(" \t", first);
+    if (last == std::string::npos)
+        return false;
+    std::string_view keyword(line.data() + first, last - first);
+    std::size_t start = code.size();
+    bool parsed = false;
+    std::size_t added = 1;
+    auto emit = [&](ScriptOp op) {
+        code.push_back(static_cast<std::int32_t>(op));
+    };
+    AddParser parser(line, last, code);
+    if (keyword == "addpoint") {
+        emit(ScriptOp::AddPoint);
+        parsed = parser.ints(2);
+    }
+    else if (keyword == "addline") {
+        emit(ScriptOp::AddLine);
+        parsed = parser.ints(4);
+    }
+    else if (keyword == "addrect" || keyword == "addrectangle") {
+        emit(ScriptOp::AddRectangle);
+        parsed = parser.ints(2) && parser.ints(2, 0) && isValidRectangle(code[start + 1], code[start + 2], code[start + 3], code[start + 4]);
+    }
+    else if (keyword == "addcircle") {
+        emit(ScriptOp::AddCircle);
+        parsed = parser.ints(2) && parser.ints(1, 0) && isValidCircle(code[start + 1], code[start + 2], code[start + 3]);
+    }
+    else if (keyword == "addpolyline" || keyword == "addpolygon") {
+        bool closed = keyword == "addpolygon";
+        emit(closed ? ScriptOp::AddPolygon : ScriptOp::AddPolyline);
+        parsed = parser.counted(closed ? 3 : 2, 2);
+    }
+    else if (keyword == "addpoints" || keyword == "addlines") {
+        bool lines = keyword == "addlines";
+        emit(lines ? ScriptOp::AddLines : ScriptOp::AddPoints);
+        parsed = parser.bulk(lines ? 2 : 1);
+        if (parsed)
+            added = static_cast<std::size_t>(code[start + 1]);
+    }
+    else {
+        return false;
+    }
+    if (!parsed || !parser.done()) {
+        code.resize(start);
+        return false;
+    }
+    shapes += added;
+    return true;
+}
+
+// FNV-1a over the script text.
+std::uint64_t contentHash(const std::string& text) {
+    std::uint64_t hash = 14695981039346656037ull;
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// The cache directory, or an empty path when there is none to trust. The shared
+// temp directory lets anyone create files, and a planted cache file would run
+// as a script, so each user gets a directory only they can write to. On
+// Windows the temp directory is per user already.
+std::filesystem::path cacheDirectory() {
+    std::error_code error;
+    std::filesystem::path directory = std::filesystem::temp_directory_path(error);
+    if (error)
+        return std::filesystem::path();
+#if defined(_WIN32)
+    directory /= "minicad-scripts";
+    std::filesystem::create_directories(directory, error);
+    return error ? std::filesystem::path() : directory;
+#else
+    directory /= "minicad-scripts-" + std::to_string(getuid());
+    if (mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST)
+        return std::filesystem::path();
+    // Someone else may have created it first: it must be ours and closed to others
+    struct stat info;
+    if (lstat(directory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode) || info.st_uid != getuid() || (info.st_mode & 077) != 0)
+        return std::filesystem::path();
+    return directory;
+#endif
+}
+
+std::filesystem::path cachePath(std::uint64_t hash) {
+    std::filesystem::path directory = cacheDirectory();
+    if (directory.empty())
+        return directory;
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.mcbc", static_cast<unsigned long long>(hash));
+    return directory / name;
+}
+
+// The cache holds the words in native byte order: it is only ever read back on
+// the machine that wrote it.
+struct CacheHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t hash, textSize, shapes, codeWords, lineCount;
+};
+
+// True when every op in `script` is known and its operands are all there and
+// within what the compiler emits, so a damaged cache file can neither send the
+// interpreter past the end nor add shapes a script could not.
+bool wellFormed(const CompiledScript& script) {
+    const std::vector<std::int32_t>& code = script.code;
+    std::size_t pc = 0;
+    while (pc < code.size()) {
+        std::size_t remaining = code.size() - pc - 1;
+        std::size_t operands;
+        ScriptOp op = static_cast<ScriptOp>(code[pc]);
+        switch (op) {
+        case ScriptOp::AddPoint: operands = 2; break;
+        case ScriptOp::AddLine: operands = 4; break;
+        case ScriptOp::AddRectangle:
+            if (remaining < 4 || !isValidRectangle(code[pc + 1], code[pc + 2], code[pc + 3], code[pc + 4]))
+                return false;
+            operands = 4;
+            break;
+        case ScriptOp::AddCircle:
+            if (remaining < 3 || !isValidCircle(code[pc + 1], code[pc + 2], code[pc + 3]))
+                return false;
+            operands = 3;
+            break;
+        case ScriptOp::AddPolyline:
+        case ScriptOp::AddPolygon:
+        case ScriptOp::AddPoints:
+        case ScriptOp::AddLines: {
+            int minimum = op == ScriptOp::AddPolygon ? 3 : (op == ScriptOp::AddPolyline ? 2 : 1);
+            if (remaining < 1 || code[pc + 1] < minimum)
+                return false;
+            operands = 1 + static_cast<std::size_t>(code[pc + 1]) * (op == ScriptOp::AddLines ? 4 : 2);
+            break;
+        }
+        case ScriptOp::Console:
+            if (remaining < 1 || code[pc + 1] < 0 || static_cast<std::size_t>(code[pc + 1]) >= script.lines.size())
+                return false;
+            operands = 1;
+            break;
+        default:
+            return false;
+        }
+        if (operands > remaining)
+            return false;
+        pc += 1 + operands;
+    }
+    return true;
+}
+
+bool readCache(const std::filesystem::path& path, std::uint64_t hash, std::size_t textSize, CompiledScript& script) {
+    std::ifstream in(path, std::ios::binary);
+    CacheHeader header;
+    if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, kMagic, 4) != 0 ||
+        header.version != kFormatVersion || header.hash != hash || header.textSize != textSize ||
+        header.codeWords > textSize || header.lineCount > textSize)
+        return false;
+    script.code.resize(static_cast<std::size_t>(header.codeWords));
+    if (!in.read(reinterpret_cast<char*>(script.code.data()), static_cast<std::streamsize>(script.code.size() * sizeof(std::int32_t))))
+        return false;
+    script.lines.resize(static_cast<std::size_t>(header.lineCount));
+    for (std::string& line : script.lines) {
+        std::uint32_t length;
+        if (!in.read(reinterpret_cast<char*>(&length), sizeof(length)) || length > textSize)
+            return false;
+        line.resize(length);
+        if (!in.read(&line[0], length))
+            return false;
+    }
+    script.shapes = static_cast<std::size_t>(header.shapes);
+    return wellFormed(script);
+}
+
+void writeCache(const std::filesystem::path& path, std::uint64_t hash, std::size_t textSize, const CompiledScript& script) {
+    std::error_code error;
+    // Written under a temporary name and renamed, so readers never see half a file
+    std::filesystem::path partial = path;
+    partial += ".partial";
+    {
+        std::ofstream out(partial, std::ios::binary);
+        CacheHeader header = {};
+        std::memcpy(header.magic, kMagic, 4);
+        header.version = kFormatVersion;
+        header.hash = hash;
+        header.textSize = textSize;
+        header.shapes = script.shapes;
+        header.codeWords = script.code.size();
+        header.lineCount = script.lines.size();
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(script.code.data()), static_cast<std::streamsize>(script.code.size() * sizeof(std::int32_t)));
+        for (const std::string& line : script.lines) {
+            std::uint32_t length = static_cast<std::uint32_t>(line.size());
+            out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+            out.write(line.data(), length);
+        }
+        if (!out)
+            return;
+    }
+    std::filesystem::rename(partial, path, error);
+    if (error)
+        std::filesystem::remove(partial, error);
+}
+
+}
+
+bool readPoints(const std::string& line, std::size_t from, std::size_t count, std::vector<Point>& points) {
+    const char* p = line.data() + from;
+    const char* end = line.data() + line.size();
+    auto skipBlanks = [&]() {
+        while (p < end && isBlank(*p))
+            ++p;
+    };
+    // Every point takes at least four characters either way
+    if (count > line.size() / 4)
+        return false;
+    points.reserve(count);
+    skipBlanks();
+    if (line.compare(static_cast<std::size_t>(p - line.data()), 6, "base64") == 0) {
+        p += 6;
+        skipBlanks();
+        std::vector<unsigned char> bytes;
+        p = line.data() + decodeBase64(line, static_cast<std::size_t>(p - line.data()), bytes);
+        skipBlanks();
+        if (p != end || bytes.size() != count * 8)
+            return false;
+        auto word = [&](std::size_t at) {
+            return static_cast<int>(static_cast<std::uint32_t>(bytes[at]) | static_cast<std::uint32_t>(bytes[at + 1]) << 8 |
+                static_cast<std::uint32_t>(bytes[at + 2]) << 16 | static_cast<std::uint32_t>(bytes[at + 3]) << 24);
+        };
+        for (std::size_t i = 0; i < count; ++i)
+            points.push_back(Point(word(8 * i), word(8 * i + 4)));
+        return true;
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+        int xy[2];
+        for (int& value : xy) {
+            skipBlanks();
+            std::from_chars_result result = std::from_chars(p, end, value);
+            if (result.ec != std::errc())
+                return false;
+            p = result.ptr;
+        }
+        points.push_back(Point(xy[0], xy[1]));
+    }
+    skipBlanks();
+    return p == end;
+}
+
+CompiledScript compileScript(const std::string& text) {
+    CompiledScript script;
+    script.code.reserve(text.size() / 4);
+    std::size_t begin = 0;
+    while (begin < text.size()) {
+        std::size_t newline = text.find('\n', begin);
+        std::size_t end = newline == std::string::npos ? text.size() : newline;
+        std::string line = text.substr(begin, end - begin);
+        begin = end + 1;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        std::size_t first = line.find_first_not_of(" \t");
+        if (first == std::string::npos || line[first] == '#')
+            continue;
+        if (compileAdd(line, script.code, script.shapes))
+            continue;
+        script.code.push_back(static_cast<std::int32_t>(ScriptOp::Console));
+        script.code.push_back(static_cast<std::int32_t>(script.lines.size()));
+        script.lines.push_back(std::move(line));
+    }
+    return script;
+}
+
+bool loadScript(const std::string& path, CompiledScript& script) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    std::uint64_t hash = contentHash(text);
+    std::filesystem::path cached = cachePath(hash);
+    if (!cached.empty() && readCache(cached, hash, text.size(), script)) {
+        script.fromCache = true;
+        return true;
+    }
+    script = compileScript(text);
+    if (!cached.empty())
+        writeCache(cached, hash, text.size(), script);
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Shape.h"
+
+// Word codes of a compiled script. Each op is followed by its operands.
+enum class ScriptOp : std::int32_t {
+    AddPoint,     // x y
+    AddLine,      // x1 y1 x2 y2
+    AddRectangle, // left top width height
+    AddCircle,    // cx cy radius
+    AddPolyline,  // n, then n x y pairs
+    AddPolygon,   // n, then n x y pairs
+    AddPoints,    // n, then n x y pairs
+    AddLines,     // n, then n x1 y1 x2 y2 quadruples
+    Console,      // index into CompiledScript::lines, run through the interpreter
+};
+
+// A console script ("run file") compiled to a flat word stream. Add commands
+// become ops with their coordinates already parsed; every other line, and any
+// add the compiler cannot parse, is kept as text for the interpreter, so a
+// script behaves exactly as if its lines were typed.
+struct CompiledScript {
+    std::vector<std::int32_t> code;
+    std::vector<std::string> lines;
+    std::size_t shapes = 0; // added by the add ops
+    bool fromCache = false;
+};
+
+CompiledScript compileScript(const std::string& text);
+
+// Compiles the script at `path`, or loads the compiled form from the on-disk
+// cache (keyed by a hash of the file content, in a directory private to the
+// user) when the same text was compiled before. False when the file cannot be
+// read.
+bool loadScript(const std::string& path, CompiledScript& script);
+
+// Reads `count` points from `line` starting at `from`: either whitespace
+// separated "x y" pairs, or "base64" followed by the coordinates as
+// little-endian 32-bit integers. False unless exactly that many follow.
+bool readPoints(const std::string& line, std::size_t from, std::size_t count, std::vector<Point>& points);
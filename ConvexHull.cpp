@@ -0,0 +1,329 @@
+#include "ConvexHull.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <thread>
+#include "Block.h"
+#include "Predicates.h"
+#include "ShapeArray.h"
+#include "TaskScheduler.h"
+
+namespace {
+
+const std::size_t kMinPointsPerThread = 1 << 16;
+
+bool lessXY(const IntPoint& a, const IntPoint& b) {
+    return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+// Nearest int to `v`; placements are validated, so clamping only guards against rounding at the edge.
+int clampToInt(double v) {
+    return static_cast<int>(std::lround(std::max<double>(INT_MIN, std::min<double>(INT_MAX, v))));
+}
+
+int orient(const IntPoint& a, const IntPoint& b, const IntPoint& c) {
+    return orient2d(a.x, a.y, b.x, b.y, c.x, c.y);
+}
+
+// Andrew's monotone chain; sorts `points` in place.
+Path monotoneChain(std::vector<IntPoint>& points) {
+    std::sort(points.begin(), points.end(), lessXY);
+    points.erase(std::unique(points.begin(), points.end(),
+        [](const IntPoint& a, const IntPoint& b) { return a.x == b.x && a.y == b.y; }), points.end());
+    if (points.size() < 3)
+        return points;
+
+    Path hull(points.size() * 2);
+    std::size_t k = 0;
+    for (std::size_t i = 0; i < points.size(); ++i) {
+        while (k >= 2 && orient(hull[k - 2], hull[k - 1], points[i]) <= 0)
+            --k;
+        hull[k++] = points[i];
+    }
+    for (std::size_t i = points.size() - 1, lower = k + 1; i-- > 0;) {
+        while (k >= lower && orient(hull[k - 2], hull[k - 1], points[i]) <= 0)
+            --k;
+        hull[k++] = points[i];
+    }
+    hull.resize(k - 1); // the last point repeats the first
+    return hull;
+}
+
+// Points that reach furthest in the eight compass directions.
+struct Extremes {
+    IntPoint minX, minSum, minY, maxDiff, maxX, maxSum, maxY, minDiff;
+
+    explicit Extremes(const IntPoint& p) : minX(p), minSum(p), minY(p), maxDiff(p), maxX(p), maxSum(p), maxY(p), minDiff(p) {}
+
+    static long long sum(const IntPoint& p) { return static_cast<long long>(p.x) + p.y; }
+    static long long diff(const IntPoint& p) { return static_cast<long long>(p.x) - p.y; }
+
+    void add(const IntPoint& p) {
+        if (p.x < minX.x) minX = p;
+        if (p.x > maxX.x) maxX = p;
+        if (p.y < minY.y) minY = p;
+        if (p.y > maxY.y) maxY = p;
+        if (sum(p) < sum(minSum)) minSum = p;
+        if (sum(p) > sum(maxSum)) maxSum = p;
+        if (diff(p) < diff(minDiff)) minDiff = p;
+        if (diff(p) > diff(maxDiff)) maxDiff = p;
+    }
+
+    void add(const Extremes& other) {
+        for (const IntPoint& p : { other.minX, other.minSum, other.minY, other.maxDiff, other.maxX, other.maxSum, other.maxY, other.minDiff })
+            add(p);
+    }
+
+    // Counter-clockwise (y-up) octagon through the extremes, repeated corners removed.
+    Path octagon() const {
+        Path ring;
+        for (const IntPoint& p : { minX, minSum, minY, maxDiff, maxX, maxSum, maxY, minDiff }) {
+            if (ring.empty() || ring.back().x != p.x || ring.back().y != p.y)
+                ring.push_back(p);
+        }
+        while (ring.size() > 1 && ring.back().x == ring.front().x && ring.back().y == ring.front().y)
+            ring.pop_back();
+        return ring;
+    }
+};
+
+// Discards points that are certainly inside a convex counter-clockwise ring.
+// Edge tests run in double precision against a per-edge rounding bound; points
+// too close to call are kept, which is always safe for the hull that follows.
+class InteriorFilter {
+public:
+    InteriorFilter(const Path& ring, const Extremes& extremes) {
+        // Degenerate rings (collinear corners) contain nothing, so every point is kept
+        if (ring.size() < 3 || signedArea2(ring) == 0)
+            return;
+        double spanX = static_cast<double>(extremes.maxX.x) - extremes.minX.x;
+        double spanY = static_cast<double>(extremes.maxY.y) - extremes.minY.y;
+        for (std::size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+            Edge e;
+            e.px = ring[j].x;
+            e.py = ring[j].y;
+            e.dx = static_cast<double>(ring[i].x) - ring[j].x;
+            e.dy = static_cast<double>(ring[i].y) - ring[j].y;
+            e.bound = 8.0 * 1.1102230246251565e-16 * (std::abs(e.dx) * spanY + std::abs(e.dy) * spanX);
+            edges.push_back(e);
+        }
+    }
+
+    bool inside(const IntPoint& p) const {
+        if (edges.empty())
+            return false;
+        for (const Edge& e : edges) {
+            if (e.dx * (p.y - e.py) - e.dy * (p.x - e.px) <= e.bound)
+                return false;
+        }
+        return true;
+    }
+
+private:
+    struct Edge {
+        double px, py, dx, dy, bound;
+    };
+    std::vector<Edge> edges;
+};
+
+// Runs fn(worker, begin, end) over contiguous chunks of [0, count), one per
+// worker, on the shared scheduler.
+template <typename Fn>
+void forEachChunk(std::size_t count, std::size_t workers, Fn fn) {
+    std::size_t chunk = (count + workers - 1) / workers;
+    TaskScheduler::shared().parallelFor(workers, 1, [&](std::size_t first, std::size_t last) {
+        for (std::size_t w = first; w < last; ++w)
+            fn(w, std::min(count, w * chunk), std::min(count, (w + 1) * chunk));
+    }, TaskPriority::Normal);
+}
+
+void appendVertices(const Shape& shape, double circleTolerance, std::vector<IntPoint>& vertices) {
+    if (auto p = dynamic_cast<const Point*>(&shape)) {
+        vertices.push_back(IntPoint{ p->x, p->y });
+    }
+    else if (auto l = dynamic_cast<const Line*>(&shape)) {
+        vertices.push_back(IntPoint{ l->start.x, l->start.y });
+        vertices.push_back(IntPoint{ l->end.x, l->end.y });
+    }
+    else if (auto pl = dynamic_cast<const Polyline*>(&shape)) {
+        for (std::size_t i = 0; i < pl->count; ++i)
+            vertices.push_back(IntPoint{ pl->pool->xs[pl->offset + i], pl->pool->ys[pl->offset + i] });
+    }
+    else if (auto a = dynamic_cast<const ShapeArray*>(&shape)) {
+        // The item's vertices at the few instances that span the array's hull
+        std::vector<IntPoint> item;
+        appendVertices(*a->item, circleTolerance, item);
+        for (const Point& o : a->hullOffsets()) {
+            for (const IntPoint& v : item)
+                vertices.push_back(IntPoint{ v.x + o.x, v.y + o.y });
+        }
+    }
+    else if (auto r = dynamic_cast<const BlockReference*>(&shape)) {
+        std::vector<IntPoint> block;
+        for (const auto& part : r->block->shapes)
+            appendVertices(*part, circleTolerance / r->scale(), block);
+        const Affine2D& m = r->placement;
+        for (const IntPoint& v : block) {
+            vertices.push_back(IntPoint{ clampToInt(m.a * v.x + m.b * v.y + m.tx), clampToInt(m.c * v.x + m.d * v.y + m.ty) });
+        }
+    }
+    else {
+        Path path = shapeToPath(shape, circleTolerance);
+        vertices.insert(vertices.end(), path.begin(), path.end());
+    }
+}
+
+}
+
+Path convexHull(const std::vector<IntPoint>& points, unsigned threads) {
+    if (points.empty())
+        return Path();
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t workers = std::min<std::size_t>(threads, std::max<std::size_t>(1, points.size() / kMinPointsPerThread));
+
+    // Pass 1: extreme points per chunk, reduced into the global octagon
+    std::vector<Extremes> extremes(workers, Extremes(points[0]));
+    forEachChunk(points.size(), workers, [&](std::size_t w, std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i)
+            extremes[w].add(points[i]);
+    });
+    for (std::size_t w = 1; w < workers; ++w)
+        extremes[0].add(extremes[w]);
+    const Path octagon = extremes[0].octagon();
+    const InteriorFilter filter(octagon, extremes[0]);
+
+    // Pass 2: hull of the survivors in each chunk. For spread-out input the
+    // octagon discards almost everything, leaving very little to sort.
+    std::vector<Path> chunkHulls(workers);
+    forEachChunk(points.size(), workers, [&](std::size_t w, std::size_t begin, std::size_t end) {
+        std::vector<IntPoint> survivors;
+        for (std::size_t i = begin; i < end; ++i) {
+            if (!filter.inside(points[i]))
+                survivors.push_back(points[i]);
+        }
+        chunkHulls[w] = monotoneChain(survivors);
+    });
+
+    // Merge: the hull of the chunk hulls
+    std::vector<IntPoint> merged(octagon.begin(), octagon.end());
+    for (const auto& h : chunkHulls)
+        merged.insert(merged.end(), h.begin(), h.end());
+    return monotoneChain(merged);
+}
+
+std::vector<IntPoint> shapeVertices(const std::vector<std::shared_ptr<Shape>>& shapes,
+    const std::vector<std::size_t>& selection, double circleTolerance) {
+    std::vector<IntPoint> vertices;
+    auto add = [&](const Shape& shape) { appendVertices(shape, circleTolerance, vertices); };
+    if (selection.empty()) {
+        for (const auto& shape : shapes)
+            add(*shape);
+    }
+    else {
+        for (std::size_t index : selection)
+            add(*shapes[index]);
+    }
+    return vertices;
+}
+
+double OrientedRect::area() const {
+    return width * height;
+}
+
+OrientedRect minAreaRect(const Path& hull) {
+    OrientedRect best = {};
+    std::size_t n = hull.size();
+    if (n == 0)
+        return best;
+    for (auto& corner : best.corners) {
+        corner[0] = hull[0].x;
+        corner[1] = hull[0].y;
+    }
+    if (n == 1)
+        return best;
+
+    auto at = [&](std::size_t i) { return hull[i % n]; };
+    auto dot = [](const IntPoint& p, double ux, double uy) { return p.x * ux + p.y * uy; };
+    double bestArea = HUGE_VAL;
+    // Calipers as running (unwrapped) indices: furthest along the edge, furthest
+    // from it and furthest back along it. Each only ever moves forward.
+    std::size_t right = 1, far = 1, left = 1;
+    for (std::size_t i = 0; i < n; ++i) {
+        IntPoint a = hull[i], b = at(i + 1);
+        double ex = static_cast<double>(b.x) - a.x, ey = static_cast<double>(b.y) - a.y;
+        double length = std::sqrt(ex * ex + ey * ey);
+        double ux = ex / length, uy = ey / length;
+        double nx = -uy, ny = ux; // inward normal of a counter-clockwise ring
+
+        right = std::max(right, i + 1);
+        while (right < i + n && dot(at(right + 1), ux, uy) > dot(at(right), ux, uy))
+            ++right;
+        far = std::max(far, right);
+        while (far < i + n && dot(at(far + 1), nx, ny) > dot(at(far), nx, ny))
+            ++far;
+        left = std::max(left, far);
+        while (left < i + n && dot(at(left + 1), ux, uy) < dot(at(left), ux, uy))
+            ++left;
+
+        double base = dot(a, ux, uy), baseN = dot(a, nx, ny);
+        double minU = dot(at(left), ux, uy) - base, maxU = dot(at(right), ux, uy) - base;
+        double height = dot(at(far), nx, ny) - baseN;
+        double area = (maxU - minU) * height;
+        if (area < bestArea) {
+            bestArea = area;
+            const double s[4] = { minU, maxU, maxU, minU }, t[4] = { 0.0, 0.0, height, height };
+            for (int k = 0; k < 4; ++k) {
+                best.corners[k][0] = a.x + s[k] * ux + t[k] * nx;
+                best.corners[k][1] = a.y + s[k] * uy + t[k] * ny;
+            }
+            best.width = maxU - minU;
+            best.height = height;
+            best.angleDegrees = std::atan2(uy, ux) * 180.0 / 3.14159265358979323846;
+        }
+    }
+    return best;
+}
+
+HullDiameter hullDiameter(const Path& hull) {
+    HullDiameter best = {};
+    std::size_t n = hull.size();
+    if (n == 0)
+        return best;
+    best.a = best.b = hull[0];
+    auto distanceSq = [](const IntPoint& p, const IntPoint& q) {
+        double dx = static_cast<double>(p.x) - q.x, dy = static_cast<double>(p.y) - q.y;
+        return dx * dx + dy * dy;
+    };
+    auto consider = [&](const IntPoint& p, const IntPoint& q) {
+        double d = distanceSq(p, q);
+        if (d > best.length) {
+            best.length = d;
+            best.a = p;
+            best.b = q;
+        }
+    };
+    if (n <= 3) {
+        for (std::size_t i = 0; i < n; ++i)
+            for (std::size_t j = i + 1; j < n; ++j)
+                consider(hull[i], hull[j]);
+    }
+    else {
+        // Antipodal pairs: for each edge, advance the vertex furthest from it
+        auto area2 = [](const IntPoint& a, const IntPoint& b, const IntPoint& c) {
+            return (static_cast<double>(b.x) - a.x) * (static_cast<double>(c.y) - a.y) -
+                (static_cast<double>(b.y) - a.y) * (static_cast<double>(c.x) - a.x);
+        };
+        std::size_t j = 1;
+        for (std::size_t i = 0; i < n; ++i) {
+            const IntPoint& a = hull[i];
+            const IntPoint& b = hull[(i + 1) % n];
+            while (area2(a, b, hull[(j + 1) % n]) > area2(a, b, hull[j % n]))
+                ++j;
+            consider(a, hull[j % n]);
+            consider(b, hull[j % n]);
+        }
+    }
+    best.length = std::sqrt(best.length);
+    return best;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "PolygonBoolean.h"
+#include "Shape.h"
+
+// Convex hull of a point set, counter-clockwise (positive signedArea2) without
+// collinear vertices. Points are split into one chunk per worker (`threads`,
+// 0 = hardware concurrency); each chunk drops points strictly inside the
+// octagon spanned by the global extreme points, runs a monotone chain on the
+// rest, and the chunk hulls are merged with one more monotone chain.
+// Degenerate input yields fewer than three vertices (a segment or a point).
+Path convexHull(const std::vector<IntPoint>& points, unsigned threads = 0);
+
+// Every vertex that shapes' outlines pass through: points, line ends, rectangle
+// corners, polyline vertices and circles tessellated within `circleTolerance`;
+// for an array, those of the instances on its hull; for a block reference,
+// those of the block's shapes, placed.
+// `selection` indexes into shapes; an empty selection means all shapes.
+std::vector<IntPoint> shapeVertices(const std::vector<std::shared_ptr<Shape>>& shapes,
+    const std::vector<std::size_t>& selection, double circleTolerance = 0.5);
+
+// Smallest-area rectangle enclosing a convex hull, found with rotating calipers.
+// One side is always parallel to a hull edge.
+struct OrientedRect {
+    double corners[4][2]; // counter-clockwise, starting on the hull edge it rests on
+    double width;         // along the hull edge
+    double height;
+    double angleDegrees;  // direction of the width side
+    double area() const;
+};
+
+OrientedRect minAreaRect(const Path& hull);
+
+// Farthest pair of hull vertices (the diameter of the point set).
+struct HullDiameter {
+    IntPoint a, b;
+    double length;
+};
+
+HullDiameter hullDiameter(const Path& hull);
@@ -0,0 +1,253 @@
+#include "EditHistory.h"
+#include <algorithm>
+#include <utility>
+
+EditHistory::EditHistory(std::size_t budgetBytes) : budgetBytes(budgetBytes) {
+}
+
+void EditHistory::beginGroup() {
+    if (groupDepth++ == 0) {
+        groupStarted = false;
+        openRecords = 0;
+    }
+}
+
+void EditHistory::endGroup() {
+    if (--groupDepth == 0) {
+        // The group may have gone over the budget while trim() had to keep it
+        openRecords = 0;
+        trim();
+    }
+}
+
+void EditHistory::recordAdd() {
+    Record record;
+    record.kind = EditKind::Add;
+    push(std::move(record));
+}
+
+void EditHistory::recordTransform(TransformCommand command) {
+    Record record;
+    record.kind = EditKind::Transform;
+    record.transform.reset(new TransformCommand(std::move(command)));
+    push(std::move(record));
+}
+
+void EditHistory::recordReplace(std::vector<std::shared_ptr<Shape>> previous) {
+    Record record;
+    record.kind = EditKind::Replace;
+    record.shapes = std::move(previous);
+    push(std::move(record));
+}
+
+void EditHistory::recordSwap(std::vector<std::size_t> indices, std::vector<std::shared_ptr<Shape>> previous) {
+    Record record;
+    record.kind = EditKind::Swap;
+    record.indices = std::move(indices);
+    record.shapes = std::move(previous);
+    push(std::move(record));
+}
+
+void EditHistory::push(Record record) {
+    stepOpen = false;
+    for (const Record& dropped : future)
+        totalBytes -= dropped.bytes;
+    future.clear();
+    record.continues = groupDepth > 0 && groupStarted;
+    groupStarted = groupDepth > 0;
+    if (record.kind == EditKind::Add && extendAdds(record.continues))
+        return;
+    if (groupDepth > 0)
+        ++openRecords;
+    record.bytes = measure(record);
+    totalBytes += record.bytes;
+    past.push_back(std::move(record));
+    trim();
+}
+
+bool EditHistory::extendAdds(bool continues) {
+    // An add that starts a step inside a group gets its own record, so that the
+    // open group never shares one with the steps before it
+    if (past.empty() || past.back().kind != EditKind::Add || (!continues && groupDepth > 0))
+        return false;
+    Record& last = past.back();
+    if ((last.adds > 1 && last.chained != continues) || last.adds == UINT32_MAX)
+        return false;
+    last.chained = continues;
+    ++last.adds;
+    ++mergedAdds;
+    return true;
+}
+
+EditStep EditHistory::undo(std::vector<std::shared_ptr<Shape>>& shapes) {
+    // Redone transforms may have grown since the last trim; steps half replayed stay whole
+    if (!stepOpen)
+        trim();
+    EditStep step;
+    if (past.empty())
+        return step;
+    Record record;
+    if (past.back().kind == EditKind::Add && past.back().adds > 1) {
+        // The newest add of a run comes off on its own
+        record.kind = EditKind::Add;
+        record.continues = past.back().chained;
+        --past.back().adds;
+        --mergedAdds;
+    }
+    else {
+        record = std::move(past.back());
+        past.pop_back();
+        totalBytes -= record.bytes;
+        openRecords = std::min(openRecords, past.size());
+    }
+    step.kind = record.kind;
+    step.grouped = record.continues && !past.empty();
+    stepOpen = step.grouped;
+    switch (record.kind) {
+    case EditKind::Add:
+        record.shapes.push_back(std::move(shapes.back()));
+        shapes.pop_back();
+        step.shapes = 1;
+        break;
+    case EditKind::Transform:
+        record.transform->undo(shapes);
+        break;
+    case EditKind::Replace:
+        // The list in the record becomes the live one and the live one becomes the redo state
+        shapes.swap(record.shapes);
+        step.shapes = shapes.size();
+        break;
+    case EditKind::Swap:
+        swapShapes(shapes, record);
+        break;
+    case EditKind::None:
+        break;
+    }
+    record.bytes = measure(record);
+    totalBytes += record.bytes;
+    future.push_back(std::move(record));
+    if (step.kind == EditKind::Transform)
+        step.touched = &future.back().transform->selection;
+    else if (step.kind == EditKind::Swap)
+        step.touched = &future.back().indices;
+    if (step.touched)
+        step.shapes = step.touched->size();
+    return step;
+}
+
+EditStep EditHistory::redo(std::vector<std::shared_ptr<Shape>>& shapes, const std::shared_ptr<VertexPool>& pool) {
+    if (!stepOpen)
+        trim();
+    EditStep step;
+    if (future.empty())
+        return step;
+    Record record = std::move(future.back());
+    future.pop_back();
+    totalBytes -= record.bytes;
+    step.kind = record.kind;
+    step.grouped = !future.empty() && future.back().continues;
+    stepOpen = step.grouped;
+    switch (record.kind) {
+    case EditKind::Add:
+        shapes.push_back(std::move(record.shapes.back()));
+        record.shapes.clear();
+        step.shapes = 1;
+        if (extendAdds(record.continues))
+            return step;
+        break;
+    case EditKind::Transform: {
+        // Transforms are deterministic, so applying the same matrix again reproduces the edit.
+        // Shapes turned into polygons get new vertices each time, which the pool keeps
+        std::size_t poolBefore = pool->size();
+        *record.transform = transformShapes(shapes, pool, record.transform->selection, record.transform->matrix);
+        record.poolBytes += (pool->size() - poolBefore) * 2 * sizeof(int);
+        break;
+    }
+    case EditKind::Replace:
+        shapes.swap(record.shapes);
+        step.shapes = shapes.size();
+        break;
+    case EditKind::Swap:
+        swapShapes(shapes, record);
+        break;
+    case EditKind::None:
+        break;
+    }
+    record.bytes = measure(record);
+    totalBytes += record.bytes;
+    past.push_back(std::move(record));
+    if (step.kind == EditKind::Transform)
+        step.touched = &past.back().transform->selection;
+    else if (step.kind == EditKind::Swap)
+        step.touched = &past.back().indices;
+    if (step.touched)
+        step.shapes = step.touched->size();
+    return step;
+}
+
+std::size_t EditHistory::undoCount() const {
+    return past.size() + mergedAdds;
+}
+
+std::size_t EditHistory::redoCount() const {
+    return future.size();
+}
+
+std::size_t EditHistory::memoryBytes() const {
+    return totalBytes;
+}
+
+std::size_t EditHistory::budget() const {
+    return budgetBytes;
+}
+
+void EditHistory::setBudget(std::size_t bytes) {
+    budgetBytes = bytes;
+    trim();
+}
+
+void EditHistory::clear() {
+    past.clear();
+    future.clear();
+    totalBytes = 0;
+    groupStarted = false;
+    openRecords = 0;
+    mergedAdds = 0;
+    stepOpen = false;
+}
+
+std::size_t EditHistory::measure(const Record& record) {
+    // Shapes are shared with the live list or other steps, so only the pointers count
+    std::size_t bytes = sizeof(Record) + record.shapes.capacity() * sizeof(std::shared_ptr<Shape>) +
+        record.indices.capacity() * sizeof(std::size_t) + record.poolBytes;
+    if (record.transform)
+        bytes += record.transform->memoryBytes();
+    return bytes;
+}
+
+void EditHistory::swapShapes(std::vector<std::shared_ptr<Shape>>& shapes, Record& record) {
+    for (std::size_t i = 0; i < record.indices.size(); ++i)
+        shapes[record.indices[i]].swap(record.shapes[i]);
+}
+
+void EditHistory::trim() {
+    // The steps furthest from the present go first, each with all its records:
+    // the oldest undo steps, then the redo steps furthest ahead. The group being
+    // recorded stays whole, or undo would replay part of it
+    std::size_t open = groupDepth > 0 ? openRecords : 0;
+    while (totalBytes > budgetBytes && past.size() > open) {
+        do {
+            mergedAdds -= past.front().adds - 1;
+            totalBytes -= past.front().bytes;
+            past.pop_front();
+        } while (past.size() > open && past.front().continues);
+    }
+    while (totalBytes > budgetBytes && !future.empty()) {
+        bool continues;
+        do {
+            continues = future.front().continues;
+            totalBytes -= future.front().bytes;
+            future.pop_front();
+        } while (continues && !future.empty());
+    }
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+#include "Shape.h"
+#include "Transform.h"
+
+enum class EditKind : std::uint8_t {
+    None,
+    Add,       // one shape appended
+    Transform, // a bulk transform of a selection
+    Replace,   // the whole shape list swapped for another (booleans)
+    Swap,      // some shapes replaced at their indices (arrays losing materialized instances)
+};
+
+// What an undo or redo changed, for the caller's bookkeeping.
+struct EditStep {
+    EditKind kind = EditKind::None;
+    bool grouped = false; // more edits of the same step follow, to undo or redo in the same way
+    std::size_t shapes = 0;                            // Transform, Swap: shapes touched; Replace: shapes in the list put back
+    const std::vector<std::size_t>* touched = nullptr; // Transform, Swap: their indices, valid until the next edit
+};
+
+// Undo and redo for every edit that changes shapes. Each step keeps only its
+// inverse: an added shape costs nothing until it is undone (a run of adds
+// shares one record), a transform keeps the coordinates it overwrote (nothing
+// for integer moves), and a boolean keeps the list it replaced. Shapes are
+// shared by pointer between the live list and the history, never copied, so
+// undoing a bulk edit costs the shapes it changed rather than the size of the
+// drawing. The oldest steps are forgotten once the history outgrows its memory
+// budget, whole steps at a time and never the group still being recorded.
+class EditHistory {
+public:
+    static const std::size_t kDefaultBudget = 256u << 20;
+
+    explicit EditHistory(std::size_t budgetBytes = kDefaultBudget);
+
+    // Edits recorded between these form one step, undone and redone together.
+    void beginGroup();
+    void endGroup();
+    // Record an edit that has just been applied. Recording drops the redo steps.
+    void recordAdd();
+    void recordTransform(TransformCommand command);
+    void recordReplace(std::vector<std::shared_ptr<Shape>> previous);
+    // `previous[i]` is the shape that was at `indices[i]`.
+    void recordSwap(std::vector<std::size_t> indices, std::vector<std::shared_ptr<Shape>> previous);
+
+    // Undoes or redoes one edit; while the result is `grouped`, call again to
+    // finish the step.
+    EditStep undo(std::vector<std::shared_ptr<Shape>>& shapes);
+    // Transforms are applied again, so redo needs the pool their paths live in.
+    EditStep redo(std::vector<std::shared_ptr<Shape>>& shapes, const std::shared_ptr<VertexPool>& pool);
+
+    std::size_t undoCount() const;
+    std::size_t redoCount() const;
+    std::size_t memoryBytes() const;
+    std::size_t budget() const;
+    // Forgets the oldest steps until the history fits.
+    void setBudget(std::size_t bytes);
+    void clear();
+
+private:
+    struct Record {
+        EditKind kind = EditKind::None;
+        bool continues = false; // part of the same step as the record before it
+        bool chained = false;   // Add: the adds after the first one continue it too
+        std::uint32_t adds = 1; // Add: how many consecutive adds the record stands for
+        std::size_t bytes = 0;
+        std::size_t poolBytes = 0; // Transform: vertices its redos appended to the pool
+        // Add: the shape while it is undone; Replace: the other version of the list;
+        // Swap: the other version of the shapes at `indices`
+        std::vector<std::shared_ptr<Shape>> shapes;
+        std::vector<std::size_t> indices;
+        std::unique_ptr<TransformCommand> transform;
+    };
+
+    std::deque<Record> past, future; // the back of each is the next step to undo or redo
+    std::size_t totalBytes = 0;
+    std::size_t budgetBytes;
+    int groupDepth = 0;
+    bool groupStarted = false;   // the open group has its first record
+    std::size_t openRecords = 0; // records of the open group, which trim() keeps
+    std::size_t mergedAdds = 0;  // adds folded into the Add record before them
+    bool stepOpen = false;       // the last undo or redo stopped inside a grouped step
+
+    void push(Record record);
+    // Folds an add into the Add record at the back of `past` when they fit in
+    // one record; false when the add needs a record of its own.
+    bool extendAdds(bool continues);
+    static std::size_t measure(const Record& record);
+    // Swap records hold the other version of their shapes: trading them undoes or redoes the edit.
+    static void swapShapes(std::vector<std::shared_ptr<Shape>>& shapes, Record& record);
+    void trim();
+};
@@ -0,0 +1,194 @@
+#include "Intersection.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <vector>
+#include "Block.h"
+#include "PolygonBoolean.h"
+#include "Predicates.h"
+#include "ShapeArray.h"
+
+namespace {
+
+// One connected piece of a shape: the rings of a closed shape, filled by the
+// even-odd rule, or the one path of an open shape (a single vertex for a point).
+struct Region {
+    Paths rings;
+    bool closed = false;
+    Bounds box;
+};
+
+bool overlaps(const Bounds& a, const Bounds& b) {
+    return a.minX <= b.maxX && b.minX <= a.maxX && a.minY <= b.maxY && b.minY <= a.maxY;
+}
+
+int clampToInt(double v) {
+    return static_cast<int>(std::lround(std::max<double>(INT_MIN, std::min<double>(INT_MAX, v))));
+}
+
+void addRegion(Paths rings, bool closed, std::vector<Region>& regions) {
+    Region region;
+    region.rings = std::move(rings);
+    region.closed = closed;
+    for (const Path& ring : region.rings) {
+        for (const IntPoint& p : ring)
+            region.box.expand(p.x, p.y);
+    }
+    regions.push_back(std::move(region));
+}
+
+// Regions of a shape that is neither an array nor a reference.
+void plainRegions(const Shape& shape, double circleTolerance, std::vector<Region>& regions) {
+    Paths rings;
+    bool closed = true;
+    switch (shape.type()) {
+    case ShapeType::Point: {
+        const Point& p = static_cast<const Point&>(shape);
+        rings.push_back(Path{ { p.x, p.y } });
+        closed = false;
+        break;
+    }
+    case ShapeType::Line: {
+        const Line& l = static_cast<const Line&>(shape);
+        rings.push_back(Path{ { l.start.x, l.start.y }, { l.end.x, l.end.y } });
+        closed = false;
+        break;
+    }
+    case ShapeType::Polyline: {
+        const Polyline& pl = static_cast<const Polyline&>(shape);
+        Path path;
+        path.reserve(pl.count);
+        for (std::size_t i = 0; i < pl.count; ++i)
+            path.push_back(IntPoint{ pl.pool->xs[pl.offset + i], pl.pool->ys[pl.offset + i] });
+        rings.push_back(std::move(path));
+        closed = false;
+        break;
+    }
+    default:
+        rings = shapeToPaths(shape, circleTolerance);
+        break;
+    }
+    addRegion(std::move(rings), closed, regions);
+}
+
+// Regions of `shape` near `near`; false when an array has too many instances there to test.
+bool shapeRegions(const Shape& shape, const Bounds& near, double circleTolerance, std::vector<Region>& regions) {
+    if (shape.type() == ShapeType::Array) {
+        const ShapeArray& array = static_cast<const ShapeArray&>(shape);
+        // Instances wholly inside `near` are a cheap lower bound on those meeting it
+        if (array.countInside(near) > kMaxTestedInstances)
+            return false;
+        std::vector<std::size_t> instances;
+        array.instancesIn(near, instances);
+        if (instances.size() > kMaxTestedInstances)
+            return false;
+        std::vector<Region> item;
+        shapeRegions(*array.item, array.item->bounds(), circleTolerance, item);
+        for (std::size_t k : instances) {
+            Point o = array.offset(k);
+            for (const Region& region : item) {
+                Paths rings = region.rings;
+                for (Path& ring : rings) {
+                    for (IntPoint& p : ring) {
+                        p.x += o.x;
+                        p.y += o.y;
+                    }
+                }
+                addRegion(std::move(rings), region.closed, regions);
+            }
+        }
+        return true;
+    }
+    if (shape.type() == ShapeType::Reference) {
+        const BlockReference& reference = static_cast<const BlockReference&>(shape);
+        const Affine2D& m = reference.placement;
+        std::vector<Region> block;
+        for (const auto& part : reference.block->shapes)
+            plainRegions(*part, circleTolerance / reference.scale(), block);
+        for (Region& region : block) {
+            for (Path& ring : region.rings) {
+                for (IntPoint& p : ring) {
+                    double x = p.x, y = p.y;
+                    p = IntPoint{ clampToInt(m.a * x + m.b * y + m.tx), clampToInt(m.c * x + m.d * y + m.ty) };
+                }
+            }
+            addRegion(std::move(region.rings), region.closed, regions);
+        }
+        return true;
+    }
+    plainRegions(shape, circleTolerance, regions);
+    return true;
+}
+
+// Calls `edge(a, b)` for each edge of `region` until it returns true; a lone
+// vertex is an edge of length zero.
+template <class Edge>
+bool anyEdge(const Region& region, Edge edge) {
+    for (const Path& ring : region.rings) {
+        std::size_t n = ring.size();
+        if (n == 1 && edge(ring[0], ring[0]))
+            return true;
+        std::size_t edges = region.closed ? n : n - 1;
+        for (std::size_t i = 0; n > 1 && i < edges; ++i) {
+            if (edge(ring[i], ring[(i + 1) % n]))
+                return true;
+        }
+    }
+    return false;
+}
+
+// True when `p` is inside the rings of a closed region (even-odd); points on
+// an edge are found by the edge tests instead.
+bool inside(const Region& region, const IntPoint& p) {
+    if (!region.box.contains(p.x, p.y))
+        return false;
+    bool in = false;
+    for (const Path& ring : region.rings) {
+        for (std::size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+            const IntPoint& a = ring[j];
+            const IntPoint& b = ring[i];
+            if ((b.y > p.y) != (a.y > p.y)) {
+                int side = orient2d(a.x, a.y, b.x, b.y, p.x, p.y);
+                if (b.y > a.y ? side > 0 : side < 0)
+                    in = !in;
+            }
+        }
+    }
+    return in;
+}
+
+bool regionsMeet(const Region& a, const Region& b) {
+    if (!overlaps(a.box, b.box))
+        return false;
+    // Edges of `a` near `b` against every edge of `b`
+    bool crossing = anyEdge(a, [&](const IntPoint& p, const IntPoint& q) {
+        Bounds edge(std::min(p.x, q.x), std::min(p.y, q.y), std::max(p.x, q.x), std::max(p.y, q.y));
+        if (!overlaps(edge, b.box))
+            return false;
+        return anyEdge(b, [&](const IntPoint& r, const IntPoint& s) {
+            return segmentIntersection(p.x, p.y, q.x, q.y, r.x, r.y, s.x, s.y) != SegmentIntersection::None;
+        });
+    });
+    if (crossing)
+        return true;
+    // No outline crosses the other, so each region lies wholly inside or outside the other
+    return (b.closed && inside(b, a.rings.front().front())) || (a.closed && inside(a, b.rings.front().front()));
+}
+
+}
+
+bool shapesIntersect(const Shape& a, const Shape& b, double circleTolerance) {
+    Bounds boxA = a.bounds(), boxB = b.bounds();
+    if (!overlaps(boxA, boxB))
+        return false;
+    std::vector<Region> regionsA, regionsB;
+    if (!shapeRegions(a, boxB, circleTolerance, regionsA) || !shapeRegions(b, boxA, circleTolerance, regionsB))
+        return true;
+    for (const Region& ra : regionsA) {
+        for (const Region& rb : regionsB) {
+            if (!ra.rings.empty() && !rb.rings.empty() && regionsMeet(ra, rb))
+                return true;
+        }
+    }
+    return false;
+}
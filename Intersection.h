@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include "Shape.h"
+
+// Exact contact test between two shapes as drawn: true when their outlines
+// cross or touch, or when one lies inside the area of a closed shape
+// (rectangle, circle, polygon; the holes of a polygon are outside it). Lines
+// and polylines have no area. Decided with the exact orientation predicates on
+// integer coordinates; circles are tessellated within `circleTolerance` and the
+// shapes of a placed block rounded to integer coordinates first.
+//
+// Arrays are tested instance by instance, but only the instances whose bounds
+// meet the other shape. Past kMaxTestedInstances of them the array counts as
+// touching the other shape, as a bounding-box test would have it.
+const std::size_t kMaxTestedInstances = 1 << 16;
+
+bool shapesIntersect(const Shape& a, const Shape& b, double circleTolerance = 0.5);
@@ -0,0 +1,228 @@
+#include "LockStats.h"
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "Profiler.h"
+
+namespace {
+
+// Sites live until exit, so the mutexes and threads can keep plain pointers
+class SiteRegistry {
+public:
+    LockSite& find(const std::string& label) {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::unique_ptr<LockSite>& site = byLabel[label];
+        if (!site) {
+            site.reset(new LockSite());
+            site->label = label;
+        }
+        return *site;
+    }
+
+    std::vector<LockSite*> all() {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<LockSite*> sites;
+        for (auto& entry : byLabel)
+            sites.push_back(entry.second.get());
+        return sites;
+    }
+
+private:
+    std::mutex mutex;
+    std::map<std::string, std::unique_ptr<LockSite>> byLabel;
+};
+
+SiteRegistry& registry() {
+    static SiteRegistry sites;
+    return sites;
+}
+
+// file_name() points at a string literal per translation unit, so a thread
+// can find the site again from the pointer and line without the registry lock
+LockSite& siteAt(const char* mutexName, const std::source_location& where) {
+    thread_local std::map<std::pair<const char*, std::uint_least32_t>, LockSite*> cache;
+    LockSite*& site = cache[std::make_pair(where.file_name(), where.line())];
+    if (!site) {
+        const char* file = where.file_name();
+        for (const char* p = file; *p; ++p) {
+            if (*p == '/' || *p == '\\')
+                file = p + 1;
+        }
+        site = &registry().find(std::string(mutexName) + " " + file + ":" + std::to_string(where.line()));
+    }
+    return *site;
+}
+
+int bucketOf(std::uint64_t ns) {
+    return std::min(LockSite::kBuckets - 1, std::max(0, static_cast<int>(std::bit_width(ns)) - 1));
+}
+
+void raiseMax(std::atomic<std::uint64_t>& max, std::uint64_t value) {
+    std::uint64_t seen = max.load(std::memory_order_relaxed);
+    while (value > seen && !max.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+    }
+}
+
+void recordWait(LockSite& site, bool contended, std::uint64_t ns) {
+    site.acquisitions.fetch_add(1, std::memory_order_relaxed);
+    if (contended)
+        site.contended.fetch_add(1, std::memory_order_relaxed);
+    site.waitNs.fetch_add(ns, std::memory_order_relaxed);
+    site.waitHistogram[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    raiseMax(site.maxWaitNs, ns);
+}
+
+void recordHold(LockSite& site, std::uint64_t ns) {
+    site.holdNs.fetch_add(ns, std::memory_order_relaxed);
+    site.holdHistogram[bucketOf(ns)].fetch_add(1, std::memory_order_relaxed);
+    raiseMax(site.maxHoldNs, ns);
+}
+
+// Upper edge of the bucket holding the p-th quantile, in microseconds.
+double percentileUs(const std::atomic<std::uint64_t> (&histogram)[LockSite::kBuckets], double p) {
+    std::uint64_t counts[LockSite::kBuckets], total = 0;
+    for (int b = 0; b < LockSite::kBuckets; ++b)
+        total += counts[b] = histogram[b].load(std::memory_order_relaxed);
+    if (total == 0)
+        return 0.0;
+    std::uint64_t rank = static_cast<std::uint64_t>(p * (total - 1)), seen = 0;
+    for (int b = 0; b < LockSite::kBuckets; ++b) {
+        seen += counts[b];
+        if (seen > rank)
+            return static_cast<double>(std::uint64_t(1) << (b + 1)) / 1000.0;
+    }
+    return 0.0;
+}
+
+void writeHistogram(std::ostream& out, const std::atomic<std::uint64_t> (&histogram)[LockSite::kBuckets]) {
+    out << "[";
+    for (int b = 0; b < LockSite::kBuckets; ++b)
+        out << (b ? "," : "") << histogram[b].load(std::memory_order_relaxed);
+    out << "]";
+}
+
+}
+
+InstrumentedMutex::InstrumentedMutex(const char* name)
+    : name(name), unattributed(&registry().find(std::string(name) + " unattributed")) {
+}
+
+void InstrumentedMutex::lock() {
+    lock(*unattributed);
+}
+
+void InstrumentedMutex::lock(LockSite& site) {
+    bool contended = !mutex.try_lock();
+    std::uint64_t start = contended ? profileNowNs() : 0;
+    if (contended)
+        mutex.lock();
+    std::uint64_t now = profileNowNs();
+    recordWait(site, contended, contended ? now - start : 0);
+    holder = &site;
+    acquiredAt = now;
+}
+
+bool InstrumentedMutex::try_lock() {
+    if (!mutex.try_lock())
+        return false;
+    acquiredAt = profileNowNs();
+    recordWait(*unattributed, false, 0);
+    holder = unattributed;
+    return true;
+}
+
+void InstrumentedMutex::unlock() {
+    LockSite* site = holder;
+    std::uint64_t held = profileNowNs() - acquiredAt;
+    mutex.unlock();
+    // Outside the lock, so the bookkeeping does not lengthen the hold
+    recordHold(*site, held);
+}
+
+InstrumentedLock::InstrumentedLock(InstrumentedMutex& mutex, std::source_location where)
+    : mutex(mutex), site(siteAt(mutex.name, where)) {
+    lock();
+}
+
+InstrumentedLock::InstrumentedLock(InstrumentedMutex& mutex, std::defer_lock_t, std::source_location where)
+    : mutex(mutex), site(siteAt(mutex.name, where)) {
+}
+
+InstrumentedLock::~InstrumentedLock() {
+    if (owns)
+        mutex.unlock();
+}
+
+void InstrumentedLock::lock() {
+    mutex.lock(site);
+    owns = true;
+}
+
+void InstrumentedLock::unlock() {
+    mutex.unlock();
+    owns = false;
+}
+
+void printLockStats(std::ostream& out) {
+    std::vector<LockSite*> sites = registry().all();
+    sites.erase(std::remove_if(sites.begin(), sites.end(), [](const LockSite* site) { return site->acquisitions == 0; }), sites.end());
+    if (sites.empty()) {
+        out << "No instrumented locks taken since the last reset.\n";
+        return;
+    }
+    std::sort(sites.begin(), sites.end(), [](const LockSite* a, const LockSite* b) { return a->waitNs > b->waitNs; });
+    char header[192];
+    std::snprintf(header, sizeof(header), "%-34s %8s %9s | %7s %7s %7s | %7s %7s %7s\n", "site (times in us)", "locks",
+        "contended", "wait50", "wait99", "waitmax", "hold50", "hold99", "holdmax");
+    out << header;
+    for (const LockSite* site : sites) {
+        std::uint64_t locks = site->acquisitions;
+        char line[192];
+        std::snprintf(line, sizeof(line), "%-34s %8llu %8.2f%% | %7.1f %7.1f %7.1f | %7.1f %7.1f %7.1f\n", site->label.c_str(),
+            static_cast<unsigned long long>(locks), 100.0 * site->contended / locks,
+            percentileUs(site->waitHistogram, 0.50), percentileUs(site->waitHistogram, 0.99), site->maxWaitNs / 1000.0,
+            percentileUs(site->holdHistogram, 0.50), percentileUs(site->holdHistogram, 0.99), site->maxHoldNs / 1000.0);
+        out << line;
+    }
+}
+
+void resetLockStats() {
+    // Locks in flight may land on either side of the reset
+    for (LockSite* site : registry().all()) {
+        site->acquisitions = 0;
+        site->contended = 0;
+        site->waitNs = 0;
+        site->holdNs = 0;
+        site->maxWaitNs = 0;
+        site->maxHoldNs = 0;
+        for (int b = 0; b < LockSite::kBuckets; ++b) {
+            site->waitHistogram[b] = 0;
+            site->holdHistogram[b] = 0;
+        }
+    }
+}
+
+bool exportLockStats(const std::string& path) {
+    std::ofstream out(path);
+    if (!out)
+        return false;
+    std::vector<LockSite*> sites = registry().all();
+    out << "{\"bucketNs\":\"bucket i counts durations from 2^i to 2^(i+1) ns\",\"sites\":[\n";
+    for (std::size_t i = 0; i < sites.size(); ++i) {
+        const LockSite& s = *sites[i];
+        out << "{\"site\":\"" << s.label << "\",\"acquisitions\":" << s.acquisitions << ",\"contended\":" << s.contended
+            << ",\"waitNs\":" << s.waitNs << ",\"holdNs\":" << s.holdNs << ",\"maxWaitNs\":" << s.maxWaitNs
+            << ",\"maxHoldNs\":" << s.maxHoldNs << ",\"waitHistogram\":";
+        writeHistogram(out, s.waitHistogram);
+        out << ",\"holdHistogram\":";
+        writeHistogram(out, s.holdHistogram);
+        out << "}" << (i + 1 < sites.size() ? ",\n" : "\n");
+    }
+    out << "]}\n";
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <source_location>
+#include <string>
+
+// Lock timings of one place in the code that takes an instrumented mutex.
+// Histogram bucket i counts durations of 2^i to 2^(i+1) nanoseconds (bucket 0
+// also holds zero, which is what an uncontended acquisition waits).
+struct LockSite {
+    static const int kBuckets = 40;
+
+    std::string label; // "scene Scene.cpp:194"
+    std::atomic<std::uint64_t> acquisitions{ 0 };
+    std::atomic<std::uint64_t> contended{ 0 }; // found the mutex already held
+    std::atomic<std::uint64_t> waitNs{ 0 }, holdNs{ 0 };
+    std::atomic<std::uint64_t> maxWaitNs{ 0 }, maxHoldNs{ 0 };
+    std::atomic<std::uint64_t> waitHistogram[kBuckets] = {};
+    std::atomic<std::uint64_t> holdHistogram[kBuckets] = {};
+};
+
+// A std::mutex that records how long each call site waited for it and held it.
+// Lock it through InstrumentedLock so the time is charged to the right site;
+// plain lock() (std::lock_guard and friends) is charged to "<name> unattributed".
+class InstrumentedMutex {
+public:
+    explicit InstrumentedMutex(const char* name);
+
+    void lock();
+    bool try_lock();
+    void unlock();
+    void lock(LockSite& site);
+
+private:
+    std::mutex mutex;
+    const char* name;
+    LockSite* unattributed;
+    LockSite* holder = nullptr; // written and read by the holding thread only
+    std::int64_t acquiredAt = 0;
+
+    friend class InstrumentedLock;
+};
+
+// std::unique_lock for an InstrumentedMutex, charging the time to the line
+// that constructs it.
+class InstrumentedLock {
+public:
+    explicit InstrumentedLock(InstrumentedMutex& mutex, std::source_location where = std::source_location::current());
+    InstrumentedLock(InstrumentedMutex& mutex, std::defer_lock_t, std::source_location where = std::source_location::current());
+    ~InstrumentedLock();
+    InstrumentedLock(const InstrumentedLock&) = delete;
+    InstrumentedLock& operator=(const InstrumentedLock&) = delete;
+
+    void lock();
+    void unlock();
+
+private:
+    InstrumentedMutex& mutex;
+    LockSite& site;
+    bool owns = false;
+};
+
+// One line per site, the longest total wait first.
+void printLockStats(std::ostream& out);
+void resetLockStats();
+// Writes every site with its full histograms as JSON.
+bool exportLockStats(const std::string& path);
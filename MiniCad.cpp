@@ -1,19 +1,97 @@
 #include <iostream>
 #include <vector>
 #include <memory>
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <string>
 #include <thread>
 #include <mutex>
 #include "Shape.h"
 #include "SFML/Graphics.hpp"
 #include "ShapeType.h"
+#include "PolygonBoolean.h"
+#include "Transform.h"
+#include "SpatialIndex.h"
+#include "SceneRenderer.h"
+#include "Profiler.h"
+#include "Scene.h"
+#include "CommandInterpreter.h"
+#include "SceneServer.h"
+#include "Session.h"
+#include "AsyncJob.h"
 
-int main() {
-    std::vector<std::shared_ptr<Shape>> shapes;
-    std::mutex shapeMutex;
+int main(int argc, char** argv) {
+    // Both input sources post edits to the scene owner instead of touching the scene
+    Scene scene;
+    SceneOwner sceneOwner(scene);
+    CommandInterpreter interpreter(scene, sceneOwner);
+
+    // --serve <socket>: headless, no window or render thread, just the command server.
+    // --host <port>: share the drawing, on loopback unless --bind names another
+    // interface; --join <address> <port>: edit a shared one.
+    std::string servePath, joinAddress;
+    sf::IpAddress bindAddress = sf::IpAddress::LocalHost;
+    unsigned short hostPort = 0, joinPort = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--serve" && i + 1 < argc)
+            servePath = argv[++i];
+        else if (arg == "--host" && i + 1 < argc)
+            hostPort = static_cast<unsigned short>(std::atoi(argv[++i]));
+        else if (arg == "--bind" && i + 1 < argc)
+            bindAddress = sf::IpAddress(argv[++i]);
+        else if (arg == "--join" && i + 2 < argc) {
+            joinAddress = argv[++i];
+            joinPort = static_cast<unsigned short>(std::atoi(argv[++i]));
+        }
+        else {
+            std::cerr << "Usage: MiniCad [--serve socket] [--host port [--bind address] | --join address port]\n";
+            return 1;
+        }
+    }
+    if (joinPort != 0 && (hostPort != 0 || !servePath.empty())) {
+        std::cerr << "A joining viewer can neither host nor serve\n";
+        return 1;
+    }
+
+    SessionHost sessionHost(scene, sceneOwner);
+    if (hostPort != 0) {
+        if (bindAddress == sf::IpAddress::None || !sessionHost.start(hostPort, bindAddress)) {
+            std::cerr << "Could not listen on " << bindAddress << ":" << hostPort << "\n";
+            return 1;
+        }
+        std::cout << "Hosting the drawing on " << bindAddress << ":" << hostPort << "\n";
+    }
+    SessionViewer sessionViewer(sceneOwner);
+    if (joinPort != 0) {
+        if (!sessionViewer.connect(joinAddress, joinPort)) {
+            std::cerr << "Could not join " << joinAddress << ":" << joinPort << "\n";
+            return 1;
+        }
+        std::cout << "Joined the drawing at " << joinAddress << ":" << joinPort << "\n";
+    }
+    // A viewer's edits and commands go to the host; its own scene only mirrors the host's
+    std::function<void(SceneCommand)> postEdit = [&](SceneCommand command) {
+        if (joinPort != 0)
+            sessionViewer.post(command);
+        else
+            sceneOwner.post(std::move(command));
+    };
+
+    if (!servePath.empty()) {
+        int status = runSceneServer(servePath, scene, sceneOwner);
+        JobList::shared().cancelAll();
+        return status;
+    }
 
     // State for live shape preview
     bool isDrawing = false;
     sf::Vector2f startPoint;
+    std::vector<Point> pathPoints; // vertices placed so far for polyline/polygon
     ShapeType selectedShapeType = ShapeType::None;
 
     std::thread renderThread([&]() {
@@ -31,12 +109,84 @@ int main() {
         hintText.setFillColor(sf::Color::Black);
         hintText.setPosition(10.f, 10.f);
 
+        // Profiler overlay (F3): rolling stage percentiles, refreshed twice a second
+        bool showProfile = false;
+        unsigned framesSinceProfileText = 0;
+        sf::Text profileText;
+        profileText.setFont(font);
+        profileText.setCharacterSize(13);
+        profileText.setFillColor(sf::Color(40, 40, 40));
+
+        // Camera: the wheel zooms about the cursor, middle drag pans, Home resets.
+        // `zoom` is the world size of one screen pixel.
+        sf::View camera = window.getDefaultView();
+        sf::View hudView = window.getDefaultView();
+        float zoom = 1.f;
+        bool isPanning = false;
+        sf::Vector2i panAnchor;
+
+        SpatialIndex sceneIndex;
+        PointCloud pointCloud;
+        SceneRenderer sceneRenderer;
+        // The committed scene is cached in a layer and only redrawn after edits or camera moves
+        SceneLayer sceneLayer;
+        unsigned long long layerVersion = 0;
+        std::size_t layerShapeCount = 0;
+
+        // Hover highlighting: nearest entity within a few pixels of the cursor
+        const double kHoverTolerance = 6.0;
+        std::size_t hovered = 0, hoverShapeCount = 0;
+        unsigned long long hoverVersion = 0;
+        sf::Vector2f hoverMouse(NAN, NAN);
+
         while (window.isOpen()) {
+            ProfileScope frameScope(ProfileStage::Frame);
+            std::uint64_t eventsStart = profileNowNs();
             sf::Event event;
             while (window.pollEvent(event)) {
                 if (event.type == sf::Event::Closed)
                     window.close();
 
+                if (event.type == sf::Event::Resized) {
+                    sf::Vector2f size(static_cast<float>(event.size.width), static_cast<float>(event.size.height));
+                    camera.setSize(size * zoom);
+                    hudView.reset(sf::FloatRect(0.f, 0.f, size.x, size.y));
+                }
+
+                if (event.type == sf::Event::MouseWheelScrolled) {
+                    // Keep the world point under the cursor fixed while zooming
+                    sf::Vector2i pixel(event.mouseWheelScroll.x, event.mouseWheelScroll.y);
+                    sf::Vector2f before = window.mapPixelToCoords(pixel, camera);
+                    zoom *= std::pow(1.15f, -event.mouseWheelScroll.delta);
+                    zoom = std::max(1e-3f, std::min(1e5f, zoom));
+                    camera.setSize(sf::Vector2f(window.getSize()) * zoom);
+                    camera.move(before - window.mapPixelToCoords(pixel, camera));
+                }
+
+                if (event.type == sf::Event::MouseButtonPressed && event.mouseButton.button == sf::Mouse::Middle) {
+                    isPanning = true;
+                    panAnchor = sf::Vector2i(event.mouseButton.x, event.mouseButton.y);
+                }
+                if (event.type == sf::Event::MouseButtonReleased && event.mouseButton.button == sf::Mouse::Middle)
+                    isPanning = false;
+                if (event.type == sf::Event::MouseMoved && isPanning) {
+                    sf::Vector2i pixel(event.mouseMove.x, event.mouseMove.y);
+                    camera.move(sf::Vector2f(panAnchor - pixel) * zoom);
+                    panAnchor = pixel;
+                }
+
+                if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F3) {
+                    showProfile = !showProfile;
+                    if (showProfile)
+                        setProfilingEnabled(true);
+                    framesSinceProfileText = 30;
+                }
+
+                if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Home) {
+                    zoom = 1.f;
+                    camera.reset(sf::FloatRect(0.f, 0.f, static_cast<float>(window.getSize().x), static_cast<float>(window.getSize().y)));
+                }
+
                 if (event.type == sf::Event::KeyPressed) {
                     switch (event.key.code) {
                     case sf::Keyboard::Num1:
@@ -59,6 +209,18 @@ int main() {
                         std::cout << "Mode: Circle\n";
                         isDrawing = false;
                         break;
+                    case sf::Keyboard::Num5:
+                        selectedShapeType = ShapeType::Polyline;
+                        std::cout << "Mode: Polyline\n";
+                        isDrawing = false;
+                        pathPoints.clear();
+                        break;
+                    case sf::Keyboard::Num6:
+                        selectedShapeType = ShapeType::Polygon;
+                        std::cout << "Mode: Polygon\n";
+                        isDrawing = false;
+                        pathPoints.clear();
+                        break;
                     default:
                         break;
                     }
@@ -66,11 +228,10 @@ int main() {
 
                 if (event.type == sf::Event::MouseButtonPressed &&
                     event.mouseButton.button == sf::Mouse::Left) {
-                    sf::Vector2f clickPos(static_cast<float>(event.mouseButton.x), static_cast<float>(event.mouseButton.y));
-                    std::lock_guard<std::mutex> lock(shapeMutex);
+                    sf::Vector2f clickPos = window.mapPixelToCoords(sf::Vector2i(event.mouseButton.x, event.mouseButton.y), camera);
 
                     if (selectedShapeType == ShapeType::Point) {
-                        shapes.push_back(std::make_shared<Point>(static_cast<int>(clickPos.x), static_cast<int>(clickPos.y)));
+                        postEdit(SceneCommand::addPoint(static_cast<int>(clickPos.x), static_cast<int>(clickPos.y)));
                         std::cout << "Point added at (" << clickPos.x << ", " << clickPos.y << ")\n";
                     }
                     else if (selectedShapeType == ShapeType::Line) {
@@ -80,10 +241,8 @@ int main() {
                             std::cout << "Line start point at (" << startPoint.x << ", " << startPoint.y << ")\n";
                         }
                         else {
-                            shapes.push_back(std::make_shared<Line>(
-                                Point(static_cast<int>(startPoint.x), static_cast<int>(startPoint.y)),
-                                Point(static_cast<int>(clickPos.x), static_cast<int>(clickPos.y))
-                            ));
+                            postEdit(SceneCommand::addLine(static_cast<int>(startPoint.x), static_cast<int>(startPoint.y),
+                                static_cast<int>(clickPos.x), static_cast<int>(clickPos.y)));
                             std::cout << "Line completed to (" << clickPos.x << ", " << clickPos.y << ")\n";
                             isDrawing = false;
                         }
@@ -99,7 +258,7 @@ int main() {
                             int top = static_cast<int>(std::min(startPoint.y, clickPos.y));
                             int width = static_cast<int>(std::abs(clickPos.x - startPoint.x));
                             int height = static_cast<int>(std::abs(clickPos.y - startPoint.y));
-                            shapes.push_back(std::make_shared<Rectangle>(Point(left, top), width, height));
+                            postEdit(SceneCommand::addRectangle(left, top, width, height));
                             std::cout << "Rectangle completed at (" << left << ", " << top << ") size (" << width << ", " << height << ")\n";
                             isDrawing = false;
                         }
@@ -114,57 +273,85 @@ int main() {
                             float dx = clickPos.x - startPoint.x;
                             float dy = clickPos.y - startPoint.y;
                             int radius = static_cast<int>(std::sqrt(dx * dx + dy * dy));
-                            shapes.push_back(std::make_shared<Circle>(Point(static_cast<int>(startPoint.x), static_cast<int>(startPoint.y)), radius));
+                            postEdit(SceneCommand::addCircle(static_cast<int>(startPoint.x), static_cast<int>(startPoint.y), radius));
                             std::cout << "Circle completed with radius " << radius << "\n";
                             isDrawing = false;
                         }
                     }
+                    else if (selectedShapeType == ShapeType::Polyline || selectedShapeType == ShapeType::Polygon) {
+                        pathPoints.push_back(Point(static_cast<int>(clickPos.x), static_cast<int>(clickPos.y)));
+                        isDrawing = true;
+                        std::cout << "Vertex " << pathPoints.size() << " at (" << clickPos.x << ", " << clickPos.y << ")\n";
+                    }
+                }
+
+                // Right click finishes the polyline/polygon being drawn
+                if (event.type == sf::Event::MouseButtonPressed &&
+                    event.mouseButton.button == sf::Mouse::Right && isDrawing &&
+                    (selectedShapeType == ShapeType::Polyline || selectedShapeType == ShapeType::Polygon)) {
+                    bool closed = selectedShapeType == ShapeType::Polygon;
+                    if (pathPoints.size() >= (closed ? 3u : 2u)) {
+                        postEdit(SceneCommand::addPath(pathPoints, closed));
+                        std::cout << (closed ? "Polygon" : "Polyline") << " completed with " << pathPoints.size() << " vertices\n";
+                    }
+                    else {
+                        std::cout << "Not enough vertices, discarded\n";
+                    }
+                    pathPoints.clear();
+                    isDrawing = false;
                 }
             }
+            profileRecord(ProfileStage::Events, eventsStart, profileNowNs() - eventsStart);
 
             window.clear(sf::Color::White);
+            window.setView(camera);
+            sf::Vector2f currentPos = window.mapPixelToCoords(sf::Mouse::getPosition(window), camera);
 
+            std::string hoverText;
             {
-                std::lock_guard<std::mutex> lock(shapeMutex);
-                for (const auto& shape : shapes) {
-                    if (auto p = std::dynamic_pointer_cast<Point>(shape)) {
-                        sf::CircleShape circle(3.f);
-                        circle.setPosition(static_cast<float>(p->x) - 3.f, static_cast<float>(p->y) - 3.f); // center circle on point
-                        circle.setFillColor(sf::Color::Black);
-                        window.draw(circle);
-                    }
-                    else if (auto l = std::dynamic_pointer_cast<Line>(shape)) {
-                        sf::Vertex line[] = {
-                            sf::Vertex(sf::Vector2f(static_cast<float>(l->start.x), static_cast<float>(l->start.y)), sf::Color::Blue),
-                            sf::Vertex(sf::Vector2f(static_cast<float>(l->end.x), static_cast<float>(l->end.y)), sf::Color::Blue)
-                        };
-                        window.draw(line, 2, sf::Lines);
-                    }
-                    else if (auto r = std::dynamic_pointer_cast<Rectangle>(shape)) {
-                        sf::RectangleShape rectShape(sf::Vector2f(static_cast<float>(r->width), static_cast<float>(r->height)));
-                        rectShape.setPosition(static_cast<float>(r->topLeft.x), static_cast<float>(r->topLeft.y));
-                        rectShape.setFillColor(sf::Color::Transparent);
-                        rectShape.setOutlineColor(sf::Color::Green);
-                        rectShape.setOutlineThickness(2.f);
-                        window.draw(rectShape);
+                InstrumentedLock lock(scene.mutex, std::defer_lock);
+                {
+                    ProfileScope waiting(ProfileStage::Lock);
+                    lock.lock();
+                }
+                bool moved;
+                {
+                    ProfileScope traversing(ProfileStage::Traversal);
+                    sceneIndex.refresh(scene.shapes, scene.editVersion);
+                    pointCloud.refresh(scene.shapes, scene.editVersion);
+                    moved = !scene.movedShapes.empty();
+                    if (moved) {
+                        sceneIndex.refit(scene.shapes, scene.movedShapes);
+                        pointCloud.update(scene.shapes, scene.movedShapes);
+                        sceneRenderer.markDirty(sceneIndex, scene.movedShapes);
+                        scene.movedShapes.clear();
                     }
-                    else if (auto c = std::dynamic_pointer_cast<Circle>(shape)) {
-                        sf::CircleShape circleShape(static_cast<float>(c->radius));
-                        circleShape.setPosition(static_cast<float>(c->center.x) - static_cast<float>(c->radius),
-                            static_cast<float>(c->center.y) - static_cast<float>(c->radius));
-                        circleShape.setFillColor(sf::Color::Transparent);
-                        circleShape.setOutlineColor(sf::Color::Magenta);
-                        circleShape.setOutlineThickness(2.f);
-                        window.draw(circleShape);
+
+                    // Re-query the entity under the cursor whenever the cursor, camera or scene moved
+                    if (moved || currentPos != hoverMouse || scene.editVersion != hoverVersion || scene.shapes.size() != hoverShapeCount) {
+                        hoverMouse = currentPos;
+                        hoverVersion = scene.editVersion;
+                        hoverShapeCount = scene.shapes.size();
+                        std::vector<Neighbor> hit = sceneIndex.nearest(scene.shapes, currentPos.x, currentPos.y, 1, kHoverTolerance * zoom);
+                        hovered = hit.empty() ? scene.shapes.size() : hit[0].index;
                     }
                 }
+
+                bool sceneChanged = moved || scene.editVersion != layerVersion || scene.shapes.size() != layerShapeCount;
+                layerVersion = scene.editVersion;
+                layerShapeCount = scene.shapes.size();
+                sceneLayer.composite(window, camera, sceneChanged, [&](sf::RenderTarget& target) {
+                    sceneRenderer.draw(target, scene.shapes, *scene.vertexPool, sceneIndex, pointCloud);
+                });
+                if (hovered < scene.shapes.size()) {
+                    const sf::Color highlight(255, 190, 0);
+                    drawShape(window, *scene.shapes[hovered], *scene.vertexPool, &highlight, zoom);
+                    hoverText = scene.shapes[hovered]->toString();
+                }
             }
 
             // Draw live preview for shapes with two points
             if (isDrawing) {
-                sf::Vector2i mousePos = sf::Mouse::getPosition(window);
-                sf::Vector2f currentPos(static_cast<float>(mousePos.x), static_cast<float>(mousePos.y));
-
                 if (selectedShapeType == ShapeType::Line) {
                     sf::Vertex tempLine[] = {
                         sf::Vertex(startPoint, sf::Color::Red),
@@ -182,7 +369,7 @@ int main() {
                     rectShape.setPosition(left, top);
                     rectShape.setFillColor(sf::Color::Transparent);
                     rectShape.setOutlineColor(sf::Color::Red);
-                    rectShape.setOutlineThickness(1.f);
+                    rectShape.setOutlineThickness(zoom);
                     window.draw(rectShape);
                 }
                 else if (selectedShapeType == ShapeType::Circle) {
@@ -194,58 +381,83 @@ int main() {
                     circleShape.setPosition(startPoint.x - radius, startPoint.y - radius);
                     circleShape.setFillColor(sf::Color::Transparent);
                     circleShape.setOutlineColor(sf::Color::Red);
-                    circleShape.setOutlineThickness(1.f);
+                    circleShape.setOutlineThickness(zoom);
                     window.draw(circleShape);
                 }
+                else if (selectedShapeType == ShapeType::Polyline || selectedShapeType == ShapeType::Polygon) {
+                    sf::VertexArray tempPath(sf::LineStrip);
+                    for (const auto& p : pathPoints)
+                        tempPath.append(sf::Vertex(sf::Vector2f(static_cast<float>(p.x), static_cast<float>(p.y)), sf::Color::Red));
+                    tempPath.append(sf::Vertex(currentPos, sf::Color::Red));
+                    if (selectedShapeType == ShapeType::Polygon && !pathPoints.empty())
+                        tempPath.append(sf::Vertex(tempPath[0].position, sf::Color::Red));
+                    window.draw(tempPath);
+                }
             }
 
             if (selectedShapeType == ShapeType::None)
-                hintText.setString("Press 1: Point | 2: Line | 3: Rect | 4: Circle");
+                hintText.setString("Press 1: Point | 2: Line | 3: Rect | 4: Circle | 5: Polyline | 6: Polygon\n"
+                    "Wheel: zoom | Middle drag: pan | Home: reset view");
             else if (selectedShapeType == ShapeType::Point)
-                hintText.setString("Click to place a point (1-4 to change shape)");
+                hintText.setString("Click to place a point (1-6 to change shape)");
             else if (selectedShapeType == ShapeType::Line)
                 hintText.setString(isDrawing ? "Click to finish the line" : "Click to start a line");
             else if (selectedShapeType == ShapeType::Rectangle)
                 hintText.setString(isDrawing ? "Click to finish the rectangle" : "Click to start a rectangle");
             else if (selectedShapeType == ShapeType::Circle)
                 hintText.setString(isDrawing ? "Click to finish the circle" : "Click to start a circle");
+            else if (selectedShapeType == ShapeType::Polyline)
+                hintText.setString(isDrawing ? "Click to add a vertex, right click to finish" : "Click to start a polyline");
+            else if (selectedShapeType == ShapeType::Polygon)
+                hintText.setString(isDrawing ? "Click to add a vertex, right click to close" : "Click to start a polygon");
 
+            if (!hoverText.empty())
+                hintText.setString(hintText.getString() + "\n" + hoverText);
+            // Imports and exports run in the background; show how far along they are
+            for (const auto& job : JobList::shared().running()) {
+                char progress[32];
+                std::snprintf(progress, sizeof(progress), " %.0f%%", job->fraction() * 100.0);
+                hintText.setString(hintText.getString() + "\n" + job->description + progress);
+            }
+            window.setView(hudView);
             window.draw(hintText);
+
+            if (showProfile) {
+                if (++framesSinceProfileText >= 30) {
+                    framesSinceProfileText = 0;
+                    std::string lines = "stage          p50     p95     p99  (ms, last 240)\n";
+                    for (int stage = 0; stage < static_cast<int>(ProfileStage::Count); ++stage) {
+                        ProfileStageStats stats = profileStageStats(static_cast<ProfileStage>(stage), 240);
+                        char line[96];
+                        std::snprintf(line, sizeof(line), "%-12s %7.2f %7.2f %7.2f\n", profileStageName(static_cast<ProfileStage>(stage)),
+                            stats.p50Ms, stats.p95Ms, stats.p99Ms);
+                        lines += line;
+                    }
+                    profileText.setString(lines);
+                }
+                profileText.setPosition(10.f, hudView.getSize().y - profileText.getLocalBounds().height - 20.f);
+                window.draw(profileText);
+            }
+
+            ProfileScope displaying(ProfileStage::Display);
             window.display();
         }
         });
 
     // Command-line input (runs in main thread)
+    std::string line;
     while (true) {
-        std::cout << "Commands: addpoint x y | addline x1 y1 x2 y2 | exit\n";
+        CommandInterpreter::printHelp(std::cout);
         std::cout << "Enter command: ";
-
-        std::string command;
-        std::cin >> command;
-
-        if (command == "addpoint") {
-            int x, y;
-            std::cin >> x >> y;
-            std::lock_guard<std::mutex> lock(shapeMutex);
-            shapes.push_back(std::make_shared<Point>(x, y));
-            std::cout << "Point added.\n";
-        }
-        else if (command == "addline") {
-            int x1, y1, x2, y2;
-            std::cin >> x1 >> y1 >> x2 >> y2;
-            std::lock_guard<std::mutex> lock(shapeMutex);
-            shapes.push_back(std::make_shared<Line>(Point(x1, y1), Point(x2, y2)));
-            std::cout << "Line added.\n";
-        }
-        else if (command == "exit") {
+        if (!std::getline(std::cin, line))
+            break;
+        bool keepGoing = joinPort != 0 ? sessionViewer.execute(line, std::cout) : interpreter.execute(line, std::cout);
+        if (!keepGoing)
             break;
-        }
-        else {
-            std::cout << "Unknown command.\n";
-        }
     }
 
     renderThread.join();
+    JobList::shared().cancelAll();
 
     return 0;
 }
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Bounded lock-free queue for any number of producers and one consumer.
+// Every cell carries a sequence number: producers claim a position with one
+// compare-and-swap on the tail and publish the cell by advancing its sequence,
+// and the consumer takes cells strictly in claim order, so the order of
+// commands is the order in which their positions were claimed.
+template <typename T>
+class MpscQueue {
+public:
+    // `capacity` is rounded up to a power of two.
+    explicit MpscQueue(std::size_t capacity) {
+        std::size_t size = 2;
+        while (size < capacity)
+            size *= 2;
+        cells.reset(new Cell[size]);
+        mask = size - 1;
+        for (std::size_t i = 0; i < size; ++i)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    // Appends `value` unless the queue is full. Safe from any thread.
+    bool tryPush(T& value) {
+        std::uint64_t position = tail.load(std::memory_order_relaxed);
+        Cell* cell;
+        for (;;) {
+            cell = &cells[position & mask];
+            std::uint64_t sequence = cell->sequence.load(std::memory_order_acquire);
+            std::int64_t lag = static_cast<std::int64_t>(sequence - position);
+            if (lag == 0) {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (lag < 0) {
+                return false; // the consumer has not freed this cell yet
+            }
+            else {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Appends `value`, yielding while the queue is full.
+    void push(T value) {
+        while (!tryPush(value))
+            std::this_thread::yield();
+    }
+
+    // Consumer only: moves up to `max` published values, oldest first, to the
+    // end of `out` and returns how many were taken.
+    std::size_t drain(std::vector<T>& out, std::size_t max) {
+        std::size_t taken = 0;
+        while (taken < max) {
+            Cell& cell = cells[head & mask];
+            if (cell.sequence.load(std::memory_order_acquire) != head + 1)
+                break;
+            out.push_back(std::move(cell.value));
+            cell.sequence.store(head + mask + 1, std::memory_order_release);
+            ++head;
+            ++taken;
+        }
+        return taken;
+    }
+
+    // Positions claimed so far; every value pushed before a call to this is
+    // below the returned count.
+    std::uint64_t claimed() const {
+        return tail.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Cell {
+        std::atomic<std::uint64_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    std::size_t mask;
+    alignas(64) std::atomic<std::uint64_t> tail{ 0 };
+    alignas(64) std::uint64_t head = 0; // consumer only
+};
@@ -0,0 +1,131 @@
+#include "PointCloud.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include "TaskScheduler.h"
+
+namespace {
+
+const std::size_t kMinPointsPerThread = 1 << 17;
+const std::uint32_t kNoPoint = 0xFFFFFFFFu;
+
+}
+
+void PointCloud::refresh(const std::vector<std::shared_ptr<Shape>>& shapes, unsigned long long version) {
+    if (version != scannedVersion || shapes.size() < scannedShapes) {
+        xs.clear();
+        ys.clear();
+        pointOf.clear();
+        scannedShapes = 0;
+        scannedVersion = version;
+    }
+    pointOf.resize(shapes.size(), kNoPoint);
+    for (std::size_t i = scannedShapes; i < shapes.size(); ++i) {
+        if (shapes[i]->type() == ShapeType::Point) {
+            const Point& p = static_cast<const Point&>(*shapes[i]);
+            pointOf[i] = static_cast<std::uint32_t>(xs.size());
+            xs.push_back(p.x);
+            ys.push_back(p.y);
+        }
+    }
+    scannedShapes = shapes.size();
+}
+
+void PointCloud::update(const std::vector<std::shared_ptr<Shape>>& shapes, const std::vector<std::size_t>& changed) {
+    for (std::size_t i : changed) {
+        if (i >= scannedShapes || pointOf[i] == kNoPoint)
+            continue;
+        const Point& p = static_cast<const Point&>(*shapes[i]);
+        xs[pointOf[i]] = p.x;
+        ys[pointOf[i]] = p.y;
+    }
+}
+
+std::size_t PointCloud::size() const {
+    return xs.size();
+}
+
+std::size_t PointCloud::bin(double originX, double originY, double cellSize, unsigned width, unsigned height,
+    std::vector<std::uint32_t>& grid, unsigned threads) const {
+    std::size_t cells = static_cast<std::size_t>(width) * height;
+    grid.assign(cells, 0);
+    if (xs.empty() || cells == 0)
+        return 0;
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t workers = std::min<std::size_t>(threads, std::max<std::size_t>(1, xs.size() / kMinPointsPerThread));
+    std::vector<std::vector<std::uint32_t>> partial(workers - 1, std::vector<std::uint32_t>(cells));
+    std::vector<std::size_t> binned(workers);
+
+    const double scale = 1.0 / cellSize;
+    const double limitX = width, limitY = height;
+    auto binRange = [&](std::size_t w, std::size_t begin, std::size_t end) {
+        std::uint32_t* counts = w == 0 ? grid.data() : partial[w - 1].data();
+        std::size_t inside = 0;
+        for (std::size_t i = begin; i < end; ++i) {
+            // Truncation equals floor once negative offsets are rejected
+            double cx = (xs[i] - originX) * scale, cy = (ys[i] - originY) * scale;
+            if (!(cx >= 0.0 && cy >= 0.0 && cx < limitX && cy < limitY))
+                continue;
+            ++counts[static_cast<std::size_t>(cy) * width + static_cast<std::size_t>(cx)];
+            ++inside;
+        }
+        binned[w] = inside;
+    };
+
+    std::size_t chunk = (xs.size() + workers - 1) / workers;
+    TaskScheduler& scheduler = TaskScheduler::shared();
+    scheduler.parallelFor(workers, 1, [&](std::size_t first, std::size_t last) {
+        for (std::size_t w = first; w < last; ++w)
+            binRange(w, std::min(xs.size(), w * chunk), std::min(xs.size(), (w + 1) * chunk));
+    });
+
+    // Reduce the per-worker grids, each worker summing its own band of cells
+    if (workers > 1) {
+        std::size_t band = (cells + workers - 1) / workers;
+        scheduler.parallelFor(cells, band, [&](std::size_t begin, std::size_t end) {
+            for (const auto& counts : partial) {
+                for (std::size_t c = begin; c < end; ++c)
+                    grid[c] += counts[c];
+            }
+        });
+    }
+
+    std::size_t total = 0;
+    for (std::size_t n : binned)
+        total += n;
+    return total;
+}
+
+void densityToRgba(const std::vector<std::uint32_t>& grid, std::uint32_t saturation, std::vector<std::uint8_t>& rgba) {
+    // Ramp indexed by count; the log curve is evaluated once per distinct count up to saturation
+    saturation = std::max<std::uint32_t>(saturation, 2);
+    std::vector<std::uint32_t> ramp(saturation + 1);
+    ramp[0] = 0;
+    const double logMax = std::log(static_cast<double>(saturation));
+    for (std::uint32_t n = 1; n <= saturation; ++n) {
+        double t = std::log(static_cast<double>(n)) / logMax; // 0 for a single point, 1 at saturation
+        double r, g, b;
+        if (t < 0.5) {
+            double u = t * 2.0; // blue -> yellow
+            r = 255.0 * u; g = 255.0 * u; b = 255.0 * (1.0 - u);
+        }
+        else {
+            double u = (t - 0.5) * 2.0; // yellow -> red
+            r = 255.0; g = 255.0 * (1.0 - u); b = 0.0;
+        }
+        std::uint32_t alpha = static_cast<std::uint32_t>(160.0 + 95.0 * t);
+        ramp[n] = static_cast<std::uint32_t>(r) | (static_cast<std::uint32_t>(g) << 8) |
+            (static_cast<std::uint32_t>(b) << 16) | (alpha << 24);
+    }
+
+    rgba.resize(grid.size() * 4);
+    for (std::size_t i = 0; i < grid.size(); ++i) {
+        std::uint32_t color = ramp[std::min(grid[i], saturation)];
+        rgba[i * 4 + 0] = static_cast<std::uint8_t>(color);
+        rgba[i * 4 + 1] = static_cast<std::uint8_t>(color >> 8);
+        rgba[i * 4 + 2] = static_cast<std::uint8_t>(color >> 16);
+        rgba[i * 4 + 3] = static_cast<std::uint8_t>(color >> 24);
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Shape.h"
+
+// Coordinates of every Point shape in the scene, kept in two columns so that
+// millions of them can be binned without touching the shape objects.
+class PointCloud {
+public:
+    // Same contract as SpatialIndex::refresh: a changed `version` rescans every
+    // shape, otherwise only shapes appended since the last call are picked up.
+    void refresh(const std::vector<std::shared_ptr<Shape>>& shapes, unsigned long long version);
+    // Re-reads the coordinates of points moved in place. Edits never turn a
+    // shape into a Point or a Point into something else.
+    void update(const std::vector<std::shared_ptr<Shape>>& shapes, const std::vector<std::size_t>& changed);
+    std::size_t size() const;
+
+    // Counts the points falling into each cell of a width x height grid whose
+    // cell (0, 0) starts at (originX, originY) and whose cells are `cellSize`
+    // world units square (row-major, rows along y). Work is split over
+    // `threads` workers (0 = hardware concurrency), each binning into its own
+    // grid before a parallel reduction. Returns the number of points binned.
+    std::size_t bin(double originX, double originY, double cellSize, unsigned width, unsigned height,
+        std::vector<std::uint32_t>& grid, unsigned threads = 0) const;
+
+private:
+    std::vector<int> xs, ys;
+    std::vector<std::uint32_t> pointOf; // slot in xs/ys of each scanned shape
+    std::size_t scannedShapes = 0;
+    unsigned long long scannedVersion = 0;
+};
+
+// Heatmap colors for a density grid as RGBA bytes: empty cells stay fully
+// transparent, occupied ones follow a logarithmic ramp from blue (one point)
+// through yellow to red (`saturation` points or more).
+void densityToRgba(const std::vector<std::uint32_t>& grid, std::uint32_t saturation, std::vector<std::uint8_t>& rgba);
@@ -0,0 +1,610 @@
+#include "PolygonBoolean.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include "Predicates.h"
+#include "TaskScheduler.h"
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+
+// Non-horizontal input edge, stored bottom-up (y0 < y1).
+struct Edge {
+    int x0, y0, x1, y1;
+    double dxdy;
+    int wind; // +1 when the ring walks up along this edge, -1 when it walks down
+    int set;  // 0 = subject, 1 = clip
+
+    // Every output coordinate is produced by this one expression so that the
+    // same (edge, y) pair always yields bit-identical x values across beams.
+    double xAt(double y) const {
+        if (y == y1)
+            return x1;
+        return x0 + (y - y0) * dxdy;
+    }
+};
+
+struct Segment {
+    double x0, y0, x1, y1;
+};
+
+struct Interval {
+    double left, right;
+};
+
+// Output of one strip of scanbeams.
+struct StripResult {
+    std::vector<Segment> segments;
+    std::vector<Interval> firstBottom; // runs touching the strip's lower scanline
+    std::vector<Interval> lastTop;     // runs touching the strip's upper scanline
+};
+
+void addEdges(const Paths& paths, int set, std::vector<Edge>& edges) {
+    for (const auto& path : paths) {
+        std::size_t n = path.size();
+        if (n < 3)
+            continue;
+        for (std::size_t i = 0; i < n; ++i) {
+            const IntPoint& a = path[i];
+            const IntPoint& b = path[(i + 1) % n];
+            if (a.y == b.y)
+                continue; // horizontal edges do not change the winding inside a beam
+            Edge e;
+            if (a.y < b.y) {
+                e.x0 = a.x; e.y0 = a.y; e.x1 = b.x; e.y1 = b.y; e.wind = 1;
+            }
+            else {
+                e.x0 = b.x; e.y0 = b.y; e.x1 = a.x; e.y1 = a.y; e.wind = -1;
+            }
+            e.dxdy = static_cast<double>(e.x1 - e.x0) / (e.y1 - e.y0);
+            e.set = set;
+            edges.push_back(e);
+        }
+    }
+}
+
+bool isInside(BooleanOp op, int windSubject, int windClip) {
+    bool s = windSubject != 0;
+    bool c = windClip != 0;
+    switch (op) {
+    case BooleanOp::Union: return s || c;
+    case BooleanOp::Intersection: return s && c;
+    case BooleanOp::Difference: return s && !c;
+    case BooleanOp::Xor: return s != c;
+    }
+    return false;
+}
+
+// Horizontal boundary pieces on scanline y: runs starting above contribute +x,
+// runs ending below contribute -x, and overlapping parts cancel out. Counts are
+// kept signed so that a run pinched to a slightly inverted interval at a crossing
+// still cancels exactly and every vertex stays balanced.
+void cancelHorizontals(double y, const std::vector<Interval>& above, const std::vector<Interval>& below,
+    std::vector<Segment>& out) {
+    if (above.empty() && below.empty())
+        return;
+
+    std::vector<std::pair<double, int>> marks; // (x, delta) with +1/-1 for above, +2/-2 for below
+    marks.reserve(2 * (above.size() + below.size()));
+    for (const auto& iv : above) {
+        marks.push_back(std::make_pair(iv.left, 1));
+        marks.push_back(std::make_pair(iv.right, -1));
+    }
+    for (const auto& iv : below) {
+        marks.push_back(std::make_pair(iv.left, 2));
+        marks.push_back(std::make_pair(iv.right, -2));
+    }
+    std::sort(marks.begin(), marks.end());
+
+    int a = 0, b = 0;
+    for (std::size_t i = 0; i < marks.size();) {
+        double x = marks[i].first;
+        for (; i < marks.size() && marks[i].first == x; ++i) {
+            if (marks[i].second == 1 || marks[i].second == -1)
+                a += marks[i].second;
+            else
+                b += marks[i].second / 2;
+        }
+        if (i == marks.size())
+            break;
+        double next = marks[i].first;
+        for (int net = a - b; net > 0; --net)
+            out.push_back(Segment{ x, y, next, y });
+        for (int net = a - b; net < 0; ++net)
+            out.push_back(Segment{ next, y, x, y });
+    }
+}
+
+struct Run {
+    double xl0, xl1, xr0, xr1;
+    const Edge* left;
+    const Edge* right;
+};
+
+// Collects the inside runs of one sub-beam whose active edges are already in
+// left-to-right order.
+void collectRuns(const std::vector<const Edge*>& order, BooleanOp op, double y0, double y1, std::vector<Run>& runs) {
+    runs.clear();
+    int wind[2] = { 0, 0 };
+    bool inside = false;
+    const Edge* left = nullptr;
+    for (const Edge* e : order) {
+        wind[e->set] += e->wind;
+        bool now = isInside(op, wind[0], wind[1]);
+        if (now == inside)
+            continue;
+        if (now) {
+            left = e;
+        }
+        else {
+            Run run{ left->xAt(y0), left->xAt(y1), e->xAt(y0), e->xAt(y1), left, e };
+            if (run.xl0 == run.xr0 && run.xl1 == run.xr1)
+                ; // zero-width sliver from coincident edges
+            else if (!runs.empty() && runs.back().xr0 == run.xl0 && runs.back().xr1 == run.xl1) {
+                runs.back().xr0 = run.xr0; // touching along a shared edge: one run
+                runs.back().xr1 = run.xr1;
+                runs.back().right = e;
+            }
+            else
+                runs.push_back(run);
+        }
+        inside = now;
+    }
+}
+
+StripResult clipStrip(const std::vector<Edge>& edges, const std::vector<int>& scanlines,
+    std::size_t firstBeam, std::size_t lastBeam, BooleanOp op) {
+    StripResult result;
+    double stripBottom = scanlines[firstBeam];
+    double stripTop = scanlines[lastBeam];
+
+    std::vector<const Edge*> pending;
+    for (const auto& e : edges) {
+        if (e.y0 < stripTop && e.y1 > stripBottom)
+            pending.push_back(&e);
+    }
+    std::sort(pending.begin(), pending.end(), [](const Edge* a, const Edge* b) { return a->y0 < b->y0; });
+
+    std::vector<const Edge*> active, incoming, merged;
+    std::vector<std::pair<double, const Edge*>> keyed;
+    std::vector<double> splits;
+    std::vector<Run> runs;
+    std::vector<Interval> prevTop, bottom;
+    // Side segments that end on the previous sub-beam's top, keyed by their edge.
+    std::vector<std::pair<const Edge*, std::size_t>> openLeft, openRight, nextLeft, nextRight;
+    std::size_t next = 0;
+    bool firstSubBeam = true;
+
+    auto sortAt = [&](double y) {
+        keyed.clear();
+        for (const Edge* e : active)
+            keyed.push_back(std::make_pair(e->xAt(y), e));
+        std::stable_sort(keyed.begin(), keyed.end(),
+            [](const std::pair<double, const Edge*>& a, const std::pair<double, const Edge*>& b) { return a.first < b.first; });
+        for (std::size_t i = 0; i < keyed.size(); ++i)
+            active[i] = keyed[i].second;
+    };
+
+    for (std::size_t k = firstBeam; k < lastBeam; ++k) {
+        double ya = scanlines[k];
+        double yb = scanlines[k + 1];
+
+        active.erase(std::remove_if(active.begin(), active.end(), [ya](const Edge* e) { return e->y1 <= ya; }), active.end());
+        incoming.clear();
+        for (; next < pending.size() && pending[next]->y0 <= ya; ++next) {
+            if (pending[next]->y1 > ya)
+                incoming.push_back(pending[next]);
+        }
+
+        // Active edges stay nearly ordered from the previous beam (only edges meeting
+        // at ya may need to swap), so merge the new ones in and finish by insertion.
+        auto lessAtBottom = [ya, yb](const Edge* a, const Edge* b) {
+            double xa = a->xAt(ya), xb = b->xAt(ya);
+            return xa < xb || (xa == xb && a->xAt(yb) < b->xAt(yb));
+        };
+        if (!incoming.empty()) {
+            std::sort(incoming.begin(), incoming.end(), lessAtBottom);
+            merged.clear();
+            std::merge(active.begin(), active.end(), incoming.begin(), incoming.end(), std::back_inserter(merged), lessAtBottom);
+            active.swap(merged);
+        }
+        for (std::size_t i = 1; i < active.size(); ++i) {
+            for (std::size_t j = i; j > 0 && lessAtBottom(active[j], active[j - 1]); --j)
+                std::swap(active[j], active[j - 1]);
+        }
+
+        // Pairs that change order between ya and yb cross inside the beam; an insertion
+        // sort by x at yb visits each such pair exactly once.
+        splits.clear();
+        keyed.clear();
+        for (const Edge* e : active)
+            keyed.push_back(std::make_pair(e->xAt(yb), e));
+        for (std::size_t i = 1; i < keyed.size(); ++i) {
+            for (std::size_t j = i; j > 0 && keyed[j - 1].first > keyed[j].first; --j) {
+                const Edge* lo = keyed[j - 1].second;
+                const Edge* hi = keyed[j].second;
+                double gapBottom = hi->xAt(ya) - lo->xAt(ya);
+                double gapTop = keyed[j - 1].first - keyed[j].first;
+                double t = gapBottom / (gapBottom + gapTop);
+                double y = ya + t * (yb - ya);
+                if (y > ya && y < yb)
+                    splits.push_back(y);
+                std::swap(keyed[j - 1], keyed[j]);
+            }
+        }
+        std::sort(splits.begin(), splits.end());
+        splits.erase(std::unique(splits.begin(), splits.end()), splits.end());
+        splits.push_back(yb);
+
+        double y0 = ya;
+        for (double y1 : splits) {
+            if (y1 <= y0)
+                continue;
+            if (splits.size() > 1)
+                sortAt(0.5 * (y0 + y1));
+            collectRuns(active, op, y0, y1, runs);
+
+            // A side that continues along the same edge as in the sub-beam below only
+            // extends that segment, so long edges do not turn into one piece per beam.
+            bottom.clear();
+            nextLeft.clear();
+            nextRight.clear();
+            std::size_t li = 0, ri = 0;
+            for (const auto& run : runs) {
+                bottom.push_back(Interval{ run.xl0, run.xr0 });
+
+                std::size_t right = result.segments.size();
+                for (; ri < openRight.size() && result.segments[openRight[ri].second].x1 < run.xr0; ++ri) {}
+                for (std::size_t k = ri; k < openRight.size() && result.segments[openRight[k].second].x1 == run.xr0; ++k) {
+                    if (openRight[k].first == run.right) {
+                        right = openRight[k].second;
+                        break;
+                    }
+                }
+                if (right == result.segments.size())
+                    result.segments.push_back(Segment{ run.xr0, y0, run.xr1, y1 }); // right side walks up
+                else {
+                    result.segments[right].x1 = run.xr1;
+                    result.segments[right].y1 = y1;
+                }
+
+                std::size_t left = result.segments.size();
+                for (; li < openLeft.size() && result.segments[openLeft[li].second].x0 < run.xl0; ++li) {}
+                for (std::size_t k = li; k < openLeft.size() && result.segments[openLeft[k].second].x0 == run.xl0; ++k) {
+                    if (openLeft[k].first == run.left) {
+                        left = openLeft[k].second;
+                        break;
+                    }
+                }
+                if (left == result.segments.size())
+                    result.segments.push_back(Segment{ run.xl1, y1, run.xl0, y0 }); // left side walks down
+                else {
+                    result.segments[left].x0 = run.xl1;
+                    result.segments[left].y0 = y1;
+                }
+
+                nextLeft.push_back(std::make_pair(run.left, left));
+                nextRight.push_back(std::make_pair(run.right, right));
+            }
+            openLeft.swap(nextLeft);
+            openRight.swap(nextRight);
+            if (firstSubBeam)
+                result.firstBottom = bottom;
+            else
+                cancelHorizontals(y0, bottom, prevTop, result.segments);
+            firstSubBeam = false;
+
+            prevTop.clear();
+            for (const auto& run : runs)
+                prevTop.push_back(Interval{ run.xl1, run.xr1 });
+            y0 = y1;
+        }
+    }
+    result.lastTop = prevTop;
+    return result;
+}
+
+struct PointKey {
+    double x, y;
+    bool operator==(const PointKey& o) const {
+        return x == o.x && y == o.y;
+    }
+};
+
+struct PointKeyHash {
+    std::size_t operator()(const PointKey& p) const {
+        std::hash<double> h; // +0.0 and -0.0 compare equal, so hash them alike
+        return h(p.x == 0.0 ? 0.0 : p.x) * 31 + h(p.y == 0.0 ? 0.0 : p.y);
+    }
+};
+
+bool collinear(const std::pair<long long, long long>& a, const std::pair<long long, long long>& b,
+    const std::pair<long long, long long>& c) {
+    return (b.first - a.first) * (c.second - b.second) - (b.second - a.second) * (c.first - b.first) == 0;
+}
+
+// Links boundary segments into closed rings and snaps them to integer coordinates.
+Paths buildRings(const std::vector<Segment>& segments) {
+    std::unordered_map<PointKey, std::vector<std::size_t>, PointKeyHash> outgoing;
+    outgoing.reserve(segments.size());
+    for (std::size_t i = 0; i < segments.size(); ++i)
+        outgoing[PointKey{ segments[i].x0, segments[i].y0 }].push_back(i);
+
+    std::vector<bool> used(segments.size(), false);
+    Paths result;
+    for (std::size_t start = 0; start < segments.size(); ++start) {
+        if (used[start])
+            continue;
+
+        std::vector<std::pair<long long, long long>> ring;
+        std::size_t current = start;
+        while (true) {
+            used[current] = true;
+            const Segment& s = segments[current];
+            ring.push_back(std::make_pair(std::llround(s.x0), std::llround(s.y0)));
+            if (s.x1 == segments[start].x0 && s.y1 == segments[start].y0)
+                break;
+            auto& candidates = outgoing[PointKey{ s.x1, s.y1 }];
+            while (!candidates.empty() && used[candidates.back()])
+                candidates.pop_back();
+            if (candidates.empty())
+                break; // unbalanced vertex; cannot happen for a consistent sweep
+            current = candidates.back();
+            candidates.pop_back();
+        }
+
+        // Drop repeated and collinear vertices introduced by beam splitting and rounding.
+        // Each removal is judged against the current neighbours, so it never changes
+        // the winding of the ring away from its outline.
+        std::vector<std::pair<long long, long long>> kept;
+        kept.reserve(ring.size());
+        for (const auto& p : ring) {
+            kept.push_back(p);
+            while (kept.size() >= 2 && kept[kept.size() - 1] == kept[kept.size() - 2])
+                kept.pop_back();
+            while (kept.size() >= 3 && collinear(kept[kept.size() - 3], kept[kept.size() - 2], kept[kept.size() - 1]))
+                kept.erase(kept.end() - 2);
+        }
+        std::size_t head = 0;
+        while (kept.size() - head >= 3) {
+            if (kept.back() == kept[head] || collinear(kept[kept.size() - 2], kept.back(), kept[head]))
+                kept.pop_back();
+            else if (collinear(kept.back(), kept[head], kept[head + 1]))
+                ++head;
+            else
+                break;
+        }
+        ring.assign(kept.begin() + head, kept.end());
+        if (ring.size() < 3)
+            continue;
+
+        Path path;
+        path.reserve(ring.size());
+        for (const auto& p : ring)
+            path.push_back(IntPoint{ static_cast<int>(p.first), static_cast<int>(p.second) });
+        if (signedArea2(path) != 0)
+            result.push_back(std::move(path));
+    }
+    return result;
+}
+
+}
+
+double signedArea2(const Path& path) {
+    // Each cross product fits in 64 bits but their sum may not, so it is carried
+    // in two words and rounded once: the sign, and whether it is zero, stay exact
+    std::uint64_t low = 0;
+    std::int64_t high = 0;
+    auto add = [&](long long term) {
+        std::uint64_t before = low;
+        low += static_cast<std::uint64_t>(term);
+        high += (term < 0 ? -1 : 0) + (low < before ? 1 : 0);
+    };
+    std::size_t n = path.size();
+    for (std::size_t i = 0; i < n; ++i) {
+        const IntPoint& a = path[i];
+        const IntPoint& b = path[(i + 1) % n];
+        add(static_cast<long long>(a.x) * b.y);
+        add(-static_cast<long long>(b.x) * a.y);
+    }
+    bool negative = high < 0;
+    if (negative) {
+        low = ~low + 1;
+        high = ~high + (low == 0 ? 1 : 0);
+    }
+    double magnitude = static_cast<double>(high) * 18446744073709551616.0 + static_cast<double>(low);
+    return negative ? -magnitude : magnitude;
+}
+
+std::size_t circleSegments(int radius, double tolerance) {
+    if (radius <= 0)
+        return 0;
+    double r = static_cast<double>(radius);
+    double n = tolerance >= r ? 8.0 : std::ceil(kPi / std::acos(1.0 - tolerance / r));
+    return static_cast<std::size_t>(std::max(8.0, std::min(1024.0, n)));
+}
+
+Path tessellateCircle(int cx, int cy, int radius, std::size_t segments) {
+    Path path;
+    path.reserve(segments);
+    for (std::size_t i = 0; i < segments; ++i) {
+        double angle = 2.0 * kPi * static_cast<double>(i) / static_cast<double>(segments);
+        path.push_back(IntPoint{ cx + static_cast<int>(std::lround(radius * std::cos(angle))),
+            cy + static_cast<int>(std::lround(radius * std::sin(angle))) });
+    }
+    return path;
+}
+
+Path shapeToPath(const Shape& shape, double circleTolerance) {
+    if (auto r = dynamic_cast<const Rectangle*>(&shape)) {
+        int x = r->topLeft.x, y = r->topLeft.y;
+        return Path{ { x, y }, { x + r->width, y }, { x + r->width, y + r->height }, { x, y + r->height } };
+    }
+    if (auto c = dynamic_cast<const Circle*>(&shape))
+        return tessellateCircle(c->center.x, c->center.y, c->radius, circleSegments(c->radius, circleTolerance));
+    if (auto pg = dynamic_cast<const Polygon*>(&shape)) {
+        std::size_t last = pg->holes.empty() ? pg->count : pg->holes.front();
+        Path path;
+        path.reserve(last);
+        for (std::size_t i = 0; i < last; ++i)
+            path.push_back(IntPoint{ pg->pool->xs[pg->offset + i], pg->pool->ys[pg->offset + i] });
+        return path;
+    }
+    return Path();
+}
+
+Paths shapeToPaths(const Shape& shape, double circleTolerance) {
+    Paths paths;
+    Path outline = shapeToPath(shape, circleTolerance);
+    if (outline.empty())
+        return paths;
+    paths.push_back(std::move(outline));
+    if (auto pg = dynamic_cast<const Polygon*>(&shape)) {
+        for (std::size_t h = 0; h < pg->holes.size(); ++h) {
+            std::size_t last = h + 1 < pg->holes.size() ? pg->holes[h + 1] : pg->count;
+            Path hole;
+            hole.reserve(last - pg->holes[h]);
+            for (std::size_t i = pg->holes[h]; i < last; ++i)
+                hole.push_back(IntPoint{ pg->pool->xs[pg->offset + i], pg->pool->ys[pg->offset + i] });
+            paths.push_back(std::move(hole));
+        }
+    }
+    return paths;
+}
+
+std::vector<Paths> groupRings(Paths rings) {
+    struct Ring {
+        Path path;
+        double area;
+        int minX, minY, maxX, maxY;
+    };
+    std::vector<Ring> outers, holes;
+    for (auto& path : rings) {
+        if (path.empty())
+            continue;
+        Ring ring{ std::move(path), 0.0, INT_MAX, INT_MAX, INT_MIN, INT_MIN };
+        ring.area = signedArea2(ring.path);
+        for (const IntPoint& p : ring.path) {
+            ring.minX = std::min(ring.minX, p.x);
+            ring.minY = std::min(ring.minY, p.y);
+            ring.maxX = std::max(ring.maxX, p.x);
+            ring.maxY = std::max(ring.maxY, p.y);
+        }
+        (ring.area < 0.0 ? holes : outers).push_back(std::move(ring));
+    }
+    // Smallest first, so the first outer ring found around a hole is the one it belongs to
+    std::sort(outers.begin(), outers.end(), [](const Ring& a, const Ring& b) { return a.area < b.area; });
+
+    // +1 inside, -1 outside, 0 on the outline
+    auto side = [](const Path& ring, const IntPoint& p) {
+        bool inside = false;
+        for (std::size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++) {
+            const IntPoint& a = ring[j];
+            const IntPoint& b = ring[i];
+            int turn = orient2d(a.x, a.y, b.x, b.y, p.x, p.y);
+            if (turn == 0 && pointOnSegment(p.x, p.y, a.x, a.y, b.x, b.y))
+                return 0;
+            if ((b.y > p.y) != (a.y > p.y) && (b.y > a.y ? turn > 0 : turn < 0))
+                inside = !inside;
+        }
+        return inside ? 1 : -1;
+    };
+
+    std::vector<Paths> polygons(outers.size());
+    for (std::size_t i = 0; i < outers.size(); ++i)
+        polygons[i].push_back(std::move(outers[i].path));
+    for (auto& hole : holes) {
+        for (std::size_t i = 0; i < outers.size(); ++i) {
+            const Ring& outer = outers[i];
+            if (hole.minX < outer.minX || hole.maxX > outer.maxX || hole.minY < outer.minY || hole.maxY > outer.maxY)
+                continue;
+            // Holes may touch their outline at a vertex; any other vertex decides
+            int found = 0;
+            for (const IntPoint& p : hole.path) {
+                found = side(polygons[i].front(), p);
+                if (found != 0)
+                    break;
+            }
+            if (found >= 0) {
+                polygons[i].push_back(std::move(hole.path));
+                break;
+            }
+        }
+    }
+    return polygons;
+}
+
+Paths polygonBoolean(const Paths& subject, const Paths& clip, BooleanOp op, unsigned threads) {
+    std::vector<Edge> edges;
+    addEdges(subject, 0, edges);
+    addEdges(clip, 1, edges);
+    if (edges.empty())
+        return Paths();
+
+    std::vector<int> scanlines;
+    scanlines.reserve(edges.size() * 2);
+    for (const auto& e : edges) {
+        scanlines.push_back(e.y0);
+        scanlines.push_back(e.y1);
+    }
+    std::sort(scanlines.begin(), scanlines.end());
+    scanlines.erase(std::unique(scanlines.begin(), scanlines.end()), scanlines.end());
+    std::size_t beams = scanlines.size() - 1;
+
+    // Balance strips by the number of active edges per beam.
+    std::vector<long long> load(beams + 1, 0);
+    for (const auto& e : edges) {
+        std::size_t a = std::lower_bound(scanlines.begin(), scanlines.end(), e.y0) - scanlines.begin();
+        std::size_t b = std::lower_bound(scanlines.begin(), scanlines.end(), e.y1) - scanlines.begin();
+        load[a] += 1;
+        load[b] -= 1;
+    }
+    long long total = 0, running = 0;
+    for (std::size_t k = 0; k < beams; ++k) {
+        running += load[k];
+        load[k] = running + 1;
+        total += load[k];
+    }
+
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t stripCount = std::min<std::size_t>(beams, threads == 1 ? 1 : threads * 4);
+    std::vector<std::size_t> bounds(1, 0);
+    long long accumulated = 0;
+    for (std::size_t k = 0; k < beams; ++k) {
+        accumulated += load[k];
+        if (accumulated * static_cast<long long>(stripCount) >= total * static_cast<long long>(bounds.size()) &&
+            k + 1 < beams)
+            bounds.push_back(k + 1);
+    }
+    bounds.push_back(beams);
+    stripCount = bounds.size() - 1;
+
+    // One task per strip: with several strips per thread, idle workers steal
+    // the remaining strips and uneven ones balance out
+    std::vector<StripResult> strips(stripCount);
+    TaskScheduler::shared().parallelFor(stripCount, 1, [&](std::size_t first, std::size_t last) {
+        for (std::size_t s = first; s < last; ++s)
+            strips[s] = clipStrip(edges, scanlines, bounds[s], bounds[s + 1], op);
+    }, TaskPriority::Normal);
+
+    // Stitch the strips together along their shared scanlines.
+    std::vector<Segment> segments;
+    std::vector<Interval> none;
+    for (std::size_t s = 0; s < stripCount; ++s) {
+        const std::vector<Interval>& below = s == 0 ? none : strips[s - 1].lastTop;
+        cancelHorizontals(scanlines[bounds[s]], strips[s].firstBottom, below, segments);
+        segments.insert(segments.end(), strips[s].segments.begin(), strips[s].segments.end());
+        std::vector<Segment>().swap(strips[s].segments);
+    }
+    cancelHorizontals(scanlines[beams], none, strips.back().lastTop, segments);
+
+    return buildRings(segments);
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "Shape.h"
+
+enum class BooleanOp {
+    Union,
+    Intersection,
+    Difference,
+    Xor
+};
+
+struct IntPoint {
+    int x, y;
+};
+
+using Path = std::vector<IntPoint>;
+using Paths = std::vector<Path>;
+
+// Twice the signed area of a ring (positive when counter-clockwise in y-up terms).
+// Exact in sign and in being zero for any int coordinates; the magnitude is
+// rounded to double.
+double signedArea2(const Path& path);
+
+// Number of segments needed to keep the chord error of a circle below `tolerance`.
+std::size_t circleSegments(int radius, double tolerance = 0.5);
+Path tessellateCircle(int cx, int cy, int radius, std::size_t segments);
+
+// Outer ring of a closed shape (Rectangle, Circle tessellated, Polygon),
+// counter-clockwise so that overlapping outlines add up under nonzero fill.
+// Open shapes yield an empty path.
+Path shapeToPath(const Shape& shape, double circleTolerance = 0.5);
+
+// Every ring of a closed shape: the outer ring as above, then the holes of a
+// polygon, clockwise. Open shapes yield no paths.
+Paths shapeToPaths(const Shape& shape, double circleTolerance = 0.5);
+
+// Boolean operation on integer polygons using a scanbeam (Vatti-style) sweep.
+// Both inputs use the nonzero fill rule, so overlapping rings inside one operand
+// are merged. The sweep is split into horizontal strips of scanbeams that are
+// clipped on `threads` workers (0 = hardware concurrency) and stitched afterwards.
+// Result rings use the same orientation convention as signedArea2: outer
+// boundaries have positive area, holes negative.
+Paths polygonBoolean(const Paths& subject, const Paths& clip, BooleanOp op, unsigned threads = 0);
+
+// Sorts the rings of a boolean result into polygons: each outer ring followed
+// by the holes directly inside it.
+std::vector<Paths> groupRings(Paths rings);
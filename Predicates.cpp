@@ -0,0 +1,243 @@
+#include "Predicates.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+namespace {
+
+// Half an ulp of 1.0, and the a-priori error bounds from Shewchuk's
+// "Adaptive Precision Floating-Point Arithmetic and Fast Robust Geometric Predicates".
+const double kEpsilon = 1.1102230246251565e-16;
+const double kIncircleBound = (10.0 + 96.0 * kEpsilon) * kEpsilon;
+
+thread_local PredicateStats stats;
+
+// Two's complement 128-bit integer, just enough for sums of 64x64-bit products.
+struct Int128 {
+    std::uint64_t lo;
+    std::int64_t hi;
+};
+
+Int128 mul64(std::int64_t a, std::int64_t b) {
+    bool negative = (a < 0) != (b < 0);
+    std::uint64_t ua = a < 0 ? 0 - static_cast<std::uint64_t>(a) : static_cast<std::uint64_t>(a);
+    std::uint64_t ub = b < 0 ? 0 - static_cast<std::uint64_t>(b) : static_cast<std::uint64_t>(b);
+
+    std::uint64_t aLo = ua & 0xffffffffu, aHi = ua >> 32;
+    std::uint64_t bLo = ub & 0xffffffffu, bHi = ub >> 32;
+    std::uint64_t ll = aLo * bLo, lh = aLo * bHi, hl = aHi * bLo, hh = aHi * bHi;
+    std::uint64_t mid = (ll >> 32) + (lh & 0xffffffffu) + (hl & 0xffffffffu);
+    std::uint64_t lo = (mid << 32) | (ll & 0xffffffffu);
+    std::uint64_t hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+
+    if (negative) {
+        lo = ~lo + 1;
+        hi = ~hi + (lo == 0 ? 1 : 0);
+    }
+    return Int128{ lo, static_cast<std::int64_t>(hi) };
+}
+
+Int128 add(Int128 a, Int128 b) {
+    std::uint64_t lo = a.lo + b.lo;
+    std::uint64_t carry = lo < a.lo ? 1 : 0;
+    return Int128{ lo, static_cast<std::int64_t>(static_cast<std::uint64_t>(a.hi) + static_cast<std::uint64_t>(b.hi) + carry) };
+}
+
+Int128 negate(Int128 a) {
+    std::uint64_t lo = ~a.lo + 1;
+    std::uint64_t hi = ~static_cast<std::uint64_t>(a.hi) + (lo == 0 ? 1 : 0);
+    return Int128{ lo, static_cast<std::int64_t>(hi) };
+}
+
+int sign(Int128 a) {
+    if (a.hi < 0)
+        return -1;
+    return (a.hi == 0 && a.lo == 0) ? 0 : 1;
+}
+
+// 256-bit two's complement integer for the incircle determinant when coordinate
+// differences exceed 30 bits and the lifted terms no longer fit 64-bit factors.
+struct Int256 {
+    std::uint32_t limb[8];
+
+    explicit Int256(std::int64_t v) {
+        std::uint64_t u = static_cast<std::uint64_t>(v);
+        limb[0] = static_cast<std::uint32_t>(u);
+        limb[1] = static_cast<std::uint32_t>(u >> 32);
+        std::uint32_t fill = v < 0 ? 0xffffffffu : 0;
+        for (int i = 2; i < 8; ++i)
+            limb[i] = fill;
+    }
+
+    bool negative() const {
+        return (limb[7] & 0x80000000u) != 0;
+    }
+
+    Int256 operator-() const {
+        Int256 r(0);
+        std::uint64_t carry = 1;
+        for (int i = 0; i < 8; ++i) {
+            std::uint64_t v = static_cast<std::uint64_t>(static_cast<std::uint32_t>(~limb[i])) + carry;
+            r.limb[i] = static_cast<std::uint32_t>(v);
+            carry = v >> 32;
+        }
+        return r;
+    }
+
+    Int256 operator+(const Int256& o) const {
+        Int256 r(0);
+        std::uint64_t carry = 0;
+        for (int i = 0; i < 8; ++i) {
+            std::uint64_t v = static_cast<std::uint64_t>(limb[i]) + o.limb[i] + carry;
+            r.limb[i] = static_cast<std::uint32_t>(v);
+            carry = v >> 32;
+        }
+        return r;
+    }
+
+    Int256 operator-(const Int256& o) const {
+        return *this + (-o);
+    }
+
+    Int256 operator*(const Int256& o) const {
+        Int256 a = negative() ? -*this : *this;
+        Int256 b = o.negative() ? -o : o;
+        Int256 r(0);
+        for (int i = 0; i < 8; ++i) {
+            std::uint64_t carry = 0;
+            for (int j = 0; i + j < 8; ++j) {
+                std::uint64_t v = static_cast<std::uint64_t>(a.limb[i]) * b.limb[j] + r.limb[i + j] + carry;
+                r.limb[i + j] = static_cast<std::uint32_t>(v);
+                carry = v >> 32;
+            }
+        }
+        return negative() != o.negative() ? -r : r;
+    }
+
+    int sign() const {
+        if (negative())
+            return -1;
+        for (int i = 0; i < 8; ++i) {
+            if (limb[i] != 0)
+                return 1;
+        }
+        return 0;
+    }
+};
+
+bool fits(std::int64_t v, int bits) {
+    std::int64_t limit = static_cast<std::int64_t>(1) << bits;
+    return v > -limit && v < limit;
+}
+
+int incircleFilter(int ax, int ay, int bx, int by, int cx, int cy, int dx, int dy, bool& certain) {
+    double adx = static_cast<double>(ax) - dx, ady = static_cast<double>(ay) - dy;
+    double bdx = static_cast<double>(bx) - dx, bdy = static_cast<double>(by) - dy;
+    double cdx = static_cast<double>(cx) - dx, cdy = static_cast<double>(cy) - dy;
+
+    double bdxcdy = bdx * cdy, cdxbdy = cdx * bdy, alift = adx * adx + ady * ady;
+    double cdxady = cdx * ady, adxcdy = adx * cdy, blift = bdx * bdx + bdy * bdy;
+    double adxbdy = adx * bdy, bdxady = bdx * ady, clift = cdx * cdx + cdy * cdy;
+
+    double det = alift * (bdxcdy - cdxbdy) + blift * (cdxady - adxcdy) + clift * (adxbdy - bdxady);
+    double permanent = (std::fabs(bdxcdy) + std::fabs(cdxbdy)) * alift +
+        (std::fabs(cdxady) + std::fabs(adxcdy)) * blift +
+        (std::fabs(adxbdy) + std::fabs(bdxady)) * clift;
+    double bound = kIncircleBound * permanent;
+    certain = det > bound || -det > bound || permanent == 0.0;
+    return det > 0 ? 1 : (det < 0 ? -1 : 0);
+}
+
+}
+
+// No floating-point filter here: on int input the 64-bit determinant below is
+// exact and cheaper than the filter, and the 128-bit products are needed only
+// for points more than 2^30 apart.
+int orient2d(int ax, int ay, int bx, int by, int cx, int cy) {
+    std::int64_t acx = static_cast<std::int64_t>(ax) - cx, acy = static_cast<std::int64_t>(ay) - cy;
+    std::int64_t bcx = static_cast<std::int64_t>(bx) - cx, bcy = static_cast<std::int64_t>(by) - cy;
+    if (fits(acx, 31) && fits(acy, 31) && fits(bcx, 31) && fits(bcy, 31)) {
+        std::int64_t det = acx * bcy - acy * bcx;
+        return det > 0 ? 1 : (det < 0 ? -1 : 0);
+    }
+    return sign(add(mul64(acx, bcy), negate(mul64(acy, bcx))));
+}
+
+int incircleExact(int ax, int ay, int bx, int by, int cx, int cy, int dx, int dy) {
+    std::int64_t adx = static_cast<std::int64_t>(ax) - dx, ady = static_cast<std::int64_t>(ay) - dy;
+    std::int64_t bdx = static_cast<std::int64_t>(bx) - dx, bdy = static_cast<std::int64_t>(by) - dy;
+    std::int64_t cdx = static_cast<std::int64_t>(cx) - dx, cdy = static_cast<std::int64_t>(cy) - dy;
+
+    if (fits(adx, 30) && fits(ady, 30) && fits(bdx, 30) && fits(bdy, 30) && fits(cdx, 30) && fits(cdy, 30)) {
+        // Lifts and 2x2 minors stay below 2^61, so every product fits 128 bits.
+        std::int64_t alift = adx * adx + ady * ady;
+        std::int64_t blift = bdx * bdx + bdy * bdy;
+        std::int64_t clift = cdx * cdx + cdy * cdy;
+        Int128 det = mul64(alift, bdx * cdy - cdx * bdy);
+        det = add(det, mul64(blift, cdx * ady - adx * cdy));
+        det = add(det, mul64(clift, adx * bdy - bdx * ady));
+        return sign(det);
+    }
+
+    Int256 ax_(adx), ay_(ady), bx_(bdx), by_(bdy), cx_(cdx), cy_(cdy);
+    Int256 det = (ax_ * ax_ + ay_ * ay_) * (bx_ * cy_ - cx_ * by_) +
+        (bx_ * bx_ + by_ * by_) * (cx_ * ay_ - ax_ * cy_) +
+        (cx_ * cx_ + cy_ * cy_) * (ax_ * by_ - bx_ * ay_);
+    return det.sign();
+}
+
+int incircle(int ax, int ay, int bx, int by, int cx, int cy, int dx, int dy) {
+    bool certain;
+    int result = incircleFilter(ax, ay, bx, by, cx, cy, dx, dy, certain);
+    if (certain) {
+        ++stats.filtered;
+        return result;
+    }
+    ++stats.exact;
+    return incircleExact(ax, ay, bx, by, cx, cy, dx, dy);
+}
+
+bool pointOnSegment(int px, int py, int ax, int ay, int bx, int by) {
+    if (px < std::min(ax, bx) || px > std::max(ax, bx) || py < std::min(ay, by) || py > std::max(ay, by))
+        return false;
+    return orient2d(ax, ay, bx, by, px, py) == 0;
+}
+
+SegmentIntersection segmentIntersection(int ax, int ay, int bx, int by, int cx, int cy, int dx, int dy) {
+    if (std::max(ax, bx) < std::min(cx, dx) || std::max(cx, dx) < std::min(ax, bx) ||
+        std::max(ay, by) < std::min(cy, dy) || std::max(cy, dy) < std::min(ay, by))
+        return SegmentIntersection::None;
+
+    int o1 = orient2d(ax, ay, bx, by, cx, cy);
+    int o2 = orient2d(ax, ay, bx, by, dx, dy);
+    int o3 = orient2d(cx, cy, dx, dy, ax, ay);
+    int o4 = orient2d(cx, cy, dx, dy, bx, by);
+
+    if (o1 == 0 && o2 == 0 && o3 == 0 && o4 == 0) {
+        // Collinear (or degenerate): compare the projections on the dominant axis.
+        bool useX = std::abs(static_cast<long long>(bx) - ax) + std::abs(static_cast<long long>(dx) - cx) >=
+            std::abs(static_cast<long long>(by) - ay) + std::abs(static_cast<long long>(dy) - cy);
+        long long a0 = useX ? ax : ay, a1 = useX ? bx : by;
+        long long c0 = useX ? cx : cy, c1 = useX ? dx : dy;
+        long long lo = std::max(std::min(a0, a1), std::min(c0, c1));
+        long long hi = std::min(std::max(a0, a1), std::max(c0, c1));
+        if (lo > hi)
+            return SegmentIntersection::None;
+        return lo == hi ? SegmentIntersection::Touch : SegmentIntersection::Overlap;
+    }
+
+    if ((o1 > 0 && o2 > 0) || (o1 < 0 && o2 < 0) || (o3 > 0 && o4 > 0) || (o3 < 0 && o4 < 0))
+        return SegmentIntersection::None;
+    if (o1 == 0 || o2 == 0 || o3 == 0 || o4 == 0)
+        return SegmentIntersection::Touch;
+    return SegmentIntersection::Proper;
+}
+
+PredicateStats predicateStats() {
+    return stats;
+}
+
+void resetPredicateStats() {
+    stats = PredicateStats();
+}
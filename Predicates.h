@@ -0,0 +1,40 @@
+#pragma once
+
+// Robust geometric predicates on integer coordinates, always exact. incircle
+// first evaluates in double precision with a forward error bound (Shewchuk-style
+// filter) and only falls back to exact integer arithmetic (128-bit or wider
+// products) when the filter cannot certify the sign. orient2d goes straight to
+// its exact 64-bit determinant, which costs less than the filter would.
+
+// +1 when a, b, c turn counter-clockwise (y-up), -1 when clockwise, 0 when collinear.
+int orient2d(int ax, int ay, int bx, int by, int cx, int cy);
+
+// +1 when d lies inside the circle through a, b, c (given counter-clockwise),
+// -1 when outside, 0 when cocircular. The sign flips for clockwise a, b, c.
+int incircle(int ax, int ay, int bx, int by, int cx, int cy, int dx, int dy);
+
+enum class SegmentIntersection {
+    None,
+    Proper,  // the segments cross at a single interior point
+    Touch,   // they meet at an endpoint of one of them
+    Overlap  // collinear with a shared stretch
+};
+
+SegmentIntersection segmentIntersection(int ax, int ay, int bx, int by, int cx, int cy, int dx, int dy);
+
+// True when p lies on the closed segment a-b.
+bool pointOnSegment(int px, int py, int ax, int ay, int bx, int by);
+
+// Always-exact incircle, used by the benchmarks as the unfiltered baseline.
+int incircleExact(int ax, int ay, int bx, int by, int cx, int cy, int dx, int dy);
+
+// How often the incircle filter decided on its own. Counters are per
+// thread so the hot path never touches shared cache lines.
+struct PredicateStats {
+    unsigned long long filtered = 0;
+    unsigned long long exact = 0;
+};
+
+PredicateStats predicateStats();
+void resetPredicateStats();
+
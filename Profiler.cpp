@@ -0,0 +1,154 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+namespace {
+
+const std::size_t kRingCapacity = 1 << 15; // per thread; about nine minutes of frames at 60 Hz
+
+class SampleRing {
+public:
+    explicit SampleRing(std::uint32_t thread_) : thread(thread_), samples(new ProfileSample[kRingCapacity]) {}
+
+    void push(ProfileStage stage, std::uint64_t startNs, std::uint64_t durationNs) {
+        std::uint64_t n = written.load(std::memory_order_relaxed);
+        samples[n & (kRingCapacity - 1)] = ProfileSample{ startNs, durationNs, stage, thread };
+        written.store(n + 1, std::memory_order_release);
+    }
+
+    void copyRecent(std::size_t max, std::vector<ProfileSample>& out) const {
+        std::uint64_t end = written.load(std::memory_order_acquire);
+        std::uint64_t count = std::min<std::uint64_t>(end, std::min<std::uint64_t>(max, kRingCapacity));
+        std::size_t first = out.size();
+        for (std::uint64_t i = end - count; i < end; ++i)
+            out.push_back(samples[i & (kRingCapacity - 1)]);
+        // Slots the writer lapped while we copied hold newer data; drop them
+        std::uint64_t after = written.load(std::memory_order_acquire);
+        std::uint64_t oldestIntact = after > kRingCapacity ? after - kRingCapacity : 0;
+        if (end - count < oldestIntact) {
+            std::size_t lost = static_cast<std::size_t>(std::min<std::uint64_t>(count, oldestIntact - (end - count)));
+            out.erase(out.begin() + first, out.begin() + first + lost);
+        }
+    }
+
+private:
+    std::uint32_t thread;
+    std::unique_ptr<ProfileSample[]> samples;
+    std::atomic<std::uint64_t> written{ 0 };
+};
+
+std::atomic<bool> profilingOn{ false };
+const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+// Rings live until exit so readers never see one disappear; the mutex is only
+// taken when a thread records for the first time and when reading.
+std::mutex ringsMutex;
+std::vector<std::unique_ptr<SampleRing>>& rings() {
+    static std::vector<std::unique_ptr<SampleRing>> all;
+    return all;
+}
+
+SampleRing& threadRing() {
+    thread_local SampleRing* ring = nullptr;
+    if (!ring) {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        rings().push_back(std::unique_ptr<SampleRing>(new SampleRing(static_cast<std::uint32_t>(rings().size() + 1))));
+        ring = rings().back().get();
+    }
+    return *ring;
+}
+
+}
+
+const char* profileStageName(ProfileStage stage) {
+    switch (stage) {
+    case ProfileStage::Frame: return "frame";
+    case ProfileStage::Events: return "events";
+    case ProfileStage::Lock: return "lock";
+    case ProfileStage::Traversal: return "traversal";
+    case ProfileStage::Tessellation: return "tessellation";
+    case ProfileStage::Submission: return "submission";
+    case ProfileStage::Display: return "display";
+    default: return "unknown";
+    }
+}
+
+void setProfilingEnabled(bool enabled) {
+    profilingOn.store(enabled, std::memory_order_relaxed);
+}
+
+bool profilingEnabled() {
+    return profilingOn.load(std::memory_order_relaxed);
+}
+
+std::uint64_t profileNowNs() {
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - epoch).count());
+}
+
+void profileRecord(ProfileStage stage, std::uint64_t startNs, std::uint64_t durationNs) {
+    if (profilingEnabled())
+        threadRing().push(stage, startNs, durationNs);
+}
+
+std::vector<ProfileSample> profileSnapshot(std::size_t maxPerThread) {
+    std::vector<ProfileSample> out;
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    for (const auto& ring : rings())
+        ring->copyRecent(maxPerThread, out);
+    return out;
+}
+
+ProfileStageStats profileStageStats(ProfileStage stage, std::size_t window) {
+    // Every stage of a frame is recorded, so the last window * stage-count
+    // samples per thread cover at least `window` samples of this stage
+    std::vector<ProfileSample> samples = profileSnapshot(window * static_cast<std::size_t>(ProfileStage::Count));
+    std::vector<std::uint64_t> durations;
+    for (auto it = samples.rbegin(); it != samples.rend() && durations.size() < window; ++it) {
+        if (it->stage == stage)
+            durations.push_back(it->durationNs);
+    }
+
+    ProfileStageStats stats;
+    stats.samples = durations.size();
+    if (durations.empty())
+        return stats;
+    std::sort(durations.begin(), durations.end());
+    auto at = [&](double q) {
+        std::size_t i = static_cast<std::size_t>(q * static_cast<double>(durations.size() - 1) + 0.5);
+        return static_cast<double>(durations[i]) / 1e6;
+    };
+    stats.p50Ms = at(0.50);
+    stats.p95Ms = at(0.95);
+    stats.p99Ms = at(0.99);
+    stats.maxMs = static_cast<double>(durations.back()) / 1e6;
+    return stats;
+}
+
+bool exportChromeTrace(const std::string& path) {
+    std::ofstream out(path);
+    if (!out)
+        return false;
+    std::vector<ProfileSample> samples = profileSnapshot(kRingCapacity);
+    out << "{\"traceEvents\":[\n";
+    for (std::size_t i = 0; i < samples.size(); ++i) {
+        const ProfileSample& s = samples[i];
+        out << "{\"name\":\"" << profileStageName(s.stage) << "\",\"cat\":\"frame\",\"ph\":\"X\",\"ts\":"
+            << static_cast<double>(s.startNs) / 1000.0 << ",\"dur\":" << static_cast<double>(s.durationNs) / 1000.0
+            << ",\"pid\":1,\"tid\":" << s.thread << "}" << (i + 1 < samples.size() ? ",\n" : "\n");
+    }
+    out << "],\"displayTimeUnit\":\"ms\"}\n";
+    return static_cast<bool>(out);
+}
+
+ProfileScope::ProfileScope(ProfileStage stage_)
+    : stage(stage_), active(profilingEnabled()), start(active ? profileNowNs() : 0) {}
+
+ProfileScope::~ProfileScope() {
+    if (active)
+        profileRecord(stage, start, profileNowNs() - start);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Stages of a frame that can be timed. Names are in profileStageName().
+enum class ProfileStage : std::uint8_t {
+    Frame,
+    Events,       // window.pollEvent loop
+    Lock,         // waiting for the shape lock
+    Traversal,    // index refresh and visible-set collection
+    Tessellation, // building vertex batches and heatmaps
+    Submission,   // draw calls
+    Display,      // window.display(), including vsync waits
+    Count
+};
+
+const char* profileStageName(ProfileStage stage);
+
+struct ProfileSample {
+    std::uint64_t startNs;    // since the profiler epoch
+    std::uint64_t durationNs;
+    ProfileStage stage;
+    std::uint32_t thread;     // small per-profiler thread number
+};
+
+// Frame profiler. Every thread that records gets its own fixed-size ring of
+// samples, written without locks or atomic read-modify-write: the owner writes
+// the slot, then publishes it with a release store of the write counter.
+// Readers copy a range and re-check the counter to drop slots that were
+// overwritten while copying. Recording is a no-op while disabled.
+void setProfilingEnabled(bool enabled);
+bool profilingEnabled();
+std::uint64_t profileNowNs();
+void profileRecord(ProfileStage stage, std::uint64_t startNs, std::uint64_t durationNs);
+
+// Up to `maxPerThread` most recent samples of every thread, oldest first per thread.
+std::vector<ProfileSample> profileSnapshot(std::size_t maxPerThread);
+
+struct ProfileStageStats {
+    std::size_t samples = 0;
+    double p50Ms = 0, p95Ms = 0, p99Ms = 0, maxMs = 0;
+};
+
+// Rolling percentiles over the last `window` samples of `stage` across threads.
+ProfileStageStats profileStageStats(ProfileStage stage, std::size_t window);
+
+// Writes every retained sample as Chrome trace-event JSON ("X" complete events,
+// microsecond timestamps) viewable in chrome://tracing or Perfetto.
+bool exportChromeTrace(const std::string& path);
+
+// Times the enclosing scope as one sample of `stage`.
+class ProfileScope {
+public:
+    explicit ProfileScope(ProfileStage stage);
+    ~ProfileScope();
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    ProfileStage stage;
+    bool active; // profiling was on at construction
+    std::uint64_t start;
+};
@@ -0,0 +1,449 @@
+#include "Raster.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include "Block.h"
+#include "PolygonBoolean.h"
+#include "ShapeArray.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MINICAD_AVX2 1
+#endif
+
+namespace {
+
+inline float clamp01(float v) {
+    return std::min(1.f, std::max(0.f, v));
+}
+
+// Pixel index at or below `v`, clamped to [-1, limit] while still a float: a
+// coordinate far off the image (or NaN) must never reach the int conversion.
+inline int pixelFloor(float v, int limit) {
+    return static_cast<int>(std::floor(std::min(static_cast<float>(limit), std::max(-1.f, v))));
+}
+
+inline int pixelCeil(float v, int limit) {
+    return static_cast<int>(std::ceil(std::min(static_cast<float>(limit), std::max(-1.f, v))));
+}
+
+// A rounded scene coordinate clamped to int range.
+inline int clampedCoordinate(double v) {
+    return static_cast<int>(std::max<double>(INT_MIN, std::min<double>(INT_MAX, v)));
+}
+
+#if defined(MINICAD_AVX2)
+inline __m256 abs8(__m256 v) {
+    return _mm256_andnot_ps(_mm256_set1_ps(-0.f), v);
+}
+
+inline __m256 clamp01(__m256 v) {
+    return _mm256_min_ps(_mm256_set1_ps(1.f), _mm256_max_ps(_mm256_setzero_ps(), v));
+}
+#endif
+
+// Each coverage function maps a pixel center to the fraction of the pixel the
+// stroke covers: 1 within the stroke, falling linearly to 0 over one pixel
+// past its edge. `reach` is half the stroke width plus half a pixel.
+
+// Segment with butt ends; (dx, dy) is the unit direction.
+struct SegmentCoverage {
+    float x0, y0, dx, dy, length, reach;
+
+    float at(float x, float y) const {
+        float px = x - x0, py = y - y0;
+        float along = px * dx + py * dy, across = std::fabs(px * dy - py * dx);
+        return clamp01(reach - across) * clamp01(along + 0.5f) * clamp01(length - along + 0.5f);
+    }
+#if defined(MINICAD_AVX2)
+    __m256 at(__m256 x, __m256 y) const {
+        __m256 px = _mm256_sub_ps(x, _mm256_set1_ps(x0)), py = _mm256_sub_ps(y, _mm256_set1_ps(y0));
+        __m256 vdx = _mm256_set1_ps(dx), vdy = _mm256_set1_ps(dy), half = _mm256_set1_ps(0.5f);
+        __m256 along = _mm256_add_ps(_mm256_mul_ps(px, vdx), _mm256_mul_ps(py, vdy));
+        __m256 across = abs8(_mm256_sub_ps(_mm256_mul_ps(px, vdy), _mm256_mul_ps(py, vdx)));
+        __m256 side = clamp01(_mm256_sub_ps(_mm256_set1_ps(reach), across));
+        __m256 start = clamp01(_mm256_add_ps(along, half));
+        __m256 end = clamp01(_mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps(length), along), half));
+        return _mm256_mul_ps(_mm256_mul_ps(side, start), end);
+    }
+#endif
+};
+
+struct RingCoverage {
+    float cx, cy, radius, reach;
+
+    float at(float x, float y) const {
+        float px = x - cx, py = y - cy;
+        return clamp01(reach - std::fabs(std::sqrt(px * px + py * py) - radius));
+    }
+#if defined(MINICAD_AVX2)
+    __m256 at(__m256 x, __m256 y) const {
+        __m256 px = _mm256_sub_ps(x, _mm256_set1_ps(cx)), py = _mm256_sub_ps(y, _mm256_set1_ps(cy));
+        __m256 d = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(px, px), _mm256_mul_ps(py, py)));
+        return clamp01(_mm256_sub_ps(_mm256_set1_ps(reach), abs8(_mm256_sub_ps(d, _mm256_set1_ps(radius)))));
+    }
+#endif
+};
+
+// Rectangle outline around center (cx, cy) with half extents (hx, hy). The
+// Chebyshev distance to the outline gives square (mitered) outer corners.
+struct BoxCoverage {
+    float cx, cy, hx, hy, reach;
+
+    float at(float x, float y) const {
+        float ex = std::fabs(x - cx) - hx, ey = std::fabs(y - cy) - hy;
+        return clamp01(reach - std::fabs(std::max(ex, ey)));
+    }
+#if defined(MINICAD_AVX2)
+    __m256 at(__m256 x, __m256 y) const {
+        __m256 ex = _mm256_sub_ps(abs8(_mm256_sub_ps(x, _mm256_set1_ps(cx))), _mm256_set1_ps(hx));
+        __m256 ey = _mm256_sub_ps(abs8(_mm256_sub_ps(y, _mm256_set1_ps(cy))), _mm256_set1_ps(hy));
+        return clamp01(_mm256_sub_ps(_mm256_set1_ps(reach), abs8(_mm256_max_ps(ex, ey))));
+    }
+#endif
+};
+
+// Source-over with straight alpha on one RGBA pixel.
+inline void blendPixel(std::uint8_t* px, float coverage, RasterColor color) {
+    float sa = coverage * color.a * (1.f / 255.f);
+    if (sa <= 0.f)
+        return;
+    float keep = px[3] * (1.f / 255.f) * (1.f - sa), outA = sa + keep, inverse = 1.f / outA;
+    px[0] = static_cast<std::uint8_t>((color.r * sa + px[0] * keep) * inverse + 0.5f);
+    px[1] = static_cast<std::uint8_t>((color.g * sa + px[1] * keep) * inverse + 0.5f);
+    px[2] = static_cast<std::uint8_t>((color.b * sa + px[2] * keep) * inverse + 0.5f);
+    px[3] = static_cast<std::uint8_t>(outA * 255.f + 0.5f);
+}
+
+#if defined(MINICAD_AVX2)
+// blendPixel for eight pixels held as little-endian RGBA words.
+inline __m256i blend8(__m256i dst, __m256 coverage, RasterColor color) {
+    const __m256i byteMask = _mm256_set1_epi32(0xFF);
+    __m256 sa = _mm256_mul_ps(coverage, _mm256_set1_ps(color.a * (1.f / 255.f)));
+    __m256 da = _mm256_cvtepi32_ps(_mm256_srli_epi32(dst, 24));
+    __m256 keep = _mm256_mul_ps(_mm256_mul_ps(da, _mm256_set1_ps(1.f / 255.f)), _mm256_sub_ps(_mm256_set1_ps(1.f), sa));
+    __m256 outA = _mm256_add_ps(sa, keep);
+    __m256 inverse = _mm256_div_ps(_mm256_set1_ps(1.f), _mm256_max_ps(outA, _mm256_set1_ps(1e-6f)));
+    __m256 half = _mm256_set1_ps(0.5f);
+
+    __m256i result = _mm256_slli_epi32(_mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(outA, _mm256_set1_ps(255.f)), half)), 24);
+    const float source[3] = { static_cast<float>(color.r), static_cast<float>(color.g), static_cast<float>(color.b) };
+    for (int channel = 0; channel < 3; ++channel) {
+        __m256 dc = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(dst, 8 * channel), byteMask));
+        __m256 mixed = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(source[channel]), sa), _mm256_mul_ps(dc, keep));
+        __m256i value = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_mul_ps(mixed, inverse), half));
+        result = _mm256_or_si256(result, _mm256_slli_epi32(_mm256_min_epi32(value, byteMask), 8 * channel));
+    }
+    // Pixels the stroke does not reach keep their exact bytes
+    __m256 touched = _mm256_cmp_ps(sa, _mm256_setzero_ps(), _CMP_GT_OQ);
+    return _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(dst), _mm256_castsi256_ps(result), touched));
+}
+#endif
+
+// Blends the stroke over pixels [x0, x1) of row y, clipped to the image.
+template <typename Coverage>
+void blendRun(RasterImage& image, int y, float x0, float x1, const Coverage& coverage, RasterColor color) {
+    int begin = std::max(0, pixelFloor(x0, static_cast<int>(image.width)));
+    int end = std::min(static_cast<int>(image.width), pixelCeil(x1, static_cast<int>(image.width)));
+    if (y < 0 || y >= static_cast<int>(image.height) || begin >= end)
+        return;
+    std::uint8_t* row = image.rgba.data() + static_cast<std::size_t>(y) * image.width * 4;
+    float cy = static_cast<float>(y) + 0.5f;
+    int x = begin;
+#if defined(MINICAD_AVX2)
+    const __m256 lanes = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+    const __m256i laneIndex = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    __m256 vy = _mm256_set1_ps(cy);
+    for (; x < end; x += 8) {
+        // The last group of a run is loaded and stored under a mask, so runs
+        // never fall back to a scalar tail
+        __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(end - x), laneIndex);
+        __m256 cover = coverage.at(_mm256_add_ps(_mm256_set1_ps(static_cast<float>(x)), lanes), vy);
+        if (_mm256_movemask_ps(_mm256_cmp_ps(cover, _mm256_setzero_ps(), _CMP_GT_OQ)) == 0)
+            continue;
+        int* pixels = reinterpret_cast<int*>(row + static_cast<std::size_t>(x) * 4);
+        _mm256_maskstore_epi32(pixels, mask, blend8(_mm256_maskload_epi32(pixels, mask), cover, color));
+    }
+#endif
+    for (; x < end; ++x)
+        blendPixel(row + static_cast<std::size_t>(x) * 4, coverage.at(static_cast<float>(x) + 0.5f, cy), color);
+}
+
+// Horizontal extent of a convex polygon within the band yLow <= y <= yHigh: its
+// extremes are either vertices inside the band or edge crossings of the band's
+// borders, and both are endpoints of the edges clipped to the band.
+bool convexRowSpan(const float (*polygon)[2], int count, float yLow, float yHigh, float& xMin, float& xMax) {
+    xMin = HUGE_VALF;
+    xMax = -HUGE_VALF;
+    for (int i = 0; i < count; ++i) {
+        const float* a = polygon[i];
+        const float* b = polygon[(i + 1) % count];
+        float low = std::max(yLow, std::min(a[1], b[1])), high = std::min(yHigh, std::max(a[1], b[1]));
+        if (low > high)
+            continue;
+        if (a[1] == b[1]) {
+            xMin = std::min(xMin, std::min(a[0], b[0]));
+            xMax = std::max(xMax, std::max(a[0], b[0]));
+            continue;
+        }
+        float slope = (b[0] - a[0]) / (b[1] - a[1]);
+        float xLow = a[0] + (low - a[1]) * slope, xHigh = a[0] + (high - a[1]) * slope;
+        xMin = std::min(xMin, std::min(xLow, xHigh));
+        xMax = std::max(xMax, std::max(xLow, xHigh));
+    }
+    return xMin <= xMax;
+}
+
+int firstRow(const RasterImage& image, float y) {
+    return std::max(0, pixelFloor(y, static_cast<int>(image.height)));
+}
+
+int lastRow(const RasterImage& image, float y) {
+    return std::min(static_cast<int>(image.height) - 1, pixelFloor(y, static_cast<int>(image.height)));
+}
+
+SegmentCoverage segmentCoverage(double x0, double y0, double x1, double y1, double width) {
+    float dx = static_cast<float>(x1 - x0), dy = static_cast<float>(y1 - y0);
+    float length = std::sqrt(dx * dx + dy * dy);
+    float ux = length > 0.f ? dx / length : 1.f, uy = length > 0.f ? dy / length : 0.f;
+    return SegmentCoverage{ static_cast<float>(x0), static_cast<float>(y0), ux, uy, length,
+        static_cast<float>(std::max(0.0, width)) * 0.5f + 0.5f };
+}
+
+BoxCoverage boxCoverage(double x0, double y0, double x1, double y1, double width) {
+    return BoxCoverage{ static_cast<float>((x0 + x1) * 0.5), static_cast<float>((y0 + y1) * 0.5),
+        static_cast<float>(std::fabs(x1 - x0) * 0.5), static_cast<float>(std::fabs(y1 - y0) * 0.5),
+        static_cast<float>(std::max(0.0, width)) * 0.5f + 0.5f };
+}
+
+RingCoverage ringCoverage(double cx, double cy, double radius, double width) {
+    return RingCoverage{ static_cast<float>(cx), static_cast<float>(cy), static_cast<float>(radius),
+        static_cast<float>(std::max(0.0, width)) * 0.5f + 0.5f };
+}
+
+// Evaluates every pixel of the box [x0, x1) x [y0, y1), clipped to the image.
+template <typename Coverage>
+void referenceFill(RasterImage& image, float x0, float y0, float x1, float y1, const Coverage& coverage, RasterColor color) {
+    int left = std::max(0, pixelFloor(x0, static_cast<int>(image.width)));
+    int right = std::min(static_cast<int>(image.width), pixelCeil(x1, static_cast<int>(image.width)));
+    for (int y = firstRow(image, y0); y <= lastRow(image, y1); ++y) {
+        for (int x = left; x < right; ++x) {
+            std::uint8_t* px = image.rgba.data() + (static_cast<std::size_t>(y) * image.width + x) * 4;
+            blendPixel(px, coverage.at(static_cast<float>(x) + 0.5f, static_cast<float>(y) + 0.5f), color);
+        }
+    }
+}
+
+}
+
+RasterImage::RasterImage(unsigned width, unsigned height, RasterColor background)
+    : width(width), height(height), rgba(static_cast<std::size_t>(width) * height * 4) {
+    for (std::size_t i = 0; i < rgba.size(); i += 4) {
+        rgba[i] = background.r;
+        rgba[i + 1] = background.g;
+        rgba[i + 2] = background.b;
+        rgba[i + 3] = background.a;
+    }
+}
+
+RasterColor RasterImage::pixel(unsigned x, unsigned y) const {
+    const std::uint8_t* px = rgba.data() + (static_cast<std::size_t>(y) * width + x) * 4;
+    return RasterColor{ px[0], px[1], px[2], px[3] };
+}
+
+void rasterLine(RasterImage& image, double x0, double y0, double x1, double y1, double width, RasterColor color) {
+    SegmentCoverage coverage = segmentCoverage(x0, y0, x1, y1, width);
+    // The stroke rectangle grown by a pixel on every side for the fringe
+    float nx = -coverage.dy * (coverage.reach + 0.5f), ny = coverage.dx * (coverage.reach + 0.5f);
+    float ax = static_cast<float>(x0) - coverage.dx, ay = static_cast<float>(y0) - coverage.dy;
+    float bx = static_cast<float>(x1) + coverage.dx, by = static_cast<float>(y1) + coverage.dy;
+    const float quad[4][2] = { { ax + nx, ay + ny }, { bx + nx, by + ny }, { bx - nx, by - ny }, { ax - nx, ay - ny } };
+    float top = std::min(std::min(quad[0][1], quad[1][1]), std::min(quad[2][1], quad[3][1]));
+    float bottom = std::max(std::max(quad[0][1], quad[1][1]), std::max(quad[2][1], quad[3][1]));
+
+    for (int y = firstRow(image, top); y <= lastRow(image, bottom); ++y) {
+        float xMin, xMax;
+        if (convexRowSpan(quad, 4, static_cast<float>(y), static_cast<float>(y + 1), xMin, xMax))
+            blendRun(image, y, xMin, xMax, coverage, color);
+    }
+}
+
+void rasterCircle(RasterImage& image, double cx, double cy, double radius, double width, RasterColor color) {
+    RingCoverage coverage = ringCoverage(cx, cy, radius, width);
+    float outer = coverage.radius + coverage.reach + 0.5f, inner = coverage.radius - coverage.reach - 0.5f;
+
+    for (int y = firstRow(image, coverage.cy - outer); y <= lastRow(image, coverage.cy + outer); ++y) {
+        // Nearest and farthest vertical distance from the center within the row
+        float above = coverage.cy - static_cast<float>(y + 1), below = static_cast<float>(y) - coverage.cy;
+        float nearest = std::max(0.f, std::max(above, below));
+        float farthest = std::max(std::fabs(above), std::fabs(below));
+        if (nearest >= outer)
+            continue;
+        float reachX = std::sqrt(outer * outer - nearest * nearest);
+        float holeX = inner > farthest ? std::sqrt(inner * inner - farthest * farthest) : 0.f;
+        if (holeX >= 1.f) {
+            // The stroke cannot reach the hole on this row: only the two arcs are
+            // visited, kept a pixel apart so that no pixel is blended twice
+            blendRun(image, y, coverage.cx - reachX, coverage.cx - holeX, coverage, color);
+            blendRun(image, y, coverage.cx + holeX, coverage.cx + reachX, coverage, color);
+        }
+        else {
+            blendRun(image, y, coverage.cx - reachX, coverage.cx + reachX, coverage, color);
+        }
+    }
+}
+
+void rasterRectangle(RasterImage& image, double x0, double y0, double x1, double y1, double width, RasterColor color) {
+    BoxCoverage coverage = boxCoverage(x0, y0, x1, y1, width);
+    float pad = coverage.reach + 0.5f;
+    float left = coverage.cx - coverage.hx, right = coverage.cx + coverage.hx;
+    float top = coverage.cy - coverage.hy, bottom = coverage.cy + coverage.hy;
+
+    for (int y = firstRow(image, top - pad); y <= lastRow(image, bottom + pad); ++y) {
+        float rowTop = static_cast<float>(y), rowBottom = static_cast<float>(y + 1);
+        bool horizontalEdge = (rowBottom >= top - pad && rowTop <= top + pad) || (rowBottom >= bottom - pad && rowTop <= bottom + pad);
+        if (horizontalEdge || left + pad + 1.f >= right - pad) {
+            blendRun(image, y, left - pad, right + pad, coverage, color);
+        }
+        else {
+            blendRun(image, y, left - pad, left + pad, coverage, color);
+            blendRun(image, y, right - pad, right + pad, coverage, color);
+        }
+    }
+}
+
+void rasterLineReference(RasterImage& image, double x0, double y0, double x1, double y1, double width, RasterColor color) {
+    SegmentCoverage coverage = segmentCoverage(x0, y0, x1, y1, width);
+    float pad = coverage.reach + 0.5f;
+    referenceFill(image, static_cast<float>(std::min(x0, x1)) - pad, static_cast<float>(std::min(y0, y1)) - pad,
+        static_cast<float>(std::max(x0, x1)) + pad, static_cast<float>(std::max(y0, y1)) + pad, coverage, color);
+}
+
+void rasterCircleReference(RasterImage& image, double cx, double cy, double radius, double width, RasterColor color) {
+    RingCoverage coverage = ringCoverage(cx, cy, radius, width);
+    float outer = coverage.radius + coverage.reach + 0.5f;
+    referenceFill(image, coverage.cx - outer, coverage.cy - outer, coverage.cx + outer, coverage.cy + outer, coverage, color);
+}
+
+void rasterRectangleReference(RasterImage& image, double x0, double y0, double x1, double y1, double width, RasterColor color) {
+    BoxCoverage coverage = boxCoverage(x0, y0, x1, y1, width);
+    float pad = coverage.reach + 0.5f;
+    referenceFill(image, coverage.cx - coverage.hx - pad, coverage.cy - coverage.hy - pad,
+        coverage.cx + coverage.hx + pad, coverage.cy + coverage.hy + pad, coverage, color);
+}
+
+namespace {
+
+// Strokes a shape of a block mapped to pixels by `m`. Rectangles that do not
+// stay axis-aligned are stroked edge by edge and circles that do not stay
+// round as polygons.
+bool rasterPlaced(RasterImage& image, const Shape& shape, const Affine2D& m, double width, RasterColor color) {
+    auto x = [&](double px, double py) { return m.a * px + m.b * py + m.tx; };
+    auto y = [&](double px, double py) { return m.c * px + m.d * py + m.ty; };
+    switch (shape.type()) {
+    case ShapeType::Line: {
+        const Line& l = static_cast<const Line&>(shape);
+        rasterLine(image, x(l.start.x, l.start.y), y(l.start.x, l.start.y), x(l.end.x, l.end.y), y(l.end.x, l.end.y), width, color);
+        return true;
+    }
+    case ShapeType::Rectangle: {
+        const Rectangle& r = static_cast<const Rectangle&>(shape);
+        double x0 = r.topLeft.x, y0 = r.topLeft.y, x1 = x0 + r.width, y1 = y0 + r.height;
+        if (m.isAxisAligned()) {
+            rasterRectangle(image, x(x0, y0), y(x0, y0), x(x1, y1), y(x1, y1), width, color);
+            return true;
+        }
+        const double corners[5][2] = { { x0, y0 }, { x1, y0 }, { x1, y1 }, { x0, y1 }, { x0, y0 } };
+        for (int i = 0; i < 4; ++i) {
+            const double* a = corners[i];
+            const double* b = corners[i + 1];
+            rasterLine(image, x(a[0], a[1]), y(a[0], a[1]), x(b[0], b[1]), y(b[0], b[1]), width, color);
+        }
+        return true;
+    }
+    case ShapeType::Circle: {
+        const Circle& c = static_cast<const Circle&>(shape);
+        double scale = std::sqrt(std::fabs(m.determinant()));
+        if (m.isSimilarity()) {
+            rasterCircle(image, x(c.center.x, c.center.y), y(c.center.x, c.center.y), c.radius * scale, width, color);
+            return true;
+        }
+        std::size_t segments = circleSegments(std::max(1, static_cast<int>(std::min<double>(INT_MAX, std::ceil(c.radius * scale)))), 0.25);
+        double step = 6.283185307179586 / static_cast<double>(segments);
+        for (std::size_t k = 0; k < segments; ++k) {
+            double ax = c.center.x + c.radius * std::cos(step * k), ay = c.center.y + c.radius * std::sin(step * k);
+            double bx = c.center.x + c.radius * std::cos(step * (k + 1)), by = c.center.y + c.radius * std::sin(step * (k + 1));
+            rasterLine(image, x(ax, ay), y(ax, ay), x(bx, by), y(bx, by), width, color);
+        }
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+// Strokes one shape; false for the types rasterShapes skips.
+bool rasterShape(RasterImage& image, const Shape& shape, double originX, double originY, double scale, double width,
+    RasterColor color) {
+    switch (shape.type()) {
+    case ShapeType::Line: {
+        const Line& l = static_cast<const Line&>(shape);
+        rasterLine(image, (l.start.x - originX) * scale, (l.start.y - originY) * scale,
+            (l.end.x - originX) * scale, (l.end.y - originY) * scale, width, color);
+        return true;
+    }
+    case ShapeType::Rectangle: {
+        const Rectangle& r = static_cast<const Rectangle&>(shape);
+        rasterRectangle(image, (r.topLeft.x - originX) * scale, (r.topLeft.y - originY) * scale,
+            (r.topLeft.x + r.width - originX) * scale, (r.topLeft.y + r.height - originY) * scale, width, color);
+        return true;
+    }
+    case ShapeType::Circle: {
+        const Circle& c = static_cast<const Circle&>(shape);
+        rasterCircle(image, (c.center.x - originX) * scale, (c.center.y - originY) * scale, c.radius * scale, width, color);
+        return true;
+    }
+    case ShapeType::Array: {
+        // Only the instances on the image, and at most about one per pixel
+        const ShapeArray& array = static_cast<const ShapeArray&>(shape);
+        Bounds window(clampedCoordinate(std::floor(originX)), clampedCoordinate(std::floor(originY)),
+            clampedCoordinate(std::ceil(originX + image.width / scale)), clampedCoordinate(std::ceil(originY + image.height / scale)));
+        std::size_t columnStride, rowStride;
+        array.strides(1.0 / scale, columnStride, rowStride);
+        std::vector<std::size_t> instances;
+        array.instancesIn(window, instances, false, columnStride, rowStride);
+        bool drawn = false;
+        for (std::size_t k : instances) {
+            Point o = array.offset(k);
+            drawn = rasterShape(image, *array.item, originX - o.x, originY - o.y, scale, width, color) || drawn;
+        }
+        return drawn;
+    }
+    case ShapeType::Reference: {
+        const BlockReference& reference = static_cast<const BlockReference&>(shape);
+        Bounds b = reference.bounds();
+        if ((b.maxX - originX) * scale < 0.0 || (b.minX - originX) * scale > image.width ||
+            (b.maxY - originY) * scale < 0.0 || (b.minY - originY) * scale > image.height)
+            return false;
+        Affine2D toPixels = Affine2D{ scale, 0.0, 0.0, scale, -originX * scale, -originY * scale }.after(reference.placement);
+        bool drawn = false;
+        for (const auto& part : reference.block->shapes)
+            drawn = rasterPlaced(image, *part, toPixels, width, color) || drawn;
+        return drawn;
+    }
+    default:
+        return false;
+    }
+}
+
+}
+
+std::size_t rasterShapes(RasterImage& image, const std::vector<std::shared_ptr<Shape>>& shapes,
+    double originX, double originY, double scale, double width, RasterColor color) {
+    std::size_t drawn = 0;
+    for (const auto& shape : shapes) {
+        if (rasterShape(image, *shape, originX, originY, scale, width, color))
+            ++drawn;
+    }
+    return drawn;
+}
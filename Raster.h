@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Shape.h"
+
+struct RasterColor {
+    std::uint8_t r, g, b, a;
+};
+
+// RGBA bytes with straight (not premultiplied) alpha, rows top to bottom.
+struct RasterImage {
+    unsigned width, height;
+    std::vector<std::uint8_t> rgba;
+
+    RasterImage(unsigned width, unsigned height, RasterColor background = RasterColor{ 0, 0, 0, 0 });
+    RasterColor pixel(unsigned x, unsigned y) const;
+};
+
+// Anti-aliased strokes in pixel coordinates, pixel (x, y) covering the unit
+// square from (x, y). Coverage falls off linearly over the last pixel of the
+// stroke edge, Wu style, and each stroke is alpha-composited over the image
+// with the source-over operator. Only the pixels on each row that the stroke
+// can reach are visited; with AVX2 enabled in the build they are evaluated and
+// blended eight at a time. `width` is the full stroke width in pixels.
+void rasterLine(RasterImage& image, double x0, double y0, double x1, double y1, double width, RasterColor color);
+void rasterCircle(RasterImage& image, double cx, double cy, double radius, double width, RasterColor color);
+// Outline of the axis-aligned rectangle with corners (x0, y0) and (x1, y1), mitered.
+void rasterRectangle(RasterImage& image, double x0, double y0, double x1, double y1, double width, RasterColor color);
+
+// The same strokes evaluated one pixel at a time over their whole bounding box;
+// the reference the benchmark measures and checks the kernels against.
+void rasterLineReference(RasterImage& image, double x0, double y0, double x1, double y1, double width, RasterColor color);
+void rasterCircleReference(RasterImage& image, double cx, double cy, double radius, double width, RasterColor color);
+void rasterRectangleReference(RasterImage& image, double x0, double y0, double x1, double y1, double width, RasterColor color);
+
+// Strokes the Line, Rectangle and Circle shapes of a scene, those in placed
+// blocks, and the instances of arrays of them at most one per pixel; scene
+// point (x, y) lands on pixel ((x - originX) * scale, (y - originY) * scale).
+// Other shape types are skipped. Returns the number of shapes drawn.
+std::size_t rasterShapes(RasterImage& image, const std::vector<std::shared_ptr<Shape>>& shapes,
+    double originX, double originY, double scale, double width, RasterColor color);
@@ -0,0 +1,739 @@
+#include "Scene.h"
+#include <algorithm>
+#include <climits>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+
+namespace {
+
+// Array instances a transform may turn into shapes of their own at once
+const std::size_t kMaxMaterialized = 1 << 20;
+
+// Replaces every closed shape (rectangle, circle, polygon) with the polygons of
+// `op` applied between those shapes and `clip`, leaving the old list in
+// `previous`. Returns the summary line.
+std::string replaceWithBoolean(std::vector<std::shared_ptr<Shape>>& shapes, const std::shared_ptr<VertexPool>& vertexPool,
+    BooleanOp op, const Paths& clip, std::vector<std::shared_ptr<Shape>>& previous) {
+    Paths subject;
+    std::size_t closed = 0;
+    std::vector<std::shared_ptr<Shape>> kept;
+    for (const auto& shape : shapes) {
+        Paths rings = shapeToPaths(*shape);
+        if (rings.empty()) {
+            kept.push_back(shape);
+            continue;
+        }
+        ++closed;
+        subject.insert(subject.end(), std::make_move_iterator(rings.begin()), std::make_move_iterator(rings.end()));
+    }
+
+    // Holes stay with the outline around them, so the next boolean sees them as holes
+    std::vector<Paths> result = groupRings(polygonBoolean(subject, clip, op));
+    for (const auto& rings : result) {
+        std::vector<Point> points;
+        std::vector<std::size_t> holes;
+        for (const auto& ring : rings) {
+            if (!points.empty())
+                holes.push_back(points.size());
+            for (const auto& p : ring)
+                points.push_back(Point(p.x, p.y));
+        }
+        std::size_t offset = vertexPool->append(points);
+        kept.push_back(std::make_shared<Polygon>(vertexPool, offset, points.size(), std::move(holes)));
+    }
+    shapes.swap(kept);
+    previous = std::move(kept);
+    std::ostringstream summary;
+    summary << closed << " shapes -> " << result.size() << " polygons\n";
+    return summary.str();
+}
+
+bool overlaps(const Bounds& a, const Bounds& b) {
+    return a.minX <= b.maxX && b.minX <= a.maxX && a.minY <= b.maxY && b.minY <= a.maxY;
+}
+
+int clampToInt(long long v) {
+    return static_cast<int>(std::max<long long>(INT_MIN, std::min<long long>(INT_MAX, v)));
+}
+
+// Bounds of the shape an Add* command adds, computed in 64 bits so that an
+// unchecked command cannot overflow them.
+Bounds addedBounds(const SceneCommand& add) {
+    const int* c = add.coords;
+    switch (add.op) {
+    case SceneOp::AddPoint: return Bounds(c[0], c[1], c[0], c[1]);
+    case SceneOp::AddLine: return Line(Point(c[0], c[1]), Point(c[2], c[3])).bounds();
+    case SceneOp::AddRectangle:
+        return Bounds(c[0], c[1], clampToInt(static_cast<long long>(c[0]) + c[2]), clampToInt(static_cast<long long>(c[1]) + c[3]));
+    case SceneOp::AddCircle: {
+        long long r = c[2];
+        return Bounds(clampToInt(c[0] - r), clampToInt(c[1] - r), clampToInt(c[0] + r), clampToInt(c[1] + r));
+    }
+    default: {
+        Bounds box;
+        for (const Point& p : add.path)
+            box.expand(p.x, p.y);
+        return box;
+    }
+    }
+}
+
+// True when the points of an AddPolygon split into rings of three or more.
+bool hasRings(const SceneCommand& add) {
+    std::size_t start = 0;
+    for (std::size_t hole : add.holes) {
+        if (hole < start + 3)
+            return false;
+        start = hole;
+    }
+    return add.path.size() >= start + 3;
+}
+
+SceneCommand makeCommand(SceneOp op, int c0 = 0, int c1 = 0, int c2 = 0, int c3 = 0) {
+    SceneCommand command;
+    command.op = op;
+    command.boolean = BooleanOp::Union;
+    command.coords[0] = c0;
+    command.coords[1] = c1;
+    command.coords[2] = c2;
+    command.coords[3] = c3;
+    command.matrix = Affine2D::identity();
+    command.reply = nullptr;
+    return command;
+}
+
+}
+
+SceneCommand SceneCommand::addPoint(int x, int y) {
+    return makeCommand(SceneOp::AddPoint, x, y);
+}
+
+SceneCommand SceneCommand::addLine(int x1, int y1, int x2, int y2) {
+    return makeCommand(SceneOp::AddLine, x1, y1, x2, y2);
+}
+
+SceneCommand SceneCommand::addRectangle(int left, int top, int width, int height) {
+    return makeCommand(SceneOp::AddRectangle, left, top, width, height);
+}
+
+SceneCommand SceneCommand::addCircle(int cx, int cy, int radius) {
+    return makeCommand(SceneOp::AddCircle, cx, cy, radius);
+}
+
+SceneCommand SceneCommand::addPath(std::vector<Point> points, bool closed, std::vector<std::size_t> holes) {
+    SceneCommand command = makeCommand(closed ? SceneOp::AddPolygon : SceneOp::AddPolyline);
+    command.path = std::move(points);
+    command.holes = std::move(holes);
+    return command;
+}
+
+SceneCommand SceneCommand::addPoints(std::vector<Point> points) {
+    SceneCommand command = makeCommand(SceneOp::AddPoints);
+    command.path = std::move(points);
+    return command;
+}
+
+SceneCommand SceneCommand::addLines(std::vector<Point> ends) {
+    SceneCommand command = makeCommand(SceneOp::AddLines);
+    command.path = std::move(ends);
+    return command;
+}
+
+SceneCommand SceneCommand::addArray(const ArrayPattern& pattern, SceneCommand item, std::vector<std::size_t> removed) {
+    SceneCommand command = makeCommand(SceneOp::AddArray);
+    auto array = std::make_shared<SceneArray>();
+    array->pattern = pattern;
+    array->item = std::move(item);
+    array->removed = std::move(removed);
+    command.array = std::move(array);
+    return command;
+}
+
+SceneCommand SceneCommand::addReference(std::string name, const Affine2D& placement) {
+    SceneCommand command = makeCommand(SceneOp::AddReference);
+    command.matrix = placement;
+    auto block = std::make_shared<SceneBlock>();
+    block->name = std::move(name);
+    command.block = std::move(block);
+    return command;
+}
+
+SceneCommand SceneCommand::addReference(std::shared_ptr<const BlockDefinition> definition, const Affine2D& placement) {
+    SceneCommand command = makeCommand(SceneOp::AddReference);
+    command.matrix = placement;
+    auto block = std::make_shared<SceneBlock>();
+    block->name = definition->name;
+    block->definition = std::move(definition);
+    command.block = std::move(block);
+    return command;
+}
+
+SceneCommand SceneCommand::defineBlock(std::string name, std::vector<SceneCommand> shapes) {
+    SceneCommand command = makeCommand(SceneOp::DefineBlock);
+    auto block = std::make_shared<SceneBlock>();
+    block->name = std::move(name);
+    block->shapes = std::move(shapes);
+    command.block = std::move(block);
+    return command;
+}
+
+SceneCommand SceneCommand::addCopy(const Shape& shape) {
+    switch (shape.type()) {
+    case ShapeType::Point: {
+        const Point& p = static_cast<const Point&>(shape);
+        return addPoint(p.x, p.y);
+    }
+    case ShapeType::Line: {
+        const Line& l = static_cast<const Line&>(shape);
+        return addLine(l.start.x, l.start.y, l.end.x, l.end.y);
+    }
+    case ShapeType::Rectangle: {
+        const Rectangle& r = static_cast<const Rectangle&>(shape);
+        return addRectangle(r.topLeft.x, r.topLeft.y, r.width, r.height);
+    }
+    case ShapeType::Circle: {
+        const Circle& c = static_cast<const Circle&>(shape);
+        return addCircle(c.center.x, c.center.y, c.radius);
+    }
+    case ShapeType::Array: {
+        const ShapeArray& array = static_cast<const ShapeArray&>(shape);
+        return addArray(array.pattern, addCopy(*array.item), array.removed);
+    }
+    case ShapeType::Reference: {
+        const BlockReference& reference = static_cast<const BlockReference&>(shape);
+        return addReference(reference.block, reference.placement);
+    }
+    default: {
+        const Polyline& path = static_cast<const Polyline&>(shape);
+        std::vector<Point> points;
+        points.reserve(path.count);
+        for (std::size_t i = 0; i < path.count; ++i)
+            points.push_back(path.vertex(i));
+        return addPath(std::move(points), path.isClosed(), path.holes);
+    }
+    }
+}
+
+SceneCommand SceneCommand::select(const Bounds& window) {
+    return makeCommand(SceneOp::Select, window.minX, window.minY, window.maxX, window.maxY);
+}
+
+SceneCommand SceneCommand::transform(const Affine2D& matrix) {
+    SceneCommand command = makeCommand(SceneOp::Transform);
+    command.matrix = matrix;
+    return command;
+}
+
+SceneCommand SceneCommand::undo() {
+    return makeCommand(SceneOp::Undo);
+}
+
+SceneCommand SceneCommand::redo() {
+    return makeCommand(SceneOp::Redo);
+}
+
+SceneCommand SceneCommand::setHistoryBudget(int megabytes) {
+    return makeCommand(SceneOp::HistoryBudget, megabytes);
+}
+
+SceneCommand SceneCommand::applyBoolean(BooleanOp op, const Bounds& window) {
+    SceneCommand command = makeCommand(SceneOp::Boolean, window.minX, window.minY, window.maxX, window.maxY);
+    command.boolean = op;
+    return command;
+}
+
+SceneCommand SceneCommand::transaction(std::vector<SceneCommand> batch) {
+    SceneCommand command = makeCommand(SceneOp::Transaction);
+    command.batch = std::make_shared<const std::vector<SceneCommand>>(std::move(batch));
+    return command;
+}
+
+SceneCommand SceneCommand::replicate(std::shared_ptr<const SceneDelta> delta) {
+    SceneCommand command = makeCommand(SceneOp::Replicate);
+    command.delta = std::move(delta);
+    return command;
+}
+
+bool isValidAdd(const SceneCommand& add) {
+    const int* c = add.coords;
+    switch (add.op) {
+    case SceneOp::AddPoint:
+    case SceneOp::AddLine:
+        return true;
+    case SceneOp::AddRectangle:
+        return isValidRectangle(c[0], c[1], c[2], c[3]);
+    case SceneOp::AddCircle:
+        return isValidCircle(c[0], c[1], c[2]);
+    case SceneOp::AddPolyline:
+        return add.path.size() >= 2 && add.holes.empty();
+    case SceneOp::AddPolygon:
+        return hasRings(add);
+    case SceneOp::AddPoints:
+        return !add.path.empty();
+    case SceneOp::AddLines:
+        return !add.path.empty() && add.path.size() % 2 == 0;
+    case SceneOp::AddArray:
+        return isValidArray(*add.array);
+    case SceneOp::AddReference:
+        // By name the block is only known when the command applies, which checks it then
+        return isValidBlockName(add.block->name) &&
+            (add.block->definition ? isValidPlacement(*add.block->definition, add.matrix) : isValidPlacement(add.matrix));
+    default:
+        return false;
+    }
+}
+
+bool isSingleShapeAdd(const SceneCommand& add) {
+    SceneOp op = add.op;
+    return (op == SceneOp::AddPoint || op == SceneOp::AddLine || op == SceneOp::AddRectangle || op == SceneOp::AddCircle ||
+        op == SceneOp::AddPolyline || op == SceneOp::AddPolygon) && isValidAdd(add);
+}
+
+std::shared_ptr<Shape> makeSingleShape(const SceneCommand& add, const std::shared_ptr<VertexPool>& pool) {
+    const int* c = add.coords;
+    switch (add.op) {
+    case SceneOp::AddPoint:
+        return std::make_shared<Point>(c[0], c[1]);
+    case SceneOp::AddLine:
+        return std::make_shared<Line>(Point(c[0], c[1]), Point(c[2], c[3]));
+    case SceneOp::AddRectangle:
+        return std::make_shared<Rectangle>(Point(c[0], c[1]), c[2], c[3]);
+    case SceneOp::AddCircle:
+        return std::make_shared<Circle>(Point(c[0], c[1]), c[2]);
+    default: {
+        std::size_t offset = pool->append(add.path);
+        if (add.op == SceneOp::AddPolygon)
+            return std::make_shared<Polygon>(pool, offset, add.path.size(), add.holes);
+        return std::make_shared<Polyline>(pool, offset, add.path.size());
+    }
+    }
+}
+
+bool isValidArray(const SceneArray& array) {
+    if (!isSingleShapeAdd(array.item) || !array.pattern.fits(addedBounds(array.item)))
+        return false;
+    for (std::size_t i = 0; i < array.removed.size(); ++i) {
+        if (array.removed[i] >= array.pattern.count() || (i > 0 && array.removed[i] <= array.removed[i - 1]))
+            return false;
+    }
+    return true;
+}
+
+SceneOwner::SceneOwner(Scene& scene) : scene(scene), worker(&SceneOwner::run, this) {
+}
+
+SceneOwner::~SceneOwner() {
+    stopping.store(true);
+    {
+        std::lock_guard<std::mutex> lock(waitMutex);
+        wake.notify_one();
+    }
+    worker.join();
+}
+
+void SceneOwner::post(SceneCommand command) {
+    queue.push(std::move(command));
+    // Pairs with the fence in run(): either the owner sees this command when it
+    // looks again before sleeping, or this sees that it is about to sleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(waitMutex);
+        wake.notify_one();
+    }
+}
+
+void SceneOwner::flush() {
+    std::uint64_t target = queue.claimed();
+    std::unique_lock<std::mutex> lock(waitMutex);
+    applied.wait(lock, [&]() { return appliedCount >= target; });
+}
+
+void SceneOwner::run() {
+    std::vector<SceneCommand> batch;
+    batch.reserve(kBatchSize);
+    for (;;) {
+        batch.clear();
+        if (queue.drain(batch, kBatchSize) == 0) {
+            std::unique_lock<std::mutex> lock(waitMutex);
+            sleeping.store(true, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (queue.drain(batch, kBatchSize) == 0) {
+                if (stopping.load())
+                    break;
+                wake.wait(lock);
+            }
+            sleeping.store(false, std::memory_order_relaxed);
+            if (batch.empty())
+                continue;
+        }
+
+        {
+            InstrumentedLock lock(scene.mutex);
+            for (const SceneCommand& command : batch)
+                apply(command);
+        }
+        {
+            std::lock_guard<std::mutex> lock(waitMutex);
+            appliedCount += batch.size();
+        }
+        applied.notify_all();
+    }
+}
+
+std::shared_ptr<Shape> SceneOwner::makeShape(const SceneCommand& add) {
+    switch (add.op) {
+    case SceneOp::AddArray:
+        return std::make_shared<ShapeArray>(makeShape(add.array->item), add.array->pattern, add.array->removed);
+    case SceneOp::AddReference:
+        // apply() has checked that a block of that name exists, for adds and updates alike
+        return std::make_shared<BlockReference>(add.block->definition ? add.block->definition : scene.blocks.at(add.block->name),
+            add.matrix);
+    default:
+        return makeSingleShape(add, scene.vertexPool);
+    }
+}
+
+void SceneOwner::record(SceneChange::Kind kind, std::size_t index) {
+    if (scene.recordChanges)
+        scene.changes.push_back(SceneChange{ kind, index });
+}
+
+void SceneOwner::apply(const SceneCommand& command) {
+    const int* c = command.coords;
+    std::vector<std::shared_ptr<Shape>>& shapes = scene.shapes;
+    switch (command.op) {
+    case SceneOp::AddPoint:
+    case SceneOp::AddLine:
+    case SceneOp::AddRectangle:
+    case SceneOp::AddCircle:
+    case SceneOp::AddPolyline:
+    case SceneOp::AddPolygon:
+    case SceneOp::AddArray:
+        shapes.push_back(makeShape(command));
+        scene.history.recordAdd();
+        record(SceneChange::Added, shapes.size() - 1);
+        break;
+    case SceneOp::AddReference: {
+        const SceneBlock& block = *command.block;
+        if (!block.definition && scene.blocks.count(block.name) == 0) {
+            report(command, "No block named " + block.name + ".\n");
+            break;
+        }
+        const BlockDefinition& definition = block.definition ? *block.definition : *scene.blocks.at(block.name);
+        if (!isValidPlacement(definition, command.matrix)) {
+            report(command, "Block references need an invertible placement that keeps the block within integer coordinates.\n");
+            break;
+        }
+        shapes.push_back(makeShape(command));
+        scene.history.recordAdd();
+        record(SceneChange::Added, shapes.size() - 1);
+        report(command, "Reference to " + block.name + " added.\n");
+        break;
+    }
+    case SceneOp::DefineBlock:
+        report(command, defineBlock(*command.block));
+        break;
+    case SceneOp::AddPoints:
+    case SceneOp::AddLines: {
+        bool lines = command.op == SceneOp::AddLines;
+        const std::vector<Point>& p = command.path;
+        std::size_t count = lines ? p.size() / 2 : p.size();
+        // Grow geometrically: an exact reserve per bulk command would copy the list every time
+        if (shapes.capacity() < shapes.size() + count)
+            shapes.reserve(std::max(shapes.size() + count, shapes.capacity() * 2));
+        scene.history.beginGroup();
+        for (std::size_t i = 0; i < count; ++i) {
+            if (lines)
+                shapes.push_back(std::make_shared<Line>(p[2 * i], p[2 * i + 1]));
+            else
+                shapes.push_back(std::make_shared<Point>(p[i]));
+            scene.history.recordAdd();
+            record(SceneChange::Added, shapes.size() - 1);
+        }
+        scene.history.endGroup();
+        break;
+    }
+    case SceneOp::Select: {
+        scene.selection.clear();
+        scene.selectedInstances.clear();
+        Bounds window(c[0], c[1], c[2], c[3]);
+        std::size_t instances = 0;
+        for (std::size_t i = 0; i < shapes.size(); ++i) {
+            Bounds b = shapes[i]->bounds();
+            if (b.minX >= c[0] && b.maxX <= c[2] && b.minY >= c[1] && b.maxY <= c[3]) {
+                scene.selection.push_back(i);
+            }
+            else if (shapes[i]->type() == ShapeType::Array && overlaps(b, window)) {
+                std::size_t inside = static_cast<const ShapeArray&>(*shapes[i]).countInside(window);
+                if (inside > 0)
+                    scene.selectedInstances.push_back(std::make_pair(i, window));
+                instances += inside;
+            }
+        }
+        std::string message = std::to_string(scene.selection.size()) + " shapes";
+        if (instances > 0)
+            message += " and " + std::to_string(instances) + " array instances";
+        report(command, message + " selected.\n");
+        break;
+    }
+    case SceneOp::Transform: {
+        std::size_t instances = 0;
+        for (const auto& entry : scene.selectedInstances) {
+            if (shapes[entry.first]->type() == ShapeType::Array)
+                instances += static_cast<const ShapeArray&>(*shapes[entry.first]).countInside(entry.second);
+        }
+        if (instances > kMaxMaterialized) {
+            report(command, std::to_string(instances) + " array instances selected; at most " + std::to_string(kMaxMaterialized) +
+                " can be edited one by one. Select fewer or the whole array.\n");
+            break;
+        }
+        // Checked before any coordinate changes: the columns are transformed without range checks
+        bool inRange = keepsInRange(shapes, scene.selection, command.matrix);
+        for (const auto& entry : scene.selectedInstances) {
+            const Bounds& window = entry.second;
+            Bounds b = shapes[entry.first]->bounds();
+            inRange = inRange && keepsInRange(Bounds(std::max(b.minX, window.minX), std::max(b.minY, window.minY),
+                std::min(b.maxX, window.maxX), std::min(b.maxY, window.maxY)), command.matrix);
+        }
+        if (!inRange) {
+            report(command, "The transform would move shapes beyond integer coordinates.\n");
+            break;
+        }
+        // Materializing and transforming the instances is one step
+        scene.history.beginGroup();
+        materializeSelectedInstances();
+        scene.history.recordTransform(transformShapes(shapes, scene.vertexPool, scene.selection, command.matrix));
+        scene.movedShapes.insert(scene.movedShapes.end(), scene.selection.begin(), scene.selection.end());
+        ++scene.moveVersion;
+        for (std::size_t index : scene.selection)
+            record(SceneChange::Modified, index);
+        scene.history.endGroup();
+        report(command, std::to_string(scene.selection.size()) + " shapes transformed.\n");
+        break;
+    }
+    case SceneOp::Undo:
+    case SceneOp::Redo: {
+        bool undoing = command.op == SceneOp::Undo;
+        std::size_t before = shapes.size();
+        EditStep step;
+        std::size_t edits = 0;
+        do {
+            step = undoing ? scene.history.undo(shapes) : scene.history.redo(shapes, scene.vertexPool);
+            if (step.kind == EditKind::None)
+                break;
+            ++edits;
+            trackStep(step, undoing);
+        } while (step.grouped);
+        if (edits == 0) {
+            report(command, undoing ? "Nothing to undo.\n" : "Nothing to redo.\n");
+            break;
+        }
+        if (shapes.size() != before) {
+            scene.movedShapes.clear();
+            scene.selection.clear();
+            scene.selectedInstances.clear();
+        }
+        std::string message = undoing ? "Undone: " : "Redone: ";
+        if (edits > 1) {
+            message += std::to_string(edits) + " edits";
+        }
+        else {
+            static const char* const kStepNames[] = { "", "shape added", "transform of ", "boolean", "instances taken out of arrays" };
+            message += kStepNames[static_cast<int>(step.kind)];
+            if (step.kind == EditKind::Transform)
+                message += std::to_string(step.shapes) + " shapes";
+        }
+        report(command, message + ".\n");
+        break;
+    }
+    case SceneOp::HistoryBudget:
+        scene.history.setBudget(static_cast<std::size_t>(std::max(0, c[0])) << 20);
+        report(command, "History budget " + std::to_string(c[0]) + " MB, " + std::to_string(scene.history.undoCount()) +
+            " steps kept.\n");
+        break;
+    case SceneOp::Boolean: {
+        Paths clip;
+        if (command.boolean != BooleanOp::Union)
+            clip.push_back(Path{ { c[0], c[1] }, { c[2], c[1] }, { c[2], c[3] }, { c[0], c[3] } });
+        std::vector<std::shared_ptr<Shape>> previous;
+        report(command, replaceWithBoolean(shapes, scene.vertexPool, command.boolean, clip, previous));
+        scene.history.recordReplace(std::move(previous));
+        // Shape indices changed: earlier selections no longer apply
+        scene.selection.clear();
+        scene.selectedInstances.clear();
+        scene.movedShapes.clear();
+        ++scene.editVersion;
+        record(SceneChange::Rebuilt, 0);
+        break;
+    }
+    case SceneOp::Transaction: {
+        std::size_t before = shapes.size();
+        bool outerQuiet = quiet; // transactions nest when a script runs inside one
+        quiet = true;
+        scene.history.beginGroup();
+        for (const SceneCommand& staged : *command.batch)
+            apply(staged);
+        scene.history.endGroup();
+        quiet = outerQuiet;
+        report(command, "Committed " + std::to_string(command.batch->size()) + " edits, " +
+            std::to_string(static_cast<long long>(shapes.size()) - static_cast<long long>(before)) + " shapes added.\n");
+        break;
+    }
+    case SceneOp::Replicate: {
+        // Edits happen on the host, which keeps the history
+        const SceneDelta& delta = *command.delta;
+        auto unknown = std::find_if(delta.shapes.begin(), delta.shapes.end(), [&](const auto& entry) {
+            const SceneCommand& add = entry.second;
+            return add.op == SceneOp::AddReference && !add.block->definition && scene.blocks.count(add.block->name) == 0;
+        });
+        if (unknown != delta.shapes.end()) {
+            report(command, "Update ignored: no block named " + unknown->second.block->name + ".\n");
+            break;
+        }
+        if (delta.keep < shapes.size()) {
+            shapes.resize(delta.keep);
+            scene.selection.clear();
+            scene.selectedInstances.clear();
+            scene.movedShapes.clear();
+            ++scene.editVersion;
+        }
+        for (const auto& entry : delta.shapes) {
+            if (entry.first < shapes.size()) {
+                shapes[entry.first] = makeShape(entry.second);
+                scene.movedShapes.push_back(entry.first);
+                ++scene.moveVersion;
+            }
+            else {
+                shapes.push_back(makeShape(entry.second));
+            }
+        }
+        break;
+    }
+    }
+    // Nobody is picking moves up (headless, or the viewer is closed); past this
+    // point a full rebuild is cheaper than the list anyway
+    if (scene.movedShapes.size() > shapes.size()) {
+        scene.movedShapes.clear();
+        ++scene.editVersion;
+    }
+    if (scene.changes.size() > shapes.size() + 1) {
+        scene.changes.clear();
+        record(SceneChange::Rebuilt, 0);
+    }
+}
+
+void SceneOwner::materializeSelectedInstances() {
+    std::vector<std::shared_ptr<Shape>>& shapes = scene.shapes;
+    std::vector<std::size_t> arrays, taken;
+    std::vector<std::shared_ptr<Shape>> previous, copies;
+    for (const auto& entry : scene.selectedInstances) {
+        // Edits in place since the select may have put something else at the index
+        if (shapes[entry.first]->type() != ShapeType::Array)
+            continue;
+        const ShapeArray& array = static_cast<const ShapeArray&>(*shapes[entry.first]);
+        taken.clear();
+        array.instancesIn(entry.second, taken, true);
+        if (taken.empty())
+            continue;
+        for (std::size_t k : taken) {
+            SceneCommand copy = SceneCommand::addCopy(*array.item);
+            Point by = array.offset(k);
+            copy.coords[0] += by.x;
+            copy.coords[1] += by.y;
+            if (copy.op == SceneOp::AddLine) {
+                copy.coords[2] += by.x;
+                copy.coords[3] += by.y;
+            }
+            for (Point& p : copy.path) {
+                p.x += by.x;
+                p.y += by.y;
+            }
+            copies.push_back(makeShape(copy));
+        }
+        arrays.push_back(entry.first);
+        previous.push_back(shapes[entry.first]);
+        shapes[entry.first] = array.without(taken);
+    }
+    scene.selectedInstances.clear();
+    if (arrays.empty())
+        return;
+
+    // Recorded before the copies, so undo removes the copies first and then puts the arrays back
+    scene.movedShapes.insert(scene.movedShapes.end(), arrays.begin(), arrays.end());
+    ++scene.moveVersion;
+    for (std::size_t index : arrays)
+        record(SceneChange::Modified, index);
+    scene.history.recordSwap(std::move(arrays), std::move(previous));
+    if (shapes.capacity() < shapes.size() + copies.size())
+        shapes.reserve(std::max(shapes.size() + copies.size(), shapes.capacity() * 2));
+    for (auto& copy : copies) {
+        shapes.push_back(std::move(copy));
+        scene.history.recordAdd();
+        record(SceneChange::Added, shapes.size() - 1);
+        scene.selection.push_back(shapes.size() - 1);
+    }
+}
+
+std::string SceneOwner::defineBlock(const SceneBlock& block) {
+    if (!isValidBlockName(block.name))
+        return "Block names are up to 64 letters, digits, '_', '-' and '.'.\n";
+    std::vector<SceneCommand> copies;
+    if (block.shapes.empty()) {
+        if (scene.selection.empty())
+            return "Nothing selected.\n";
+        for (std::size_t index : scene.selection)
+            copies.push_back(SceneCommand::addCopy(*scene.shapes[index]));
+    }
+    const std::vector<SceneCommand>& adds = block.shapes.empty() ? copies : block.shapes;
+    if (!std::all_of(adds.begin(), adds.end(), isSingleShapeAdd))
+        return "Blocks hold single shapes: no arrays, references or bulk adds.\n";
+
+    std::shared_ptr<BlockDefinition>& definition = scene.blocks[block.name];
+    if (!definition)
+        definition = std::make_shared<BlockDefinition>(block.name);
+    // References share the definition: once placed, a block stays as it is
+    else if (definition.use_count() > 1)
+        return "Block " + block.name + " is already placed and cannot change.\n";
+    for (const SceneCommand& add : adds)
+        definition->append(makeShape(add));
+    return "Block " + block.name + ": " + std::to_string(definition->shapes.size()) + " shapes.\n";
+}
+
+void SceneOwner::trackStep(const EditStep& step, bool undone) {
+    std::vector<std::shared_ptr<Shape>>& shapes = scene.shapes;
+    switch (step.kind) {
+    case EditKind::Add:
+        if (undone) {
+            // Another shape may take the same index before the next frame
+            ++scene.editVersion;
+            record(SceneChange::Removed, shapes.size());
+        }
+        else {
+            record(SceneChange::Added, shapes.size() - 1);
+        }
+        break;
+    case EditKind::Transform:
+    case EditKind::Swap:
+        scene.movedShapes.insert(scene.movedShapes.end(), step.touched->begin(), step.touched->end());
+        ++scene.moveVersion;
+        for (std::size_t index : *step.touched)
+            record(SceneChange::Modified, index);
+        break;
+    case EditKind::Replace:
+        ++scene.editVersion;
+        record(SceneChange::Rebuilt, 0);
+        break;
+    case EditKind::None:
+        break;
+    }
+}
+
+void SceneOwner::report(const SceneCommand& command, const std::string& message) {
+    if (quiet)
+        return;
+    if (command.reply)
+        command.reply->message += message;
+    else
+        std::cout << message;
+}
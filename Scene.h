@@ -0,0 +1,226 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "Block.h"
+#include "EditHistory.h"
+#include "LockStats.h"
+#include "MpscQueue.h"
+#include "PolygonBoolean.h"
+#include "Shape.h"
+#include "ShapeArray.h"
+#include "SpatialIndex.h"
+#include "Transform.h"
+
+// One shape-level edit, recorded for the collaboration host.
+struct SceneChange {
+    enum Kind : std::uint8_t {
+        Added,    // appended at `index`
+        Modified, // replaced or edited in place
+        Removed,  // erased; later shapes shift down
+        Rebuilt,  // the whole list was replaced; `index` is unused
+    };
+    Kind kind;
+    std::size_t index;
+};
+
+// The drawing and its edit state. Only the scene owner thread writes it, under
+// `mutex`; other threads read it under the same mutex. `movedShapes` and
+// `queryIndex` are the exceptions: the renderer empties movedShapes after
+// picking the moves up (without a renderer it is capped by turning it into an
+// editVersion bump), and queries bring queryIndex up to date before using it.
+struct Scene {
+    std::vector<std::shared_ptr<Shape>> shapes;
+    std::shared_ptr<VertexPool> vertexPool = std::make_shared<VertexPool>();
+    std::vector<std::size_t> selection;             // indices into shapes
+    // Arrays the select window only partly covered, with that window: their
+    // instances inside it are selected too, and become shapes of their own
+    // when the selection is edited.
+    std::vector<std::pair<std::size_t, Bounds>> selectedInstances;
+    // Block definitions by name. Defining a block is not an edit of the
+    // drawing: undo leaves the table alone.
+    std::map<std::string, std::shared_ptr<BlockDefinition>> blocks;
+    EditHistory history;                            // undo and redo of every shape edit
+    unsigned long long editVersion = 0;             // bumped by every edit that replaces or reorders shapes
+    std::vector<std::size_t> movedShapes;           // shapes edited in place since the last frame
+    unsigned long long moveVersion = 0;             // bumped by every edit in place
+    bool recordChanges = false;                     // set by a collaboration host, which empties `changes`
+    std::vector<SceneChange> changes;               // shape edits since the host last published, oldest first
+    SpatialIndex queryIndex;                        // for console queries; readers refresh it under `mutex`
+    InstrumentedMutex mutex{ "scene" };             // lock through InstrumentedLock to time each call site
+};
+
+enum class SceneOp : std::uint8_t {
+    AddPoint,
+    AddLine,
+    AddRectangle,
+    AddCircle,
+    AddPolyline,
+    AddPolygon,
+    AddPoints,
+    AddLines,
+    AddArray,
+    AddReference,
+    DefineBlock,
+    Select,
+    Transform,
+    Undo,
+    Redo,
+    HistoryBudget,
+    Boolean,
+    Replicate,
+    Transaction,
+};
+
+struct SceneDelta;
+struct SceneArray;
+struct SceneBlock;
+
+// Where the owner writes the outcome of a command ("3 shapes selected.").
+struct SceneReply {
+    std::string message;
+};
+
+// One edit posted to the scene owner. Only the fields of its op are used.
+struct SceneCommand {
+    SceneOp op;
+    BooleanOp boolean;
+    int coords[4];           // point; line ends; rectangle corner and size; circle center and radius; select or clip window; budget in MB
+    Affine2D matrix;         // Transform; placement of AddReference
+    std::vector<Point> path; // AddPolyline, AddPolygon; the points of AddPoints; line ends in pairs for AddLines
+    std::vector<std::size_t> holes; // AddPolygon: where each hole ring starts in `path`
+    SceneReply* reply;       // filled before the command counts as applied; null prints to std::cout
+    std::shared_ptr<const SceneDelta> delta; // Replicate
+    std::shared_ptr<const std::vector<SceneCommand>> batch; // Transaction
+    std::shared_ptr<const SceneArray> array; // AddArray
+    std::shared_ptr<const SceneBlock> block; // AddReference, DefineBlock
+
+    static SceneCommand addPoint(int x, int y);
+    static SceneCommand addLine(int x1, int y1, int x2, int y2);
+    static SceneCommand addRectangle(int left, int top, int width, int height);
+    static SceneCommand addCircle(int cx, int cy, int radius);
+    // A polygon has holes when `holes` splits its points into rings (see Polygon).
+    static SceneCommand addPath(std::vector<Point> points, bool closed, std::vector<std::size_t> holes = {});
+    // Adds every point, or a line per pair of `ends`, under one lock and as
+    // one undo step.
+    static SceneCommand addPoints(std::vector<Point> points);
+    static SceneCommand addLines(std::vector<Point> ends);
+    // Adds an array of copies of the shape `item` adds (see isSingleShapeAdd),
+    // leaving out the `removed` instance numbers.
+    static SceneCommand addArray(const ArrayPattern& pattern, SceneCommand item, std::vector<std::size_t> removed = {});
+    // Adds a reference placing block `name`, looked up when the command applies.
+    static SceneCommand addReference(std::string name, const Affine2D& placement);
+    // Adds a reference to `definition` itself, whether or not the block table
+    // holds it; replicas receive their blocks this way.
+    static SceneCommand addReference(std::shared_ptr<const BlockDefinition> definition, const Affine2D& placement);
+    // Appends copies of the shapes `shapes` add (Add* commands of single
+    // shapes) to block `name`, defining it first when needed. With no shapes,
+    // copies of the selected shapes are appended instead.
+    static SceneCommand defineBlock(std::string name, std::vector<SceneCommand> shapes);
+    // The Add* command that recreates `shape`.
+    static SceneCommand addCopy(const Shape& shape);
+    // Selects the shapes lying entirely inside the window.
+    static SceneCommand select(const Bounds& window);
+    static SceneCommand transform(const Affine2D& matrix);
+    static SceneCommand undo();
+    static SceneCommand redo();
+    static SceneCommand setHistoryBudget(int megabytes);
+    // Clips closed shapes against the window (Intersection, Difference) or merges them (Union).
+    static SceneCommand applyBoolean(BooleanOp op, const Bounds& window);
+    // Applies every command in `batch` under one lock, so that readers see all
+    // of them or none, as a single undo step. Their replies are dropped.
+    static SceneCommand transaction(std::vector<SceneCommand> batch);
+    // Brings a replica in line with its collaboration host.
+    static SceneCommand replicate(std::shared_ptr<const SceneDelta> delta);
+};
+
+// The payload of an AddArray command.
+struct SceneArray {
+    ArrayPattern pattern;
+    SceneCommand item;
+    std::vector<std::size_t> removed; // sorted
+};
+
+// The payload of AddReference and DefineBlock commands.
+struct SceneBlock {
+    std::string name;
+    std::shared_ptr<const BlockDefinition> definition; // AddReference: null to look `name` up
+    std::vector<SceneCommand> shapes;                  // DefineBlock
+};
+
+// True when what `add` adds is well formed: no negative sizes, every edge
+// within integer coordinates, enough vertices for each path and ring, and a
+// pattern or placement that fits for arrays and references. Every add from
+// outside the owner (console, scripts, drawing files, sessions) is checked.
+bool isValidAdd(const SceneCommand& add);
+
+// True when `add` adds one valid shape that a block or an array can hold:
+// anything but arrays, block references and the bulk adds.
+bool isSingleShapeAdd(const SceneCommand& add);
+
+// The shape a single shape add makes, with the vertices of a path appended
+// to `pool`.
+std::shared_ptr<Shape> makeSingleShape(const SceneCommand& add, const std::shared_ptr<VertexPool>& pool);
+
+// True when `array` can be added: its item is a single shape add, its
+// pattern fits the item and its removed instances are in range.
+bool isValidArray(const SceneArray& array);
+
+// Shapes received from a collaboration host: the replica keeps its first
+// `keep` shapes, then overwrites or appends each shape at its index, in
+// ascending index order. A snapshot keeps nothing.
+struct SceneDelta {
+    std::size_t keep = 0;
+    std::vector<std::pair<std::size_t, SceneCommand>> shapes; // index, Add* command
+};
+
+// The only thread that edits the scene. Input sources post commands into a
+// lock-free queue; the owner drains them in batches, applying each batch under
+// a single lock of the scene mutex, so producers never wait on the renderer or
+// on each other and edits apply in the order they were posted.
+class SceneOwner {
+public:
+    explicit SceneOwner(Scene& scene);
+    // Applies whatever is still queued, then stops the thread.
+    ~SceneOwner();
+
+    void post(SceneCommand command);
+    // Blocks until every command posted before the call has been applied.
+    void flush();
+
+private:
+    static const std::size_t kQueueCapacity = 4096;
+    static const std::size_t kBatchSize = 512;
+
+    Scene& scene;
+    MpscQueue<SceneCommand> queue{ kQueueCapacity };
+    std::atomic<bool> sleeping{ false };
+    std::atomic<bool> stopping{ false };
+    std::uint64_t appliedCount = 0; // guarded by waitMutex
+    bool quiet = false;             // inside a transaction: no replies
+    std::mutex waitMutex;
+    std::condition_variable wake, applied;
+    std::thread worker;
+
+    void run();
+    void apply(const SceneCommand& command);
+    std::shared_ptr<Shape> makeShape(const SceneCommand& add);
+    void record(SceneChange::Kind kind, std::size_t index);
+    // Turns the selected array instances into shapes of their own, appended
+    // and added to the selection, and takes them out of their arrays.
+    void materializeSelectedInstances();
+    // Applies a DefineBlock command and returns its reply.
+    std::string defineBlock(const SceneBlock& block);
+    // Bookkeeping for one undone or redone edit.
+    void trackStep(const EditStep& step, bool undone);
+    void report(const SceneCommand& command, const std::string& message);
+};
@@ -0,0 +1,577 @@
+#include "SceneFile.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+const std::size_t kChunkBytes = 1 << 20;     // text parsed and posted as one batch
+const std::size_t kPieceBytes = 64 * 1024;   // text parsed by one task
+const std::size_t kExportBatch = 16 * 1024;  // shapes formatted per step of an export
+
+struct ParsedText {
+    std::vector<SceneCommand> commands;
+    std::size_t skipped = 0; // malformed lines
+};
+
+const char* skipBlanks(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+        ++p;
+    return p;
+}
+
+bool readInt(const char*& p, const char* end, int& value) {
+    p = skipBlanks(p, end);
+    std::from_chars_result result = std::from_chars(p, end, value);
+    if (result.ec != std::errc())
+        return false;
+    p = result.ptr;
+    return true;
+}
+
+bool readInts(const char*& p, const char* end, int* values, int count) {
+    for (int i = 0; i < count; ++i) {
+        if (!readInt(p, end, values[i]))
+            return false;
+    }
+    return true;
+}
+
+bool readDouble(const char*& p, const char* end, double& value) {
+    p = skipBlanks(p, end);
+    std::from_chars_result result = std::from_chars(p, end, value);
+    if (result.ec != std::errc())
+        return false;
+    p = result.ptr;
+    return true;
+}
+
+std::string_view readWord(const char*& p, const char* end) {
+    p = skipBlanks(p, end);
+    const char* word = p;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r')
+        ++p;
+    return std::string_view(word, static_cast<std::size_t>(p - word));
+}
+
+bool parseLine(const char* p, const char* end, std::vector<SceneCommand>& commands);
+
+// The rest of an "array" line: "linear n dx dy", "grid columns rows dx dy" (or
+// with both steps as vectors: "grid columns rows columnX columnY rowX rowY") or
+// "polar n cx cy [degrees]", then "except n k1 .. kn" when instances were taken
+// out, then the item as an add line.
+bool parseArray(const char*& p, const char* end, SceneCommand& add) {
+    p = skipBlanks(p, end);
+    const char* word = p;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r')
+        ++p;
+    std::string_view kind(word, static_cast<std::size_t>(p - word));
+    int v[6];
+    int count = 0;
+    for (;;) {
+        const char* next = skipBlanks(p, end);
+        if (count == 6 || next == end || !(*next == '-' || (*next >= '0' && *next <= '9')) || !readInt(p, end, v[count]))
+            break;
+        ++count;
+    }
+    ArrayPattern pattern;
+    if (kind == "linear" && count == 3) {
+        pattern.columns = v[0];
+        pattern.columnX = v[1];
+        pattern.columnY = v[2];
+    }
+    else if (kind == "grid" && (count == 4 || count == 6)) {
+        pattern.columns = v[0];
+        pattern.rows = v[1];
+        pattern.columnX = v[2];
+        pattern.columnY = count == 6 ? v[3] : 0;
+        pattern.rowX = count == 6 ? v[4] : 0;
+        pattern.rowY = count == 6 ? v[5] : v[3];
+    }
+    else if (kind == "polar" && (count == 3 || count == 4)) {
+        pattern.kind = ArrayKind::Polar;
+        pattern.columns = v[0];
+        pattern.centerX = v[1];
+        pattern.centerY = v[2];
+        pattern.fillDegrees = count == 4 ? v[3] : 360;
+    }
+    else {
+        return false;
+    }
+
+    std::vector<std::size_t> removed;
+    p = skipBlanks(p, end);
+    if (static_cast<std::size_t>(end - p) > 6 && std::string_view(p, 6) == "except") {
+        p += 6;
+        int n;
+        // Each instance number takes at least two characters
+        if (!readInt(p, end, n) || n < 0 || static_cast<std::size_t>(n) > static_cast<std::size_t>(end - p) / 2)
+            return false;
+        removed.resize(static_cast<std::size_t>(n));
+        for (std::size_t& k : removed) {
+            p = skipBlanks(p, end);
+            std::from_chars_result result = std::from_chars(p, end, k);
+            if (result.ec != std::errc())
+                return false;
+            p = result.ptr;
+        }
+    }
+
+    std::vector<SceneCommand> item;
+    if (!parseLine(p, end, item) || item.size() != 1)
+        return false;
+    add = SceneCommand::addArray(pattern, std::move(item[0]), std::move(removed));
+    p = end;
+    return isValidArray(*add.array);
+}
+
+// The rest of an "insert" line: the block name and where its origin goes, then
+// either "degrees [scale]" turning and scaling the block about its origin, or
+// "matrix a b c d" with the linear part of the placement.
+bool parseInsert(const char*& p, const char* end, SceneCommand& add) {
+    std::string name(readWord(p, end));
+    double x, y;
+    if (!isValidBlockName(name) || !readDouble(p, end, x) || !readDouble(p, end, y))
+        return false;
+    Affine2D placement = Affine2D::translation(x, y);
+    if (skipBlanks(p, end) != end) {
+        const char* mark = p;
+        if (readWord(p, end) == "matrix") {
+            if (!readDouble(p, end, placement.a) || !readDouble(p, end, placement.b) ||
+                !readDouble(p, end, placement.c) || !readDouble(p, end, placement.d))
+                return false;
+        }
+        else {
+            p = mark;
+            double degrees, scale = 1.0;
+            if (!readDouble(p, end, degrees) || (skipBlanks(p, end) != end && !readDouble(p, end, scale)))
+                return false;
+            placement = Affine2D::translation(x, y).after(Affine2D::rotation(degrees, 0.0, 0.0).after(Affine2D::scaling(scale, scale, 0.0, 0.0)));
+        }
+    }
+    if (!isValidPlacement(placement))
+        return false;
+    add = SceneCommand::addReference(std::move(name), placement);
+    return true;
+}
+
+// Parses one line (without its newline). False when it is malformed.
+bool parseLine(const char* p, const char* end, std::vector<SceneCommand>& commands) {
+    p = skipBlanks(p, end);
+    if (p == end || *p == '#')
+        return true;
+    const char* word = p;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\r')
+        ++p;
+    std::string_view keyword(word, static_cast<std::size_t>(p - word));
+    int v[4];
+    if (keyword == "addpoint") {
+        if (!readInts(p, end, v, 2))
+            return false;
+        commands.push_back(SceneCommand::addPoint(v[0], v[1]));
+    }
+    else if (keyword == "addline") {
+        if (!readInts(p, end, v, 4))
+            return false;
+        commands.push_back(SceneCommand::addLine(v[0], v[1], v[2], v[3]));
+    }
+    else if (keyword == "addrect" || keyword == "addrectangle") {
+        if (!readInts(p, end, v, 4) || !isValidRectangle(v[0], v[1], v[2], v[3]))
+            return false;
+        commands.push_back(SceneCommand::addRectangle(v[0], v[1], v[2], v[3]));
+    }
+    else if (keyword == "addcircle") {
+        if (!readInts(p, end, v, 3) || !isValidCircle(v[0], v[1], v[2]))
+            return false;
+        commands.push_back(SceneCommand::addCircle(v[0], v[1], v[2]));
+    }
+    else if (keyword == "addpolyline" || keyword == "addpolygon") {
+        bool closed = keyword == "addpolygon";
+        int n;
+        // Each vertex takes at least four characters, so a larger count is a typo, not a reason to reserve gigabytes
+        if (!readInt(p, end, n) || n < (closed ? 3 : 2) || static_cast<std::size_t>(n) > static_cast<std::size_t>(end - p))
+            return false;
+        std::vector<Point> points;
+        points.reserve(static_cast<std::size_t>(n));
+        for (int i = 0; i < n; ++i) {
+            if (!readInts(p, end, v, 2))
+                return false;
+            points.push_back(Point(v[0], v[1]));
+        }
+        // A polygon with holes ends with "holes k i1 .. ik", the vertices where each hole starts
+        std::vector<std::size_t> holes;
+        p = skipBlanks(p, end);
+        if (closed && p != end && readWord(p, end) == "holes") {
+            int k;
+            if (!readInt(p, end, k) || k < 1 || k > n / 3)
+                return false;
+            holes.resize(static_cast<std::size_t>(k));
+            for (std::size_t& hole : holes) {
+                if (!readInt(p, end, v[0]) || v[0] < 0)
+                    return false;
+                hole = static_cast<std::size_t>(v[0]);
+            }
+        }
+        commands.push_back(SceneCommand::addPath(std::move(points), closed, std::move(holes)));
+        if (!isValidAdd(commands.back()))
+            return false;
+    }
+    else if (keyword == "array") {
+        SceneCommand array;
+        if (!parseArray(p, end, array))
+            return false;
+        commands.push_back(std::move(array));
+    }
+    else if (keyword == "block") {
+        std::string name(readWord(p, end));
+        std::vector<SceneCommand> shape;
+        if (!isValidBlockName(name) || !parseLine(p, end, shape) || shape.size() != 1 || !isSingleShapeAdd(shape[0]))
+            return false;
+        commands.push_back(SceneCommand::defineBlock(std::move(name), std::move(shape)));
+        p = end;
+    }
+    else if (keyword == "insert") {
+        SceneCommand reference;
+        if (!parseInsert(p, end, reference))
+            return false;
+        commands.push_back(std::move(reference));
+    }
+    else {
+        return false;
+    }
+    return skipBlanks(p, end) == end;
+}
+
+void parseLines(const char* begin, const char* end, ParsedText& parsed) {
+    while (begin < end) {
+        const char* newline = static_cast<const char*>(std::memchr(begin, '\n', static_cast<std::size_t>(end - begin)));
+        const char* lineEnd = newline ? newline : end;
+        if (!parseLine(begin, lineEnd, parsed.commands))
+            ++parsed.skipped;
+        begin = newline ? newline + 1 : end;
+    }
+}
+
+// Splits whole lines into pieces at line breaks, parses the pieces in parallel
+// and joins the results in file order.
+ParsedText parseText(const char* begin, const char* end, TaskScheduler& scheduler) {
+    std::vector<const char*> cuts(1, begin);
+    while (end - cuts.back() > static_cast<std::ptrdiff_t>(kPieceBytes)) {
+        const char* cut = cuts.back() + kPieceBytes;
+        const char* newline = static_cast<const char*>(std::memchr(cut, '\n', static_cast<std::size_t>(end - cut)));
+        if (!newline)
+            break;
+        cuts.push_back(newline + 1);
+    }
+    cuts.push_back(end);
+
+    std::vector<ParsedText> pieces(cuts.size() - 1);
+    scheduler.parallelFor(pieces.size(), 1, [&](std::size_t first, std::size_t last) {
+        for (std::size_t i = first; i < last; ++i)
+            parseLines(cuts[i], cuts[i + 1], pieces[i]);
+        }, TaskPriority::Background);
+
+    ParsedText joined = std::move(pieces[0]);
+    for (std::size_t i = 1; i < pieces.size(); ++i) {
+        joined.commands.insert(joined.commands.end(), std::make_move_iterator(pieces[i].commands.begin()),
+            std::make_move_iterator(pieces[i].commands.end()));
+        joined.skipped += pieces[i].skipped;
+    }
+    return joined;
+}
+
+void appendInt(std::string& text, long long value) {
+    char digits[24];
+    text += ' ';
+    text.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+}
+
+void appendDouble(std::string& text, double value) {
+    char digits[32];
+    text += ' ';
+    text.append(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr);
+}
+
+// Everything an export writes, copied under one lock of the scene. Shapes
+// edited in place are copied by value and arrays and references, which edits
+// replace, are shared. Paths are shared for their vertex count and holes, but
+// their vertices move in place in the scene's pool (which also reallocates as
+// it grows), so those are copied into `xs` and `ys`, path after path in the
+// order the shapes are formatted.
+struct ExportSnapshot {
+    std::vector<std::pair<std::string, std::shared_ptr<const Shape>>> blockShapes;
+    std::vector<std::shared_ptr<const Shape>> shapes;
+    std::vector<int> xs, ys;
+};
+
+std::shared_ptr<const Shape> snapshotShape(const std::shared_ptr<const Shape>& shape, ExportSnapshot& snapshot) {
+    switch (shape->type()) {
+    case ShapeType::Point: return std::make_shared<Point>(static_cast<const Point&>(*shape));
+    case ShapeType::Line: return std::make_shared<Line>(static_cast<const Line&>(*shape));
+    case ShapeType::Rectangle: return std::make_shared<Rectangle>(static_cast<const Rectangle&>(*shape));
+    case ShapeType::Circle: return std::make_shared<Circle>(static_cast<const Circle&>(*shape));
+    case ShapeType::Array:
+        snapshotShape(static_cast<const ShapeArray&>(*shape).item, snapshot); // its vertices, if a path
+        return shape;
+    case ShapeType::Reference: return shape;
+    default: {
+        const Polyline& path = static_cast<const Polyline&>(*shape);
+        snapshot.xs.insert(snapshot.xs.end(), path.pool->xs.begin() + path.offset, path.pool->xs.begin() + path.offset + path.count);
+        snapshot.ys.insert(snapshot.ys.end(), path.pool->ys.begin() + path.offset, path.pool->ys.begin() + path.offset + path.count);
+        return shape;
+    }
+    }
+}
+
+// Formats one shape of a snapshot; path vertices come from `xs` and `ys`,
+// which move past them.
+void appendShape(std::string& text, const Shape& shape, const int*& xs, const int*& ys) {
+    switch (shape.type()) {
+    case ShapeType::Point: {
+        const Point& p = static_cast<const Point&>(shape);
+        text += "addpoint";
+        appendInt(text, p.x);
+        appendInt(text, p.y);
+        break;
+    }
+    case ShapeType::Line: {
+        const Line& l = static_cast<const Line&>(shape);
+        text += "addline";
+        appendInt(text, l.start.x);
+        appendInt(text, l.start.y);
+        appendInt(text, l.end.x);
+        appendInt(text, l.end.y);
+        break;
+    }
+    case ShapeType::Rectangle: {
+        const Rectangle& r = static_cast<const Rectangle&>(shape);
+        text += "addrect";
+        appendInt(text, r.topLeft.x);
+        appendInt(text, r.topLeft.y);
+        appendInt(text, r.width);
+        appendInt(text, r.height);
+        break;
+    }
+    case ShapeType::Circle: {
+        const Circle& c = static_cast<const Circle&>(shape);
+        text += "addcircle";
+        appendInt(text, c.center.x);
+        appendInt(text, c.center.y);
+        appendInt(text, c.radius);
+        break;
+    }
+    case ShapeType::Array: {
+        const ShapeArray& array = static_cast<const ShapeArray&>(shape);
+        const ArrayPattern& p = array.pattern;
+        text += "array";
+        if (p.kind == ArrayKind::Polar) {
+            text += " polar";
+            for (int value : { p.columns, p.centerX, p.centerY, p.fillDegrees })
+                appendInt(text, value);
+        }
+        else if (p.rows == 1) {
+            text += " linear";
+            for (int value : { p.columns, p.columnX, p.columnY })
+                appendInt(text, value);
+        }
+        else if (p.columnY == 0 && p.rowX == 0) {
+            text += " grid";
+            for (int value : { p.columns, p.rows, p.columnX, p.rowY })
+                appendInt(text, value);
+        }
+        else {
+            text += " grid";
+            for (int value : { p.columns, p.rows, p.columnX, p.columnY, p.rowX, p.rowY })
+                appendInt(text, value);
+        }
+        if (!array.removed.empty()) {
+            text += " except";
+            appendInt(text, static_cast<long long>(array.removed.size()));
+            for (std::size_t k : array.removed)
+                appendInt(text, static_cast<long long>(k));
+        }
+        text += ' ';
+        appendShape(text, *array.item, xs, ys); // ends the line
+        return;
+    }
+    case ShapeType::Reference: {
+        const BlockReference& reference = static_cast<const BlockReference&>(shape);
+        const Affine2D& m = reference.placement;
+        text += "insert ";
+        text += reference.block->name;
+        appendDouble(text, m.tx);
+        appendDouble(text, m.ty);
+        if (m.a != 1.0 || m.b != 0.0 || m.c != 0.0 || m.d != 1.0) {
+            text += " matrix";
+            for (double value : { m.a, m.b, m.c, m.d })
+                appendDouble(text, value);
+        }
+        break;
+    }
+    default: {
+        const Polyline& path = static_cast<const Polyline&>(shape);
+        text += path.isClosed() ? "addpolygon" : "addpolyline";
+        appendInt(text, static_cast<int>(path.count));
+        for (std::size_t i = 0; i < path.count; ++i) {
+            appendInt(text, *xs++);
+            appendInt(text, *ys++);
+        }
+        if (!path.holes.empty()) {
+            text += " holes";
+            appendInt(text, static_cast<long long>(path.holes.size()));
+            for (std::size_t hole : path.holes)
+                appendInt(text, static_cast<long long>(hole));
+        }
+        break;
+    }
+    }
+    text += '\n';
+}
+
+AsyncJob runImport(std::string path, SceneOwner& owner, std::shared_ptr<JobProgress> job) {
+    TaskScheduler& scheduler = TaskScheduler::shared();
+    co_await resumeOn(scheduler);
+
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        job->finish("Could not read " + path + ".");
+        co_return;
+    }
+    in.seekg(0, std::ios::end);
+    job->total = static_cast<std::uint64_t>(std::max<std::streamoff>(0, in.tellg()));
+    in.seekg(0, std::ios::beg);
+
+    std::string text;
+    std::size_t added = 0, skipped = 0;
+    SceneReply reply; // the owner writes it while applying the batch in flight
+    bool inFlight = false;
+    bool atEnd = false;
+    while (!atEnd && !job->cancelRequested) {
+        std::size_t kept = text.size();
+        text.resize(kept + kChunkBytes);
+        in.read(&text[kept], static_cast<std::streamsize>(kChunkBytes));
+        text.resize(kept + static_cast<std::size_t>(in.gcount()));
+        atEnd = !in;
+        // Parse whole lines only; a partial last line waits for the next chunk
+        std::size_t cut = text.size();
+        if (!atEnd) {
+            std::size_t newline = text.rfind('\n');
+            if (newline == std::string::npos)
+                continue;
+            cut = newline + 1;
+        }
+        ParsedText parsed = parseText(text.data(), text.data() + cut, scheduler);
+        text.erase(0, cut);
+        skipped += parsed.skipped;
+
+        // One batch in flight at a time: the next chunk parses while the owner
+        // applies this one, and memory stays bounded by two chunks
+        if (inFlight)
+            owner.flush();
+        inFlight = false;
+        if (job->cancelRequested)
+            break;
+        if (!parsed.commands.empty()) {
+            added += parsed.commands.size();
+            SceneCommand batch = SceneCommand::transaction(std::move(parsed.commands));
+            batch.reply = &reply;
+            owner.post(std::move(batch));
+            inFlight = true;
+        }
+        job->done += cut;
+        // Give other work a turn between chunks
+        co_await resumeOn(scheduler);
+    }
+    if (inFlight)
+        owner.flush();
+
+    std::string outcome = (job->cancelRequested ? "Cancelled after importing " : "Imported ") + std::to_string(added)
+        + " shapes from " + path;
+    if (skipped != 0)
+        outcome += " (" + std::to_string(skipped) + " unreadable lines skipped)";
+    job->finish(outcome + ".");
+}
+
+AsyncJob runExport(std::string path, Scene& scene, SceneOwner& owner, std::shared_ptr<JobProgress> job) {
+    // Runs on the caller until here, so the file holds everything it posted before
+    owner.flush();
+    TaskScheduler& scheduler = TaskScheduler::shared();
+    co_await resumeOn(scheduler);
+
+    std::ofstream out(path, std::ios::binary);
+    if (!out) {
+        job->finish("Could not write " + path + ".");
+        co_return;
+    }
+    // One snapshot, so the file holds a single state of the scene however long formatting takes
+    ExportSnapshot snapshot;
+    {
+        InstrumentedLock lock(scene.mutex);
+        for (const auto& entry : scene.blocks) {
+            for (const auto& shape : entry.second->shapes)
+                snapshot.blockShapes.emplace_back(entry.first, snapshotShape(shape, snapshot));
+        }
+        snapshot.shapes.reserve(scene.shapes.size());
+        for (const auto& shape : scene.shapes)
+            snapshot.shapes.push_back(snapshotShape(shape, snapshot));
+    }
+    std::size_t count = snapshot.shapes.size();
+    job->total = count;
+    const int* xs = snapshot.xs.data();
+    const int* ys = snapshot.ys.data();
+
+    // Block definitions go first, so that the references after them resolve
+    std::string text;
+    for (const auto& [name, shape] : snapshot.blockShapes) {
+        text += "block ";
+        text += name;
+        text += ' ';
+        appendShape(text, *shape, xs, ys);
+    }
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+    std::size_t written = 0;
+    while (written < count && !job->cancelRequested) {
+        text.clear();
+        std::size_t end = std::min(written + kExportBatch, count);
+        for (std::size_t i = written; i < end; ++i)
+            appendShape(text, *snapshot.shapes[i], xs, ys);
+        out.write(text.data(), static_cast<std::streamsize>(text.size()));
+        written = end;
+        job->done = written;
+        co_await resumeOn(scheduler);
+    }
+    out.close();
+
+    if (!out)
+        job->finish("Could not write " + path + ".");
+    else if (job->cancelRequested)
+        job->finish("Cancelled; " + path + " holds only the first " + std::to_string(written) + " shapes.");
+    else
+        job->finish("Exported " + std::to_string(written) + " shapes to " + path + ".");
+}
+
+}
+
+bool parseDrawingLine(const std::string& line, SceneCommand& add) {
+    std::vector<SceneCommand> commands;
+    if (!parseLine(line.data(), line.data() + line.size(), commands) || commands.size() != 1)
+        return false;
+    add = std::move(commands[0]);
+    return true;
+}
+
+std::shared_ptr<JobProgress> importDrawing(const std::string& path, SceneOwner& owner) {
+    std::shared_ptr<JobProgress> job = JobList::shared().add("import " + path);
+    runImport(path, owner, job);
+    return job;
+}
+
+std::shared_ptr<JobProgress> exportDrawing(const std::string& path, Scene& scene, SceneOwner& owner) {
+    std::shared_ptr<JobProgress> job = JobList::shared().add("export " + path);
+    runExport(path, scene, owner, job);
+    return job;
+}
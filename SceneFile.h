@@ -0,0 +1,37 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include "AsyncJob.h"
+#include "Scene.h"
+
+// Drawing files are plain text, one shape per line in the console's add
+// syntax ("addline 0 0 100 50", "addrect 0 0 40 20", "addpolygon 3 0 0 10 0 5 8").
+// Arrays take one line: the pattern, then the instances materialized as shapes
+// of their own, then the item ("array grid 100 20 50 40 except 2 7 9 addcircle 0 0 10").
+// Block definitions come first, one line per shape ("block valve addcircle 0 0 10"),
+// and each reference names its block and placement ("insert valve 500 20", with
+// "matrix a b c d" after the position when the block is turned or scaled).
+// Blank lines and lines starting with '#' are skipped.
+//
+// Both jobs run as coroutines on the shared task scheduler at Background
+// priority and return at once. Each stops at the next batch boundary once
+// cancellation is requested. Their steps block on the scene mutex and on the
+// owner, which is safe only because steps run on pool workers alone: threads
+// that hold the scene lock while they wait on the scheduler (the renderer, the
+// owner) run nothing but their own parallelFor pieces.
+
+// Parses one line of a drawing file into the Add* command it holds. False for
+// blank lines, comments and anything malformed.
+bool parseDrawingLine(const std::string& line, SceneCommand& add);
+
+// Reads the file in chunks, parses each chunk on the workers and posts its
+// shapes as one transaction, so the drawing fills in batch by batch and every
+// batch is one undo step. A cancelled import keeps the batches already added.
+std::shared_ptr<JobProgress> importDrawing(const std::string& path, SceneOwner& owner);
+
+// Writes every shape the scene holds once the edits posted before the call
+// are applied. Copies the scene under one lock of its mutex and formats the
+// copy a batch at a time, so the file holds that one state of the drawing and
+// edits made while it is written never end up in it.
+std::shared_ptr<JobProgress> exportDrawing(const std::string& path, Scene& scene, SceneOwner& owner);
@@ -0,0 +1,616 @@
+#include "SceneRenderer.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include "Block.h"
+#include "PolygonBoolean.h"
+#include "Profiler.h"
+#include "ShapeArray.h"
+#include "TaskScheduler.h"
+
+namespace {
+
+const std::size_t kDetailedShapes = 20000;
+const float kImpostorPixels = 8.f;
+const float kImpostorPixelsPerShape = 16.f; // impostors need one shape per 4x4 pixels or more
+const float kPointRadiusPixels = 3.f;
+const float kOutlinePixels = 2.f;
+const std::size_t kHeatmapPoints = 20000;
+const std::uint32_t kHeatmapSaturation = 64; // points per pixel drawn at full heat
+const std::size_t kChunkShapes = 4096;
+const unsigned long long kEvictFrames = 600; // about ten seconds out of view
+const float kArrayCellPixels = 3.f; // array instances closer than this are drawn as cells
+const int kNoBand = INT_MIN;
+
+sf::Color shapeColor(ShapeType type) {
+    switch (type) {
+    case ShapeType::Line: return sf::Color::Blue;
+    case ShapeType::Rectangle: return sf::Color::Green;
+    case ShapeType::Circle: return sf::Color::Magenta;
+    case ShapeType::Polyline: return sf::Color(0, 128, 128);
+    case ShapeType::Polygon: return sf::Color(200, 100, 0);
+    default: return sf::Color::Black;
+    }
+}
+
+// Segments for a circle outline of `screenRadius` pixels, within half a pixel.
+std::size_t screenCircleSegments(float screenRadius) {
+    return circleSegments(std::max(1, static_cast<int>(std::ceil(screenRadius))), 0.5);
+}
+
+void appendQuad(std::vector<sf::Vertex>& quads, float x0, float y0, float x1, float y1, sf::Color color) {
+    quads.push_back(sf::Vertex(sf::Vector2f(x0, y0), color));
+    quads.push_back(sf::Vertex(sf::Vector2f(x1, y0), color));
+    quads.push_back(sf::Vertex(sf::Vector2f(x1, y1), color));
+    quads.push_back(sf::Vertex(sf::Vector2f(x0, y1), color));
+}
+
+void appendSegment(std::vector<sf::Vertex>& lines, float x0, float y0, float x1, float y1, sf::Color color) {
+    lines.push_back(sf::Vertex(sf::Vector2f(x0, y0), color));
+    lines.push_back(sf::Vertex(sf::Vector2f(x1, y1), color));
+}
+
+bool overlaps(const Bounds& a, const Bounds& b) {
+    return a.minX <= b.maxX && b.minX <= a.maxX && a.minY <= b.maxY && b.minY <= a.maxY;
+}
+
+// Chunks are tessellated for zoom bands half an octave wide, at the finest
+// pixel size of the band, so outlines never look coarser than they should.
+int zoomBand(float pixelSize) {
+    return static_cast<int>(std::floor(std::log2(pixelSize) * 2.f));
+}
+
+float bandPixelSize(int band) {
+    return std::exp2(static_cast<float>(band) * 0.5f);
+}
+
+// A shape smaller than a pixel, reduced to the pixel cell its box starts in.
+struct CollapsedCell {
+    long long x, y;
+    ShapeType type;
+
+    bool operator<(const CollapsedCell& other) const {
+        if (x != other.x)
+            return x < other.x;
+        if (y != other.y)
+            return y < other.y;
+        return type < other.type;
+    }
+    bool operator==(const CollapsedCell& other) const {
+        return x == other.x && y == other.y && type == other.type;
+    }
+};
+
+// Outline of a block in block coordinates for one zoom band.
+struct BlockTessellation {
+    std::vector<sf::Vertex> lines, markers;
+};
+
+// Tessellations of block definitions, one per block and zoom band, shared by
+// the render thread and the chunk workers: every reference to a block copies
+// the same vertices through its placement instead of tessellating the block.
+class BlockTessellations {
+public:
+    std::shared_ptr<const BlockTessellation> get(const std::shared_ptr<const BlockDefinition>& block,
+        const VertexPool& vertexPool, int band);
+
+private:
+    struct Entry {
+        std::weak_ptr<const BlockDefinition> block; // a new block may reuse the address of a dead one
+        std::shared_ptr<const BlockTessellation> tessellation;
+    };
+    std::mutex mutex;
+    std::map<std::pair<const BlockDefinition*, int>, Entry> entries;
+    std::size_t pruneAt = 64; // entries of dead blocks are dropped once the map grows past this
+};
+
+BlockTessellations& blockTessellations() {
+    static BlockTessellations tessellations;
+    return tessellations;
+}
+
+// Appends the outline of one shape to `lines`, or its marker to `markers` for
+// points; shapes under a pixel only leave their cell in `collapsed`.
+void tessellateShape(const Shape& shape, const VertexPool& vertexPool, float pixelSize,
+    std::vector<sf::Vertex>& lines, std::vector<sf::Vertex>& markers, std::vector<CollapsedCell>& collapsed) {
+    ShapeType type = shape.type();
+    sf::Color color = shapeColor(type);
+    Bounds b = shape.bounds();
+    float x0 = static_cast<float>(b.minX), y0 = static_cast<float>(b.minY);
+    if (type == ShapeType::Point) {
+        float r = kPointRadiusPixels * pixelSize;
+        appendQuad(markers, x0 - r, y0 - r, x0 + r, y0 + r, color);
+        return;
+    }
+    if (static_cast<float>(b.maxX - b.minX) < pixelSize && static_cast<float>(b.maxY - b.minY) < pixelSize) {
+        collapsed.push_back(CollapsedCell{ static_cast<long long>(std::floor(b.minX / pixelSize)),
+            static_cast<long long>(std::floor(b.minY / pixelSize)), type });
+        return;
+    }
+
+    switch (type) {
+    case ShapeType::Line: {
+        const Line& l = static_cast<const Line&>(shape);
+        appendSegment(lines, static_cast<float>(l.start.x), static_cast<float>(l.start.y),
+            static_cast<float>(l.end.x), static_cast<float>(l.end.y), color);
+        break;
+    }
+    case ShapeType::Rectangle: {
+        float x1 = static_cast<float>(b.maxX), y1 = static_cast<float>(b.maxY);
+        appendSegment(lines, x0, y0, x1, y0, color);
+        appendSegment(lines, x1, y0, x1, y1, color);
+        appendSegment(lines, x1, y1, x0, y1, color);
+        appendSegment(lines, x0, y1, x0, y0, color);
+        break;
+    }
+    case ShapeType::Circle: {
+        const Circle& c = static_cast<const Circle&>(shape);
+        float cx = static_cast<float>(c.center.x), cy = static_cast<float>(c.center.y), r = static_cast<float>(c.radius);
+        std::size_t segments = screenCircleSegments(r / pixelSize);
+        // Walk the outline by repeated rotation instead of a sin/cos per vertex
+        double step = 6.283185307179586 / static_cast<double>(segments);
+        double cosStep = std::cos(step), sinStep = std::sin(step), ux = 1.0, uy = 0.0;
+        for (std::size_t k = 0; k < segments; ++k) {
+            double nx = ux * cosStep - uy * sinStep, ny = ux * sinStep + uy * cosStep;
+            appendSegment(lines, cx + r * static_cast<float>(ux), cy + r * static_cast<float>(uy),
+                cx + r * static_cast<float>(nx), cy + r * static_cast<float>(ny), color);
+            ux = nx;
+            uy = ny;
+        }
+        break;
+    }
+    case ShapeType::Polyline:
+    case ShapeType::Polygon: {
+        const Polyline& pl = static_cast<const Polyline&>(shape);
+        const int* xs = vertexPool.xs.data() + pl.offset;
+        const int* ys = vertexPool.ys.data() + pl.offset;
+        std::size_t segments = pl.segmentCount();
+        for (std::size_t k = 0; k < segments; ++k) {
+            std::size_t j = pl.next(k);
+            appendSegment(lines, static_cast<float>(xs[k]), static_cast<float>(ys[k]),
+                static_cast<float>(xs[j]), static_cast<float>(ys[j]), color);
+        }
+        break;
+    }
+    case ShapeType::Reference: {
+        // The block's outline at the pixel size it has in block space, placed
+        const BlockReference& reference = static_cast<const BlockReference&>(shape);
+        std::shared_ptr<const BlockTessellation> block =
+            blockTessellations().get(reference.block, vertexPool, zoomBand(pixelSize / static_cast<float>(reference.scale())));
+        const Affine2D& m = reference.placement;
+        auto place = [&](const sf::Vertex& v) {
+            return sf::Vertex(sf::Vector2f(static_cast<float>(m.a * v.position.x + m.b * v.position.y + m.tx),
+                static_cast<float>(m.c * v.position.x + m.d * v.position.y + m.ty)), v.color);
+        };
+        for (const sf::Vertex& v : block->lines)
+            lines.push_back(place(v));
+        for (const sf::Vertex& v : block->markers)
+            markers.push_back(place(v));
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+std::shared_ptr<const BlockTessellation> BlockTessellations::get(const std::shared_ptr<const BlockDefinition>& block,
+    const VertexPool& vertexPool, int band) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::pair<const BlockDefinition*, int> key(block.get(), band);
+    auto found = entries.find(key);
+    if (found != entries.end() && found->second.block.lock() == block)
+        return found->second.tessellation;
+
+    auto tessellation = std::make_shared<BlockTessellation>();
+    float pixelSize = bandPixelSize(band);
+    std::vector<CollapsedCell> collapsed;
+    for (const auto& shape : block->shapes) {
+        // Paths of blocks received from a collaboration host live in a pool of their own
+        auto path = dynamic_cast<const Polyline*>(shape.get());
+        tessellateShape(*shape, path ? *path->pool : vertexPool, pixelSize, tessellation->lines, tessellation->markers, collapsed);
+    }
+    // Parts under a pixel become pixel-long strokes, so that placing the block
+    // only ever copies lines and markers
+    std::sort(collapsed.begin(), collapsed.end());
+    collapsed.erase(std::unique(collapsed.begin(), collapsed.end()), collapsed.end());
+    for (const CollapsedCell& cell : collapsed) {
+        float x0 = static_cast<float>(cell.x) * pixelSize, y0 = (static_cast<float>(cell.y) + 0.5f) * pixelSize;
+        appendSegment(tessellation->lines, x0, y0, x0 + pixelSize, y0, shapeColor(cell.type));
+    }
+
+    if (entries.size() >= pruneAt) {
+        for (auto entry = entries.begin(); entry != entries.end();)
+            entry = entry->second.block.expired() ? entries.erase(entry) : std::next(entry);
+        pruneAt = std::max<std::size_t>(64, entries.size() * 2);
+    }
+    entries[key] = Entry{ block, tessellation };
+    return tessellation;
+}
+
+// One pixel quad per distinct cell and shape type: a dense chunk zoomed out
+// costs as many quads as the pixels it covers, not as many as its shapes.
+void emitCollapsed(std::vector<CollapsedCell>& collapsed, float pixelSize, std::vector<sf::Vertex>& quads) {
+    std::sort(collapsed.begin(), collapsed.end());
+    collapsed.erase(std::unique(collapsed.begin(), collapsed.end()), collapsed.end());
+    for (const CollapsedCell& cell : collapsed) {
+        float x0 = static_cast<float>(cell.x) * pixelSize, y0 = static_cast<float>(cell.y) * pixelSize;
+        appendQuad(quads, x0, y0, x0 + pixelSize, y0 + pixelSize, shapeColor(cell.type));
+    }
+    collapsed.clear();
+}
+
+// Appends the instances of `array` that meet `window`, each a copy of one
+// tessellation of the item. Once neighbouring instances come closer than
+// kArrayCellPixels, only every n-th column and row is visited and each visit
+// is drawn as a translucent quad over the cell of instances it stands for, so
+// the cost follows the pixels the array covers rather than its instances.
+void tessellateArray(const ShapeArray& array, const VertexPool& vertexPool, const Bounds& window, float pixelSize,
+    std::vector<sf::Vertex>& lines, std::vector<sf::Vertex>& markers, std::vector<sf::Vertex>& quads,
+    std::vector<CollapsedCell>& collapsed) {
+    std::size_t columnStride, rowStride;
+    array.strides(kArrayCellPixels * pixelSize, columnStride, rowStride);
+    std::vector<std::size_t> instances;
+    array.instancesIn(window, instances, false, columnStride, rowStride);
+    ShapeType itemType = array.item->type();
+    if (columnStride > 1 || rowStride > 1) {
+        sf::Color color = shapeColor(itemType);
+        color.a = 128;
+        for (std::size_t k : instances) {
+            Bounds cell = array.cellBounds(k, columnStride, rowStride);
+            float x0 = static_cast<float>(cell.minX), y0 = static_cast<float>(cell.minY);
+            appendQuad(quads, x0, y0, std::max(x0 + pixelSize, static_cast<float>(cell.maxX)),
+                std::max(y0 + pixelSize, static_cast<float>(cell.maxY)), color);
+        }
+        return;
+    }
+
+    std::vector<sf::Vertex> itemLines, itemMarkers;
+    std::vector<CollapsedCell> itemCells;
+    tessellateShape(*array.item, vertexPool, pixelSize, itemLines, itemMarkers, itemCells);
+    Bounds itemBox = array.item->bounds();
+    for (std::size_t k : instances) {
+        Point o = array.offset(k);
+        sf::Vector2f by(static_cast<float>(o.x), static_cast<float>(o.y));
+        for (const sf::Vertex& v : itemLines)
+            lines.push_back(sf::Vertex(v.position + by, v.color));
+        for (const sf::Vertex& v : itemMarkers)
+            markers.push_back(sf::Vertex(v.position + by, v.color));
+        if (!itemCells.empty()) {
+            collapsed.push_back(CollapsedCell{ static_cast<long long>(std::floor((itemBox.minX + o.x) / pixelSize)),
+                static_cast<long long>(std::floor((itemBox.minY + o.y) / pixelSize)), itemType });
+        }
+    }
+}
+
+// The part of the world the target's current view shows.
+Bounds viewWorldBounds(const sf::RenderTarget& target) {
+    const sf::View& view = target.getView();
+    sf::Vector2f half = view.getSize() / 2.f;
+    return Bounds(static_cast<int>(std::floor(view.getCenter().x - half.x)), static_cast<int>(std::floor(view.getCenter().y - half.y)),
+        static_cast<int>(std::ceil(view.getCenter().x + half.x)), static_cast<int>(std::ceil(view.getCenter().y + half.y)));
+}
+
+Bounds rangeBounds(const std::vector<Bounds>& boxes, std::size_t first, std::size_t last) {
+    Bounds box;
+    for (std::size_t i = first; i < last; ++i)
+        box.expand(boxes[i]);
+    return box;
+}
+
+}
+
+float viewPixelSize(const sf::RenderTarget& target) {
+    return target.getView().getSize().x / static_cast<float>(std::max(1u, target.getSize().x));
+}
+
+void drawShape(sf::RenderTarget& target, const Shape& shape, const VertexPool& vertexPool,
+    const sf::Color* highlight, float pixelSize) {
+    sf::Color color = highlight ? *highlight : shapeColor(shape.type());
+    if (auto array = dynamic_cast<const ShapeArray*>(&shape)) {
+        std::vector<sf::Vertex> lines, markers, quads;
+        std::vector<CollapsedCell> collapsed;
+        tessellateArray(*array, vertexPool, viewWorldBounds(target), pixelSize, lines, markers, quads, collapsed);
+        emitCollapsed(collapsed, pixelSize, quads);
+        if (highlight) {
+            for (auto* buffer : { &lines, &markers, &quads }) {
+                for (sf::Vertex& v : *buffer)
+                    v.color = sf::Color(highlight->r, highlight->g, highlight->b, v.color.a);
+            }
+        }
+        target.draw(quads.data(), quads.size(), sf::Quads);
+        target.draw(lines.data(), lines.size(), sf::Lines);
+        target.draw(markers.data(), markers.size(), sf::Quads);
+    }
+    else if (auto reference = dynamic_cast<const BlockReference*>(&shape)) {
+        // The shared tessellation of the block, placed by the render states
+        std::shared_ptr<const BlockTessellation> block = blockTessellations().get(reference->block, vertexPool,
+            zoomBand(pixelSize / static_cast<float>(reference->scale())));
+        const Affine2D& m = reference->placement;
+        sf::RenderStates states(sf::Transform(static_cast<float>(m.a), static_cast<float>(m.b), static_cast<float>(m.tx),
+            static_cast<float>(m.c), static_cast<float>(m.d), static_cast<float>(m.ty), 0.f, 0.f, 1.f));
+        if (highlight) {
+            std::vector<sf::Vertex> lines = block->lines, markers = block->markers;
+            for (auto* buffer : { &lines, &markers }) {
+                for (sf::Vertex& v : *buffer)
+                    v.color = *highlight;
+            }
+            target.draw(lines.data(), lines.size(), sf::Lines, states);
+            target.draw(markers.data(), markers.size(), sf::Quads, states);
+        }
+        else {
+            target.draw(block->lines.data(), block->lines.size(), sf::Lines, states);
+            target.draw(block->markers.data(), block->markers.size(), sf::Quads, states);
+        }
+    }
+    else if (auto p = dynamic_cast<const Point*>(&shape)) {
+        float radius = kPointRadiusPixels * pixelSize;
+        sf::CircleShape circle(radius, 12);
+        circle.setPosition(static_cast<float>(p->x) - radius, static_cast<float>(p->y) - radius); // center circle on point
+        circle.setFillColor(color);
+        target.draw(circle);
+    }
+    else if (auto l = dynamic_cast<const Line*>(&shape)) {
+        sf::Vertex line[] = {
+            sf::Vertex(sf::Vector2f(static_cast<float>(l->start.x), static_cast<float>(l->start.y)), color),
+            sf::Vertex(sf::Vector2f(static_cast<float>(l->end.x), static_cast<float>(l->end.y)), color)
+        };
+        target.draw(line, 2, sf::Lines);
+    }
+    else if (auto r = dynamic_cast<const Rectangle*>(&shape)) {
+        sf::RectangleShape rectShape(sf::Vector2f(static_cast<float>(r->width), static_cast<float>(r->height)));
+        rectShape.setPosition(static_cast<float>(r->topLeft.x), static_cast<float>(r->topLeft.y));
+        rectShape.setFillColor(sf::Color::Transparent);
+        rectShape.setOutlineColor(color);
+        rectShape.setOutlineThickness(kOutlinePixels * pixelSize);
+        target.draw(rectShape);
+    }
+    else if (auto c = dynamic_cast<const Circle*>(&shape)) {
+        float radius = static_cast<float>(c->radius);
+        sf::CircleShape circleShape(radius, screenCircleSegments(radius / pixelSize));
+        circleShape.setPosition(static_cast<float>(c->center.x) - radius, static_cast<float>(c->center.y) - radius);
+        circleShape.setFillColor(sf::Color::Transparent);
+        circleShape.setOutlineColor(color);
+        circleShape.setOutlineThickness(kOutlinePixels * pixelSize);
+        target.draw(circleShape);
+    }
+    else if (auto pl = dynamic_cast<const Polyline*>(&shape)) {
+        // One strip per ring; the closing vertex repeats the first for polygons
+        bool closed = pl->isClosed();
+        const int* xs = vertexPool.xs.data() + pl->offset;
+        const int* ys = vertexPool.ys.data() + pl->offset;
+        for (std::size_t r = 0; r <= pl->holes.size(); ++r) {
+            std::size_t first = r == 0 ? 0 : pl->holes[r - 1], last = r == pl->holes.size() ? pl->count : pl->holes[r];
+            sf::VertexArray strip(sf::LineStrip, last - first + (closed ? 1 : 0));
+            for (std::size_t i = 0; i < strip.getVertexCount(); ++i) {
+                std::size_t v = first + i % (last - first);
+                strip[i] = sf::Vertex(sf::Vector2f(static_cast<float>(xs[v]), static_cast<float>(ys[v])), color);
+            }
+            target.draw(strip);
+        }
+    }
+}
+
+void SceneRenderer::drawHeatmap(sf::RenderTarget& target) {
+    sf::Vector2u size = target.getSize();
+    if (heatTexture.getSize() != size)
+        heatTexture.create(size.x, size.y);
+    heatTexture.update(heatPixels.data());
+
+    // The grid is already in screen pixels: draw it 1:1 under a pixel view
+    sf::View cameraView = target.getView();
+    target.setView(sf::View(sf::FloatRect(0.f, 0.f, static_cast<float>(size.x), static_cast<float>(size.y))));
+    target.draw(sf::Sprite(heatTexture));
+    target.setView(cameraView);
+}
+
+void SceneRenderer::draw(sf::RenderTarget& target, const std::vector<std::shared_ptr<Shape>>& shapes,
+    const VertexPool& vertexPool, const SpatialIndex& index, const PointCloud& points) {
+    const sf::View& view = target.getView();
+    const float pixelSize = viewPixelSize(target);
+    Bounds viewBounds = viewWorldBounds(target);
+    ++frame;
+
+    visible.clear();
+    clusters.clear();
+    {
+        ProfileScope traversing(ProfileStage::Traversal);
+        index.collect(shapes, viewBounds, kImpostorPixels * pixelSize, 1.0 / (kImpostorPixelsPerShape * pixelSize * pixelSize), visible, clusters);
+    }
+
+    // Points go into a heatmap instead when too many of them are in view. Fewer
+    // points than the threshold overall cannot exceed it in view, so binning is
+    // skipped for small clouds.
+    heatmap = points.size() > kHeatmapPoints;
+    if (heatmap) {
+        ProfileScope tessellating(ProfileStage::Tessellation);
+        sf::Vector2u size = target.getSize();
+        sf::Vector2f origin = view.getCenter() - view.getSize() / 2.f;
+        heatmap = points.bin(origin.x, origin.y, pixelSize, size.x, size.y, density) > kHeatmapPoints;
+        if (heatmap)
+            densityToRgba(density, kHeatmapSaturation, heatPixels);
+    }
+
+    impostors.clear();
+    chunksInView.clear();
+    staleChunks.clear();
+    if (visible.size() <= kDetailedShapes) {
+        for (const auto& cluster : clusters) {
+            // Opacity grows with the number of shapes folded into the impostor
+            sf::Uint8 alpha = static_cast<sf::Uint8>(std::min<std::size_t>(255, 60 + 4 * cluster.count));
+            float x0 = static_cast<float>(cluster.box.minX), y0 = static_cast<float>(cluster.box.minY);
+            appendQuad(impostors, x0, y0, std::max(x0 + pixelSize, static_cast<float>(cluster.box.maxX)),
+                std::max(y0 + pixelSize, static_cast<float>(cluster.box.maxY)), sf::Color(90, 90, 90, alpha));
+        }
+
+        // Individual shapes tessellate inside their draw calls; timed as submission
+        ProfileScope submitting(ProfileStage::Submission);
+        target.draw(impostors.data(), impostors.size(), sf::Quads);
+        for (std::size_t i : visible) {
+            if (!heatmap || shapes[i]->type() != ShapeType::Point)
+                drawShape(target, *shapes[i], vertexPool, nullptr, pixelSize);
+        }
+        if (heatmap)
+            drawHeatmap(target);
+        return;
+    }
+
+    {
+        ProfileScope tessellating(ProfileStage::Tessellation);
+        syncChunks(index);
+        int band = zoomBand(pixelSize);
+        for (std::size_t c = 0; c < chunks.size(); ++c) {
+            Chunk& chunk = chunks[c];
+            if (overlaps(chunk.box, viewBounds)) {
+                chunksInView.push_back(c);
+                chunk.lastDrawn = frame;
+                if (chunk.dirty || chunk.band != band)
+                    staleChunks.push_back(c);
+            }
+            else if (chunk.band != kNoBand && frame - chunk.lastDrawn > kEvictFrames) {
+                std::vector<sf::Vertex>().swap(chunk.lines);
+                std::vector<sf::Vertex>().swap(chunk.quads);
+                std::vector<sf::Vertex>().swap(chunk.markers);
+                chunk.band = kNoBand;
+            }
+        }
+        if (!staleChunks.empty())
+            tessellateChunks(shapes, vertexPool, index, band);
+
+        // Shapes appended since the last index build are not in any chunk yet;
+        // the index rebuilds once they add up, so this stays a small share.
+        // Arrays are never in a chunk: only the part in view is expanded
+        float bandPixel = bandPixelSize(band);
+        std::vector<CollapsedCell> collapsed;
+        loose.lines.clear();
+        loose.quads.clear();
+        loose.markers.clear();
+        for (std::size_t i : visible) {
+            if (shapes[i]->type() == ShapeType::Array)
+                tessellateArray(static_cast<const ShapeArray&>(*shapes[i]), vertexPool, viewBounds, bandPixel,
+                    loose.lines, loose.markers, loose.quads, collapsed);
+            else if (i >= index.indexedCount())
+                tessellateShape(*shapes[i], vertexPool, bandPixel, loose.lines, loose.markers, collapsed);
+        }
+        emitCollapsed(collapsed, bandPixel, loose.quads);
+    }
+
+    ProfileScope submitting(ProfileStage::Submission);
+    for (std::size_t c : chunksInView)
+        drawChunk(target, chunks[c]);
+    drawChunk(target, loose);
+    if (heatmap)
+        drawHeatmap(target);
+}
+
+void SceneRenderer::markDirty(const SpatialIndex& index, const std::vector<std::size_t>& changed) {
+    // After a rebuild the chunks are cut again from scratch on the next draw
+    if (index.generation() != chunkGeneration)
+        return;
+    std::vector<std::size_t> touched;
+    for (std::size_t i : changed) {
+        if (i < index.indexedCount())
+            touched.push_back(index.position(i) / kChunkShapes);
+    }
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+    const std::vector<Bounds>& boxes = index.orderedBounds();
+    for (std::size_t c : touched) {
+        chunks[c].dirty = true;
+        chunks[c].box = rangeBounds(boxes, c * kChunkShapes, std::min(boxes.size(), (c + 1) * kChunkShapes));
+    }
+}
+
+void SceneRenderer::syncChunks(const SpatialIndex& index) {
+    std::size_t count = (index.indexedCount() + kChunkShapes - 1) / kChunkShapes;
+    if (index.generation() == chunkGeneration && chunks.size() == count)
+        return;
+    chunkGeneration = index.generation();
+    const std::vector<Bounds>& boxes = index.orderedBounds();
+    chunks.assign(count, Chunk());
+    for (std::size_t c = 0; c < count; ++c)
+        chunks[c].box = rangeBounds(boxes, c * kChunkShapes, std::min(boxes.size(), (c + 1) * kChunkShapes));
+}
+
+void SceneRenderer::tessellateChunks(const std::vector<std::shared_ptr<Shape>>& shapes, const VertexPool& vertexPool,
+    const SpatialIndex& index, int band) {
+    const float pixelSize = bandPixelSize(band);
+    const std::vector<std::uint32_t>& order = index.orderedShapes();
+    // One task per stale chunk, filling only that chunk's buffers
+    TaskScheduler::shared().parallelFor(staleChunks.size(), 1, [&](std::size_t firstStale, std::size_t lastStale) {
+        std::vector<CollapsedCell> collapsed;
+        for (std::size_t s = firstStale; s < lastStale; ++s) {
+            Chunk& chunk = chunks[staleChunks[s]];
+            chunk.lines.clear();
+            chunk.quads.clear();
+            chunk.markers.clear();
+            std::size_t first = staleChunks[s] * kChunkShapes, last = std::min(order.size(), first + kChunkShapes);
+            for (std::size_t p = first; p < last; ++p) {
+                if (shapes[order[p]]->type() != ShapeType::Array)
+                    tessellateShape(*shapes[order[p]], vertexPool, pixelSize, chunk.lines, chunk.markers, collapsed);
+            }
+            emitCollapsed(collapsed, pixelSize, chunk.quads);
+            chunk.band = band;
+            chunk.dirty = false;
+        }
+    });
+}
+
+void SceneRenderer::drawChunk(sf::RenderTarget& target, const Chunk& chunk) const {
+    target.draw(chunk.quads.data(), chunk.quads.size(), sf::Quads);
+    target.draw(chunk.lines.data(), chunk.lines.size(), sf::Lines);
+    if (!heatmap)
+        target.draw(chunk.markers.data(), chunk.markers.size(), sf::Quads);
+}
+
+std::size_t SceneRenderer::drawnShapes() const {
+    return chunksInView.empty() ? visible.size() : 0;
+}
+
+std::size_t SceneRenderer::drawnImpostors() const {
+    return impostors.size() / 4;
+}
+
+std::size_t SceneRenderer::drawnChunks() const {
+    return chunksInView.size();
+}
+
+std::size_t SceneRenderer::tessellatedChunks() const {
+    return staleChunks.size();
+}
+
+bool SceneRenderer::drewHeatmap() const {
+    return heatmap;
+}
+
+bool SceneLayer::composite(sf::RenderTarget& target, const sf::View& view, bool sceneChanged,
+    const std::function<void(sf::RenderTarget&)>& drawScene) {
+    sf::Vector2u pixels = target.getSize();
+    if (layer.getSize() != pixels) {
+        valid = layer.create(pixels.x, pixels.y);
+        if (!valid) {
+            target.setView(view);
+            drawScene(target);
+            return true;
+        }
+    }
+
+    bool redraw = !valid || sceneChanged || view.getCenter() != center || view.getSize() != size;
+    if (redraw) {
+        layer.setView(view);
+        layer.clear(sf::Color::White);
+        drawScene(layer);
+        layer.display();
+        center = view.getCenter();
+        size = view.getSize();
+        valid = true;
+    }
+
+    // The layer matches the target pixel for pixel: copy it under a pixel view
+    target.setView(sf::View(sf::FloatRect(0.f, 0.f, static_cast<float>(pixels.x), static_cast<float>(pixels.y))));
+    target.draw(sf::Sprite(layer.getTexture()));
+    target.setView(view);
+    return redraw;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <climits>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "SFML/Graphics.hpp"
+#include "PointCloud.h"
+#include "Shape.h"
+#include "SpatialIndex.h"
+
+// Draws one shape in its usual color, or entirely in `highlight` when given.
+// `pixelSize` is the world size of one screen pixel under the current view:
+// markers and outline widths stay constant on screen and circles get as many
+// segments as their on-screen radius needs.
+void drawShape(sf::RenderTarget& target, const Shape& shape, const VertexPool& vertexPool,
+    const sf::Color* highlight, float pixelSize = 1.f);
+
+// Level-of-detail drawing of the scene through the target's current view.
+//  - Only shapes whose bounds meet the view are visited, found through the index.
+//  - Index subtrees under eight pixels on screen that hold at least one shape
+//    per 4x4 pixels are drawn as a single grey impostor quad whose opacity follows
+//    the number of shapes inside.
+//  - Up to 20000 visible shapes are drawn individually at full quality. Beyond
+//    that the scene is drawn from cached vertex buffers, one set per chunk of
+//    4096 shapes taken in index order, so every chunk covers a compact area.
+//    A chunk is tessellated for a band of zoom levels (shapes under a pixel
+//    collapse to a single pixel and circles use screen-space tessellation) by a
+//    worker thread writing only that chunk's buffers; the render thread just
+//    submits the buffers of chunks in view. A chunk is tessellated again only
+//    when markDirty() names one of its shapes, the index is rebuilt or the zoom
+//    leaves its band, and chunks left out of view for a while drop their buffers.
+//  - Arrays stay out of the chunks: every frame, the instances in view are
+//    copied from one tessellation of the item, and once neighbours come
+//    closer than three pixels a strided subset is drawn as translucent cells.
+//  - Each block is tessellated once per zoom band, in block coordinates, and
+//    every reference in view copies those vertices through its placement, or
+//    draws them under a transform when shapes are drawn individually.
+//  - With more than 20000 Point shapes in view, points are binned into a
+//    screen-resolution density grid and drawn as one heatmap texture instead.
+class SceneRenderer {
+public:
+    void draw(sf::RenderTarget& target, const std::vector<std::shared_ptr<Shape>>& shapes,
+        const VertexPool& vertexPool, const SpatialIndex& index, const PointCloud& points);
+    // Flags the chunks holding `changed` shapes, after `index` was refit to them.
+    void markDirty(const SpatialIndex& index, const std::vector<std::size_t>& changed);
+    // Shapes drawn individually and impostors drawn by the last call to draw().
+    std::size_t drawnShapes() const;
+    std::size_t drawnImpostors() const;
+    // Chunks submitted and chunks tessellated by the last call to draw().
+    std::size_t drawnChunks() const;
+    std::size_t tessellatedChunks() const;
+    // True when the last call to draw() rendered points as a heatmap.
+    bool drewHeatmap() const;
+
+private:
+    struct Chunk {
+        Bounds box;
+        std::vector<sf::Vertex> lines, quads;
+        std::vector<sf::Vertex> markers; // Point shapes, left out under the heatmap
+        int band = INT_MIN;              // zoom band tessellated for; INT_MIN when empty
+        bool dirty = true;
+        unsigned long long lastDrawn = 0; // frame number
+    };
+
+    std::vector<std::size_t> visible;
+    std::vector<IndexCluster> clusters;
+    std::vector<sf::Vertex> impostors;
+    std::vector<Chunk> chunks;
+    unsigned long long chunkGeneration = 0; // index generation the chunks were cut from
+    unsigned long long frame = 0;
+    std::vector<std::size_t> chunksInView, staleChunks;
+    Chunk loose; // shapes appended since the index was built, tessellated every frame
+    bool heatmap = false;
+    std::vector<std::uint32_t> density;
+    std::vector<std::uint8_t> heatPixels;
+    sf::Texture heatTexture;
+
+    void syncChunks(const SpatialIndex& index);
+    void tessellateChunks(const std::vector<std::shared_ptr<Shape>>& shapes, const VertexPool& vertexPool,
+        const SpatialIndex& index, int band);
+    void drawChunk(sf::RenderTarget& target, const Chunk& chunk) const;
+    void drawHeatmap(sf::RenderTarget& target);
+};
+
+// Offscreen copy of the committed scene, so that previews, highlights and the
+// HUD can change every frame without the scene being drawn again underneath.
+class SceneLayer {
+public:
+    // Draws the scene into the layer through `view` with `drawScene` when the
+    // target was resized, the view moved or `sceneChanged` is set, then copies the
+    // layer onto `target` and leaves `view` set on it. Falls back to drawing the
+    // scene straight into `target` when no offscreen texture can be created.
+    // Returns true when `drawScene` ran.
+    bool composite(sf::RenderTarget& target, const sf::View& view, bool sceneChanged,
+        const std::function<void(sf::RenderTarget&)>& drawScene);
+
+private:
+    sf::RenderTexture layer;
+    bool valid = false;
+    sf::Vector2f center, size; // view the layer was drawn through
+};
+
+// World size of one screen pixel for the target's current view.
+float viewPixelSize(const sf::RenderTarget& target);
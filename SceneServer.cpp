@@ -0,0 +1,330 @@
+#include "SceneServer.h"
+#include <iostream>
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+const std::size_t kMaxInput = 16 << 20;        // a longer line without a newline closes the connection; bulk adds of about a million points fit
+const std::size_t kMaxPendingOutput = 4 << 20; // stop running a client's commands while this much is unsent
+const int kMaxEvents = 256;
+const std::chrono::seconds kReportInterval(5);
+
+volatile std::sig_atomic_t stopRequested = 0;
+
+void requestStop(int) {
+    stopRequested = 1;
+}
+
+std::int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Command latencies, from the read that completed a command line to its reply
+// being queued, so time spent behind earlier pipelined commands counts too.
+class ServerStats {
+public:
+    ServerStats() : since(nowNs()) {
+        latencies.reserve(kWindow);
+    }
+
+    void record(std::int64_t ns) {
+        if (latencies.size() < kWindow)
+            latencies.push_back(ns);
+        else
+            latencies[next] = ns;
+        next = (next + 1) % kWindow;
+        ++commands;
+    }
+
+    // Rate since the last reset and percentiles over the last 64k commands.
+    std::string summary() const {
+        double seconds = std::max(1e-9, (nowNs() - since) / 1e9);
+        char text[192];
+        if (latencies.empty()) {
+            std::snprintf(text, sizeof(text), "%d clients, 0 commands/s\n", clients);
+            return text;
+        }
+        std::vector<std::int64_t> sorted(latencies);
+        auto percentile = [&](double p) {
+            std::size_t k = std::min(sorted.size() - 1, static_cast<std::size_t>(p * sorted.size()));
+            std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+            return sorted[k] / 1000.0;
+        };
+        double p50 = percentile(0.50), p95 = percentile(0.95), p99 = percentile(0.99);
+        std::snprintf(text, sizeof(text), "%d clients, %.0f commands/s, latency p50 %.1f us, p95 %.1f us, p99 %.1f us\n",
+            clients, commands / seconds, p50, p95, p99);
+        return text;
+    }
+
+    void reset() {
+        commands = 0;
+        since = nowNs();
+    }
+
+    int clients = 0;
+
+private:
+    static const std::size_t kWindow = 1 << 16;
+
+    std::vector<std::int64_t> latencies;
+    std::size_t next = 0;
+    std::uint64_t commands = 0;
+    std::int64_t since;
+};
+
+struct Client {
+    std::unique_ptr<CommandInterpreter> interpreter;
+    std::string input, output;
+    std::int64_t receivedAt = 0;
+    bool finished = false;  // sent "exit": close once the replies are out
+    bool peerClosed = false;
+    std::uint32_t events = 0; // the epoll interest currently registered
+};
+
+class Server {
+public:
+    Server(int epoll, int listener, Scene& scene, SceneOwner& owner)
+        : epoll(epoll), listener(listener), scene(scene), owner(owner) {
+    }
+
+    void acceptClients() {
+        for (;;) {
+            int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+                return; // EAGAIN once the backlog is empty; other errors only lose that client
+            Client& client = clients[fd];
+            client = Client();
+            client.interpreter.reset(new CommandInterpreter(scene, owner));
+            client.events = EPOLLIN | EPOLLRDHUP;
+            epoll_event event = {};
+            event.events = client.events;
+            event.data.fd = fd;
+            epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+            ++stats.clients;
+        }
+    }
+
+    void handle(int fd, std::uint32_t events) {
+        auto found = clients.find(fd);
+        if (found == clients.end())
+            return;
+        Client& client = found->second;
+        if (events & EPOLLERR) {
+            close(fd);
+            return;
+        }
+        if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP))
+            receive(fd, client);
+        // Run what has arrived and send all of its replies in one write
+        for (;;) {
+            runCommands(client);
+            if (!flush(fd, client)) {
+                close(fd);
+                return;
+            }
+            // Stop once the socket is full or nothing runnable is left
+            if (!client.output.empty() || client.finished || client.input.find('\n') == std::string::npos)
+                break;
+        }
+        if (client.output.empty() && (client.finished || client.peerClosed)) {
+            close(fd);
+            return;
+        }
+        if (client.input.size() >= kMaxInput && client.input.find('\n') == std::string::npos) {
+            std::cerr << "Client sent an overlong line; closing it\n";
+            close(fd);
+            return;
+        }
+        std::uint32_t wanted = client.output.empty() ? 0u : static_cast<std::uint32_t>(EPOLLOUT);
+        if (!client.finished && !client.peerClosed && client.input.size() < kMaxInput)
+            wanted |= EPOLLIN | EPOLLRDHUP;
+        if (wanted != client.events) {
+            client.events = wanted;
+            epoll_event event = {};
+            event.events = wanted;
+            event.data.fd = fd;
+            epoll_ctl(epoll, EPOLL_CTL_MOD, fd, &event);
+        }
+    }
+
+    void closeAll() {
+        while (!clients.empty())
+            close(clients.begin()->first);
+    }
+
+    ServerStats stats;
+
+private:
+    int epoll, listener;
+    Scene& scene;
+    SceneOwner& owner;
+    std::unordered_map<int, Client> clients;
+
+    void receive(int fd, Client& client) {
+        char buffer[64 * 1024];
+        while (!client.peerClosed && client.input.size() < kMaxInput) {
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n > 0) {
+                client.input.append(buffer, static_cast<std::size_t>(n));
+                client.receivedAt = nowNs();
+            }
+            else if (n == 0) {
+                client.peerClosed = true;
+            }
+            else if (errno == EINTR) {
+                continue;
+            }
+            else {
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    client.peerClosed = true;
+                break;
+            }
+        }
+    }
+
+    void runCommands(Client& client) {
+        std::size_t start = 0;
+        while (!client.finished && client.output.size() < kMaxPendingOutput) {
+            std::size_t end = client.input.find('\n', start);
+            if (end == std::string::npos)
+                break;
+            std::string line = client.input.substr(start, end - start);
+            start = end + 1;
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+
+            std::ostringstream reply;
+            if (line == "serverstats")
+                reply << stats.summary();
+            else if (!client.interpreter->execute(line, reply))
+                client.finished = true;
+            client.output += reply.str();
+            client.output += ".\n";
+            stats.record(nowNs() - client.receivedAt);
+        }
+        client.input.erase(0, start);
+    }
+
+    // Writes as much pending output as the socket takes. False on a dead peer.
+    bool flush(int fd, Client& client) {
+        std::size_t sent = 0;
+        while (sent < client.output.size()) {
+            ssize_t n = send(fd, client.output.data() + sent, client.output.size() - sent, MSG_NOSIGNAL);
+            if (n > 0)
+                sent += static_cast<std::size_t>(n);
+            else if (n < 0 && errno == EINTR)
+                continue;
+            else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                break;
+            else
+                return false;
+        }
+        client.output.erase(0, sent);
+        return true;
+    }
+
+    void close(int fd) {
+        epoll_ctl(epoll, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        clients.erase(fd);
+        --stats.clients;
+    }
+};
+
+}
+
+int runSceneServer(const std::string& socketPath, Scene& scene, SceneOwner& owner) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path must be 1 to " << sizeof(address.sun_path) - 1 << " characters\n";
+        return 1;
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listener < 0) {
+        std::perror("socket");
+        return 1;
+    }
+    // A socket file left behind by an earlier run would make bind fail
+    unlink(socketPath.c_str());
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(listener, SOMAXCONN) < 0) {
+        std::perror(socketPath.c_str());
+        ::close(listener);
+        return 1;
+    }
+    int epoll = epoll_create1(EPOLL_CLOEXEC);
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = listener;
+    if (epoll < 0 || epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &event) < 0) {
+        std::perror("epoll");
+        ::close(listener);
+        return 1;
+    }
+
+    stopRequested = 0;
+    std::signal(SIGINT, requestStop);
+    std::signal(SIGTERM, requestStop);
+    std::cout << "Serving on " << socketPath << " (Ctrl+C stops)" << std::endl;
+
+    Server server(epoll, listener, scene, owner);
+    epoll_event events[kMaxEvents];
+    auto nextReport = std::chrono::steady_clock::now() + kReportInterval;
+    while (!stopRequested) {
+        int timeout = static_cast<int>(std::max<long long>(0,
+            std::chrono::duration_cast<std::chrono::milliseconds>(nextReport - std::chrono::steady_clock::now()).count()));
+        int ready = epoll_wait(epoll, events, kMaxEvents, timeout);
+        if (ready < 0 && errno != EINTR) {
+            std::perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < ready; ++i) {
+            if (events[i].data.fd == listener)
+                server.acceptClients();
+            else
+                server.handle(events[i].data.fd, events[i].events);
+        }
+        if (std::chrono::steady_clock::now() >= nextReport) {
+            std::cout << server.stats.summary() << std::flush;
+            server.stats.reset();
+            nextReport = std::chrono::steady_clock::now() + kReportInterval;
+        }
+    }
+
+    server.closeAll();
+    ::close(epoll);
+    ::close(listener);
+    unlink(socketPath.c_str());
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    std::cout << "Server stopped.\n";
+    return 0;
+}
+
+#else
+
+int runSceneServer(const std::string&, Scene&, SceneOwner&) {
+    std::cerr << "--serve needs epoll and is only available on Linux\n";
+    return 1;
+}
+
+#endif
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+#include "CommandInterpreter.h"
+
+// Headless mode ("MiniCad --serve <socket path>"): serves the console command
+// language over a UNIX stream socket, with no window or render thread. One
+// epoll loop multiplexes every client, each with its own interpreter, so
+// transactions stay per client. A client may pipeline any number of
+// command lines without waiting; each reply ends with a line holding a single
+// ".", and all the replies produced for a client in one pass of the loop go
+// out in a single write. "serverstats" replies with the commands per second
+// and latency percentiles, which the server also prints every five seconds.
+// Runs until SIGINT or SIGTERM and returns the process exit code. Linux only.
+int runSceneServer(const std::string& socketPath, Scene& scene, SceneOwner& owner);
@@ -0,0 +1,551 @@
+#include "Session.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+
+namespace {
+
+// Every packet starts with one of these.
+enum SessionMessage : sf::Uint8 {
+    ShapesMessage,  // host -> viewer: Uint32 keep, Uint32 count, count x (Uint32 index, shape)
+    EditMessage,    // viewer -> host: shape
+    CommandMessage, // viewer -> host: command line
+    ReplyMessage,   // host -> viewer: reply text
+};
+
+const std::chrono::milliseconds kPublishInterval(20);
+
+const sf::Uint32 kBlockByName = 0xFFFFFFFF;
+
+// Block definitions already written to or read from one packet. Each travels
+// once per packet; later references to it send its number in the packet.
+struct PacketBlocks {
+    std::vector<const BlockDefinition*> written;
+    std::vector<std::shared_ptr<const BlockDefinition>> read;
+};
+
+// A shape travels as its Add* command: the op, then its coordinates, or the
+// vertex count and vertices for paths, then for polygons the hole count and
+// where each hole starts. An array sends its pattern, the count and numbers of
+// the instances taken out, then its item. A block reference sends the block
+// name, its placement and the block's number in the packet, followed by the
+// shape count and shapes the first time the block appears.
+void writeShape(sf::Packet& packet, const SceneCommand& add, PacketBlocks& blocks) {
+    const int* c = add.coords;
+    packet << static_cast<sf::Uint8>(add.op);
+    switch (add.op) {
+    case SceneOp::AddReference: {
+        const Affine2D& m = add.matrix;
+        packet << add.block->name << m.a << m.b << m.c << m.d << m.tx << m.ty;
+        const BlockDefinition* definition = add.block->definition.get();
+        if (!definition) {
+            packet << kBlockByName;
+            break;
+        }
+        auto sent = std::find(blocks.written.begin(), blocks.written.end(), definition);
+        packet << static_cast<sf::Uint32>(sent - blocks.written.begin());
+        if (sent == blocks.written.end()) {
+            blocks.written.push_back(definition);
+            packet << static_cast<sf::Uint32>(definition->shapes.size());
+            for (const auto& shape : definition->shapes)
+                writeShape(packet, SceneCommand::addCopy(*shape), blocks);
+        }
+        break;
+    }
+    case SceneOp::AddArray: {
+        const ArrayPattern& p = add.array->pattern;
+        packet << static_cast<sf::Uint8>(p.kind);
+        for (int value : { p.columns, p.rows, p.columnX, p.columnY, p.rowX, p.rowY, p.centerX, p.centerY, p.fillDegrees })
+            packet << sf::Int32(value);
+        packet << static_cast<sf::Uint32>(add.array->removed.size());
+        for (std::size_t k : add.array->removed)
+            packet << static_cast<sf::Uint64>(k);
+        writeShape(packet, add.array->item, blocks);
+        break;
+    }
+    case SceneOp::AddPoint:
+        packet << sf::Int32(c[0]) << sf::Int32(c[1]);
+        break;
+    case SceneOp::AddCircle:
+        packet << sf::Int32(c[0]) << sf::Int32(c[1]) << sf::Int32(c[2]);
+        break;
+    case SceneOp::AddLine:
+    case SceneOp::AddRectangle:
+        packet << sf::Int32(c[0]) << sf::Int32(c[1]) << sf::Int32(c[2]) << sf::Int32(c[3]);
+        break;
+    default:
+        packet << static_cast<sf::Uint32>(add.path.size());
+        for (const Point& p : add.path)
+            packet << sf::Int32(p.x) << sf::Int32(p.y);
+        if (add.op == SceneOp::AddPolygon) {
+            packet << static_cast<sf::Uint32>(add.holes.size());
+            for (std::size_t hole : add.holes)
+                packet << static_cast<sf::Uint32>(hole);
+        }
+        break;
+    }
+}
+
+bool readShape(sf::Packet& packet, SceneCommand& add, PacketBlocks& blocks) {
+    sf::Uint8 op = 0;
+    sf::Int32 c[4] = {};
+    packet >> op;
+    switch (static_cast<SceneOp>(op)) {
+    case SceneOp::AddReference: {
+        std::string name;
+        Affine2D placement;
+        sf::Uint32 number = 0;
+        packet >> name >> placement.a >> placement.b >> placement.c >> placement.d >> placement.tx >> placement.ty >> number;
+        if (!packet || !isValidBlockName(name) || !isValidPlacement(placement))
+            return false;
+        if (number == kBlockByName) {
+            add = SceneCommand::addReference(std::move(name), placement);
+            break;
+        }
+        if (number > blocks.read.size())
+            return false;
+        if (number == blocks.read.size()) {
+            // Blocks hold single shapes, each taking at least five bytes
+            sf::Uint32 count = 0;
+            packet >> count;
+            if (!packet || count == 0 || count > packet.getDataSize() / 5)
+                return false;
+            auto definition = std::make_shared<BlockDefinition>(name);
+            auto pool = std::make_shared<VertexPool>();
+            for (sf::Uint32 i = 0; i < count; ++i) {
+                SceneCommand shape;
+                if (!readShape(packet, shape, blocks) || !isSingleShapeAdd(shape))
+                    return false;
+                definition->append(makeSingleShape(shape, pool));
+            }
+            blocks.read.push_back(std::move(definition));
+        }
+        if (blocks.read[number]->name != name)
+            return false;
+        add = SceneCommand::addReference(blocks.read[number], placement);
+        break;
+    }
+    case SceneOp::AddArray: {
+        sf::Uint8 kind = 0;
+        sf::Int32 v[9] = {};
+        sf::Uint32 count = 0;
+        packet >> kind;
+        for (sf::Int32& value : v)
+            packet >> value;
+        packet >> count;
+        if (!packet || kind > static_cast<sf::Uint8>(ArrayKind::Polar) || count > packet.getDataSize() / 8)
+            return false;
+        ArrayPattern pattern;
+        pattern.kind = static_cast<ArrayKind>(kind);
+        int* fields[] = { &pattern.columns, &pattern.rows, &pattern.columnX, &pattern.columnY, &pattern.rowX, &pattern.rowY,
+            &pattern.centerX, &pattern.centerY, &pattern.fillDegrees };
+        for (int i = 0; i < 9; ++i)
+            *fields[i] = v[i];
+        std::vector<std::size_t> removed(count);
+        for (std::size_t& k : removed) {
+            sf::Uint64 value = 0;
+            packet >> value;
+            k = static_cast<std::size_t>(value);
+        }
+        // Arrays do not nest and hold no block references
+        SceneCommand item;
+        if (!packet || !readShape(packet, item, blocks) || !isSingleShapeAdd(item))
+            return false;
+        add = SceneCommand::addArray(pattern, std::move(item), std::move(removed));
+        if (!isValidArray(*add.array))
+            return false;
+        break;
+    }
+    case SceneOp::AddPoint:
+        packet >> c[0] >> c[1];
+        add = SceneCommand::addPoint(c[0], c[1]);
+        break;
+    case SceneOp::AddCircle:
+        packet >> c[0] >> c[1] >> c[2];
+        add = SceneCommand::addCircle(c[0], c[1], c[2]);
+        break;
+    case SceneOp::AddLine:
+        packet >> c[0] >> c[1] >> c[2] >> c[3];
+        add = SceneCommand::addLine(c[0], c[1], c[2], c[3]);
+        break;
+    case SceneOp::AddRectangle:
+        packet >> c[0] >> c[1] >> c[2] >> c[3];
+        add = SceneCommand::addRectangle(c[0], c[1], c[2], c[3]);
+        break;
+    case SceneOp::AddPolyline:
+    case SceneOp::AddPolygon: {
+        sf::Uint32 count = 0;
+        packet >> count;
+        // Each vertex takes 8 bytes, which bounds the count before allocating
+        if (!packet || count < 2 || count > packet.getDataSize() / 8)
+            return false;
+        std::vector<Point> points;
+        points.reserve(count);
+        for (sf::Uint32 i = 0; i < count; ++i) {
+            packet >> c[0] >> c[1];
+            points.push_back(Point(c[0], c[1]));
+        }
+        std::vector<std::size_t> holes;
+        if (static_cast<SceneOp>(op) == SceneOp::AddPolygon) {
+            sf::Uint32 holeCount = 0;
+            packet >> holeCount;
+            // Every hole has at least three of the vertices
+            if (!packet || holeCount > count / 3)
+                return false;
+            holes.resize(holeCount);
+            for (std::size_t& hole : holes) {
+                sf::Uint32 start = 0;
+                packet >> start;
+                hole = start;
+            }
+        }
+        add = SceneCommand::addPath(std::move(points), static_cast<SceneOp>(op) == SceneOp::AddPolygon, std::move(holes));
+        break;
+    }
+    default:
+        return false;
+    }
+    // The same checks as for adds typed on the console or read from a file
+    return packet && isValidAdd(add);
+}
+
+bool readShapes(sf::Packet& packet, SceneDelta& delta) {
+    sf::Uint32 keep = 0, count = 0;
+    packet >> keep >> count;
+    if (!packet)
+        return false;
+    delta.keep = keep;
+    PacketBlocks blocks;
+    for (sf::Uint32 i = 0; i < count; ++i) {
+        sf::Uint32 index = 0;
+        SceneCommand add;
+        packet >> index;
+        // The host's shapes carry their blocks; only edits name one
+        if (!readShape(packet, add, blocks) || (add.op == SceneOp::AddReference && !add.block->definition))
+            return false;
+        if (!delta.shapes.empty() && index <= delta.shapes.back().first)
+            return false;
+        delta.shapes.push_back(std::make_pair(static_cast<std::size_t>(index), std::move(add)));
+    }
+    return true;
+}
+
+}
+
+SessionHost::SessionHost(Scene& scene, SceneOwner& owner) : scene(scene), owner(owner) {
+}
+
+SessionHost::~SessionHost() {
+    if (!thread.joinable())
+        return;
+    stopping.store(true);
+    thread.join();
+    for (auto& viewer : viewers)
+        viewer->socket.disconnect();
+    listener.close();
+    InstrumentedLock lock(scene.mutex);
+    scene.recordChanges = false;
+    scene.changes.clear();
+}
+
+bool SessionHost::start(unsigned short port, const sf::IpAddress& address) {
+    if (listener.listen(port, address) != sf::Socket::Done)
+        return false;
+    selector.add(listener);
+    {
+        InstrumentedLock lock(scene.mutex);
+        scene.recordChanges = true;
+        scene.changes.clear();
+        snapshot = encodeSnapshot();
+        publishedCount = scene.shapes.size();
+    }
+    thread = std::thread(&SessionHost::run, this);
+    return true;
+}
+
+void SessionHost::run() {
+    auto lastPublish = std::chrono::steady_clock::now();
+    while (!stopping.load()) {
+        // Unsent output is retried every few milliseconds, since the selector only reports readable sockets
+        bool backlog = std::any_of(viewers.begin(), viewers.end(),
+            [](const std::unique_ptr<Viewer>& viewer) { return !viewer->outbox.empty(); });
+        if (selector.wait(sf::milliseconds(backlog ? 2 : 20))) {
+            if (selector.isReady(listener))
+                accept();
+            for (auto& viewer : viewers) {
+                if (selector.isReady(viewer->socket))
+                    receive(*viewer);
+            }
+        }
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastPublish >= kPublishInterval) {
+            publish();
+            lastPublish = now;
+        }
+        for (auto& viewer : viewers) {
+            if (!viewer->dropped && !flush(*viewer))
+                viewer->dropped = true;
+        }
+        auto gone = std::remove_if(viewers.begin(), viewers.end(), [&](const std::unique_ptr<Viewer>& viewer) {
+            if (viewer->dropped) {
+                selector.remove(viewer->socket);
+                std::cout << "Viewer " << viewer->address << " left the session.\n";
+            }
+            return viewer->dropped;
+        });
+        viewers.erase(gone, viewers.end());
+    }
+}
+
+void SessionHost::accept() {
+    std::unique_ptr<Viewer> viewer(new Viewer());
+    if (listener.accept(viewer->socket) != sf::Socket::Done)
+        return;
+    viewer->socket.setBlocking(false);
+    viewer->interpreter.reset(new CommandInterpreter(scene, owner, CommandAccess::SceneOnly));
+    viewer->address = viewer->socket.getRemoteAddress().toString();
+    selector.add(viewer->socket);
+    resync(*viewer);
+    std::cout << "Viewer " << viewer->address << " joined the session.\n";
+    viewers.push_back(std::move(viewer));
+}
+
+void SessionHost::receive(Viewer& viewer) {
+    for (;;) {
+        sf::Packet packet;
+        sf::Socket::Status status = viewer.socket.receive(packet);
+        if (status == sf::Socket::NotReady)
+            return;
+        if (status != sf::Socket::Done) {
+            viewer.dropped = true;
+            return;
+        }
+        sf::Uint8 type = 0;
+        packet >> type;
+        if (type == EditMessage) {
+            SceneCommand add;
+            PacketBlocks blocks;
+            // Viewers draw single shapes; anything else comes as a command
+            if (readShape(packet, add, blocks) && isSingleShapeAdd(add))
+                owner.post(std::move(add));
+        }
+        else if (type == CommandMessage) {
+            std::string line;
+            packet >> line;
+            std::ostringstream out;
+            viewer.interpreter->execute(line, out);
+            sf::Packet reply;
+            reply << static_cast<sf::Uint8>(ReplyMessage) << out.str();
+            viewer.outbox.push_back(reply);
+        }
+    }
+}
+
+void SessionHost::publish() {
+    InstrumentedLock lock(scene.mutex);
+    if (scene.changes.empty())
+        return;
+
+    // Replay the changes on the shape count alone: shapes at or past `keep`
+    // are sent whole, earlier ones once each however often they changed
+    std::size_t count = publishedCount, keep = publishedCount;
+    bool rebuilt = false;
+    std::vector<std::size_t> modified;
+    for (const SceneChange& change : scene.changes) {
+        switch (change.kind) {
+        case SceneChange::Added:
+            ++count;
+            break;
+        case SceneChange::Modified:
+            modified.push_back(change.index);
+            break;
+        case SceneChange::Removed:
+            // Only removing the last shape keeps the other indices valid
+            if (change.index + 1 == count) {
+                --count;
+                keep = std::min(keep, count);
+            }
+            else {
+                rebuilt = true;
+            }
+            break;
+        case SceneChange::Rebuilt:
+            rebuilt = true;
+            break;
+        }
+    }
+    scene.changes.clear();
+    publishedCount = scene.shapes.size();
+
+    if (rebuilt || count != scene.shapes.size()) {
+        snapshot = encodeSnapshot();
+        tail.clear();
+        tailBytes = 0;
+        for (auto& viewer : viewers)
+            enqueue(*viewer, snapshot);
+        return;
+    }
+
+    std::sort(modified.begin(), modified.end());
+    modified.erase(std::unique(modified.begin(), modified.end()), modified.end());
+    modified.erase(std::lower_bound(modified.begin(), modified.end(), keep), modified.end());
+    sf::Packet delta;
+    PacketBlocks blocks;
+    delta << static_cast<sf::Uint8>(ShapesMessage) << static_cast<sf::Uint32>(keep)
+        << static_cast<sf::Uint32>(modified.size() + count - keep);
+    for (std::size_t index : modified) {
+        delta << static_cast<sf::Uint32>(index);
+        writeShape(delta, SceneCommand::addCopy(*scene.shapes[index]), blocks);
+    }
+    for (std::size_t index = keep; index < count; ++index) {
+        delta << static_cast<sf::Uint32>(index);
+        writeShape(delta, SceneCommand::addCopy(*scene.shapes[index]), blocks);
+    }
+    tail.push_back(delta);
+    tailBytes += delta.getDataSize();
+    for (auto& viewer : viewers)
+        enqueue(*viewer, delta);
+    // Joiners replay the tail; once it outweighs a snapshot, a fresh snapshot is cheaper
+    if (tailBytes > snapshot.getDataSize()) {
+        snapshot = encodeSnapshot();
+        tail.clear();
+        tailBytes = 0;
+    }
+}
+
+sf::Packet SessionHost::encodeSnapshot() const {
+    sf::Packet packet;
+    PacketBlocks blocks;
+    packet << static_cast<sf::Uint8>(ShapesMessage) << sf::Uint32(0) << static_cast<sf::Uint32>(scene.shapes.size());
+    for (std::size_t index = 0; index < scene.shapes.size(); ++index) {
+        packet << static_cast<sf::Uint32>(index);
+        writeShape(packet, SceneCommand::addCopy(*scene.shapes[index]), blocks);
+    }
+    return packet;
+}
+
+void SessionHost::enqueue(Viewer& viewer, const sf::Packet& packet) {
+    if (viewer.outbox.size() < kMaxQueued)
+        viewer.outbox.push_back(packet);
+    else
+        resync(viewer);
+}
+
+void SessionHost::resync(Viewer& viewer) {
+    // The snapshot and tail hold every queued update; a partly sent front
+    // packet still has to be finished and command replies must not be lost
+    if (viewer.outbox.size() > 1) {
+        auto isReply = [](const sf::Packet& packet) {
+            return packet.getDataSize() > 0 && static_cast<const sf::Uint8*>(packet.getData())[0] == ReplyMessage;
+        };
+        auto kept = std::stable_partition(viewer.outbox.begin() + 1, viewer.outbox.end(), isReply);
+        viewer.outbox.erase(kept, viewer.outbox.end());
+    }
+    viewer.outbox.push_back(snapshot);
+    viewer.outbox.insert(viewer.outbox.end(), tail.begin(), tail.end());
+}
+
+bool SessionHost::flush(Viewer& viewer) {
+    while (!viewer.outbox.empty()) {
+        sf::Socket::Status status = viewer.socket.send(viewer.outbox.front());
+        if (status == sf::Socket::Partial || status == sf::Socket::NotReady)
+            return true;
+        if (status != sf::Socket::Done)
+            return false;
+        viewer.outbox.pop_front();
+    }
+    return true;
+}
+
+SessionViewer::SessionViewer(SceneOwner& owner) : owner(owner) {
+}
+
+SessionViewer::~SessionViewer() {
+    if (!thread.joinable())
+        return;
+    stopping.store(true);
+    thread.join();
+    socket.disconnect();
+}
+
+bool SessionViewer::connect(const std::string& address, unsigned short port) {
+    if (socket.connect(address, port, sf::seconds(5)) != sf::Socket::Done)
+        return false;
+    connected = true;
+    thread = std::thread(&SessionViewer::run, this);
+    return true;
+}
+
+void SessionViewer::post(const SceneCommand& add) {
+    sf::Packet packet;
+    PacketBlocks blocks;
+    packet << static_cast<sf::Uint8>(EditMessage);
+    writeShape(packet, add, blocks);
+    std::lock_guard<std::mutex> lock(sendMutex);
+    socket.send(packet);
+}
+
+bool SessionViewer::execute(const std::string& line, std::ostream& out) {
+    std::istringstream in(line);
+    std::string command;
+    if (!(in >> command))
+        return true;
+    if (command == "exit")
+        return false;
+
+    std::lock_guard<std::mutex> request(requestMutex);
+    {
+        std::lock_guard<std::mutex> lock(replyMutex);
+        if (!connected) {
+            out << "Not connected to the host.\n";
+            return true;
+        }
+        hasReply = false;
+    }
+    sf::Packet packet;
+    packet << static_cast<sf::Uint8>(CommandMessage) << line;
+    {
+        std::lock_guard<std::mutex> lock(sendMutex);
+        socket.send(packet);
+    }
+    std::unique_lock<std::mutex> lock(replyMutex);
+    replied.wait(lock, [&]() { return hasReply || !connected; });
+    out << (hasReply ? reply : std::string("The host closed the session.\n"));
+    return true;
+}
+
+void SessionViewer::run() {
+    // Polls so that the destructor can stop the thread: closing a socket does
+    // not wake a blocked receive everywhere
+    sf::SocketSelector selector;
+    selector.add(socket);
+    while (!stopping.load()) {
+        if (!selector.wait(sf::milliseconds(100)))
+            continue;
+        sf::Packet packet;
+        if (socket.receive(packet) != sf::Socket::Done)
+            break;
+        sf::Uint8 type = 0;
+        packet >> type;
+        if (type == ShapesMessage) {
+            std::shared_ptr<SceneDelta> delta = std::make_shared<SceneDelta>();
+            if (!readShapes(packet, *delta)) {
+                std::cerr << "Malformed update from the host\n";
+                break;
+            }
+            owner.post(SceneCommand::replicate(std::move(delta)));
+        }
+        else if (type == ReplyMessage) {
+            std::lock_guard<std::mutex> lock(replyMutex);
+            packet >> reply;
+            hasReply = true;
+            replied.notify_all();
+        }
+    }
+    std::lock_guard<std::mutex> lock(replyMutex);
+    connected = false;
+    replied.notify_all();
+    if (!stopping.load())
+        std::cout << "The host closed the session.\n";
+}
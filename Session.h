@@ -0,0 +1,103 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SFML/Network.hpp"
+#include "CommandInterpreter.h"
+#include "Scene.h"
+
+// Collaborative editing over TCP. One process hosts the drawing ("--host
+// port") and any number of viewers join it ("--join address port"). Viewers
+// hold a replica that the host keeps current with binary deltas: each delta
+// lists the shapes added or modified since the previous one and how many
+// shapes survive removals. The host publishes at most every 20 ms, so a burst
+// of edits to the same shapes goes out once, as their latest state. Viewer
+// edits and console commands travel to the host and come back as deltas;
+// commands that touch the host beyond the drawing are refused.
+
+// Runs on the hosting process. A joiner first receives the last snapshot and
+// every delta published since; a new snapshot replaces them once the deltas
+// outgrow it. A viewer that falls too far behind is resynchronized the same way.
+class SessionHost {
+public:
+    SessionHost(Scene& scene, SceneOwner& owner);
+    // Disconnects every viewer.
+    ~SessionHost();
+
+    // Listens on `port` of the interface at `address` and starts serving. False
+    // when the port cannot be opened. Viewers are not authenticated, so keep
+    // the loopback default unless the network is trusted; they may only run
+    // commands that read or edit the drawing (CommandAccess::SceneOnly).
+    bool start(unsigned short port, const sf::IpAddress& address = sf::IpAddress::LocalHost);
+
+private:
+    struct Viewer {
+        sf::TcpSocket socket;
+        std::unique_ptr<CommandInterpreter> interpreter;
+        std::deque<sf::Packet> outbox; // the front may be partly sent
+        std::string address;
+        bool dropped = false;
+    };
+
+    static const std::size_t kMaxQueued = 64;
+
+    Scene& scene;
+    SceneOwner& owner;
+    sf::TcpListener listener;
+    sf::SocketSelector selector;
+    std::vector<std::unique_ptr<Viewer>> viewers;
+    sf::Packet snapshot;
+    std::vector<sf::Packet> tail; // deltas published since `snapshot`
+    std::size_t tailBytes = 0;
+    std::size_t publishedCount = 0; // shapes as of the last publication
+    std::atomic<bool> stopping{ false };
+    std::thread thread;
+
+    void run();
+    void accept();
+    void receive(Viewer& viewer);
+    // Sends the changes recorded since the last call to every viewer.
+    void publish();
+    sf::Packet encodeSnapshot() const; // needs scene.mutex
+    void enqueue(Viewer& viewer, const sf::Packet& packet);
+    void resync(Viewer& viewer);
+    bool flush(Viewer& viewer);
+};
+
+// Runs on a joining process: applies the host's deltas to the local scene
+// through its owner and forwards edits and commands to the host.
+class SessionViewer {
+public:
+    explicit SessionViewer(SceneOwner& owner);
+    ~SessionViewer();
+
+    bool connect(const std::string& address, unsigned short port);
+    // Sends an Add* command to the host; the shape appears with the next delta.
+    void post(const SceneCommand& add);
+    // Runs a console command on the host and writes its reply to `out`.
+    // Returns false for "exit", which only leaves the session.
+    bool execute(const std::string& line, std::ostream& out);
+
+private:
+    SceneOwner& owner;
+    sf::TcpSocket socket;
+    std::mutex sendMutex;
+    std::mutex replyMutex;
+    std::condition_variable replied;
+    std::string reply;       // guarded by replyMutex
+    bool hasReply = false;   // guarded by replyMutex
+    bool connected = false;  // guarded by replyMutex
+    std::mutex requestMutex; // one command in flight at a time
+    std::atomic<bool> stopping{ false };
+    std::thread thread;
+
+    void run();
+};
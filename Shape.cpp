@@ -1,6 +1,26 @@
 #include "Shape.h"
+#include "PolygonBoolean.h"
+#include "Predicates.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
 
+namespace {
+
+// Squared distance from (x, y) to the segment a-b (a point when a == b).
+double segmentDistanceSq(double x, double y, double ax, double ay, double bx, double by) {
+    double dx = bx - ax, dy = by - ay;
+    double lengthSq = dx * dx + dy * dy;
+    double t = lengthSq > 0.0 ? ((x - ax) * dx + (y - ay) * dy) / lengthSq : 0.0;
+    t = std::max(0.0, std::min(1.0, t));
+    double px = ax + t * dx - x, py = ay + t * dy - y;
+    return px * px + py * py;
+}
+
+}
+
 Point::Point(int x_, int y_) : x(x_), y(y_) {}
 
 void Point::draw() const {
@@ -11,6 +31,18 @@ std::string Point::toString() const {
     return "Point(" + std::to_string(x) + ", " + std::to_string(y) + ")";
 }
 
+ShapeType Point::type() const {
+    return ShapeType::Point;
+}
+
+Bounds Point::bounds() const {
+    return Bounds(x, y, x, y);
+}
+
+double Point::distanceTo(double px, double py) const {
+    return std::hypot(px - x, py - y);
+}
+
 Line::Line(Point s, Point e) : start(s), end(e) {}
 
 void Line::draw() const {
@@ -21,6 +53,18 @@ std::string Line::toString() const {
     return "Line(" + start.toString() + " -> " + end.toString() + ")";
 }
 
+ShapeType Line::type() const {
+    return ShapeType::Line;
+}
+
+Bounds Line::bounds() const {
+    return Bounds(std::min(start.x, end.x), std::min(start.y, end.y), std::max(start.x, end.x), std::max(start.y, end.y));
+}
+
+double Line::distanceTo(double x, double y) const {
+    return std::sqrt(segmentDistanceSq(x, y, start.x, start.y, end.x, end.y));
+}
+
 Rectangle::Rectangle(Point tl, int w, int h) : topLeft(tl), width(w), height(h) {}
 
 void Rectangle::draw() const {
@@ -31,10 +75,313 @@ std::string Rectangle::toString() const {
     return "Rectangle(" + topLeft.toString() + ", w=" + std::to_string(width) + ", h=" + std::to_string(height) + ")";
 }
 
+ShapeType Rectangle::type() const {
+    return ShapeType::Rectangle;
+}
+
+Bounds Rectangle::bounds() const {
+    return Bounds(topLeft.x, topLeft.y, topLeft.x + width, topLeft.y + height);
+}
+
+double Rectangle::distanceTo(double x, double y) const {
+    Bounds box = bounds();
+    if (x < box.minX || x > box.maxX || y < box.minY || y > box.maxY)
+        return box.distanceTo(x, y);
+    // Inside: the outline is the nearest of the four edges
+    return std::min(std::min(x - box.minX, box.maxX - x), std::min(y - box.minY, box.maxY - y));
+}
+
 Circle::Circle(Point c, int r) : center(c), radius(r) {}
 void Circle::draw() const {
     std::cout << "Draw Circle at " << center.toString() << " with radius " << radius << "\n";
 }
 std::string Circle::toString() const {
     return "Circle(" + center.toString() + ", r=" + std::to_string(radius) + ")";
+}
+
+ShapeType Circle::type() const {
+    return ShapeType::Circle;
+}
+
+Bounds Circle::bounds() const {
+    return Bounds(center.x - radius, center.y - radius, center.x + radius, center.y + radius);
+}
+
+double Circle::distanceTo(double x, double y) const {
+    return std::abs(std::hypot(x - center.x, y - center.y) - radius);
+}
+
+bool isValidRectangle(int left, int top, int width, int height) {
+    return width >= 0 && height >= 0 && static_cast<long long>(left) + width <= INT_MAX &&
+        static_cast<long long>(top) + height <= INT_MAX;
+}
+
+bool isValidCircle(int cx, int cy, int radius) {
+    long long r = radius;
+    return r >= 0 && cx - r >= INT_MIN && cx + r <= INT_MAX && cy - r >= INT_MIN && cy + r <= INT_MAX;
+}
+
+Bounds::Bounds() : minX(INT_MAX), minY(INT_MAX), maxX(INT_MIN), maxY(INT_MIN) {}
+
+Bounds::Bounds(int minX_, int minY_, int maxX_, int maxY_) : minX(minX_), minY(minY_), maxX(maxX_), maxY(maxY_) {}
+
+bool Bounds::isEmpty() const {
+    return minX > maxX || minY > maxY;
+}
+
+void Bounds::expand(int x, int y) {
+    minX = std::min(minX, x);
+    minY = std::min(minY, y);
+    maxX = std::max(maxX, x);
+    maxY = std::max(maxY, y);
+}
+
+void Bounds::expand(const Bounds& other) {
+    if (other.isEmpty())
+        return;
+    expand(other.minX, other.minY);
+    expand(other.maxX, other.maxY);
+}
+
+double Bounds::distanceTo(double x, double y) const {
+    double dx = std::max(0.0, std::max(minX - x, x - maxX));
+    double dy = std::max(0.0, std::max(minY - y, y - maxY));
+    return std::hypot(dx, dy);
+}
+
+bool Bounds::contains(int x, int y, int tolerance) const {
+    return !isEmpty() &&
+        static_cast<long long>(x) >= static_cast<long long>(minX) - tolerance &&
+        static_cast<long long>(x) <= static_cast<long long>(maxX) + tolerance &&
+        static_cast<long long>(y) >= static_cast<long long>(minY) - tolerance &&
+        static_cast<long long>(y) <= static_cast<long long>(maxY) + tolerance;
+}
+
+std::size_t VertexPool::append(const std::vector<Point>& points) {
+    std::size_t offset = xs.size();
+    // No exact reserve: push_back grows the columns geometrically, which keeps
+    // a long run of appends linear
+    for (const auto& p : points) {
+        xs.push_back(p.x);
+        ys.push_back(p.y);
+    }
+    return offset;
+}
+
+std::size_t VertexPool::size() const {
+    return xs.size();
+}
+
+Polyline::Polyline(std::shared_ptr<VertexPool> pool_, std::size_t offset_, std::size_t count_)
+    : pool(std::move(pool_)), offset(offset_), count(count_) {
+    updateSegmentTree();
+}
+
+Point Polyline::vertex(std::size_t i) const {
+    return Point(pool->xs[offset + i], pool->ys[offset + i]);
+}
+
+bool Polyline::isClosed() const {
+    return false;
+}
+
+std::size_t Polyline::segmentCount() const {
+    if (count < 2)
+        return 0;
+    return isClosed() ? count : count - 1;
+}
+
+std::size_t Polyline::next(std::size_t i) const {
+    if (holes.empty())
+        return i + 1 < count ? i + 1 : 0;
+    auto end = std::upper_bound(holes.begin(), holes.end(), i);
+    if (i + 1 < (end == holes.end() ? count : *end))
+        return i + 1;
+    return end == holes.begin() ? 0 : *(end - 1);
+}
+
+ShapeType Polyline::type() const {
+    return ShapeType::Polyline;
+}
+
+Bounds Polyline::bounds() const {
+    if (segmentTree.empty())
+        return count == 1 ? Point(pool->xs[offset], pool->ys[offset]).bounds() : Bounds();
+    return segmentTree.back().front();
+}
+
+void Polyline::updateSegmentTree() {
+    segmentTree.clear();
+    std::size_t segments = segmentCount();
+    if (segments == 0)
+        return;
+
+    const int* xs = pool->xs.data() + offset;
+    const int* ys = pool->ys.data() + offset;
+
+    std::vector<Bounds> leaves((segments + kSegmentsPerLeaf - 1) / kSegmentsPerLeaf);
+    for (std::size_t i = 0; i < segments; ++i) {
+        std::size_t j = next(i);
+        Bounds& leaf = leaves[i / kSegmentsPerLeaf];
+        leaf.expand(xs[i], ys[i]);
+        leaf.expand(xs[j], ys[j]);
+    }
+    segmentTree.push_back(std::move(leaves));
+
+    while (segmentTree.back().size() > 1) {
+        const std::vector<Bounds>& below = segmentTree.back();
+        std::vector<Bounds> level((below.size() + 1) / 2);
+        for (std::size_t i = 0; i < below.size(); ++i)
+            level[i / 2].expand(below[i]);
+        segmentTree.push_back(std::move(level));
+    }
+}
+
+bool Polyline::hitSegment(std::size_t i, int x, int y, int tolerance) const {
+    std::size_t j = next(i);
+    if (tolerance == 0)
+        return pointOnSegment(x, y, pool->xs[offset + i], pool->ys[offset + i], pool->xs[offset + j], pool->ys[offset + j]);
+    double distanceSq = segmentDistanceSq(x, y, pool->xs[offset + i], pool->ys[offset + i], pool->xs[offset + j], pool->ys[offset + j]);
+    return distanceSq <= static_cast<double>(tolerance) * tolerance;
+}
+
+bool Polyline::hitNode(std::size_t level, std::size_t index, int x, int y, int tolerance) const {
+    if (!segmentTree[level][index].contains(x, y, tolerance))
+        return false;
+
+    if (level == 0) {
+        std::size_t first = index * kSegmentsPerLeaf;
+        std::size_t last = std::min(first + kSegmentsPerLeaf, segmentCount());
+        for (std::size_t i = first; i < last; ++i) {
+            if (hitSegment(i, x, y, tolerance))
+                return true;
+        }
+        return false;
+    }
+
+    std::size_t child = index * 2;
+    if (hitNode(level - 1, child, x, y, tolerance))
+        return true;
+    return child + 1 < segmentTree[level - 1].size() && hitNode(level - 1, child + 1, x, y, tolerance);
+}
+
+bool Polyline::hitTest(int x, int y, int tolerance) const {
+    if (segmentTree.empty())
+        return count == 1 && std::abs(vertex(0).x - x) <= tolerance && std::abs(vertex(0).y - y) <= tolerance;
+    return hitNode(segmentTree.size() - 1, 0, x, y, tolerance);
+}
+
+void Polyline::nearestInNode(std::size_t level, std::size_t index, double x, double y, double& best) const {
+    if (segmentTree[level][index].distanceTo(x, y) >= best)
+        return;
+
+    if (level == 0) {
+        const int* xs = pool->xs.data() + offset;
+        const int* ys = pool->ys.data() + offset;
+        std::size_t first = index * kSegmentsPerLeaf;
+        std::size_t last = std::min(first + kSegmentsPerLeaf, segmentCount());
+        for (std::size_t i = first; i < last; ++i) {
+            std::size_t j = next(i);
+            best = std::min(best, std::sqrt(segmentDistanceSq(x, y, xs[i], ys[i], xs[j], ys[j])));
+        }
+        return;
+    }
+
+    // Visit the nearer child first so the farther one is more likely to be pruned
+    std::size_t child = index * 2;
+    const std::vector<Bounds>& below = segmentTree[level - 1];
+    if (child + 1 < below.size() && below[child + 1].distanceTo(x, y) < below[child].distanceTo(x, y)) {
+        nearestInNode(level - 1, child + 1, x, y, best);
+        nearestInNode(level - 1, child, x, y, best);
+    }
+    else {
+        nearestInNode(level - 1, child, x, y, best);
+        if (child + 1 < below.size())
+            nearestInNode(level - 1, child + 1, x, y, best);
+    }
+}
+
+double Polyline::distanceTo(double x, double y) const {
+    if (segmentTree.empty())
+        return count == 1 ? vertex(0).distanceTo(x, y) : HUGE_VAL;
+    double best = HUGE_VAL;
+    nearestInNode(segmentTree.size() - 1, 0, x, y, best);
+    return best;
+}
+
+std::string Polyline::pathToString(const std::string& name) const {
+    std::string result = name + "(" + std::to_string(count) + " vertices";
+    if (count > 0)
+        result += ", " + vertex(0).toString() + " -> " + vertex(count - 1).toString();
+    return result + ")";
+}
+
+void Polyline::draw() const {
+    std::cout << "Draw " << toString() << "\n";
+}
+
+std::string Polyline::toString() const {
+    return pathToString("Polyline");
+}
+
+Polygon::Polygon(std::shared_ptr<VertexPool> pool_, std::size_t offset_, std::size_t count_, std::vector<std::size_t> holes_)
+    : Polyline(std::move(pool_), offset_, count_) {
+    holes = std::move(holes_);
+    orientRings();
+    // The base constructor ran before the closing segment was visible through isClosed().
+    updateSegmentTree();
+}
+
+bool Polygon::isClosed() const {
+    return true;
+}
+
+ShapeType Polygon::type() const {
+    return ShapeType::Polygon;
+}
+
+bool Polygon::contains(int x, int y, int tolerance) const {
+    if (!bounds().contains(x, y, tolerance))
+        return false;
+    if (hitTest(x, y, tolerance))
+        return true;
+
+    bool inside = false;
+    const int* xs = pool->xs.data() + offset;
+    const int* ys = pool->ys.data() + offset;
+    for (std::size_t i = 0; i < count; ++i) {
+        std::size_t j = next(i);
+        if ((ys[i] > y) != (ys[j] > y)) {
+            // The point is left of the crossing exactly when it is left of an upward edge
+            // (right of a downward one); decided by the exact orientation predicate.
+            int side = orient2d(xs[j], ys[j], xs[i], ys[i], x, y);
+            if (ys[i] > ys[j] ? side > 0 : side < 0)
+                inside = !inside;
+        }
+    }
+    return inside;
+}
+
+void Polygon::orientRings() {
+    int* xs = pool->xs.data() + offset;
+    int* ys = pool->ys.data() + offset;
+    Path ring;
+    for (std::size_t r = 0; r <= holes.size(); ++r) {
+        std::size_t first = r == 0 ? 0 : holes[r - 1], last = r == holes.size() ? count : holes[r];
+        ring.clear();
+        for (std::size_t i = first; i < last; ++i)
+            ring.push_back(IntPoint{ xs[i], ys[i] });
+        double area = signedArea2(ring);
+        if (r == 0 ? area < 0.0 : area > 0.0) {
+            std::reverse(xs + first, xs + last);
+            std::reverse(ys + first, ys + last);
+        }
+    }
+}
+
+std::string Polygon::toString() const {
+    std::string text = pathToString("Polygon");
+    if (!holes.empty())
+        text.insert(text.size() - 1, ", " + std::to_string(holes.size()) + (holes.size() == 1 ? " hole" : " holes"));
+    return text;
 }
\ No newline at end of file
@@ -1,13 +1,35 @@
 #pragma once
 
+#include <cstddef>
+#include <memory>
 #include <string>
 #include <vector>
+#include "ShapeType.h"
+
+// Axis-aligned bounding box in scene coordinates (inclusive).
+struct Bounds {
+    int minX, minY, maxX, maxY;
+    Bounds();
+    Bounds(int minX, int minY, int maxX, int maxY);
+    bool isEmpty() const;
+    void expand(int x, int y);
+    void expand(const Bounds& other);
+    bool contains(int x, int y, int tolerance = 0) const;
+    // Euclidean distance from (x, y) to the box; 0 inside. A lower bound for the
+    // distance to anything the box encloses.
+    double distanceTo(double x, double y) const;
+};
 
 class Shape {
 public:
     virtual ~Shape() {}
     virtual void draw() const = 0;
     virtual std::string toString() const = 0;
+    virtual ShapeType type() const = 0;
+    virtual Bounds bounds() const = 0;
+    // Distance from (x, y) to the geometry as drawn: outlines for rectangles,
+    // circles and polygons, so a point inside one is as far as its nearest edge.
+    virtual double distanceTo(double x, double y) const = 0;
 };
 
 class Point : public Shape {
@@ -16,6 +38,9 @@ public:
     Point(int x, int y);
     void draw() const override;
     std::string toString() const override;
+    ShapeType type() const override;
+    Bounds bounds() const override;
+    double distanceTo(double x, double y) const override;
 };
 
 class Line : public Shape {
@@ -24,6 +49,9 @@ public:
     Line(Point s, Point e);
     void draw() const override;
     std::string toString() const override;
+    ShapeType type() const override;
+    Bounds bounds() const override;
+    double distanceTo(double x, double y) const override;
 };
 
 class Rectangle : public Shape {
@@ -33,6 +61,9 @@ public:
     Rectangle(Point tl, int w, int h);
     void draw() const override;
     std::string toString() const override;
+    ShapeType type() const override;
+    Bounds bounds() const override;
+    double distanceTo(double x, double y) const override;
 };
 
 class Circle : public Shape {
@@ -42,6 +73,76 @@ public:
     Circle(Point c, int r);
     void draw() const override;
     std::string toString() const override;
+    ShapeType type() const override;
+    Bounds bounds() const override;
+    double distanceTo(double x, double y) const override;
+};
+
+// True when the size is not negative and the far corner of the rectangle, or
+// the whole box of the circle, lies within integer coordinates. Shapes that
+// fail would overflow their own bounds().
+bool isValidRectangle(int left, int top, int width, int height);
+bool isValidCircle(int cx, int cy, int radius);
+
+// Shared vertex storage for polylines and polygons. Coordinates are kept in
+// two contiguous columns; each path addresses its vertices by offset + count
+// instead of owning a separate Point per vertex.
+class VertexPool {
+public:
+    std::vector<int> xs, ys;
+    std::size_t append(const std::vector<Point>& points);
+    std::size_t size() const;
+};
+
+class Polyline : public Shape {
+public:
+    std::shared_ptr<VertexPool> pool;
+    std::size_t offset, count;
+    // Polygons only: the vertex numbers where each hole ring starts, ascending.
+    // The outer ring runs from vertex 0 to the first hole.
+    std::vector<std::size_t> holes;
+    Polyline(std::shared_ptr<VertexPool> pool, std::size_t offset, std::size_t count);
+    Point vertex(std::size_t i) const;
+    virtual bool isClosed() const;
+    std::size_t segmentCount() const;
+    // The vertex that segment i ends at: i + 1, or the first of its ring for
+    // the closing segment.
+    std::size_t next(std::size_t i) const;
+    ShapeType type() const override;
+    Bounds bounds() const override;
+    // Rebuilds the per-segment bounding hierarchy after the vertices in the pool changed.
+    void updateSegmentTree();
+    // True when (x, y) lies within `tolerance` of any segment.
+    bool hitTest(int x, int y, int tolerance) const;
+    double distanceTo(double x, double y) const override;
+    void draw() const override;
+    std::string toString() const override;
+
+protected:
+    static const std::size_t kSegmentsPerLeaf = 8;
+    // levels[0] holds one box per leaf run of consecutive segments, each level above
+    // merges pairs of boxes from the level below; the last level is the root.
+    std::vector<std::vector<Bounds>> segmentTree;
+    bool hitSegment(std::size_t i, int x, int y, int tolerance) const;
+    bool hitNode(std::size_t level, std::size_t index, int x, int y, int tolerance) const;
+    void nearestInNode(std::size_t level, std::size_t index, double x, double y, double& best) const;
+    std::string pathToString(const std::string& name) const;
+};
+
+// A closed path, with holes when `holes` splits its vertices into rings. The
+// outer ring is kept counter-clockwise and the holes clockwise (in y-up terms),
+// so that the rings of many polygons add up under nonzero fill.
+class Polygon : public Polyline {
+public:
+    // Reverses the rings that do not run the way described above.
+    Polygon(std::shared_ptr<VertexPool> pool, std::size_t offset, std::size_t count, std::vector<std::size_t> holes = {});
+    bool isClosed() const override;
+    ShapeType type() const override;
+    // True when (x, y) is inside the polygon (even-odd rule) or near its outline.
+    bool contains(int x, int y, int tolerance) const;
+    // Puts the rings back in order after the vertices changed, e.g. mirrored.
+    void orientRings();
+    std::string toString() const override;
 };
 
 
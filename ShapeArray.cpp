@@ -0,0 +1,271 @@
+#include "ShapeArray.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <iostream>
+#include <iterator>
+#include <limits>
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+const std::size_t kMaxPolarItems = 1 << 20;
+
+bool overlaps(const Bounds& a, const Bounds& b) {
+    return a.minX <= b.maxX && b.minX <= a.maxX && a.minY <= b.maxY && b.minY <= a.maxY;
+}
+
+Bounds moved(const Bounds& box, long long dx, long long dy) {
+    return Bounds(static_cast<int>(box.minX + dx), static_cast<int>(box.minY + dy),
+        static_cast<int>(box.maxX + dx), static_cast<int>(box.maxY + dy));
+}
+
+// Narrows [first, last] to the k for which the interval [lo, hi] moved by
+// k * step meets [windowLo, windowHi], or lies inside it. False when none do.
+bool narrow(double lo, double hi, double step, double windowLo, double windowHi, bool inside,
+    long long& first, long long& last) {
+    double upper = inside ? windowHi - hi : windowHi - lo; // k * step <= upper
+    double lower = inside ? windowLo - lo : windowLo - hi; // k * step >= lower
+    if (step == 0.0) {
+        if (lower > 0.0 || upper < 0.0)
+            return false;
+    }
+    else {
+        double from = step > 0.0 ? std::ceil(lower / step) : std::ceil(upper / step);
+        double to = step > 0.0 ? std::floor(upper / step) : std::floor(lower / step);
+        if (from > static_cast<double>(first))
+            first = static_cast<long long>(std::min(from, static_cast<double>(last) + 1.0));
+        if (to < static_cast<double>(last))
+            last = static_cast<long long>(std::max(to, static_cast<double>(first) - 1.0));
+    }
+    return first <= last;
+}
+
+// Polar arrays: the angle between neighbouring items, in radians.
+double polarStep(const ArrayPattern& pattern) {
+    if (pattern.columns <= 1)
+        return 0.0;
+    bool fullTurn = pattern.fillDegrees != 0 && pattern.fillDegrees % 360 == 0;
+    return pattern.fillDegrees * kPi / 180.0 / (fullTurn ? pattern.columns : pattern.columns - 1);
+}
+
+}
+
+std::size_t ArrayPattern::count() const {
+    return static_cast<std::size_t>(columns) * static_cast<std::size_t>(rows);
+}
+
+bool ArrayPattern::fits(const Bounds& item) const {
+    if (columns < 1 || rows < 1 || item.isEmpty())
+        return false;
+    const long double limit = INT_MAX;
+    if (kind == ArrayKind::Polar) {
+        if (rows != 1 || count() > kMaxPolarItems)
+            return false;
+        // Every item stays within its distance from the center plus its own size
+        long double reach = std::hypot(static_cast<long double>(item.maxX) - centerX, static_cast<long double>(item.maxY) - centerY) +
+            std::hypot(static_cast<long double>(item.minX) - centerX, static_cast<long double>(item.minY) - centerY);
+        return std::fabs(static_cast<long double>(centerX)) + reach < limit && std::fabs(static_cast<long double>(centerY)) + reach < limit;
+    }
+    long double spanX = std::fabs(static_cast<long double>(columns - 1) * columnX) + std::fabs(static_cast<long double>(rows - 1) * rowX);
+    long double spanY = std::fabs(static_cast<long double>(columns - 1) * columnY) + std::fabs(static_cast<long double>(rows - 1) * rowY);
+    return std::max(std::fabs(static_cast<long double>(item.minX)), std::fabs(static_cast<long double>(item.maxX))) + spanX < limit &&
+        std::max(std::fabs(static_cast<long double>(item.minY)), std::fabs(static_cast<long double>(item.maxY))) + spanY < limit;
+}
+
+ShapeArray::ShapeArray(std::shared_ptr<const Shape> item_, const ArrayPattern& pattern_, std::vector<std::size_t> removed_)
+    : item(std::move(item_)), pattern(pattern_), removed(std::move(removed_)), itemBox(item->bounds()) {
+    for (const Point& corner : hullOffsets())
+        box.expand(moved(itemBox, corner.x, corner.y));
+}
+
+void ShapeArray::draw() const {
+    std::cout << "Draw Array of " << count() << " instances of " << item->toString() << "\n";
+}
+
+std::string ShapeArray::toString() const {
+    std::string text = "Array(";
+    if (pattern.kind == ArrayKind::Polar)
+        text += "polar " + std::to_string(pattern.columns) + " about " + Point(pattern.centerX, pattern.centerY).toString();
+    else
+        text += "grid " + std::to_string(pattern.columns) + "x" + std::to_string(pattern.rows);
+    text += " of " + item->toString();
+    if (!removed.empty())
+        text += ", " + std::to_string(removed.size()) + " taken out";
+    return text + ")";
+}
+
+ShapeType ShapeArray::type() const {
+    return ShapeType::Array;
+}
+
+Bounds ShapeArray::bounds() const {
+    return box;
+}
+
+double ShapeArray::distanceTo(double x, double y) const {
+    double reach = std::max(1.0, static_cast<double>(std::max(itemBox.maxX - itemBox.minX, itemBox.maxY - itemBox.minY)));
+    std::vector<std::size_t> near;
+    for (;;) {
+        // Instances nearer than `reach` have bounds within `reach` of the point,
+        // so they are all in the window: a best distance under it is final
+        auto clamp = [](double v) { return static_cast<int>(std::max<double>(INT_MIN, std::min<double>(INT_MAX, v))); };
+        Bounds window(clamp(std::floor(x - reach)), clamp(std::floor(y - reach)), clamp(std::ceil(x + reach)), clamp(std::ceil(y + reach)));
+        near.clear();
+        instancesIn(window, near);
+        double best = std::numeric_limits<double>::infinity();
+        for (std::size_t k : near) {
+            Point o = offset(k);
+            best = std::min(best, item->distanceTo(x - o.x, y - o.y));
+        }
+        bool everything = window.minX <= box.minX && window.minY <= box.minY && window.maxX >= box.maxX && window.maxY >= box.maxY;
+        if (best <= reach || everything)
+            return best;
+        reach = std::isinf(best) ? reach * 4.0 : best;
+    }
+}
+
+std::size_t ShapeArray::count() const {
+    return pattern.count() - removed.size();
+}
+
+bool ShapeArray::isRemoved(std::size_t k) const {
+    return std::binary_search(removed.begin(), removed.end(), k);
+}
+
+Point ShapeArray::offset(std::size_t k) const {
+    if (pattern.kind == ArrayKind::Polar) {
+        double angle = polarStep(pattern) * static_cast<double>(k);
+        double dx = (itemBox.minX + static_cast<double>(itemBox.maxX)) / 2.0 - pattern.centerX;
+        double dy = (itemBox.minY + static_cast<double>(itemBox.maxY)) / 2.0 - pattern.centerY;
+        double c = std::cos(angle), s = std::sin(angle);
+        return Point(static_cast<int>(std::lround(c * dx - s * dy - dx)), static_cast<int>(std::lround(s * dx + c * dy - dy)));
+    }
+    long long column = static_cast<long long>(k % static_cast<std::size_t>(pattern.columns));
+    long long row = static_cast<long long>(k / static_cast<std::size_t>(pattern.columns));
+    return Point(static_cast<int>(column * pattern.columnX + row * pattern.rowX),
+        static_cast<int>(column * pattern.columnY + row * pattern.rowY));
+}
+
+template <class Run>
+void ShapeArray::forEachRun(const Bounds& window, bool inside, std::size_t columnStride, std::size_t rowStride, Run run) const {
+    if (!overlaps(box, window))
+        return;
+    if (pattern.kind == ArrayKind::Polar) {
+        for (std::size_t k = 0; k < pattern.count(); k += columnStride) {
+            Point o = offset(k);
+            Bounds b = moved(itemBox, o.x, o.y);
+            bool hit = inside ? b.minX >= window.minX && b.maxX <= window.maxX && b.minY >= window.minY && b.maxY <= window.maxY
+                : overlaps(b, window);
+            if (hit)
+                run(k, k, columnStride);
+        }
+        return;
+    }
+
+    const ArrayPattern& p = pattern;
+    long long columns = p.columns;
+    // A whole row spans the item box swept along the columns
+    double sweepX = static_cast<double>(columns - 1) * p.columnX, sweepY = static_cast<double>(columns - 1) * p.columnY;
+    long long firstRow = 0, lastRow = p.rows - 1;
+    if (!narrow(itemBox.minX + std::min(0.0, sweepX), itemBox.maxX + std::max(0.0, sweepX), p.rowX, window.minX, window.maxX, false, firstRow, lastRow) ||
+        !narrow(itemBox.minY + std::min(0.0, sweepY), itemBox.maxY + std::max(0.0, sweepY), p.rowY, window.minY, window.maxY, false, firstRow, lastRow))
+        return;
+    // Strided visits start on multiples of the stride, so cells stay put while the window pans
+    long long rowStep = static_cast<long long>(rowStride), columnStep = static_cast<long long>(columnStride);
+    for (long long row = firstRow - firstRow % rowStep; row <= lastRow; row += rowStep) {
+        double baseX = static_cast<double>(row) * p.rowX, baseY = static_cast<double>(row) * p.rowY;
+        long long first = 0, last = columns - 1;
+        if (!narrow(itemBox.minX + baseX, itemBox.maxX + baseX, p.columnX, window.minX, window.maxX, inside, first, last) ||
+            !narrow(itemBox.minY + baseY, itemBox.maxY + baseY, p.columnY, window.minY, window.maxY, inside, first, last))
+            continue;
+        first -= first % columnStep;
+        run(static_cast<std::size_t>(row * columns + first), static_cast<std::size_t>(row * columns + last), columnStride);
+    }
+}
+
+void ShapeArray::instancesIn(const Bounds& window, std::vector<std::size_t>& out, bool inside,
+    std::size_t columnStride, std::size_t rowStride) const {
+    bool strided = columnStride > 1 || rowStride > 1;
+    forEachRun(window, inside, columnStride, rowStride, [&](std::size_t first, std::size_t last, std::size_t step) {
+        auto taken = std::lower_bound(removed.begin(), removed.end(), first);
+        for (std::size_t k = first; k <= last; k += step) {
+            if (!strided) {
+                while (taken != removed.end() && *taken < k)
+                    ++taken;
+                if (taken != removed.end() && *taken == k)
+                    continue;
+            }
+            out.push_back(k);
+        }
+    });
+}
+
+std::size_t ShapeArray::countInside(const Bounds& window) const {
+    std::size_t total = 0;
+    forEachRun(window, true, 1, 1, [&](std::size_t first, std::size_t last, std::size_t) {
+        total += last - first + 1;
+        total -= static_cast<std::size_t>(std::upper_bound(removed.begin(), removed.end(), last) -
+            std::lower_bound(removed.begin(), removed.end(), first));
+    });
+    return total;
+}
+
+void ShapeArray::strides(double spacing, std::size_t& columnStride, std::size_t& rowStride) const {
+    auto stride = [&](double distance, int count) {
+        if (spacing <= 0.0 || distance >= spacing)
+            return static_cast<std::size_t>(1);
+        if (distance <= 0.0)
+            return static_cast<std::size_t>(count);
+        return std::min(static_cast<std::size_t>(count), static_cast<std::size_t>(std::ceil(spacing / distance)));
+    };
+    if (pattern.kind == ArrayKind::Polar) {
+        double dx = (itemBox.minX + static_cast<double>(itemBox.maxX)) / 2.0 - pattern.centerX;
+        double dy = (itemBox.minY + static_cast<double>(itemBox.maxY)) / 2.0 - pattern.centerY;
+        double chord = 2.0 * std::hypot(dx, dy) * std::fabs(std::sin(polarStep(pattern) / 2.0));
+        columnStride = stride(chord, pattern.columns);
+        rowStride = 1;
+        return;
+    }
+    columnStride = stride(std::hypot(pattern.columnX, pattern.columnY), pattern.columns);
+    rowStride = stride(std::hypot(pattern.rowX, pattern.rowY), pattern.rows);
+}
+
+Bounds ShapeArray::cellBounds(std::size_t k, std::size_t columnStride, std::size_t rowStride) const {
+    Bounds cell;
+    if (pattern.kind == ArrayKind::Polar) {
+        for (std::size_t i = k; i < std::min(pattern.count(), k + columnStride); ++i) {
+            Point o = offset(i);
+            cell.expand(moved(itemBox, o.x, o.y));
+        }
+        return cell;
+    }
+    std::size_t columns = static_cast<std::size_t>(pattern.columns), rows = static_cast<std::size_t>(pattern.rows);
+    std::size_t column = k % columns, row = k / columns;
+    std::size_t lastColumn = std::min(columns, column + columnStride) - 1, lastRow = std::min(rows, row + rowStride) - 1;
+    for (std::size_t corner : { k, row * columns + lastColumn, lastRow * columns + column, lastRow * columns + lastColumn }) {
+        Point o = offset(corner);
+        cell.expand(moved(itemBox, o.x, o.y));
+    }
+    return cell;
+}
+
+std::vector<Point> ShapeArray::hullOffsets() const {
+    std::vector<Point> offsets;
+    if (pattern.kind == ArrayKind::Polar) {
+        for (std::size_t k = 0; k < pattern.count(); ++k)
+            offsets.push_back(offset(k));
+        return offsets;
+    }
+    std::size_t columns = static_cast<std::size_t>(pattern.columns), last = pattern.count() - 1;
+    for (std::size_t corner : { std::size_t(0), columns - 1, last - (columns - 1), last })
+        offsets.push_back(offset(corner));
+    return offsets;
+}
+
+std::shared_ptr<ShapeArray> ShapeArray::without(const std::vector<std::size_t>& taken) const {
+    std::vector<std::size_t> merged;
+    merged.reserve(removed.size() + taken.size());
+    std::merge(removed.begin(), removed.end(), taken.begin(), taken.end(), std::back_inserter(merged));
+    return std::make_shared<ShapeArray>(item, pattern, std::move(merged));
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Shape.h"
+
+enum class ArrayKind : std::uint8_t {
+    Grid,  // columns x rows; a linear array is a grid with one row
+    Polar, // `columns` items around a center
+};
+
+// Where the copies of an array's item go. Instance k of a grid sits in column
+// k % columns and row k / columns.
+struct ArrayPattern {
+    ArrayKind kind = ArrayKind::Grid;
+    int columns = 1, rows = 1;    // Polar: `columns` items, one row
+    int columnX = 0, columnY = 0; // Grid: offset from one column to the next
+    int rowX = 0, rowY = 0;       // Grid: offset from one row to the next
+    int centerX = 0, centerY = 0; // Polar: the item's center turns about this point
+    int fillDegrees = 360;        // Polar: angle from the first item to the last; a full turn spreads them evenly
+
+    std::size_t count() const;
+    // True when the columns and rows are positive (one row for polar arrays)
+    // and every copy of an item with bounds `item` keeps integer coordinates.
+    bool fits(const Bounds& item) const;
+};
+
+// Copies of one item laid out by a pattern, generated on demand: the array
+// stores the item, the pattern and the instances that were taken out, so a
+// 10000 x 10000 grid costs a few hundred bytes. Every instance is the item
+// moved by offset(k); polar items keep their orientation. Instances are taken
+// out when they are materialized as shapes of their own to be edited.
+//
+// Arrays are immutable once built: edits replace the whole object, which lets
+// the undo history and collaboration deltas share it by pointer.
+class ShapeArray : public Shape {
+public:
+    std::shared_ptr<const Shape> item; // instance 0; any shape except an array
+    ArrayPattern pattern;
+    std::vector<std::size_t> removed;  // sorted instance numbers
+
+    ShapeArray(std::shared_ptr<const Shape> item, const ArrayPattern& pattern, std::vector<std::size_t> removed = {});
+    void draw() const override;
+    std::string toString() const override;
+    ShapeType type() const override;
+    Bounds bounds() const override;
+    double distanceTo(double x, double y) const override;
+
+    std::size_t count() const; // instances left
+    bool isRemoved(std::size_t k) const;
+    Point offset(std::size_t k) const;
+    // Instances whose bounds meet `window`, or lie inside it when `inside` is
+    // set, appended in ascending order. With strides above one only every
+    // n-th column and row is visited, removed instances included: the caller
+    // draws each visited instance as the cell it stands for (cellBounds).
+    void instancesIn(const Bounds& window, std::vector<std::size_t>& out, bool inside = false,
+        std::size_t columnStride = 1, std::size_t rowStride = 1) const;
+    // Instances inside `window`, without enumerating them.
+    std::size_t countInside(const Bounds& window) const;
+    // Column and row strides that keep visited instances at least `spacing` apart.
+    void strides(double spacing, std::size_t& columnStride, std::size_t& rowStride) const;
+    // Bounds of the instances a strided visit of instance k stands for.
+    Bounds cellBounds(std::size_t k, std::size_t columnStride, std::size_t rowStride) const;
+    // Offsets of the instances whose convex hull is the hull of the whole array.
+    std::vector<Point> hullOffsets() const;
+    // A copy without `taken`, sorted instance numbers not removed yet.
+    std::shared_ptr<ShapeArray> without(const std::vector<std::size_t>& taken) const;
+
+private:
+    Bounds box;     // every instance, removed ones included
+    Bounds itemBox;
+
+    // Calls `run(first, last, step)` for each run of instance numbers, one row
+    // of a grid at a time, that meet or lie inside `window`.
+    template <class Run>
+    void forEachRun(const Bounds& window, bool inside, std::size_t columnStride, std::size_t rowStride, Run run) const;
+};
@@ -5,6 +5,10 @@ enum class ShapeType {
     Point,
     Line,
     Rectangle,
-    Circle
+    Circle,
+    Polyline,
+    Polygon,
+    Array,
+    Reference
 };
 
@@ -0,0 +1,317 @@
+#include "SpatialIndex.h"
+#include <algorithm>
+#include <climits>
+
+namespace {
+
+// Twice the box center; exact for any int coordinates.
+long long centerX2(const Bounds& box) {
+    return static_cast<long long>(box.minX) + box.maxX;
+}
+
+long long centerY2(const Bounds& box) {
+    return static_cast<long long>(box.minY) + box.maxY;
+}
+
+// Interleaves the low 16 bits of v with zeros (bit i moves to bit 2i).
+std::uint32_t spreadBits(std::uint32_t v) {
+    v &= 0xFFFF;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+// Keeps the k nearest candidates seen so far as a max-heap on distance.
+void offer(std::vector<Neighbor>& heap, std::size_t k, std::size_t index, double distance) {
+    auto farther = [](const Neighbor& a, const Neighbor& b) { return a.distance < b.distance; };
+    if (heap.size() == k) {
+        std::pop_heap(heap.begin(), heap.end(), farther);
+        heap.pop_back();
+    }
+    heap.push_back(Neighbor{ index, distance });
+    std::push_heap(heap.begin(), heap.end(), farther);
+}
+
+}
+
+void SpatialIndex::build(const std::vector<std::shared_ptr<Shape>>& shapes) {
+    std::size_t n = shapes.size();
+    std::vector<Bounds> boxes(n);
+    long long lowX = LLONG_MAX, highX = LLONG_MIN, lowY = LLONG_MAX, highY = LLONG_MIN;
+    for (std::size_t i = 0; i < n; ++i) {
+        boxes[i] = shapes[i]->bounds();
+        lowX = std::min(lowX, centerX2(boxes[i]));
+        highX = std::max(highX, centerX2(boxes[i]));
+        lowY = std::min(lowY, centerY2(boxes[i]));
+        highY = std::max(highY, centerY2(boxes[i]));
+    }
+
+    // Order shapes along a Z-order curve through their box centers; splitting that
+    // order in halves then gives spatially coherent subtrees without any per-level
+    // partitioning, so the build is two radix passes plus one linear sweep.
+    double scaleX = highX > lowX ? 65535.0 / static_cast<double>(highX - lowX) : 0.0;
+    double scaleY = highY > lowY ? 65535.0 / static_cast<double>(highY - lowY) : 0.0;
+    std::vector<std::uint64_t> keys(n), sorted(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        auto qx = static_cast<std::uint32_t>(static_cast<double>(centerX2(boxes[i]) - lowX) * scaleX);
+        auto qy = static_cast<std::uint32_t>(static_cast<double>(centerY2(boxes[i]) - lowY) * scaleY);
+        keys[i] = (static_cast<std::uint64_t>(spreadBits(qx) | (spreadBits(qy) << 1)) << 32) | i;
+    }
+    std::vector<std::size_t> histogram(65536);
+    for (int shift = 32; shift < 64; shift += 16) {
+        std::fill(histogram.begin(), histogram.end(), 0);
+        for (std::uint64_t key : keys)
+            ++histogram[(key >> shift) & 0xFFFF];
+        std::size_t sum = 0;
+        for (std::size_t& h : histogram) {
+            std::size_t count = h;
+            h = sum;
+            sum += count;
+        }
+        for (std::uint64_t key : keys)
+            sorted[histogram[(key >> shift) & 0xFFFF]++] = key;
+        keys.swap(sorted);
+    }
+
+    items.resize(n);
+    itemBoxes.resize(n);
+    positions.resize(n);
+    for (std::size_t i = 0; i < n; ++i) {
+        items[i] = static_cast<std::uint32_t>(keys[i]);
+        itemBoxes[i] = boxes[items[i]];
+        positions[items[i]] = static_cast<std::uint32_t>(i);
+    }
+
+    nodes.clear();
+    nodes.reserve(2 * n / kLeafSize + 1);
+    if (n > 0)
+        buildNode(0, static_cast<std::uint32_t>(n));
+    builtCount = n;
+    ++builtGeneration;
+}
+
+std::uint32_t SpatialIndex::buildNode(std::uint32_t first, std::uint32_t last) {
+    std::uint32_t self = static_cast<std::uint32_t>(nodes.size());
+    nodes.push_back(Node{ Bounds(), first, last - first, 0 });
+    if (last - first <= kLeafSize) {
+        for (std::uint32_t i = first; i < last; ++i)
+            nodes[self].box.expand(itemBoxes[i]);
+        return self;
+    }
+
+    // Split at a leaf-size multiple so only the last leaf can be partly filled
+    std::uint32_t leaves = (last - first + kLeafSize - 1) / kLeafSize;
+    std::uint32_t mid = first + (leaves / 2) * kLeafSize;
+    std::uint32_t left = buildNode(first, mid);
+    std::uint32_t right = buildNode(mid, last);
+    Bounds box = nodes[left].box;
+    box.expand(nodes[right].box);
+    nodes[self].box = box;
+    nodes[self].right = right;
+    return self;
+}
+
+void SpatialIndex::refresh(const std::vector<std::shared_ptr<Shape>>& shapes, unsigned long long version) {
+    std::size_t appended = shapes.size() >= builtCount ? shapes.size() - builtCount : 0;
+    if (version != builtVersion || shapes.size() < builtCount || appended > std::max<std::size_t>(1024, builtCount / 8)) {
+        build(shapes);
+        builtVersion = version;
+    }
+}
+
+void SpatialIndex::refit(const std::vector<std::shared_ptr<Shape>>& shapes, const std::vector<std::size_t>& changed) {
+    bool any = false;
+    for (std::size_t i : changed) {
+        if (i < builtCount) {
+            itemBoxes[positions[i]] = shapes[i]->bounds();
+            any = true;
+        }
+    }
+    if (!any)
+        return;
+
+    // Children follow their parent in depth-first order, so a reverse sweep
+    // sees both children of a node before the node itself
+    for (std::size_t n = nodes.size(); n-- > 0;) {
+        Node& node = nodes[n];
+        Bounds box;
+        if (node.right == 0) {
+            for (std::uint32_t i = node.first; i < node.first + node.count; ++i)
+                box.expand(itemBoxes[i]);
+        }
+        else {
+            box = nodes[n + 1].box;
+            box.expand(nodes[node.right].box);
+        }
+        node.box = box;
+    }
+}
+
+std::vector<Neighbor> SpatialIndex::nearest(const std::vector<std::shared_ptr<Shape>>& shapes,
+    double x, double y, std::size_t k, double maxDistance) const {
+    std::vector<Neighbor> heap;
+    // There are never more answers than shapes, however many are asked for
+    k = std::min(k, shapes.size());
+    if (k == 0)
+        return heap;
+    heap.reserve(k + 1);
+    auto bound = [&]() { return heap.size() == k ? heap.front().distance : maxDistance; };
+
+    if (!nodes.empty()) {
+        // Depth-first branch and bound, descending into the nearer child first
+        struct Pending { std::uint32_t node; double distance; };
+        Pending stack[64];
+        int top = 0;
+        stack[top++] = Pending{ 0, nodes[0].box.distanceTo(x, y) };
+        while (top > 0) {
+            Pending current = stack[--top];
+            if (current.distance > bound())
+                continue;
+            const Node& node = nodes[current.node];
+            if (node.right == 0) {
+                for (std::uint32_t i = node.first; i < node.first + node.count; ++i) {
+                    if (itemBoxes[i].distanceTo(x, y) > bound())
+                        continue;
+                    double d = shapes[items[i]]->distanceTo(x, y);
+                    if (d <= bound())
+                        offer(heap, k, items[i], d);
+                }
+                continue;
+            }
+            std::uint32_t left = current.node + 1, right = node.right;
+            double leftDistance = nodes[left].box.distanceTo(x, y);
+            double rightDistance = nodes[right].box.distanceTo(x, y);
+            if (leftDistance <= rightDistance) {
+                stack[top++] = Pending{ right, rightDistance };
+                stack[top++] = Pending{ left, leftDistance };
+            }
+            else {
+                stack[top++] = Pending{ left, leftDistance };
+                stack[top++] = Pending{ right, rightDistance };
+            }
+        }
+    }
+
+    // Shapes appended since the last build
+    for (std::size_t i = builtCount; i < shapes.size(); ++i) {
+        if (shapes[i]->bounds().distanceTo(x, y) > bound())
+            continue;
+        double d = shapes[i]->distanceTo(x, y);
+        if (d <= bound())
+            offer(heap, k, i, d);
+    }
+
+    std::sort_heap(heap.begin(), heap.end(), [](const Neighbor& a, const Neighbor& b) { return a.distance < b.distance; });
+    return heap;
+}
+
+void SpatialIndex::collect(const std::vector<std::shared_ptr<Shape>>& shapes, const Bounds& view,
+    double clusterExtent, double clusterDensity,
+    std::vector<std::size_t>& visible, std::vector<IndexCluster>& clusters) const {
+    auto meets = [&](const Bounds& b) {
+        return !b.isEmpty() && b.minX <= view.maxX && b.maxX >= view.minX && b.minY <= view.maxY && b.maxY >= view.minY;
+    };
+
+    if (!nodes.empty()) {
+        std::uint32_t stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node& node = nodes[stack[--top]];
+            if (!meets(node.box))
+                continue;
+            double width = static_cast<double>(node.box.maxX) - node.box.minX;
+            double height = static_cast<double>(node.box.maxY) - node.box.minY;
+            if (node.count > 1 && width < clusterExtent && height < clusterExtent &&
+                node.count >= clusterDensity * std::max(width, 1.0) * std::max(height, 1.0)) {
+                clusters.push_back(IndexCluster{ node.box, node.count });
+                continue;
+            }
+            if (node.right == 0) {
+                for (std::uint32_t i = node.first; i < node.first + node.count; ++i) {
+                    if (meets(itemBoxes[i]))
+                        visible.push_back(items[i]);
+                }
+                continue;
+            }
+            stack[top++] = node.right;
+            stack[top++] = static_cast<std::uint32_t>(&node - nodes.data()) + 1;
+        }
+    }
+
+    for (std::size_t i = builtCount; i < shapes.size(); ++i) {
+        if (meets(shapes[i]->bounds()))
+            visible.push_back(i);
+    }
+}
+
+std::size_t SpatialIndex::count(const std::vector<std::shared_ptr<Shape>>& shapes, const Bounds& window) const {
+    auto meets = [&](const Bounds& b) {
+        return !b.isEmpty() && b.minX <= window.maxX && b.maxX >= window.minX && b.minY <= window.maxY && b.maxY >= window.minY;
+    };
+    auto inside = [&](const Bounds& b) {
+        return b.minX >= window.minX && b.maxX <= window.maxX && b.minY >= window.minY && b.maxY <= window.maxY;
+    };
+
+    std::size_t found = 0;
+    if (!nodes.empty()) {
+        std::uint32_t stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            std::uint32_t index = stack[--top];
+            const Node& node = nodes[index];
+            if (!meets(node.box))
+                continue;
+            if (inside(node.box)) {
+                found += node.count;
+                continue;
+            }
+            if (node.right == 0) {
+                for (std::uint32_t i = node.first; i < node.first + node.count; ++i) {
+                    if (meets(itemBoxes[i]))
+                        ++found;
+                }
+                continue;
+            }
+            stack[top++] = node.right;
+            stack[top++] = index + 1;
+        }
+    }
+    for (std::size_t i = builtCount; i < shapes.size(); ++i) {
+        if (meets(shapes[i]->bounds()))
+            ++found;
+    }
+    return found;
+}
+
+Bounds SpatialIndex::extent(const std::vector<std::shared_ptr<Shape>>& shapes) const {
+    Bounds box;
+    if (!nodes.empty())
+        box = nodes[0].box;
+    for (std::size_t i = builtCount; i < shapes.size(); ++i)
+        box.expand(shapes[i]->bounds());
+    return box;
+}
+
+std::size_t SpatialIndex::indexedCount() const {
+    return builtCount;
+}
+
+const std::vector<std::uint32_t>& SpatialIndex::orderedShapes() const {
+    return items;
+}
+
+const std::vector<Bounds>& SpatialIndex::orderedBounds() const {
+    return itemBoxes;
+}
+
+std::size_t SpatialIndex::position(std::size_t shape) const {
+    return positions[shape];
+}
+
+unsigned long long SpatialIndex::generation() const {
+    return builtGeneration;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "Shape.h"
+
+struct Neighbor {
+    std::size_t index; // into the shape list the index was built over
+    double distance;
+};
+
+// A subtree reported as a whole by SpatialIndex::collect.
+struct IndexCluster {
+    Bounds box;
+    std::size_t count; // shapes inside
+};
+
+// Bounding-volume hierarchy over the bounds of a shape list, answering nearest
+// queries by true distance to each shape's outline (Shape::distanceTo).
+// The index stores shape indices only; every query takes the same list it was
+// built or refreshed with.
+class SpatialIndex {
+public:
+    void build(const std::vector<std::shared_ptr<Shape>>& shapes);
+    // Brings the index up to date with `shapes`. `version` must change whenever
+    // shapes are edited, removed or reordered; that forces a rebuild. Shapes that
+    // were only appended since the last build are searched linearly until enough
+    // of them pile up to make a rebuild worthwhile.
+    void refresh(const std::vector<std::shared_ptr<Shape>>& shapes, unsigned long long version);
+    // Updates the boxes of shapes edited in place (moved, resized or replaced at
+    // the same index) without reordering anything. The hierarchy keeps its shape,
+    // so queries stay exact but may prune less well after large moves.
+    void refit(const std::vector<std::shared_ptr<Shape>>& shapes, const std::vector<std::size_t>& changed);
+    // Up to `k` shapes within `maxDistance` of (x, y), nearest first.
+    std::vector<Neighbor> nearest(const std::vector<std::shared_ptr<Shape>>& shapes,
+        double x, double y, std::size_t k, double maxDistance) const;
+    // Shapes whose bounds meet `view`, appended to `visible`. A subtree is reported
+    // once in `clusters` instead of being descended when its box is narrower and
+    // shorter than `clusterExtent` and it holds at least `clusterDensity` shapes
+    // per unit of box area, so the cost of a dense view follows its resolution
+    // rather than the shape count.
+    void collect(const std::vector<std::shared_ptr<Shape>>& shapes, const Bounds& view,
+        double clusterExtent, double clusterDensity,
+        std::vector<std::size_t>& visible, std::vector<IndexCluster>& clusters) const;
+    // Number of shapes whose bounds meet `window`; subtrees lying inside it are
+    // counted without being descended.
+    std::size_t count(const std::vector<std::shared_ptr<Shape>>& shapes, const Bounds& window) const;
+    // Union of all shape bounds.
+    Bounds extent(const std::vector<std::shared_ptr<Shape>>& shapes) const;
+    std::size_t indexedCount() const;
+
+    // The first indexedCount() shapes in hierarchy order, which keeps shapes near
+    // each other in space near each other in the list, and their bounds.
+    // position() maps a shape index back into that order.
+    const std::vector<std::uint32_t>& orderedShapes() const;
+    const std::vector<Bounds>& orderedBounds() const;
+    std::size_t position(std::size_t shape) const;
+    // Changes with every build; the order above is stable while it holds.
+    unsigned long long generation() const;
+
+private:
+    static const std::size_t kLeafSize = 4;
+    struct Node {
+        Bounds box;
+        std::uint32_t first, count; // items covered by the subtree
+        std::uint32_t right;        // right child (the left one follows the node); 0 for leaves
+    };
+    std::vector<Node> nodes;          // depth-first order, root first
+    std::vector<std::uint32_t> items; // shape indices grouped by leaf
+    std::vector<Bounds> itemBoxes;    // bounds of items[i], kept alongside for pruning
+    std::vector<std::uint32_t> positions; // inverse of items
+    std::size_t builtCount = 0;
+    unsigned long long builtVersion = 0;
+    unsigned long long builtGeneration = 0;
+
+    std::uint32_t buildNode(std::uint32_t first, std::uint32_t last);
+};
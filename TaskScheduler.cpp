@@ -0,0 +1,233 @@
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+
+thread_local const TaskScheduler* currentScheduler = nullptr;
+thread_local int currentWorker = -1;
+
+std::int64_t nowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+TaskScheduler::TaskScheduler(unsigned workerCount) : statsSince(nowNs()) {
+    if (workerCount == 0)
+        workerCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    for (unsigned i = 0; i < workerCount; ++i)
+        workers.push_back(std::unique_ptr<Worker>(new Worker()));
+    // Threads start once every worker exists, since any of them may steal from the others
+    for (unsigned i = 0; i < workerCount; ++i)
+        workers[i]->thread = std::thread(&TaskScheduler::workerLoop, this, i);
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    sleep.notify_all();
+    for (auto& worker : workers)
+        worker->thread.join();
+}
+
+TaskScheduler& TaskScheduler::shared() {
+    static TaskScheduler scheduler;
+    return scheduler;
+}
+
+unsigned TaskScheduler::workerCount() const {
+    return static_cast<unsigned>(workers.size());
+}
+
+void TaskScheduler::submit(std::function<void()> task, TaskPriority priority) {
+    push(std::move(task), priority);
+}
+
+void TaskScheduler::push(Task task, TaskPriority priority) {
+    int p = static_cast<int>(priority);
+    if (currentScheduler == this) {
+        Worker& self = *workers[currentWorker];
+        std::lock_guard<std::mutex> lock(self.mutex);
+        self.queues[p].push_back(std::move(task));
+    }
+    else {
+        std::lock_guard<std::mutex> lock(injectMutex);
+        injected[p].push_back(std::move(task));
+    }
+    queued.fetch_add(1);
+    // Taking the mutex orders this against a worker that has just found no work
+    // and is about to sleep
+    { std::lock_guard<std::mutex> lock(sleepMutex); }
+    sleep.notify_one();
+}
+
+bool TaskScheduler::runOne(int self) {
+    if (queued.load() == 0)
+        return false;
+    Task task;
+    bool stolen = false;
+    std::size_t count = workers.size();
+    for (int p = 0; p < kPriorities && !task; ++p) {
+        if (self >= 0) {
+            Worker& own = *workers[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.queues[p].empty()) {
+                task = std::move(own.queues[p].back());
+                own.queues[p].pop_back();
+                break;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(injectMutex);
+            if (!injected[p].empty()) {
+                task = std::move(injected[p].front());
+                injected[p].pop_front();
+                break;
+            }
+        }
+        // Victims are visited starting after the thief so that thieves spread out
+        for (std::size_t k = 1; k <= count; ++k) {
+            std::size_t victim = (static_cast<std::size_t>(self + count) + k) % count;
+            if (static_cast<int>(victim) == self)
+                continue;
+            Worker& other = *workers[victim];
+            std::lock_guard<std::mutex> lock(other.mutex);
+            if (!other.queues[p].empty()) {
+                task = std::move(other.queues[p].front());
+                other.queues[p].pop_front();
+                stolen = true;
+                break;
+            }
+        }
+    }
+    if (!task)
+        return false;
+    queued.fetch_sub(1);
+
+    std::int64_t start = nowNs();
+    task();
+    if (self >= 0) {
+        Worker& own = *workers[self];
+        own.busyNs.fetch_add(static_cast<std::uint64_t>(nowNs() - start), std::memory_order_relaxed);
+        own.tasks.fetch_add(1, std::memory_order_relaxed);
+        if (stolen)
+            own.steals.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+void TaskScheduler::workerLoop(unsigned index) {
+    currentScheduler = this;
+    currentWorker = static_cast<int>(index);
+    for (;;) {
+        if (runOne(currentWorker))
+            continue;
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleep.wait(lock, [&]() { return stopping || queued.load() > 0; });
+        if (stopping && queued.load() == 0)
+            return;
+    }
+}
+
+void TaskScheduler::waitFor(const std::atomic<std::size_t>& remaining) {
+    // Only workers help: a thread outside the pool may hold locks that queued
+    // tasks take, so it never runs them
+    int self = currentScheduler == this ? currentWorker : -1;
+    while (remaining.load(std::memory_order_acquire) > 0) {
+        if (self < 0 || !runOne(self))
+            std::this_thread::yield();
+    }
+}
+
+void TaskScheduler::parallelFor(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)>& body,
+    TaskPriority priority) {
+    grain = std::max<std::size_t>(1, grain);
+    std::size_t pieces = (count + grain - 1) / grain;
+    if (pieces <= 1) {
+        if (count > 0)
+            body(0, count);
+        return;
+    }
+    // Pieces are claimed from a shared counter by the caller and by helper
+    // tasks alike, so the caller only ever runs its own pieces and never waits
+    // on one nobody has started. Helpers that find nothing left return without
+    // touching `body`; the claims outlive the call, hence the shared state.
+    struct Claims {
+        std::atomic<std::size_t> next{ 0 }, remaining{ 0 };
+    };
+    std::shared_ptr<Claims> claims = std::make_shared<Claims>();
+    claims->remaining.store(pieces);
+    auto runPieces = [&body, count, grain, pieces](Claims& shared) {
+        for (;;) {
+            std::size_t piece = shared.next.fetch_add(1, std::memory_order_relaxed);
+            if (piece >= pieces)
+                return;
+            std::size_t begin = piece * grain;
+            body(begin, std::min(count, begin + grain));
+            shared.remaining.fetch_sub(1, std::memory_order_release);
+        }
+    };
+    for (std::size_t helper = 1; helper < std::min<std::size_t>(pieces, workers.size() + 1); ++helper)
+        push([claims, runPieces]() { runPieces(*claims); }, priority);
+    runPieces(*claims);
+    // Whatever is left is running on other threads already
+    while (claims->remaining.load(std::memory_order_acquire) > 0)
+        std::this_thread::yield();
+}
+
+std::vector<WorkerStats> TaskScheduler::stats() const {
+    double elapsed = static_cast<double>(std::max<std::int64_t>(1, nowNs() - statsSince.load()));
+    std::vector<WorkerStats> result;
+    for (const auto& worker : workers) {
+        result.push_back(WorkerStats{ worker->tasks.load(), worker->steals.load(),
+            static_cast<double>(worker->busyNs.load()) / elapsed });
+    }
+    return result;
+}
+
+void TaskScheduler::resetStats() {
+    for (auto& worker : workers) {
+        worker->busyNs.store(0);
+        worker->tasks.store(0);
+        worker->steals.store(0);
+    }
+    statsSince.store(nowNs());
+}
+
+std::size_t TaskGraph::add(std::function<void()> work, TaskPriority priority) {
+    nodes.emplace_back();
+    nodes.back().work = std::move(work);
+    nodes.back().priority = priority;
+    return nodes.size() - 1;
+}
+
+void TaskGraph::precede(std::size_t before, std::size_t after) {
+    nodes[before].successors.push_back(after);
+    ++nodes[after].dependencies;
+}
+
+void TaskGraph::run(TaskScheduler& scheduler) {
+    std::atomic<std::size_t> remaining(nodes.size());
+    for (auto& node : nodes)
+        node.pending.store(node.dependencies);
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i].dependencies == 0)
+            schedule(scheduler, i, remaining);
+    }
+    scheduler.waitFor(remaining);
+}
+
+void TaskGraph::schedule(TaskScheduler& scheduler, std::size_t node, std::atomic<std::size_t>& remaining) {
+    scheduler.submit([this, &scheduler, node, &remaining]() {
+        nodes[node].work();
+        // The last predecessor to finish releases each successor
+        for (std::size_t next : nodes[node].successors) {
+            if (nodes[next].pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                schedule(scheduler, next, remaining);
+        }
+        remaining.fetch_sub(1, std::memory_order_release);
+    }, nodes[node].priority);
+}
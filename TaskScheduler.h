@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Highest first. Workers always take the highest-priority task available
+// anywhere, so interactive work queued behind a long background job starts as
+// soon as any worker finishes its current task. Running tasks are never
+// interrupted: background jobs should be split into short tasks.
+enum class TaskPriority : std::uint8_t {
+    Interactive,
+    Normal,
+    Background,
+    Count,
+};
+
+struct WorkerStats {
+    std::uint64_t tasks;  // tasks run since the last reset
+    std::uint64_t steals; // of which taken from another worker's queue
+    double utilization;   // share of wall time spent running tasks since the last reset
+};
+
+// Work-stealing thread pool. Each worker keeps a deque per priority: tasks it
+// spawns go to the back of its own deque and it takes from the back (newest
+// first, still warm in cache); idle workers steal from the front of the others
+// (oldest first, usually the biggest pieces). Threads outside the pool submit
+// through shared injection queues.
+//
+// Waiting never runs unrelated work on a thread that might hold locks:
+// parallelFor runs only its own pieces on the calling thread, whichever thread
+// that is, so callers may hold a lock that other tasks take (the renderer holds
+// the scene lock across tessellation while background jobs wait for it). Only
+// pool workers run queued tasks inside waitFor, so a task must not hold such a
+// lock across waitFor or TaskGraph::run; threads outside the pool just wait.
+class TaskScheduler {
+public:
+    // `workers` threads (0 = one less than the hardware concurrency, at least
+    // one, since the submitting thread helps while it waits).
+    explicit TaskScheduler(unsigned workers = 0);
+    ~TaskScheduler();
+
+    // The process-wide pool every subsystem shares.
+    static TaskScheduler& shared();
+
+    unsigned workerCount() const;
+    // Fire and forget.
+    void submit(std::function<void()> task, TaskPriority priority = TaskPriority::Normal);
+    // Calls body(begin, end) over [0, count) in pieces of `grain` items and
+    // returns when all of them are done; the calling thread runs pieces too,
+    // but never any other task.
+    void parallelFor(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)>& body,
+        TaskPriority priority = TaskPriority::Interactive);
+    // Returns once `remaining` drops to zero. Pool workers run queued tasks
+    // meanwhile; other threads only wait.
+    void waitFor(const std::atomic<std::size_t>& remaining);
+
+    std::vector<WorkerStats> stats() const;
+    void resetStats();
+
+private:
+    static const int kPriorities = static_cast<int>(TaskPriority::Count);
+    typedef std::function<void()> Task;
+
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> queues[kPriorities];
+        std::atomic<std::uint64_t> busyNs{ 0 }, tasks{ 0 }, steals{ 0 };
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex injectMutex;
+    std::deque<Task> injected[kPriorities];
+    std::atomic<std::size_t> queued{ 0 };
+    std::mutex sleepMutex;
+    std::condition_variable sleep;
+    bool stopping = false; // guarded by sleepMutex
+    std::atomic<std::int64_t> statsSince;
+
+    void push(Task task, TaskPriority priority);
+    // Takes and runs one task, preferring higher priorities; `self` is the
+    // calling worker's index or -1 for outside threads.
+    bool runOne(int self);
+    void workerLoop(unsigned index);
+};
+
+// Tasks with dependencies, run as a unit. A task starts once every task
+// that precedes it has finished.
+class TaskGraph {
+public:
+    std::size_t add(std::function<void()> work, TaskPriority priority = TaskPriority::Normal);
+    // `after` waits for `before`.
+    void precede(std::size_t before, std::size_t after);
+    // Runs every task and returns when all are done. The graph can be run again.
+    void run(TaskScheduler& scheduler);
+
+private:
+    struct Node {
+        std::function<void()> work;
+        TaskPriority priority;
+        std::vector<std::size_t> successors;
+        std::size_t dependencies = 0;
+        std::atomic<std::size_t> pending{ 0 };
+    };
+    std::deque<Node> nodes; // stable addresses while tasks refer to them
+
+    void schedule(TaskScheduler& scheduler, std::size_t node, std::atomic<std::size_t>& remaining);
+};
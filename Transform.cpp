@@ -0,0 +1,554 @@
+#include "Transform.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <thread>
+#include "Block.h"
+#include "PolygonBoolean.h"
+#include "ShapeArray.h"
+#include "TaskScheduler.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MINICAD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MINICAD_SSE2 1
+#endif
+
+namespace {
+
+const double kPi = 3.14159265358979323846;
+// Below this many coordinates a single thread finishes before others would start.
+const std::size_t kMinParallelCount = 1 << 16;
+
+struct Span {
+    int* xs;
+    int* ys;
+    std::size_t count;
+};
+
+// Calls fn(begin, end) on contiguous slices of [0, count), one per thread, on
+// the shared scheduler.
+template <typename Fn>
+void parallelFor(std::size_t count, unsigned threads, std::size_t minPerThread, Fn fn) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t workers = std::min<std::size_t>(threads, std::max<std::size_t>(1, count / minPerThread));
+    if (workers <= 1) {
+        fn(std::size_t(0), count);
+        return;
+    }
+    TaskScheduler::shared().parallelFor(count, (count + workers - 1) / workers, fn, TaskPriority::Normal);
+}
+
+void translateRange(int dx, int dy, int* xs, int* ys, std::size_t n) {
+    std::size_t i = 0;
+#if defined(MINICAD_AVX2)
+    __m256i vdx = _mm256_set1_epi32(dx), vdy = _mm256_set1_epi32(dy);
+    for (; i + 8 <= n; i += 8) {
+        __m256i* px = reinterpret_cast<__m256i*>(xs + i);
+        __m256i* py = reinterpret_cast<__m256i*>(ys + i);
+        _mm256_storeu_si256(px, _mm256_add_epi32(_mm256_loadu_si256(px), vdx));
+        _mm256_storeu_si256(py, _mm256_add_epi32(_mm256_loadu_si256(py), vdy));
+    }
+#elif defined(MINICAD_SSE2)
+    __m128i vdx = _mm_set1_epi32(dx), vdy = _mm_set1_epi32(dy);
+    for (; i + 4 <= n; i += 4) {
+        __m128i* px = reinterpret_cast<__m128i*>(xs + i);
+        __m128i* py = reinterpret_cast<__m128i*>(ys + i);
+        _mm_storeu_si128(px, _mm_add_epi32(_mm_loadu_si128(px), vdx));
+        _mm_storeu_si128(py, _mm_add_epi32(_mm_loadu_si128(py), vdy));
+    }
+#endif
+    for (; i < n; ++i) {
+        xs[i] += dx;
+        ys[i] += dy;
+    }
+}
+
+// Vector and scalar paths evaluate (a * x + b * y) + t in the same order and round
+// half-to-even, so results do not depend on where a coordinate falls in the column.
+void transformRange(const Affine2D& m, int* xs, int* ys, std::size_t n) {
+    std::size_t i = 0;
+#if defined(MINICAD_AVX2)
+    __m256d a = _mm256_set1_pd(m.a), b = _mm256_set1_pd(m.b), tx = _mm256_set1_pd(m.tx);
+    __m256d c = _mm256_set1_pd(m.c), d = _mm256_set1_pd(m.d), ty = _mm256_set1_pd(m.ty);
+    for (; i + 4 <= n; i += 4) {
+        __m128i* px = reinterpret_cast<__m128i*>(xs + i);
+        __m128i* py = reinterpret_cast<__m128i*>(ys + i);
+        __m256d x = _mm256_cvtepi32_pd(_mm_loadu_si128(px));
+        __m256d y = _mm256_cvtepi32_pd(_mm_loadu_si128(py));
+        __m256d nx = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(a, x), _mm256_mul_pd(b, y)), tx);
+        __m256d ny = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(c, x), _mm256_mul_pd(d, y)), ty);
+        _mm_storeu_si128(px, _mm256_cvtpd_epi32(nx));
+        _mm_storeu_si128(py, _mm256_cvtpd_epi32(ny));
+    }
+#elif defined(MINICAD_SSE2)
+    __m128d a = _mm_set1_pd(m.a), b = _mm_set1_pd(m.b), tx = _mm_set1_pd(m.tx);
+    __m128d c = _mm_set1_pd(m.c), d = _mm_set1_pd(m.d), ty = _mm_set1_pd(m.ty);
+    for (; i + 2 <= n; i += 2) {
+        __m128i* px = reinterpret_cast<__m128i*>(xs + i);
+        __m128i* py = reinterpret_cast<__m128i*>(ys + i);
+        __m128d x = _mm_cvtepi32_pd(_mm_loadl_epi64(px));
+        __m128d y = _mm_cvtepi32_pd(_mm_loadl_epi64(py));
+        __m128d nx = _mm_add_pd(_mm_add_pd(_mm_mul_pd(a, x), _mm_mul_pd(b, y)), tx);
+        __m128d ny = _mm_add_pd(_mm_add_pd(_mm_mul_pd(c, x), _mm_mul_pd(d, y)), ty);
+        _mm_storel_epi64(px, _mm_cvtpd_epi32(nx));
+        _mm_storel_epi64(py, _mm_cvtpd_epi32(ny));
+    }
+#endif
+    for (; i < n; ++i) {
+        double x = xs[i], y = ys[i];
+        xs[i] = static_cast<int>(std::nearbyint((m.a * x + m.b * y) + m.tx));
+        ys[i] = static_cast<int>(std::nearbyint((m.c * x + m.d * y) + m.ty));
+    }
+}
+
+// Transforms the concatenation of `spans` as one column, sliced evenly across threads.
+void transformSpans(const Affine2D& m, const std::vector<Span>& spans, unsigned threads) {
+    std::vector<std::size_t> starts(spans.size() + 1, 0);
+    for (std::size_t s = 0; s < spans.size(); ++s)
+        starts[s + 1] = starts[s] + spans[s].count;
+
+    bool translate = m.isIntegerTranslation();
+    int dx = static_cast<int>(m.tx), dy = static_cast<int>(m.ty);
+    parallelFor(starts.back(), threads, kMinParallelCount, [&](std::size_t begin, std::size_t end) {
+        std::size_t s = std::upper_bound(starts.begin(), starts.end(), begin) - starts.begin() - 1;
+        for (; s < spans.size() && starts[s] < end; ++s) {
+            std::size_t from = std::max(begin, starts[s]) - starts[s];
+            std::size_t to = std::min(end, starts[s + 1]) - starts[s];
+            if (to <= from)
+                continue;
+            if (translate)
+                translateRange(dx, dy, spans[s].xs + from, spans[s].ys + from, to - from);
+            else
+                transformRange(m, spans[s].xs + from, spans[s].ys + from, to - from);
+        }
+    });
+}
+
+// Number of gathered coordinate slots a shape of this type uses (paths stay in the pool).
+std::size_t slotCount(ShapeType type) {
+    switch (type) {
+    case ShapeType::Point: return 1;
+    case ShapeType::Circle: return 1;
+    case ShapeType::Line: return 2;
+    case ShapeType::Rectangle: return 2;
+    default: return 0;
+    }
+}
+
+void gather(const Shape& shape, int* xs, int* ys) {
+    switch (shape.type()) {
+    case ShapeType::Point: {
+        const Point& p = static_cast<const Point&>(shape);
+        xs[0] = p.x; ys[0] = p.y;
+        break;
+    }
+    case ShapeType::Line: {
+        const Line& l = static_cast<const Line&>(shape);
+        xs[0] = l.start.x; ys[0] = l.start.y;
+        xs[1] = l.end.x; ys[1] = l.end.y;
+        break;
+    }
+    case ShapeType::Rectangle: {
+        const Rectangle& r = static_cast<const Rectangle&>(shape);
+        xs[0] = r.topLeft.x; ys[0] = r.topLeft.y;
+        xs[1] = r.topLeft.x + r.width; ys[1] = r.topLeft.y + r.height;
+        break;
+    }
+    case ShapeType::Circle: {
+        const Circle& c = static_cast<const Circle&>(shape);
+        xs[0] = c.center.x; ys[0] = c.center.y;
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void scatter(Shape& shape, const int* xs, const int* ys) {
+    switch (shape.type()) {
+    case ShapeType::Point: {
+        Point& p = static_cast<Point&>(shape);
+        p.x = xs[0]; p.y = ys[0];
+        break;
+    }
+    case ShapeType::Line: {
+        Line& l = static_cast<Line&>(shape);
+        l.start.x = xs[0]; l.start.y = ys[0];
+        l.end.x = xs[1]; l.end.y = ys[1];
+        break;
+    }
+    case ShapeType::Rectangle: {
+        // Mirroring swaps the corners, so normalise back to top-left + size.
+        Rectangle& r = static_cast<Rectangle&>(shape);
+        r.topLeft.x = std::min(xs[0], xs[1]); r.topLeft.y = std::min(ys[0], ys[1]);
+        r.width = std::abs(xs[1] - xs[0]); r.height = std::abs(ys[1] - ys[0]);
+        break;
+    }
+    case ShapeType::Circle: {
+        Circle& c = static_cast<Circle&>(shape);
+        c.center.x = xs[0]; c.center.y = ys[0];
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+bool isPath(ShapeType type) {
+    return type == ShapeType::Polyline || type == ShapeType::Polygon;
+}
+
+// Polygon with the original geometry of a rectangle or circle; the caller transforms it.
+std::shared_ptr<Shape> toPolygon(const Shape& shape, const std::shared_ptr<VertexPool>& pool, double scale) {
+    Path path;
+    if (shape.type() == ShapeType::Circle) {
+        const Circle& c = static_cast<const Circle&>(shape);
+        int scaled = static_cast<int>(std::ceil(c.radius * scale));
+        path = tessellateCircle(c.center.x, c.center.y, c.radius, circleSegments(std::max(scaled, c.radius)));
+    }
+    else {
+        path = shapeToPath(shape);
+    }
+    std::vector<Point> points;
+    points.reserve(path.size());
+    for (const auto& p : path)
+        points.push_back(Point(p.x, p.y));
+    std::size_t offset = pool->append(points);
+    return std::make_shared<Polygon>(pool, offset, points.size());
+}
+
+// A copy that owns its geometry; paths get their own run of vertices in `pool`.
+std::shared_ptr<Shape> cloneShape(const Shape& shape, const std::shared_ptr<VertexPool>& pool) {
+    switch (shape.type()) {
+    case ShapeType::Point: return std::make_shared<Point>(static_cast<const Point&>(shape));
+    case ShapeType::Line: return std::make_shared<Line>(static_cast<const Line&>(shape));
+    case ShapeType::Rectangle: return std::make_shared<Rectangle>(static_cast<const Rectangle&>(shape));
+    case ShapeType::Circle: return std::make_shared<Circle>(static_cast<const Circle&>(shape));
+    default: {
+        const Polyline& path = static_cast<const Polyline&>(shape);
+        std::vector<Point> points;
+        points.reserve(path.count);
+        for (std::size_t i = 0; i < path.count; ++i)
+            points.push_back(path.vertex(i));
+        std::size_t offset = pool->append(points);
+        if (path.isClosed())
+            return std::make_shared<Polygon>(pool, offset, points.size(), path.holes);
+        return std::make_shared<Polyline>(pool, offset, points.size());
+    }
+    }
+}
+
+// The box around `box` placed by `m`, widened by the rounding of the corners.
+// False when it leaves integer coordinates.
+bool placedBox(const Bounds& box, const Affine2D& m, Bounds& placed) {
+    const double xs[2] = { static_cast<double>(box.minX), static_cast<double>(box.maxX) };
+    const double ys[2] = { static_cast<double>(box.minY), static_cast<double>(box.maxY) };
+    placed = Bounds();
+    for (double x : xs) {
+        for (double y : ys) {
+            double px = std::round(m.a * x + m.b * y + m.tx), py = std::round(m.c * x + m.d * y + m.ty);
+            if (!(std::fabs(px) < INT_MAX - 1.0 && std::fabs(py) < INT_MAX - 1.0))
+                return false;
+            placed.expand(Bounds(static_cast<int>(px) - 1, static_cast<int>(py) - 1, static_cast<int>(px) + 1, static_cast<int>(py) + 1));
+        }
+    }
+    return true;
+}
+
+// The pattern of `array` under `m`: the column and row steps move by the linear
+// part of the matrix, the center by all of it. False when a copy of the
+// transformed item would leave integer coordinates.
+bool transformPattern(const ShapeArray& array, const Affine2D& m, ArrayPattern& pattern) {
+    pattern = array.pattern;
+    bool inRange = true;
+    auto toInt = [&](double v) {
+        v = std::round(v);
+        if (!(std::fabs(v) < INT_MAX)) {
+            inRange = false;
+            return 0;
+        }
+        return static_cast<int>(v);
+    };
+    auto linear = [&](int& x, int& y) {
+        double vx = x, vy = y;
+        x = toInt(m.a * vx + m.b * vy);
+        y = toInt(m.c * vx + m.d * vy);
+    };
+    linear(pattern.columnX, pattern.columnY);
+    linear(pattern.rowX, pattern.rowY);
+    double cx = pattern.centerX, cy = pattern.centerY;
+    pattern.centerX = toInt(m.a * cx + m.b * cy + m.tx);
+    pattern.centerY = toInt(m.c * cx + m.d * cy + m.ty);
+    if (m.determinant() < 0.0)
+        pattern.fillDegrees = -pattern.fillDegrees;
+
+    Bounds item;
+    return inRange && placedBox(array.item->bounds(), m, item) && pattern.fits(item);
+}
+
+// The item is transformed like any shape, the column and row steps by the
+// linear part of the matrix. Polar items keep their orientation, so polar
+// arrays are exact under moves, rotations and uniform scaling only.
+std::shared_ptr<Shape> transformArray(const ShapeArray& array, const std::shared_ptr<VertexPool>& pool, const Affine2D& m) {
+    std::vector<std::shared_ptr<Shape>> item(1, cloneShape(*array.item, pool));
+    transformShapes(item, pool, std::vector<std::size_t>(1, 0), m, 1);
+    ArrayPattern pattern;
+    transformPattern(array, m, pattern);
+    return std::make_shared<ShapeArray>(item[0], pattern, array.removed);
+}
+
+void refreshPaths(std::vector<std::shared_ptr<Shape>>& shapes, const std::vector<std::size_t>& paths, unsigned threads) {
+    parallelFor(paths.size(), threads, 256, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i)
+            static_cast<Polyline&>(*shapes[paths[i]]).updateSegmentTree();
+    });
+}
+
+}
+
+Affine2D Affine2D::identity() {
+    return Affine2D{ 1.0, 0.0, 0.0, 1.0, 0.0, 0.0 };
+}
+
+Affine2D Affine2D::translation(double dx, double dy) {
+    return Affine2D{ 1.0, 0.0, 0.0, 1.0, dx, dy };
+}
+
+Affine2D Affine2D::rotation(double degrees, double cx, double cy) {
+    double rad = degrees * kPi / 180.0;
+    double cs = std::cos(rad), sn = std::sin(rad);
+    // Snap the quarter turns so that they stay axis-aligned.
+    if (std::fabs(cs) < 1e-12) cs = 0.0;
+    if (std::fabs(sn) < 1e-12) sn = 0.0;
+    return Affine2D{ cs, -sn, sn, cs, cx - cs * cx + sn * cy, cy - sn * cx - cs * cy };
+}
+
+Affine2D Affine2D::scaling(double sx, double sy, double cx, double cy) {
+    return Affine2D{ sx, 0.0, 0.0, sy, cx - sx * cx, cy - sy * cy };
+}
+
+double Affine2D::determinant() const {
+    return a * d - b * c;
+}
+
+Affine2D Affine2D::inverse() const {
+    double det = determinant();
+    double ia = d / det, ib = -b / det, ic = -c / det, id = a / det;
+    return Affine2D{ ia, ib, ic, id, -(ia * tx + ib * ty), -(ic * tx + id * ty) };
+}
+
+Affine2D Affine2D::after(const Affine2D& first) const {
+    return Affine2D{ a * first.a + b * first.c, a * first.b + b * first.d, c * first.a + d * first.c, c * first.b + d * first.d,
+        a * first.tx + b * first.ty + tx, c * first.tx + d * first.ty + ty };
+}
+
+bool Affine2D::isAxisAligned() const {
+    return (b == 0.0 && c == 0.0) || (a == 0.0 && d == 0.0);
+}
+
+bool Affine2D::isSimilarity() const {
+    const double eps = 1e-12;
+    return (std::fabs(a - d) < eps && std::fabs(b + c) < eps) || (std::fabs(a + d) < eps && std::fabs(b - c) < eps);
+}
+
+bool Affine2D::isIntegerTranslation() const {
+    return a == 1.0 && b == 0.0 && c == 0.0 && d == 1.0 && tx == std::floor(tx) && ty == std::floor(ty) &&
+        std::fabs(tx) < 2147483647.0 && std::fabs(ty) < 2147483647.0;
+}
+
+void transformColumns(const Affine2D& m, int* xs, int* ys, std::size_t count, unsigned threads) {
+    transformSpans(m, std::vector<Span>(1, Span{ xs, ys, count }), threads);
+}
+
+bool keepsInRange(const Bounds& box, const Affine2D& matrix) {
+    Bounds placed;
+    return box.isEmpty() || placedBox(box, matrix, placed);
+}
+
+bool keepsInRange(const std::vector<std::shared_ptr<Shape>>& shapes, const std::vector<std::size_t>& selection, const Affine2D& matrix) {
+    ArrayPattern pattern;
+    return std::all_of(selection.begin(), selection.end(), [&](std::size_t index) {
+        if (shapes[index]->type() == ShapeType::Array)
+            return transformPattern(static_cast<const ShapeArray&>(*shapes[index]), matrix, pattern);
+        if (shapes[index]->type() == ShapeType::Reference) {
+            // The box of a reference is clamped; the block's own box is not
+            const BlockReference& reference = static_cast<const BlockReference&>(*shapes[index]);
+            return isValidPlacement(*reference.block, matrix.after(reference.placement));
+        }
+        // Everything else stays inside its placed box: circles turned into
+        // polygons are tessellated within their bounds
+        return keepsInRange(shapes[index]->bounds(), matrix);
+    });
+}
+
+TransformCommand transformShapes(std::vector<std::shared_ptr<Shape>>& shapes, const std::shared_ptr<VertexPool>& pool,
+    const std::vector<std::size_t>& selection, const Affine2D& matrix, unsigned threads) {
+    TransformCommand command;
+    command.matrix = matrix;
+    command.selection = selection;
+    std::sort(command.selection.begin(), command.selection.end());
+    command.selection.erase(std::unique(command.selection.begin(), command.selection.end()), command.selection.end());
+
+    bool keepBefore = !matrix.isIntegerTranslation();
+    double scale = std::sqrt(std::fabs(matrix.determinant()));
+
+    // Shapes that cannot keep their type get a polygon first; it must exist before
+    // any pointer into the pool is taken, since appending may reallocate. Arrays
+    // and block references are replaced by transformed copies here and left
+    // alone below.
+    std::size_t slots = 0;
+    for (std::size_t index : command.selection) {
+        ShapeType type = shapes[index]->type();
+        if (type == ShapeType::Array) {
+            command.replaced.push_back(std::make_pair(index, shapes[index]));
+            shapes[index] = transformArray(static_cast<const ShapeArray&>(*shapes[index]), pool, matrix);
+        }
+        else if (type == ShapeType::Reference) {
+            const BlockReference& reference = static_cast<const BlockReference&>(*shapes[index]);
+            command.replaced.push_back(std::make_pair(index, shapes[index]));
+            shapes[index] = std::make_shared<BlockReference>(reference.block, matrix.after(reference.placement));
+        }
+        else if ((type == ShapeType::Rectangle && !matrix.isAxisAligned()) || (type == ShapeType::Circle && !matrix.isSimilarity())) {
+            command.replaced.push_back(std::make_pair(index, shapes[index]));
+            shapes[index] = toPolygon(*shapes[index], pool, scale);
+        }
+        else {
+            slots += slotCount(type);
+        }
+    }
+
+    std::vector<int> gx(slots), gy(slots), radii;
+    std::vector<Span> spans(1, Span{ gx.data(), gy.data(), slots });
+    std::vector<std::size_t> paths;
+    std::size_t slot = 0, replacedAt = 0;
+    for (std::size_t index : command.selection) {
+        Shape& shape = *shapes[index];
+        bool isReplacement = replacedAt < command.replaced.size() && command.replaced[replacedAt].first == index;
+        if (isReplacement)
+            ++replacedAt;
+
+        if (isPath(shape.type())) {
+            Polyline& path = static_cast<Polyline&>(shape);
+            int* xs = path.pool->xs.data() + path.offset;
+            int* ys = path.pool->ys.data() + path.offset;
+            spans.push_back(Span{ xs, ys, path.count });
+            paths.push_back(index);
+            if (keepBefore && !isReplacement) {
+                command.beforeX.insert(command.beforeX.end(), xs, xs + path.count);
+                command.beforeY.insert(command.beforeY.end(), ys, ys + path.count);
+            }
+            continue;
+        }
+        gather(shape, gx.data() + slot, gy.data() + slot);
+        slot += slotCount(shape.type());
+        if (shape.type() == ShapeType::Circle)
+            radii.push_back(static_cast<Circle&>(shape).radius);
+    }
+    if (keepBefore) {
+        command.beforeX.insert(command.beforeX.end(), gx.begin(), gx.end());
+        command.beforeY.insert(command.beforeY.end(), gy.begin(), gy.end());
+        command.beforeRadius = radii;
+    }
+
+    transformSpans(matrix, spans, threads);
+
+    slot = 0;
+    std::size_t circle = 0;
+    for (std::size_t index : command.selection) {
+        Shape& shape = *shapes[index];
+        std::size_t n = slotCount(shape.type());
+        if (n == 0)
+            continue;
+        scatter(shape, gx.data() + slot, gy.data() + slot);
+        slot += n;
+        if (shape.type() == ShapeType::Circle) {
+            Circle& c = static_cast<Circle&>(shape);
+            c.radius = static_cast<int>(std::lround(radii[circle++] * scale));
+        }
+    }
+    // A mirror turns every ring around; undo restores the saved vertices in their old order
+    if (matrix.determinant() < 0.0) {
+        for (std::size_t index : paths) {
+            if (shapes[index]->type() == ShapeType::Polygon)
+                static_cast<Polygon&>(*shapes[index]).orientRings();
+        }
+    }
+    refreshPaths(shapes, paths, threads);
+    return command;
+}
+
+void TransformCommand::undo(std::vector<std::shared_ptr<Shape>>& shapes) const {
+    for (const auto& entry : replaced)
+        shapes[entry.first] = entry.second;
+
+    std::vector<std::size_t> paths;
+    if (beforeX.empty()) {
+        // Integer translation: shift back, no saved state needed.
+        int dx = static_cast<int>(matrix.tx), dy = static_cast<int>(matrix.ty);
+        std::vector<int> gx, gy;
+        for (std::size_t index : selection) {
+            Shape& shape = *shapes[index];
+            if (isPath(shape.type())) {
+                Polyline& path = static_cast<Polyline&>(shape);
+                translateRange(-dx, -dy, path.pool->xs.data() + path.offset, path.pool->ys.data() + path.offset, path.count);
+                paths.push_back(index);
+                continue;
+            }
+            std::size_t n = slotCount(shape.type());
+            gx.resize(n);
+            gy.resize(n);
+            gather(shape, gx.data(), gy.data());
+            translateRange(-dx, -dy, gx.data(), gy.data(), n);
+            scatter(shape, gx.data(), gy.data());
+        }
+        refreshPaths(shapes, paths, 0);
+        return;
+    }
+
+    // Saved state is laid out as: path vertices in selection order, then gathered slots.
+    std::size_t pathValues = beforeX.size();
+    std::size_t replacedAt = 0;
+    for (std::size_t index : selection) {
+        if (replacedAt < replaced.size() && replaced[replacedAt].first == index) {
+            ++replacedAt;
+            continue;
+        }
+        const Shape& shape = *shapes[index];
+        if (!isPath(shape.type()))
+            pathValues -= slotCount(shape.type());
+    }
+
+    std::size_t pathAt = 0, slot = pathValues, circle = 0;
+    replacedAt = 0;
+    for (std::size_t index : selection) {
+        if (replacedAt < replaced.size() && replaced[replacedAt].first == index) {
+            ++replacedAt;
+            continue;
+        }
+        Shape& shape = *shapes[index];
+        if (isPath(shape.type())) {
+            Polyline& path = static_cast<Polyline&>(shape);
+            std::memcpy(path.pool->xs.data() + path.offset, beforeX.data() + pathAt, path.count * sizeof(int));
+            std::memcpy(path.pool->ys.data() + path.offset, beforeY.data() + pathAt, path.count * sizeof(int));
+            pathAt += path.count;
+            paths.push_back(index);
+            continue;
+        }
+        scatter(shape, beforeX.data() + slot, beforeY.data() + slot);
+        slot += slotCount(shape.type());
+        if (shape.type() == ShapeType::Circle)
+            static_cast<Circle&>(shape).radius = beforeRadius[circle++];
+    }
+    refreshPaths(shapes, paths, 0);
+}
+
+std::size_t TransformCommand::memoryBytes() const {
+    return sizeof(*this) + selection.capacity() * sizeof(std::size_t) +
+        (beforeX.capacity() + beforeY.capacity() + beforeRadius.capacity()) * sizeof(int) +
+        replaced.capacity() * sizeof(replaced[0]);
+}
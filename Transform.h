@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "Shape.h"
+
+// 2D affine map: x' = a * x + b * y + tx, y' = c * x + d * y + ty.
+struct Affine2D {
+    double a, b, c, d, tx, ty;
+
+    static Affine2D identity();
+    static Affine2D translation(double dx, double dy);
+    static Affine2D rotation(double degrees, double cx, double cy);
+    static Affine2D scaling(double sx, double sy, double cx, double cy);
+
+    Affine2D inverse() const;
+    // This map applied to the result of `first`.
+    Affine2D after(const Affine2D& first) const;
+    bool isAxisAligned() const;     // maps axis-aligned rectangles to axis-aligned rectangles
+    bool isSimilarity() const;      // maps circles to circles
+    bool isIntegerTranslation() const;
+    double determinant() const;
+};
+
+// Applies `m` in place to `count` coordinates stored as two columns, rounding to
+// the nearest integer; the results must fit in an int (see keepsInRange). Uses AVX2 when the build enables it (SSE2 otherwise) and
+// splits large inputs across `threads` workers (0 = hardware concurrency).
+void transformColumns(const Affine2D& m, int* xs, int* ys, std::size_t count, unsigned threads = 0);
+
+// One bulk move/rotate/scale of a selection, kept as a single undoable record.
+// Coordinates of the touched shapes are gathered into columns, transformed in
+// one pass and written back; polyline/polygon vertices are transformed in place
+// in the shared vertex pool. Rectangles under rotation or shear, and circles
+// under non-uniform scaling, are replaced by polygons; arrays and block
+// references are always replaced by a transformed copy.
+class TransformCommand {
+public:
+    Affine2D matrix;
+    std::vector<std::size_t> selection;
+
+    // Restores the shapes touched by this command. Exact for every matrix: integer
+    // translations are inverted arithmetically, anything else restores the saved
+    // coordinates. Must be undone in reverse order of application.
+    void undo(std::vector<std::shared_ptr<Shape>>& shapes) const;
+    std::size_t memoryBytes() const;
+
+private:
+    friend TransformCommand transformShapes(std::vector<std::shared_ptr<Shape>>& shapes,
+        const std::shared_ptr<VertexPool>& pool, const std::vector<std::size_t>& selection,
+        const Affine2D& matrix, unsigned threads);
+
+    // Coordinates before the transform, in gather order; empty for integer translations.
+    std::vector<int> beforeX, beforeY, beforeRadius;
+    // Shapes that changed type, with the original object to put back.
+    std::vector<std::pair<std::size_t, std::shared_ptr<Shape>>> replaced;
+};
+
+// True when every shape in `selection`, every copy in an array included, keeps
+// integer coordinates under `matrix`; transformShapes must not be given a
+// selection that does not.
+bool keepsInRange(const std::vector<std::shared_ptr<Shape>>& shapes, const std::vector<std::size_t>& selection, const Affine2D& matrix);
+// True when everything inside `box` keeps integer coordinates under `matrix`.
+bool keepsInRange(const Bounds& box, const Affine2D& matrix);
+
+TransformCommand transformShapes(std::vector<std::shared_ptr<Shape>>& shapes, const std::shared_ptr<VertexPool>& pool,
+    const std::vector<std::size_t>& selection, const Affine2D& matrix, unsigned threads = 0);
+